@@ -0,0 +1,122 @@
+#include "proxy_alloc.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/**
+ * Prints what many small evaluations cost with each place the results can
+ * go: make_vector (the heap), aligned_allocator, an arena reset after every
+ * batch of evaluations, and (with C++17) std::pmr::vector on the arena, in
+ * ns per evaluation. Every evaluation is (a + b) * c over a few dozen to a
+ * few thousand floats, and its result is kept until the end of its batch,
+ * as in a computation that builds up some temporaries and then throws them
+ * all away. Pass the number of evaluations per batch as the first argument
+ * (default 64).
+ */
+
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+namespace{
+using proxy::make_proxy;
+
+constexpr std::size_t batches = 2000;
+
+struct inputs{
+    std::vector<float> a, b, c;
+    explicit inputs(std::size_t n):
+        a(n, 1.f), b(n, 2.f), c(n, 0.5f)
+    {}
+};
+
+template<typename Run>
+double time_batches(Run run){
+    double best = 1e300;
+    for(int rep = 0; rep < 5; ++rep){
+        auto const start = std::chrono::steady_clock::now();
+        for(std::size_t i = 0; i < batches; ++i) run();
+        auto const end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    return best;
+}
+
+NOINLINE float heap(inputs const& x, std::size_t per_batch){
+    std::vector<std::vector<float>> kept;
+    kept.reserve(per_batch);
+    for(std::size_t i = 0; i < per_batch; ++i){
+        kept.push_back(proxy::make_vector((make_proxy(x.a) + make_proxy(x.b)) * make_proxy(x.c)));
+    }
+    return kept.back().back();
+}
+
+NOINLINE float aligned(inputs const& x, std::size_t per_batch){
+    std::vector<proxy::aligned_vector<float>> kept;
+    kept.reserve(per_batch);
+    for(std::size_t i = 0; i < per_batch; ++i){
+        kept.push_back(proxy::make_vector((make_proxy(x.a) + make_proxy(x.b)) * make_proxy(x.c),
+                                          proxy::aligned_allocator<float>{}));
+    }
+    return kept.back().back();
+}
+
+NOINLINE float in_arena(inputs const& x, std::size_t per_batch, proxy::arena& a){
+    float last;
+    {
+        std::vector<std::vector<float, proxy::arena_allocator<float>>> kept;
+        kept.reserve(per_batch);
+        for(std::size_t i = 0; i < per_batch; ++i){
+            kept.push_back(proxy::make_vector((make_proxy(x.a) + make_proxy(x.b)) * make_proxy(x.c), a));
+        }
+        last = kept.back().back();
+    }
+    a.reset();
+    return last;
+}
+
+#ifdef PROXY_HAS_MEMORY_RESOURCE
+NOINLINE float in_pmr(inputs const& x, std::size_t per_batch, proxy::arena_resource& r, proxy::arena& a){
+    float last;
+    {
+        std::vector<std::pmr::vector<float>> kept;
+        kept.reserve(per_batch);
+        for(std::size_t i = 0; i < per_batch; ++i){
+            kept.push_back(proxy::make_container<std::pmr::vector<float>>(
+                (make_proxy(x.a) + make_proxy(x.b)) * make_proxy(x.c), &r));
+        }
+        last = kept.back().back();
+    }
+    a.reset();
+    return last;
+}
+#endif
+}
+
+int main(int argc, char** argv){
+    std::size_t const per_batch = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+    std::printf("%8s %12s %12s %12s", "elements", "heap", "aligned", "arena");
+#ifdef PROXY_HAS_MEMORY_RESOURCE
+    std::printf(" %12s", "pmr arena");
+#endif
+    std::printf("   (ns per evaluation)\n");
+    float sink = 0;
+    for(std::size_t n : {16, 64, 256, 1024, 4096}){
+        inputs const x(n);
+        proxy::arena a;
+        double const evaluations = double(batches * per_batch);
+        std::printf("%8zu", n);
+        std::printf(" %12.1f", time_batches([&]{ sink += heap(x, per_batch); }) / evaluations);
+        std::printf(" %12.1f", time_batches([&]{ sink += aligned(x, per_batch); }) / evaluations);
+        std::printf(" %12.1f", time_batches([&]{ sink += in_arena(x, per_batch, a); }) / evaluations);
+#ifdef PROXY_HAS_MEMORY_RESOURCE
+        proxy::arena_resource r{a};
+        std::printf(" %12.1f", time_batches([&]{ sink += in_pmr(x, per_batch, r, a); }) / evaluations);
+#endif
+        std::printf("\n");
+    }
+    return sink == 0;
+}
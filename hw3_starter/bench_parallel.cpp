@@ -0,0 +1,35 @@
+#include "proxy_parallel.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+/**
+ * Prints how long make_vector_parallel takes on ((a|b)+c)*d for every
+ * thread count from 1 to the number of cores. Pass the element count as
+ * the first argument (default 2^26).
+ */
+int main(int argc, char** argv){
+    std::size_t const n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : std::size_t{1} << 26;
+    std::vector<float> a(n / 2, 1.f), b(n - n / 2, 2.f), c(n, 3.f), d(n, 4.f);
+    auto const e = ((proxy::make_proxy(a)|proxy::make_proxy(b))+proxy::make_proxy(c))*proxy::make_proxy(d);
+
+    std::size_t const cores = std::max(1u, std::thread::hardware_concurrency());
+    double base = 0;
+    std::printf("%8s %12s %10s\n", "threads", "ms", "speedup");
+    for(std::size_t threads = 1; threads <= cores; ++threads){
+        proxy::thread_pool pool(threads);
+        double best = 1e300;
+        for(int rep = 0; rep < 5; ++rep){
+            auto const start = std::chrono::steady_clock::now();
+            auto const v = proxy::make_vector_parallel(e, pool);
+            auto const end = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+            if(v.size() != n) return 1;
+        }
+        if(threads == 1) base = best;
+        std::printf("%8zu %12.3f %10.2f\n", threads, best, base / best);
+    }
+    return 0;
+}
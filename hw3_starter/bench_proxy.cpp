@@ -0,0 +1,232 @@
+#include "proxy.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+/**
+ * Prints what proxy expressions cost next to the same thing written as a
+ * plain loop and with std::transform, in ns per element and GB/s, for sizes
+ * from a few KiB (all in L1) to well past the last level cache. Pass the
+ * largest element count as the first argument (default 2^24).
+ *
+ * Every variant is a NOINLINE function named after its case, so with
+ * -DPROXY_BENCH_ASM=ON the hot loops can be found by name in the
+ * assembly the build keeps next to the object file (bench_proxy.cpp.s in
+ * CMakeFiles/bench_proxy.dir).
+ *
+ * std::transform only takes one or two inputs, so for the bigger trees it's
+ * written the way one would have to: a pass per operation, with the output
+ * as the temporary.
+ */
+
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+namespace{
+using proxy::make_proxy;
+using proxy::into;
+
+struct inputs{
+    std::vector<float> a, b, c, d;
+    // a and b cut in two, for the pipes
+    std::vector<float> first, second;
+    std::vector<float> out;
+    explicit inputs(std::size_t n):
+        a(n), b(n), c(n), d(n), first(n / 2), second(n - n / 2), out(n)
+    {
+        for(std::size_t i = 0; i < n; ++i){
+            a[i] = float(i % 17);
+            b[i] = float(i % 13) * 0.5f;
+            c[i] = float(i % 11) - 5.f;
+            d[i] = 1.f / float(i % 7 + 1);
+        }
+        std::copy_n(a.begin(), first.size(), first.begin());
+        std::copy_n(b.begin(), second.size(), second.begin());
+    }
+};
+
+// a + b
+NOINLINE void add_proxy(inputs& x){
+    into(x.out) = make_proxy(x.a) + make_proxy(x.b);
+}
+NOINLINE void add_loop(inputs& x){
+    std::size_t const n = x.out.size();
+    float const* a = x.a.data();
+    float const* b = x.b.data();
+    float* out = x.out.data();
+    for(std::size_t i = 0; i < n; ++i){
+        out[i] = a[i] + b[i];
+    }
+}
+NOINLINE void add_transform(inputs& x){
+    std::transform(x.a.begin(), x.a.end(), x.b.begin(), x.out.begin(), std::plus<float>{});
+}
+
+// a * b
+NOINLINE void mul_proxy(inputs& x){
+    into(x.out) = make_proxy(x.a) * make_proxy(x.b);
+}
+NOINLINE void mul_loop(inputs& x){
+    std::size_t const n = x.out.size();
+    float const* a = x.a.data();
+    float const* b = x.b.data();
+    float* out = x.out.data();
+    for(std::size_t i = 0; i < n; ++i){
+        out[i] = a[i] * b[i];
+    }
+}
+NOINLINE void mul_transform(inputs& x){
+    std::transform(x.a.begin(), x.a.end(), x.b.begin(), x.out.begin(), std::multiplies<float>{});
+}
+
+// first | second
+NOINLINE void pipe_proxy(inputs& x){
+    into(x.out) = make_proxy(x.first) | make_proxy(x.second);
+}
+NOINLINE void pipe_loop(inputs& x){
+    std::size_t const n1 = x.first.size();
+    std::size_t const n2 = x.second.size();
+    float const* first = x.first.data();
+    float const* second = x.second.data();
+    float* out = x.out.data();
+    for(std::size_t i = 0; i < n1; ++i){
+        out[i] = first[i];
+    }
+    for(std::size_t i = 0; i < n2; ++i){
+        out[n1 + i] = second[i];
+    }
+}
+NOINLINE void pipe_transform(inputs& x){
+    auto const identity = [](float v){ return v; };
+    auto const middle = std::transform(x.first.begin(), x.first.end(), x.out.begin(), identity);
+    std::transform(x.second.begin(), x.second.end(), middle, identity);
+}
+
+// a + b * c
+NOINLINE void fma_proxy(inputs& x){
+    into(x.out) = make_proxy(x.a) + make_proxy(x.b) * make_proxy(x.c);
+}
+NOINLINE void fma_loop(inputs& x){
+    std::size_t const n = x.out.size();
+    float const* a = x.a.data();
+    float const* b = x.b.data();
+    float const* c = x.c.data();
+    float* out = x.out.data();
+    for(std::size_t i = 0; i < n; ++i){
+        out[i] = a[i] + b[i] * c[i];
+    }
+}
+NOINLINE void fma_transform(inputs& x){
+    std::transform(x.b.begin(), x.b.end(), x.c.begin(), x.out.begin(), std::multiplies<float>{});
+    std::transform(x.a.begin(), x.a.end(), x.out.begin(), x.out.begin(), std::plus<float>{});
+}
+
+// ((first | second) + c) * d
+NOINLINE void mixed_proxy(inputs& x){
+    into(x.out) = ((make_proxy(x.first) | make_proxy(x.second)) + make_proxy(x.c)) * make_proxy(x.d);
+}
+NOINLINE void mixed_loop(inputs& x){
+    std::size_t const n1 = x.first.size();
+    std::size_t const n = x.out.size();
+    float const* first = x.first.data();
+    float const* second = x.second.data();
+    float const* c = x.c.data();
+    float const* d = x.d.data();
+    float* out = x.out.data();
+    for(std::size_t i = 0; i < n1; ++i){
+        out[i] = (first[i] + c[i]) * d[i];
+    }
+    for(std::size_t i = n1; i < n; ++i){
+        out[i] = (second[i - n1] + c[i]) * d[i];
+    }
+}
+NOINLINE void mixed_transform(inputs& x){
+    auto const middle = std::transform(x.first.begin(), x.first.end(), x.c.begin(),
+                                       x.out.begin(), std::plus<float>{});
+    std::transform(x.second.begin(), x.second.end(), x.c.begin() + x.first.size(),
+                   middle, std::plus<float>{});
+    std::transform(x.out.begin(), x.out.end(), x.d.begin(), x.out.begin(), std::multiplies<float>{});
+}
+
+struct bench_case{
+    char const* name;
+    // floats read and written per element of the result, for GB/s
+    std::size_t floats;
+    void (*variants[3])(inputs&);
+};
+
+bench_case const cases[] = {
+    {"a+b",           3, {add_proxy, add_loop, add_transform}},
+    {"a*b",           3, {mul_proxy, mul_loop, mul_transform}},
+    {"a|b",           2, {pipe_proxy, pipe_loop, pipe_transform}},
+    {"a+b*c",         4, {fma_proxy, fma_loop, fma_transform}},
+    {"((a|b)+c)*d",   4, {mixed_proxy, mixed_loop, mixed_transform}},
+};
+
+char const* const variant_names[] = {"proxy", "loop", "transform"};
+
+/**
+ * Best time per element in ns over a few trials, each long enough to
+ * cover about 2^26 elements.
+ */
+double time_per_element(void (*run)(inputs&), inputs& x){
+    std::size_t const n = x.out.size();
+    std::size_t const reps = std::max<std::size_t>(1, (std::size_t{1} << 26) / n);
+    run(x);
+    double best = 1e300;
+    for(int trial = 0; trial < 3; ++trial){
+        auto const start = std::chrono::steady_clock::now();
+        for(std::size_t r = 0; r < reps; ++r){
+            run(x);
+        }
+        auto const end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / double(reps * n));
+    }
+    return best;
+}
+
+// the results have to agree, or the timings mean nothing
+bool same_results(bench_case const& c, inputs& x){
+    c.variants[0](x);
+    std::vector<float> const expected = x.out;
+    for(std::size_t v = 1; v < 3; ++v){
+        std::fill(x.out.begin(), x.out.end(), 0.f);
+        c.variants[v](x);
+        for(std::size_t i = 0; i < expected.size(); ++i){
+            // the loop and transform may or may not be contracted into an fma
+            float const tolerance = 1e-5f * std::max(1.f, std::abs(expected[i]));
+            if(std::abs(x.out[i] - expected[i]) > tolerance)
+                return false;
+        }
+    }
+    return true;
+}
+}
+
+int main(int argc, char** argv){
+    std::size_t const largest = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : std::size_t{1} << 24;
+
+    std::printf("%-14s %10s %-10s %10s %10s\n", "expression", "elements", "variant", "ns/elem", "GB/s");
+    for(std::size_t n = 1024; n <= largest; n *= 16){
+        inputs x(n);
+        for(bench_case const& c : cases){
+            if(!same_results(c, x)){
+                std::fprintf(stderr, "%s: results differ at %zu elements\n", c.name, n);
+                return 1;
+            }
+            for(std::size_t v = 0; v < 3; ++v){
+                double const ns = time_per_element(c.variants[v], x);
+                double const gbs = double(c.floats * sizeof(float)) / ns;
+                std::printf("%-14s %10zu %-10s %10.3f %10.2f\n", c.name, n, variant_names[v], ns, gbs);
+            }
+        }
+    }
+    return 0;
+}
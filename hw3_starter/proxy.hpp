@@ -1,8 +1,33 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifdef PROXY_PROFILE
+#include "proxy_profile.hpp"
+#else
+#define PROXY_PROFILE_CALL(event) static_cast<void>(0)
+#define PROXY_PROFILE_EVAL(count) static_cast<void>(0)
+#endif
+
 /**
  * The main idea behind this system is proxy objects - they wrap
  * things, mostly other proxy objects, providing an lazy interface
@@ -13,6 +38,66 @@
  * - size() : reports the size of the sequence the proxy represents
  * - get(pos) : returns a copy of the element at position pos in proxy's sequence
  *
+ * They may also have:
+ * - eval(pos, count, out) : writes the elements [pos, pos + count) to out, which
+ *   points to at least count objects of the proxy's type. This is the fast path:
+ *   a whole run of elements is produced in one go instead of one get() at a time,
+ *   so the loops inside can be simple and branch free. If a proxy doesn't have it,
+ *   detail::evaluate falls back to calling get() for each position.
+ * - aliases(first, last) : true if evaluating the proxy might read memory in
+ *   [first, last). Used to evaluate safely into a buffer that is also an
+ *   input. Without it, a proxy is assumed to read anything.
+ * - elementwise : a static constexpr bool, true if element i only ever depends
+ *   on element i of the leaves (as in a + b, but not a | b). Assumed false
+ *   if missing.
+ * - extent : a static constexpr std::size_t, the size of the proxy if it is
+ *   known at compile time (from std::array or native array leaves), or
+ *   dynamic_extent if it isn't. Assumed dynamic if missing.
+ * - unbounded : a static constexpr bool, true for proxies that have a value
+ *   at every position (like a broadcast scalar). Their size() is the largest
+ *   std::size_t, so that elementwise nodes take their size from the other side.
+ * - sparse : a static constexpr bool, true for proxies that are zero almost
+ *   everywhere and can list the rest (see proxy_sparse.hpp). They also have
+ *   begin_at(pos), a cursor over the stored elements at pos and after, in
+ *   order, with done(), index(), value(), next() and seek(i) (skip to the
+ *   first one at i or after). The reductions only visit stored elements of
+ *   a sparse proxy, and + and * of two of them are left to proxy_sparse.hpp.
+ * - run_length : a static constexpr bool, true for proxies made of runs of
+ *   equal elements (see proxy_encoded.hpp). They also have runs_at(pos), a
+ *   cursor over the runs from the one pos is in, with value(), end() (one
+ *   past the run's last position) and next(). The reductions take a whole
+ *   run at a time, and + and * of two of them (or of one and a number) are
+ *   left to proxy_encoded.hpp.
+ * - children() : a tuple of (references to) the proxies it's made of, in
+ *   order. explain() shows them (see proxy_explain.hpp), and evaluate_into
+ *   looks through them for leaves that read its destination; without it, a
+ *   proxy is taken to be a leaf.
+ * - data() : for a leaf whose elements are contiguous in memory, where they
+ *   start. evaluate_into uses it to tell a = a + b (safe a block at a time)
+ *   from a shifted overlap (not).
+ *
+ * There's a second, weaker kind of proxy: streams. A stream can't say how big
+ * it is or jump to a position - it can only hand out its elements in order.
+ * filter() is one (you can't know how many elements pass the predicate without
+ * looking at all of them), and so is anything reading from a pipe. Streams
+ * must have:
+ * - type : the type of the elements the stream yields
+ * - read(out, count) : writes the next count elements to out and returns count,
+ *   or fewer than count if the stream ran out (and 0 from then on).
+ * Reading changes a stream, so the functions that consume one (make_vector,
+ * the reductions) work on a copy and the stream you pass in is left alone.
+ * Copying a stream over a proxy copies its position; copying a stream over
+ * a file or a socket shares it.
+ * Streams can be added, multiplied and piped together (or with proxies or
+ * numbers) just like proxies, and the result is a stream.
+ *
+ * Only the leaves (sequence_proxy) refer to data, and they do it by reference.
+ * Every other proxy stores its children by value, so an expression is just a
+ * small tree of copies that ends in references to your sequences. That means
+ * you can build one once, keep it around (in a variable or a struct member),
+ * and evaluate it again whenever the data it points to changes - as long as
+ * the sequences themselves outlive it.
+ *
  * You'll notice any class here has a make_* function that returns an instance of it.
  * This is because C++ prior to C++17 can only guess the template parameters of
  * template functions, not classes. Notice that the example code does not have any <>
@@ -20,6 +105,321 @@
  */
 
 namespace proxy{
+
+/**
+ * The extent of a proxy whose size is only known at run time.
+ */
+constexpr std::size_t dynamic_extent = std::numeric_limits<std::size_t>::max();
+
+namespace detail{
+/**
+ * Nodes that need scratch space to combine their children work through
+ * their range in blocks of this many elements, using buffers on the stack.
+ * 256 elements is small enough that a few of these stay in L1 at any depth
+ * of expression we realistically build.
+ */
+constexpr std::size_t block_size = 256;
+
+template<typename...>
+using void_t = void;
+
+template<typename Proxy, typename = void>
+struct has_eval : std::false_type{};
+
+template<typename Proxy>
+struct has_eval<Proxy, void_t<decltype(
+    std::declval<Proxy const&>().eval(
+        std::size_t{}, std::size_t{}, std::declval<typename Proxy::type*>()))>>
+    : std::true_type{};
+
+template<typename Proxy>
+void evaluate(Proxy const& p, std::size_t pos, std::size_t count,
+              typename Proxy::type* out, std::true_type){
+    p.eval(pos, count, out);
+}
+
+template<typename Proxy>
+void evaluate(Proxy const& p, std::size_t pos, std::size_t count,
+              typename Proxy::type* out, std::false_type){
+    for(std::size_t i = 0; i < count; ++i){
+        out[i] = p.get(pos + i);
+    }
+}
+
+/**
+ * Writes the elements [pos, pos + count) of p to out, using p.eval if p has
+ * one and p.get otherwise.
+ */
+template<typename Proxy>
+void evaluate(Proxy const& p, std::size_t pos, std::size_t count,
+              typename Proxy::type* out){
+    evaluate(p, pos, count, out, has_eval<Proxy>{});
+}
+
+template<typename T, typename Proxy>
+void evaluate_as(Proxy const& p, std::size_t pos, std::size_t count,
+                 T* out, std::true_type){
+    evaluate(p, pos, count, out);
+}
+
+template<typename T, typename Proxy>
+void evaluate_as(Proxy const& p, std::size_t pos, std::size_t count,
+                 T* out, std::false_type){
+    typename Proxy::type buffer[block_size];
+    for(std::size_t i = 0; i < count; i += block_size){
+        std::size_t const n = std::min(block_size, count - i);
+        evaluate(p, pos + i, n, buffer);
+        std::copy_n(buffer, n, out + i);
+    }
+}
+
+/**
+ * Same as evaluate, but converts the elements to T on the way out. Parent
+ * nodes use this to get their children's elements in the parent's own type,
+ * exactly as if each get() had been converted one at a time.
+ */
+template<typename T, typename Proxy>
+void evaluate_as(Proxy const& p, std::size_t pos, std::size_t count, T* out){
+    evaluate_as<T>(p, pos, count, out,
+                   std::is_same<T, typename Proxy::type>{});
+}
+
+template<typename Proxy, typename = void>
+struct has_aliases : std::false_type{};
+
+template<typename Proxy>
+struct has_aliases<Proxy, void_t<decltype(
+    std::declval<Proxy const&>().aliases(
+        std::declval<void const*>(), std::declval<void const*>()))>>
+    : std::true_type{};
+
+template<typename Proxy>
+bool may_alias(Proxy const& p, void const* first, void const* last, std::true_type){
+    return p.aliases(first, last);
+}
+
+template<typename Proxy>
+bool may_alias(Proxy const&, void const*, void const*, std::false_type){
+    return true;
+}
+
+/**
+ * Whether evaluating p might read from [first, last), erring on the side of
+ * yes.
+ */
+template<typename Proxy>
+bool may_alias(Proxy const& p, void const* first, void const* last){
+    return may_alias(p, first, last, has_aliases<Proxy>{});
+}
+
+inline bool overlaps(void const* first1, void const* last1,
+                     void const* first2, void const* last2){
+    std::less<void const*> less;
+    return less(first1, last2) && less(first2, last1);
+}
+
+template<typename Proxy, typename = void>
+struct has_children : std::false_type{};
+
+template<typename Proxy>
+struct has_children<Proxy, void_t<decltype(std::declval<Proxy const&>().children())>>
+    : std::true_type{};
+
+template<typename Proxy, typename = void>
+struct has_data : std::false_type{};
+
+template<typename Proxy>
+struct has_data<Proxy, void_t<decltype(std::declval<Proxy const&>().data())>>
+    : std::true_type{};
+
+template<typename Proxy, typename = void>
+struct is_elementwise : std::false_type{};
+
+template<typename Proxy>
+struct is_elementwise<Proxy, void_t<decltype(Proxy::elementwise)>>
+    : std::integral_constant<bool, Proxy::elementwise>{};
+
+template<typename Proxy, typename = void>
+struct static_extent : std::integral_constant<std::size_t, dynamic_extent>{};
+
+template<typename Proxy>
+struct static_extent<Proxy, void_t<decltype(Proxy::extent)>>
+    : std::integral_constant<std::size_t, Proxy::extent>{};
+
+template<typename Proxy, typename = void>
+struct is_unbounded : std::false_type{};
+
+template<typename Proxy>
+struct is_unbounded<Proxy, void_t<decltype(Proxy::unbounded)>>
+    : std::integral_constant<bool, Proxy::unbounded>{};
+
+template<typename Proxy, typename = void>
+struct is_sparse : std::false_type{};
+
+template<typename Proxy>
+struct is_sparse<Proxy, void_t<decltype(Proxy::sparse)>>
+    : std::integral_constant<bool, Proxy::sparse>{};
+
+template<typename Proxy, typename = void>
+struct is_run_length : std::false_type{};
+
+template<typename Proxy>
+struct is_run_length<Proxy, void_t<decltype(Proxy::run_length)>>
+    : std::integral_constant<bool, Proxy::run_length>{};
+
+template<typename Proxy, typename = void>
+struct is_proxy : std::false_type{};
+
+template<typename Proxy>
+struct is_proxy<Proxy, void_t<
+    typename Proxy::type,
+    decltype(std::declval<Proxy const&>().size()),
+    decltype(std::declval<Proxy const&>().get(std::size_t{}))>>
+    : std::true_type{};
+
+template<bool... B>
+struct all_of : std::true_type{};
+
+template<bool B, bool... Rest>
+struct all_of<B, Rest...> : std::integral_constant<bool, B && all_of<Rest...>::value>{};
+
+/**
+ * Lets the operators below only take part in overload resolution for proxies,
+ * and for proxies mixed with plain numbers.
+ */
+template<typename... Proxies>
+using enable_if_proxies = typename std::enable_if<
+    all_of<is_proxy<Proxies>::value...>::value, int>::type;
+
+template<typename Proxy, typename Scalar>
+using enable_if_proxy_and_scalar = typename std::enable_if<
+    is_proxy<Proxy>::value && std::is_arithmetic<Scalar>::value, int>::type;
+
+/**
+ * The sum of two sparse proxies, and the product of a sparse proxy with
+ * anything, are sparse too - those operators are in proxy_sparse.hpp, so
+ * the ones here step aside for them. Likewise the sum and product of two
+ * run-length proxies, or of one and a number, are made of runs, and those
+ * are in proxy_encoded.hpp.
+ */
+template<typename P1, typename P2>
+using enable_if_dense_sum = typename std::enable_if<
+    is_proxy<P1>::value && is_proxy<P2>::value &&
+    !(is_sparse<P1>::value && is_sparse<P2>::value) &&
+    !(is_run_length<P1>::value && is_run_length<P2>::value), int>::type;
+
+template<typename P1, typename P2>
+using enable_if_dense_product = typename std::enable_if<
+    is_proxy<P1>::value && is_proxy<P2>::value &&
+    !is_sparse<P1>::value && !is_sparse<P2>::value &&
+    !(is_run_length<P1>::value && is_run_length<P2>::value), int>::type;
+
+template<typename Proxy, typename Scalar>
+using enable_if_dense_sum_with_scalar = typename std::enable_if<
+    is_proxy<Proxy>::value && !is_run_length<Proxy>::value &&
+    std::is_arithmetic<Scalar>::value, int>::type;
+
+template<typename Proxy, typename Scalar>
+using enable_if_dense_and_scalar = typename std::enable_if<
+    is_proxy<Proxy>::value && !is_sparse<Proxy>::value && !is_run_length<Proxy>::value &&
+    std::is_arithmetic<Scalar>::value, int>::type;
+
+template<typename Stream, typename = void>
+struct is_stream : std::false_type{};
+
+template<typename Stream>
+struct is_stream<Stream, void_t<
+    typename Stream::type,
+    decltype(std::declval<Stream&>().read(
+        std::declval<typename Stream::type*>(), std::size_t{}))>>
+    : std::true_type{};
+
+template<typename Source>
+using enable_if_proxy_or_stream = typename std::enable_if<
+    is_proxy<Source>::value || is_stream<Source>::value, int>::type;
+
+/**
+ * The stream versions of the operators: at least one side has to be a
+ * stream (otherwise it's a job for the proxy ones) and the other can be
+ * either, or a plain number.
+ */
+template<typename S1, typename S2>
+using enable_if_streams = typename std::enable_if<
+    (is_stream<S1>::value || is_stream<S2>::value) &&
+    (is_proxy<S1>::value || is_stream<S1>::value) &&
+    (is_proxy<S2>::value || is_stream<S2>::value), int>::type;
+
+template<typename Stream, typename Scalar>
+using enable_if_stream_and_scalar = typename std::enable_if<
+    is_stream<Stream>::value && std::is_arithmetic<Scalar>::value, int>::type;
+
+/**
+ * Tags for tag dispatch on the kind of proxy: random access ones have
+ * size()/get(), streams only read(). Sparse proxies are random access ones
+ * that can also list their nonzero elements, and run-length ones can list
+ * their runs, so anything that only cares about random access takes them
+ * too.
+ */
+struct random_access_tag{};
+struct stream_tag{};
+struct sparse_tag : random_access_tag{};
+struct run_length_tag : random_access_tag{};
+
+template<typename Source>
+using category_of = typename std::conditional<
+    is_stream<Source>::value, stream_tag,
+    typename std::conditional<
+        is_sparse<Source>::value, sparse_tag,
+        typename std::conditional<
+            is_run_length<Source>::value, run_length_tag, random_access_tag>::type>::type>::type;
+
+template<typename Sequence>
+struct sequence_extent : std::integral_constant<std::size_t, dynamic_extent>{};
+
+template<typename T, std::size_t N>
+struct sequence_extent<std::array<T, N>> : std::integral_constant<std::size_t, N>{};
+
+template<typename T, std::size_t N>
+struct sequence_extent<T[N]> : std::integral_constant<std::size_t, N>{};
+
+/**
+ * The extents of elementwise (min) and concatenating (sum) nodes: only
+ * static if both sides are.
+ */
+constexpr std::size_t min_extent(std::size_t e1, std::size_t e2){
+    return e1 == dynamic_extent || e2 == dynamic_extent ?
+        dynamic_extent : (e1 < e2 ? e1 : e2);
+}
+
+constexpr std::size_t sum_extent(std::size_t e1, std::size_t e2){
+    return e1 == dynamic_extent || e2 == dynamic_extent ?
+        dynamic_extent : e1 + e2;
+}
+
+/**
+ * The extent of an elementwise node over Proxies: the smallest of theirs,
+ * not counting unbounded ones.
+ */
+template<typename... Proxies>
+struct elementwise_extent;
+
+template<>
+struct elementwise_extent<> : std::integral_constant<std::size_t, dynamic_extent>{};
+
+template<typename Proxy, typename... Rest>
+struct elementwise_extent<Proxy, Rest...> : std::integral_constant<std::size_t,
+    is_unbounded<Proxy>::value ? elementwise_extent<Rest...>::value :
+    all_of<is_unbounded<Rest>::value...>::value ? static_extent<Proxy>::value :
+    min_extent(static_extent<Proxy>::value, elementwise_extent<Rest...>::value)>{};
+
+template<typename Sequence, typename = void>
+struct is_contiguous : std::is_array<Sequence>{};
+
+template<typename Sequence>
+struct is_contiguous<Sequence, void_t<decltype(std::declval<Sequence const&>().data())>>
+    : std::true_type{};
+}
+
 /**
  * This is a proxy to a sequence - it holds a reference to that sequence
  * and yields copies of its elements or reports its size on request.
@@ -35,12 +435,39 @@ class sequence_proxy{
     constexpr sequence_proxy(Sequence const& sequence):
         sequence{sequence}
     {}
+    static constexpr std::size_t extent = detail::sequence_extent<Sequence>::value;
     constexpr std::size_t size() const{
-        return std::distance(std::begin(sequence), std::end(sequence));
+        PROXY_PROFILE_CALL(sizes);
+        return extent != dynamic_extent ?
+            extent : std::distance(std::begin(sequence), std::end(sequence));
     }
     constexpr T get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
         return sequence[pos];
     }
+    static constexpr bool elementwise = true;
+    void eval(std::size_t pos, std::size_t count, T* out) const {
+        PROXY_PROFILE_EVAL(count);
+        std::copy_n(std::next(std::begin(sequence), pos), count, out);
+    }
+    template<typename S = Sequence>
+    auto data() const -> decltype(std::declval<S const&>().data()) {
+        return sequence.data();
+    }
+    bool aliases(void const* first, void const* last) const {
+        return aliases(first, last, detail::is_contiguous<Sequence>{});
+    }
+    private:
+    bool aliases(void const* first, void const* last, std::true_type) const {
+        std::size_t const n = size();
+        return n != 0 && detail::overlaps(
+            std::addressof(sequence[0]), std::addressof(sequence[0]) + n,
+            first, last);
+    }
+    bool aliases(void const*, void const*, std::false_type) const {
+        // can't tell where the elements live, assume the worst
+        return true;
+    }
 };
 
 template<typename Sequence>
@@ -61,36 +488,239 @@ sequence_proxy<
     // not too bad once you know what the bits do right?
     // (feel free to ask questions if you're curious)
     typename std::decay<
-        decltype(*std::begin(std::declval<Sequence>()))>::type,
+        decltype(*std::begin(std::declval<Sequence const&>()))>::type,
     Sequence>
 {
     return {sequence};
 }
 
 /**
- * A proxy that holds a reference to two other proxies and yields
+ * A proxy to a temporary sequence would outlive it, so don't allow one.
+ */
+template<typename Sequence>
+void make_proxy(Sequence const&& sequence) = delete;
+
+/**
+ * A proxy that yields the same value at every position. It's unbounded, so
+ * in 2.0f * p or p + 1 its size is whatever p's is.
+ */
+template<typename T>
+class scalar_proxy{
+    T value;
+    public:
+    using type = T;
+    static constexpr bool elementwise = true;
+    static constexpr bool unbounded = true;
+    constexpr scalar_proxy(T value):
+        value{value}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return std::numeric_limits<std::size_t>::max();
+    }
+    constexpr T get(std::size_t) const {
+        PROXY_PROFILE_CALL(gets);
+        return value;
+    }
+    void eval(std::size_t, std::size_t count, T* out) const {
+        PROXY_PROFILE_EVAL(count);
+        std::fill(out, out + count, value);
+    }
+    bool aliases(void const*, void const*) const {
+        return false;
+    }
+};
+
+template<typename T>
+constexpr scalar_proxy<T> make_scalar(T value){
+    return {value};
+}
+
+template<typename P1, typename P2>
+class product_proxy;
+
+namespace detail{
+/**
+ * x + y*z rounds twice: once for the product and once for the sum. A fused
+ * multiply-add (the vfmadd instructions, when the target has FMA, e.g.
+ * -mfma or -march=native) rounds once, which is both faster and more
+ * accurate - but it's not bit for bit the same answer. So when the target
+ * has FMA, adder_proxy fuses whenever one side is a product_proxy of the
+ * same floating point type, unless PROXY_STRICT_FP is defined, in which case
+ * everything is evaluated exactly as written. (For that to hold all the way
+ * down, also build with -ffp-contract=off, or the compiler is free to fuse
+ * the unfused loops by itself.) Without FMA there's no fusing: std::fma is
+ * then a library call per element, several times slower than the plain loop.
+ */
+#if defined(__FMA__) && !defined(PROXY_STRICT_FP)
+constexpr bool fuse_multiply_add = true;
+#else
+constexpr bool fuse_multiply_add = false;
+#endif
+
+template<typename T, typename Proxy>
+struct is_fusable_product : std::false_type{};
+
+template<typename T, typename P1, typename P2>
+struct is_fusable_product<T, product_proxy<P1, P2>> : std::integral_constant<bool,
+    fuse_multiply_add &&
+    std::is_floating_point<T>::value &&
+    std::is_same<T, typename product_proxy<P1, P2>::type>::value>{};
+
+struct no_fusion{};
+struct fuse_right{};
+struct fuse_left{};
+
+template<typename T, typename P1, typename P2>
+using fusion_of = typename std::conditional<
+    is_fusable_product<T, P2>::value, fuse_right,
+    typename std::conditional<
+        is_fusable_product<T, P1>::value, fuse_left, no_fusion>::type>::type;
+
+/**
+ * Whether fma_block has a SIMD version for T (explain() reports it).
+ */
+template<typename T>
+struct simd_fma : std::false_type{};
+
+/**
+ * acc[i] = y[i]*z[i] + acc[i], with a single rounding.
+ */
+template<typename T>
+void fma_block(T const* y, T const* z, T* acc, std::size_t n){
+    for(std::size_t i = 0; i < n; ++i){
+        acc[i] = std::fma(y[i], z[i], acc[i]);
+    }
+}
+
+#if defined(__FMA__) && defined(__AVX__)
+inline void fma_block(float const* y, float const* z, float* acc, std::size_t n){
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        _mm256_storeu_ps(acc + i, _mm256_fmadd_ps(
+            _mm256_loadu_ps(y + i), _mm256_loadu_ps(z + i), _mm256_loadu_ps(acc + i)));
+    }
+    for(; i < n; ++i){
+        acc[i] = std::fma(y[i], z[i], acc[i]);
+    }
+}
+
+inline void fma_block(double const* y, double const* z, double* acc, std::size_t n){
+    std::size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm256_storeu_pd(acc + i, _mm256_fmadd_pd(
+            _mm256_loadu_pd(y + i), _mm256_loadu_pd(z + i), _mm256_loadu_pd(acc + i)));
+    }
+    for(; i < n; ++i){
+        acc[i] = std::fma(y[i], z[i], acc[i]);
+    }
+}
+
+template<>
+struct simd_fma<float> : std::true_type{};
+
+template<>
+struct simd_fma<double> : std::true_type{};
+#endif
+}
+
+/**
+ * A proxy that holds a copy of two other proxies and yields
  * their elements added together. It reports its size as the minimum
  * of the size of the two proxies it uses. Probably not the best for
  * error reporting, but it works.
+ *
+ * When one side is a product (a + b*c or b*c + a) of floating point
+ * values, it may evaluate as a fused multiply-add, see
+ * detail::fuse_multiply_add.
  */
 template<typename P1, typename P2>
 class adder_proxy{
-    P1 const& p1;
-    P2 const& p2;
+    P1 p1;
+    P2 p2;
     public:
     using type = typename std::common_type<
         typename P1::type,
         typename P2::type
         >::type;
-    adder_proxy(P1 const& p1, P2 const& p2):
+    private:
+    using fusion = detail::fusion_of<type, P1, P2>;
+
+    // std::fma isn't constexpr, so only the unfused sum can be a constant
+    constexpr type get(std::size_t pos, detail::no_fusion) const {
+        return p1.get(pos) + p2.get(pos);
+    }
+    type get(std::size_t pos, detail::fuse_right) const {
+        return std::fma(type(p2.left().get(pos)), type(p2.right().get(pos)), type(p1.get(pos)));
+    }
+    type get(std::size_t pos, detail::fuse_left) const {
+        return std::fma(type(p1.left().get(pos)), type(p1.right().get(pos)), type(p2.get(pos)));
+    }
+
+    void eval(std::size_t pos, std::size_t count, type* out, detail::no_fusion) const {
+        type rhs[detail::block_size];
+        for(std::size_t i = 0; i < count; i += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, count - i);
+            detail::evaluate_as<type>(p1, pos + i, n, out + i);
+            detail::evaluate_as<type>(p2, pos + i, n, rhs);
+            for(std::size_t j = 0; j < n; ++j){
+                out[i + j] = out[i + j] + rhs[j];
+            }
+        }
+    }
+    template<typename Addend, typename Product>
+    static void eval_fused(Addend const& x, Product const& yz,
+                           std::size_t pos, std::size_t count, type* out){
+        type y[detail::block_size];
+        type z[detail::block_size];
+        for(std::size_t i = 0; i < count; i += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, count - i);
+            detail::evaluate_as<type>(x, pos + i, n, out + i);
+            detail::evaluate_as<type>(yz.left(), pos + i, n, y);
+            detail::evaluate_as<type>(yz.right(), pos + i, n, z);
+            detail::fma_block(y, z, out + i, n);
+        }
+    }
+    void eval(std::size_t pos, std::size_t count, type* out, detail::fuse_right) const {
+        eval_fused(p1, p2, pos, count, out);
+    }
+    void eval(std::size_t pos, std::size_t count, type* out, detail::fuse_left) const {
+        eval_fused(p2, p1, pos, count, out);
+    }
+
+    public:
+    constexpr adder_proxy(P1 const& p1, P2 const& p2):
         p1{p1},
         p2{p2}
     {}
-    std::size_t size() const {
-        return std::min(p1.size(), p2.size());
+    constexpr P1 const& left() const {
+        return p1;
     }
-    type get(std::size_t pos) const {
-        return p1.get(pos) + p2.get(pos);
+    constexpr P2 const& right() const {
+        return p2;
+    }
+    static constexpr bool elementwise =
+        detail::is_elementwise<P1>::value && detail::is_elementwise<P2>::value;
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p1, first, last) || detail::may_alias(p2, first, last);
+    }
+    static constexpr std::size_t extent = detail::elementwise_extent<P1, P2>::value;
+    static constexpr bool unbounded =
+        detail::is_unbounded<P1>::value && detail::is_unbounded<P2>::value;
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return extent != dynamic_extent ? extent : std::min(p1.size(), p2.size());
+    }
+    constexpr type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return get(pos, fusion{});
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        eval(pos, count, out, fusion{});
+    }
+    std::tuple<P1 const&, P2 const&> children() const {
+        return std::tie(p1, p2);
     }
 };
 
@@ -98,60 +728,140 @@ class adder_proxy{
  * This is the adder_proxy's make_* function as an operator.
  * Just add two proxies together and you get an adder_proxy.
  */
-template<typename P1, typename P2>
+template<typename P1, typename P2, detail::enable_if_dense_sum<P1, P2> = 0>
+constexpr
 adder_proxy<P1, P2>
 operator+(P1 const& p1, P2 const& p2){
     return {p1, p2};
 }
 
+template<typename P, typename S, detail::enable_if_dense_sum_with_scalar<P, S> = 0>
+constexpr
+adder_proxy<P, scalar_proxy<S>>
+operator+(P const& p, S s){
+    return {p, scalar_proxy<S>{s}};
+}
+
+template<typename S, typename P, detail::enable_if_dense_sum_with_scalar<P, S> = 0>
+constexpr
+adder_proxy<scalar_proxy<S>, P>
+operator+(S s, P const& p){
+    return {scalar_proxy<S>{s}, p};
+}
+
 // product_proxy
 template<typename P1, typename P2>
 class product_proxy{
-    P1 const& p1;
-    P2 const& p2;
+    P1 p1;
+    P2 p2;
     public:
     using type = typename std::common_type<
         typename P1::type,
         typename P2::type
         >::type;
-    product_proxy(P1 const& p1, P2 const& p2):
+    constexpr product_proxy(P1 const& p1, P2 const& p2):
         p1{p1},
         p2{p2}
     {}
-
-    std::size_t size() const {
-        return std::min(p1.size(), p2.size());
+    constexpr P1 const& left() const {
+        return p1;
+    }
+    constexpr P2 const& right() const {
+        return p2;
     }
-    type get(std::size_t pos) const {
+    static constexpr bool elementwise =
+        detail::is_elementwise<P1>::value && detail::is_elementwise<P2>::value;
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p1, first, last) || detail::may_alias(p2, first, last);
+    }
+    static constexpr std::size_t extent = detail::elementwise_extent<P1, P2>::value;
+    static constexpr bool unbounded =
+        detail::is_unbounded<P1>::value && detail::is_unbounded<P2>::value;
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return extent != dynamic_extent ? extent : std::min(p1.size(), p2.size());
+    }
+    constexpr type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
         return p1.get(pos) * p2.get(pos);
     }
+    std::tuple<P1 const&, P2 const&> children() const {
+        return std::tie(p1, p2);
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        type rhs[detail::block_size];
+        for(std::size_t i = 0; i < count; i += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, count - i);
+            detail::evaluate_as<type>(p1, pos + i, n, out + i);
+            detail::evaluate_as<type>(p2, pos + i, n, rhs);
+            for(std::size_t j = 0; j < n; ++j){
+                out[i + j] = out[i + j] * rhs[j];
+            }
+        }
+    }
 };
 
-template<typename P1, typename P2>
+template<typename P1, typename P2, detail::enable_if_dense_product<P1, P2> = 0>
+constexpr
 product_proxy<P1, P2>
 operator*(P1 const& p1, P2 const& p2){
     return {p1, p2};
 }
 
+template<typename P, typename S, detail::enable_if_dense_and_scalar<P, S> = 0>
+constexpr
+product_proxy<P, scalar_proxy<S>>
+operator*(P const& p, S s){
+    return {p, scalar_proxy<S>{s}};
+}
+
+template<typename S, typename P, detail::enable_if_dense_and_scalar<P, S> = 0>
+constexpr
+product_proxy<scalar_proxy<S>, P>
+operator*(S s, P const& p){
+    return {scalar_proxy<S>{s}, p};
+}
+
 // pipe_proxy
 template<typename P1, typename P2>
 class pipe_proxy{
-    P1 const& p1;
-    P2 const& p2;
+    // there's no end of an unbounded p1 to put p2 after
+    static_assert(!detail::is_unbounded<P1>::value && !detail::is_unbounded<P2>::value,
+                  "can't pipe an unbounded proxy, it has no end");
+    P1 p1;
+    P2 p2;
     public:
     using type = typename std::common_type<
         typename P1::type,
         typename P2::type
         >::type;
-    pipe_proxy(P1 const& p1, P2 const& p2):
+    constexpr pipe_proxy(P1 const& p1, P2 const& p2):
         p1{p1},
         p2{p2}
     {}
-
-    std::size_t size() const {
-        return p1.size() + p2.size();
+    constexpr P1 const& left() const {
+        return p1;
+    }
+    constexpr P2 const& right() const {
+        return p2;
+    }
+    // element i of p2 ends up at p1.size() + i
+    static constexpr bool elementwise = false;
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p1, first, last) || detail::may_alias(p2, first, last);
+    }
+    static constexpr std::size_t extent = detail::sum_extent(
+        detail::static_extent<P1>::value, detail::static_extent<P2>::value);
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return extent != dynamic_extent ? extent : p1.size() + p2.size();
     }
-    type get(std::size_t pos) const {
+    std::tuple<P1 const&, P2 const&> children() const {
+        return std::tie(p1, p2);
+    }
+    constexpr type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
         if (pos < p1.size())
             return p1.get(pos);
         else if (pos < p1.size() + p2.size())
@@ -159,9 +869,33 @@ class pipe_proxy{
 
         return 0;
     }
+    /**
+     * Rather than asking "which side is pos on?" for every element, split
+     * the requested range into the run that falls in p1 and the run that
+     * falls in p2 and hand each one to that side in a single call. Anything
+     * past the end of both is zero, same as get().
+     */
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        std::size_t const size1 = p1.size();
+        std::size_t const size2 = p2.size();
+        std::size_t left = 0;
+        if(pos < size1){
+            left = std::min(count, size1 - pos);
+            detail::evaluate_as<type>(p1, pos, left, out);
+        }
+        std::size_t right = 0;
+        std::size_t const pos2 = pos + left - size1;
+        if(left < count && pos2 < size2){
+            right = std::min(count - left, size2 - pos2);
+            detail::evaluate_as<type>(p2, pos2, right, out + left);
+        }
+        std::fill(out + left + right, out + count, type(0));
+    }
 };
 
-template<typename P1, typename P2>
+template<typename P1, typename P2, detail::enable_if_proxies<P1, P2> = 0>
+constexpr
 pipe_proxy<P1, P2>
 operator|(P1 const& p1, P2 const& p2){
     return {p1, p2};
@@ -169,22 +903,1801 @@ operator|(P1 const& p1, P2 const& p2){
 
 
 /**
- * Takes a proxy and converts it to a vector. There's a
- * much more interesting polymorphic version of this that
- * generalises to all containers but it requires iterators.
- * That's probably for next time :)
+ * Functors for map() that the block path knows how to do with SIMD
+ * instructions on float and double. With anything else (or any other
+ * functor) they're applied one element at a time, which the compiler may
+ * still vectorize by itself.
  */
-template<typename Proxy>
-std::vector<typename Proxy::type>
-make_vector(Proxy const& p){
-    std::vector<typename Proxy::type> v;
-    // since we know how big this vector can get, preallocate
-    // enough memory so we skip resizes in push_back
-    v.reserve(p.size());
-    for(std::size_t i = 0; i < p.size(); ++i){
-        v.push_back(p.get(i));
-    }
-    return v;
+struct abs_fn{
+    template<typename T>
+    T operator()(T x) const {
+        return abs(x, std::is_floating_point<T>{});
+    }
+    private:
+    // std::abs clears the sign bit, so abs(-0.0) is 0.0 and abs(-NaN) is NaN
+    template<typename T>
+    static T abs(T x, std::true_type){
+        return std::abs(x);
+    }
+    template<typename T>
+    static constexpr T abs(T x, std::false_type){
+        return x < T(0) ? T(-x) : x;
+    }
+};
+
+struct sqrt_fn{
+    template<typename T>
+    auto operator()(T x) const -> decltype(std::sqrt(x)) {
+        return std::sqrt(x);
+    }
+};
+
+struct min_fn{
+    template<typename T>
+    constexpr T operator()(T x, T y) const {
+        return std::min(x, y);
+    }
+};
+
+struct max_fn{
+    template<typename T>
+    constexpr T operator()(T x, T y) const {
+        return std::max(x, y);
+    }
+};
+
+template<typename T>
+struct clamp_fn{
+    T lo;
+    T hi;
+    constexpr T operator()(T x) const {
+        return x < lo ? lo : (hi < x ? hi : x);
+    }
+};
+
+namespace detail{
+/**
+ * Whether map_block has a SIMD version for F, with Signature the element
+ * types as Out(In...), for explain().
+ */
+template<typename F, typename Signature, typename = void>
+struct simd_map : std::false_type{};
+
+/**
+ * out[i] = f(in[i]...) for a whole block. This is the generic version; the
+ * overloads below replace it for the functors above.
+ */
+template<typename F, typename T, typename... In>
+void map_block(F const& f, T* out, std::size_t n, In const*... in){
+    for(std::size_t i = 0; i < n; ++i){
+        out[i] = f(in[i]...);
+    }
+}
+
+#if defined(__SSE2__)
+// the SSE instructions below are exact: same results as the scalar functors,
+// including which operand comes out when one of them is a NaN
+inline void map_block(abs_fn const& f, float* out, std::size_t n, float const* x){
+    __m128 const sign = _mm_set1_ps(-0.f);
+    std::size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(out + i, _mm_andnot_ps(sign, _mm_loadu_ps(x + i)));
+    }
+    for(; i < n; ++i){
+        out[i] = f(x[i]);
+    }
+}
+
+inline void map_block(abs_fn const& f, double* out, std::size_t n, double const* x){
+    __m128d const sign = _mm_set1_pd(-0.);
+    std::size_t i = 0;
+    for(; i + 2 <= n; i += 2){
+        _mm_storeu_pd(out + i, _mm_andnot_pd(sign, _mm_loadu_pd(x + i)));
+    }
+    for(; i < n; ++i){
+        out[i] = f(x[i]);
+    }
+}
+
+inline void map_block(sqrt_fn const& f, float* out, std::size_t n, float const* x){
+    std::size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(out + i, _mm_sqrt_ps(_mm_loadu_ps(x + i)));
+    }
+    for(; i < n; ++i){
+        out[i] = f(x[i]);
+    }
+}
+
+inline void map_block(sqrt_fn const& f, double* out, std::size_t n, double const* x){
+    std::size_t i = 0;
+    for(; i + 2 <= n; i += 2){
+        _mm_storeu_pd(out + i, _mm_sqrt_pd(_mm_loadu_pd(x + i)));
+    }
+    for(; i < n; ++i){
+        out[i] = f(x[i]);
+    }
+}
+
+// std::min(x, y) is y < x ? y : x, which is _mm_min_ps(y, x)
+inline void map_block(min_fn const& f, float* out, std::size_t n, float const* x, float const* y){
+    std::size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(out + i, _mm_min_ps(_mm_loadu_ps(y + i), _mm_loadu_ps(x + i)));
+    }
+    for(; i < n; ++i){
+        out[i] = f(x[i], y[i]);
+    }
+}
+
+inline void map_block(min_fn const& f, double* out, std::size_t n, double const* x, double const* y){
+    std::size_t i = 0;
+    for(; i + 2 <= n; i += 2){
+        _mm_storeu_pd(out + i, _mm_min_pd(_mm_loadu_pd(y + i), _mm_loadu_pd(x + i)));
+    }
+    for(; i < n; ++i){
+        out[i] = f(x[i], y[i]);
+    }
+}
+
+// std::max(x, y) is x < y ? y : x, which is _mm_max_ps(y, x)
+inline void map_block(max_fn const& f, float* out, std::size_t n, float const* x, float const* y){
+    std::size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(out + i, _mm_max_ps(_mm_loadu_ps(y + i), _mm_loadu_ps(x + i)));
+    }
+    for(; i < n; ++i){
+        out[i] = f(x[i], y[i]);
+    }
+}
+
+inline void map_block(max_fn const& f, double* out, std::size_t n, double const* x, double const* y){
+    std::size_t i = 0;
+    for(; i + 2 <= n; i += 2){
+        _mm_storeu_pd(out + i, _mm_max_pd(_mm_loadu_pd(y + i), _mm_loadu_pd(x + i)));
+    }
+    for(; i < n; ++i){
+        out[i] = f(x[i], y[i]);
+    }
+}
+
+inline void map_block(clamp_fn<float> const& f, float* out, std::size_t n, float const* x){
+    __m128 const lo = _mm_set1_ps(f.lo);
+    __m128 const hi = _mm_set1_ps(f.hi);
+    std::size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(out + i, _mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(x + i))));
+    }
+    for(; i < n; ++i){
+        out[i] = f(x[i]);
+    }
+}
+
+inline void map_block(clamp_fn<double> const& f, double* out, std::size_t n, double const* x){
+    __m128d const lo = _mm_set1_pd(f.lo);
+    __m128d const hi = _mm_set1_pd(f.hi);
+    std::size_t i = 0;
+    for(; i + 2 <= n; i += 2){
+        _mm_storeu_pd(out + i, _mm_min_pd(hi, _mm_max_pd(lo, _mm_loadu_pd(x + i))));
+    }
+    for(; i < n; ++i){
+        out[i] = f(x[i]);
+    }
+}
+
+template<typename F, typename T>
+struct simd_map<F, T(T), typename std::enable_if<
+    (std::is_same<F, abs_fn>::value || std::is_same<F, sqrt_fn>::value || std::is_same<F, clamp_fn<T>>::value) &&
+    (std::is_same<T, float>::value || std::is_same<T, double>::value)>::type> : std::true_type{};
+
+template<typename F, typename T>
+struct simd_map<F, T(T, T), typename std::enable_if<
+    (std::is_same<F, min_fn>::value || std::is_same<F, max_fn>::value) &&
+    (std::is_same<T, float>::value || std::is_same<T, double>::value)>::type> : std::true_type{};
+#endif
+}
+
+/**
+ * A proxy that applies f to the elements of one or more proxies at the same
+ * position: get(pos) is f(p.get(pos)...). Like adder_proxy, its size is the
+ * smallest of theirs.
+ */
+template<typename F, typename... Proxies>
+class map_proxy{
+    F f;
+    std::tuple<Proxies...> ps;
+    public:
+    using type = typename std::decay<
+        decltype(std::declval<F const&>()(std::declval<typename Proxies::type>()...))>::type;
+    private:
+    template<std::size_t... I>
+    constexpr std::size_t size(std::index_sequence<I...>) const {
+        std::size_t result = std::numeric_limits<std::size_t>::max();
+        std::size_t const sizes[] = {std::get<I>(ps).size()...};
+        for(std::size_t s : sizes){
+            result = s < result ? s : result;
+        }
+        return result;
+    }
+    template<std::size_t... I>
+    constexpr type get(std::size_t pos, std::index_sequence<I...>) const {
+        return f(std::get<I>(ps).get(pos)...);
+    }
+    template<std::size_t... I>
+    void eval(std::size_t pos, std::size_t count, type* out,
+              std::index_sequence<I...>) const {
+        std::tuple<std::array<typename Proxies::type, detail::block_size>...> buffers;
+        for(std::size_t i = 0; i < count; i += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, count - i);
+            int const expand[] = {0, (detail::evaluate(
+                std::get<I>(ps), pos + i, n, std::get<I>(buffers).data()), 0)...};
+            (void)expand;
+            detail::map_block(f, out + i, n, static_cast<
+                typename Proxies::type const*>(std::get<I>(buffers).data())...);
+        }
+    }
+    template<std::size_t... I>
+    bool aliases(void const* first, void const* last, std::index_sequence<I...>) const {
+        bool const each[] = {false, detail::may_alias(std::get<I>(ps), first, last)...};
+        return std::find(std::begin(each), std::end(each), true) != std::end(each);
+    }
+    public:
+    static constexpr bool elementwise =
+        detail::all_of<detail::is_elementwise<Proxies>::value...>::value;
+    static constexpr std::size_t extent = detail::elementwise_extent<Proxies...>::value;
+    static constexpr bool unbounded =
+        detail::all_of<detail::is_unbounded<Proxies>::value...>::value;
+    constexpr map_proxy(F const& f, Proxies const&... ps):
+        f{f},
+        ps{ps...}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return extent != dynamic_extent ? extent : size(std::index_sequence_for<Proxies...>{});
+    }
+    constexpr type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return get(pos, std::index_sequence_for<Proxies...>{});
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        eval(pos, count, out, std::index_sequence_for<Proxies...>{});
+    }
+    std::tuple<Proxies...> const& children() const {
+        return ps;
+    }
+    bool aliases(void const* first, void const* last) const {
+        return aliases(first, last, std::index_sequence_for<Proxies...>{});
+    }
+};
+
+template<typename F, typename... Proxies, detail::enable_if_proxies<Proxies...> = 0>
+constexpr map_proxy<F, Proxies...> map(F const& f, Proxies const&... ps){
+    return {f, ps...};
+}
+
+template<typename P, detail::enable_if_proxies<P> = 0>
+constexpr map_proxy<abs_fn, P> abs(P const& p){
+    return {abs_fn{}, p};
+}
+
+template<typename P, detail::enable_if_proxies<P> = 0>
+constexpr map_proxy<sqrt_fn, P> sqrt(P const& p){
+    return {sqrt_fn{}, p};
+}
+
+/**
+ * Elementwise minimum and maximum of two proxies (min(p) and max(p) are the
+ * reductions further down).
+ */
+template<typename P1, typename P2, detail::enable_if_proxies<P1, P2> = 0>
+constexpr map_proxy<min_fn, P1, P2> minimum(P1 const& p1, P2 const& p2){
+    return {min_fn{}, p1, p2};
+}
+
+template<typename P1, typename P2, detail::enable_if_proxies<P1, P2> = 0>
+constexpr map_proxy<max_fn, P1, P2> maximum(P1 const& p1, P2 const& p2){
+    return {max_fn{}, p1, p2};
+}
+
+template<typename P, detail::enable_if_proxies<P> = 0>
+constexpr map_proxy<clamp_fn<typename P::type>, P>
+clamp(P const& p, typename P::type lo, typename P::type hi){
+    return {clamp_fn<typename P::type>{lo, hi}, p};
+}
+
+/**
+ * Views: proxies that only change which element of another proxy ends up
+ * where. None of them copy anything, and where the elements they read are
+ * still contiguous (slice, reverse, repeat, stride 1) they pass whole runs
+ * on to the proxy underneath, so it keeps its block/SIMD path.
+ */
+
+/**
+ * Elements [begin, end) of p. Both ends are clipped to p's size when it's
+ * evaluated, so a slice of a sequence that shrank is just shorter.
+ */
+template<typename P>
+class slice_proxy{
+    P p;
+    std::size_t first;
+    std::size_t last;
+    public:
+    using type = typename P::type;
+    constexpr slice_proxy(P const& p, std::size_t begin, std::size_t end):
+        p{p},
+        first{begin},
+        last{end}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return std::min(last, p.size()) > first ? std::min(last, p.size()) - first : 0;
+    }
+    constexpr type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return p.get(first + pos);
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        detail::evaluate(p, first + pos, count, out);
+    }
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    bool aliases(void const* begin, void const* end) const {
+        return detail::may_alias(p, begin, end);
+    }
+};
+
+template<typename P, detail::enable_if_proxies<P> = 0>
+constexpr slice_proxy<P> slice(P const& p, std::size_t begin, std::size_t end){
+    return {p, begin, end};
+}
+
+namespace detail{
+// a throw in one branch still leaves the constructor constexpr
+constexpr std::size_t check_step(std::size_t step){
+    return step != 0 ? step : throw std::invalid_argument("proxy: a stride has to step at least one element");
+}
+}
+
+/**
+ * Every step-th element of p, starting with the first. A step of 0 throws
+ * std::invalid_argument.
+ */
+template<typename P>
+class stride_proxy{
+    P p;
+    std::size_t step;
+    public:
+    using type = typename P::type;
+    constexpr stride_proxy(P const& p, std::size_t step):
+        p{p},
+        step{detail::check_step(step)}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return (p.size() + step - 1) / step;
+    }
+    constexpr type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return p.get(pos * step);
+    }
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    /**
+     * For small steps it's cheaper to evaluate the whole run underneath and
+     * keep every step-th element than to get() them one by one; for large
+     * steps most of that work would be thrown away.
+     */
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        if(step == 1){
+            detail::evaluate(p, pos, count, out);
+        }else if(step <= 8){
+            type buffer[detail::block_size];
+            std::size_t const per_block = detail::block_size / step;
+            for(std::size_t i = 0; i < count; i += per_block){
+                std::size_t const k = std::min(per_block, count - i);
+                detail::evaluate(p, (pos + i) * step, (k - 1) * step + 1, buffer);
+                for(std::size_t j = 0; j < k; ++j){
+                    out[i + j] = buffer[j * step];
+                }
+            }
+        }else{
+            for(std::size_t i = 0; i < count; ++i){
+                out[i] = p.get((pos + i) * step);
+            }
+        }
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p, first, last);
+    }
+};
+
+template<typename P, detail::enable_if_proxies<P> = 0>
+constexpr stride_proxy<P> stride(P const& p, std::size_t step){
+    return {p, step};
+}
+
+/**
+ * p back to front.
+ */
+template<typename P>
+class reverse_proxy{
+    P p;
+    public:
+    using type = typename P::type;
+    static constexpr std::size_t extent = detail::static_extent<P>::value;
+    constexpr reverse_proxy(P const& p):
+        p{p}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return p.size();
+    }
+    constexpr type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return p.get(p.size() - 1 - pos);
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        detail::evaluate(p, p.size() - pos - count, count, out);
+        std::reverse(out, out + count);
+    }
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p, first, last);
+    }
+};
+
+template<typename P, detail::enable_if_proxies<P> = 0>
+constexpr reverse_proxy<P> reverse(P const& p){
+    return {p};
+}
+
+/**
+ * p, times times over: like p | p | ... | p.
+ */
+template<typename P>
+class repeat_proxy{
+    static_assert(!detail::is_unbounded<P>::value, "can't repeat an unbounded proxy, it has no end");
+    P p;
+    std::size_t times;
+    public:
+    using type = typename P::type;
+    constexpr repeat_proxy(P const& p, std::size_t times):
+        p{p},
+        times{times}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return p.size() * times;
+    }
+    constexpr type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return p.get(pos % p.size());
+    }
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    // like pipe_proxy, one call per copy of p the range touches
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        // nothing to do, and an empty p has no positions to take pos modulo
+        if(count == 0)
+            return;
+        std::size_t const n = p.size();
+        std::size_t offset = pos % n;
+        for(std::size_t i = 0; i < count;){
+            std::size_t const run = std::min(n - offset, count - i);
+            detail::evaluate(p, offset, run, out + i);
+            i += run;
+            offset = 0;
+        }
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p, first, last);
+    }
+};
+
+template<typename P, detail::enable_if_proxies<P> = 0>
+constexpr repeat_proxy<P> repeat(P const& p, std::size_t times){
+    return {p, times};
+}
+
+/**
+ * A stream over a random access proxy: reads walk through it from the start.
+ */
+template<typename P>
+class cursor_stream{
+    P p;
+    std::size_t pos = 0;
+    public:
+    using type = typename P::type;
+    cursor_stream(P const& p):
+        p{p}
+    {}
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    std::size_t read(type* out, std::size_t count){
+        PROXY_PROFILE_EVAL(count);
+        std::size_t const size = p.size();
+        count = pos < size ? std::min(count, size - pos) : 0;
+        detail::evaluate(p, pos, count, out);
+        pos += count;
+        return count;
+    }
+};
+
+namespace detail{
+template<typename Source>
+cursor_stream<Source> as_stream(Source const& p, random_access_tag){
+    return {p};
+}
+
+template<typename Source>
+Source as_stream(Source const& s, stream_tag){
+    return s;
+}
+
+template<typename Source>
+using stream_of = decltype(as_stream(std::declval<Source const&>(), category_of<Source>{}));
+}
+
+/**
+ * Turns a proxy into a stream over it, and leaves streams as they are.
+ */
+template<typename Source, detail::enable_if_proxy_or_stream<Source> = 0>
+detail::stream_of<Source> as_stream(Source const& source){
+    return detail::as_stream(source, detail::category_of<Source>{});
+}
+
+/**
+ * Predicates for filter() that stream compaction knows how to do with SIMD
+ * on float and int32.
+ */
+template<typename T>
+struct greater_than_fn{
+    T value;
+    constexpr bool operator()(T x) const {
+        return x > value;
+    }
+};
+
+template<typename T>
+struct less_than_fn{
+    T value;
+    constexpr bool operator()(T x) const {
+        return x < value;
+    }
+};
+
+template<typename T>
+constexpr greater_than_fn<T> greater_than(T value){
+    return {value};
+}
+
+template<typename T>
+constexpr less_than_fn<T> less_than(T value){
+    return {value};
+}
+
+namespace detail{
+/**
+ * Copies the elements of in[0, n) that satisfy pred to the front of out, in
+ * order, and returns how many there were. out must have room for n elements
+ * (the fast versions write whole vectors past the last kept element).
+ *
+ * The generic version doesn't branch on the predicate: it always writes the
+ * element and only moves the output position along if it's kept, so an
+ * unpredictable predicate doesn't cost a misprediction per element.
+ */
+template<typename Predicate, typename T>
+std::size_t compact(Predicate const& pred, T const* in, std::size_t n, T* out){
+    std::size_t kept = 0;
+    for(std::size_t i = 0; i < n; ++i){
+        out[kept] = in[i];
+        kept += pred(in[i]) ? 1 : 0;
+    }
+    return kept;
+}
+
+#if defined(__AVX512F__)
+// AVX-512 has an instruction for exactly this: vcompress writes the
+// selected lanes of a vector contiguously
+
+template<typename Compare, typename Predicate, typename T>
+std::size_t compact_avx512(Compare compare, Predicate const& pred,
+                           T const* in, std::size_t n, T* out){
+    std::size_t kept = 0;
+    std::size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        kept += compare(in + i, out + kept);
+    }
+    return kept + compact(pred, in + i, n - i, out + kept);
+}
+
+inline std::size_t compact(greater_than_fn<float> const& pred, float const* in, std::size_t n, float* out){
+    __m512 const value = _mm512_set1_ps(pred.value);
+    return compact_avx512([value](float const* from, float* to){
+        __m512 const v = _mm512_loadu_ps(from);
+        __mmask16 const mask = _mm512_cmp_ps_mask(v, value, _CMP_GT_OQ);
+        _mm512_mask_compressstoreu_ps(to, mask, v);
+        return std::size_t(__builtin_popcount(mask));
+    }, pred, in, n, out);
+}
+
+inline std::size_t compact(less_than_fn<float> const& pred, float const* in, std::size_t n, float* out){
+    __m512 const value = _mm512_set1_ps(pred.value);
+    return compact_avx512([value](float const* from, float* to){
+        __m512 const v = _mm512_loadu_ps(from);
+        __mmask16 const mask = _mm512_cmp_ps_mask(v, value, _CMP_LT_OQ);
+        _mm512_mask_compressstoreu_ps(to, mask, v);
+        return std::size_t(__builtin_popcount(mask));
+    }, pred, in, n, out);
+}
+
+inline std::size_t compact(greater_than_fn<int> const& pred, int const* in, std::size_t n, int* out){
+    __m512i const value = _mm512_set1_epi32(pred.value);
+    return compact_avx512([value](int const* from, int* to){
+        __m512i const v = _mm512_loadu_si512(from);
+        __mmask16 const mask = _mm512_cmpgt_epi32_mask(v, value);
+        _mm512_mask_compressstoreu_epi32(to, mask, v);
+        return std::size_t(__builtin_popcount(mask));
+    }, pred, in, n, out);
+}
+
+inline std::size_t compact(less_than_fn<int> const& pred, int const* in, std::size_t n, int* out){
+    __m512i const value = _mm512_set1_epi32(pred.value);
+    return compact_avx512([value](int const* from, int* to){
+        __m512i const v = _mm512_loadu_si512(from);
+        __mmask16 const mask = _mm512_cmplt_epi32_mask(v, value);
+        _mm512_mask_compressstoreu_epi32(to, mask, v);
+        return std::size_t(__builtin_popcount(mask));
+    }, pred, in, n, out);
+}
+#elif defined(__AVX2__)
+// AVX2 doesn't have a compress instruction, but it can permute the lanes of a
+// vector any way we like. For each of the 256 possible 8 lane masks, the
+// table holds the permutation that moves the selected lanes to the front.
+
+inline __m256i const* compaction_table(){
+    struct table{
+        alignas(32) int indices[256][8];
+        table(){
+            for(int mask = 0; mask < 256; ++mask){
+                int k = 0;
+                for(int lane = 0; lane < 8; ++lane){
+                    if(mask & (1 << lane))
+                        indices[mask][k++] = lane;
+                }
+                while(k < 8){
+                    indices[mask][k++] = 0;
+                }
+            }
+        }
+    };
+    static table const t;
+    return reinterpret_cast<__m256i const*>(t.indices);
+}
+
+template<typename Compare, typename Predicate, typename T>
+std::size_t compact_avx2(Compare compare, Predicate const& pred,
+                         T const* in, std::size_t n, T* out){
+    __m256i const* const table = compaction_table();
+    std::size_t kept = 0;
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256 const v = _mm256_loadu_ps(reinterpret_cast<float const*>(in + i));
+        int const mask = _mm256_movemask_ps(compare(v));
+        _mm256_storeu_ps(reinterpret_cast<float*>(out + kept),
+                         _mm256_permutevar8x32_ps(v, _mm256_load_si256(table + mask)));
+        kept += __builtin_popcount(mask);
+    }
+    return kept + compact(pred, in + i, n - i, out + kept);
+}
+
+inline std::size_t compact(greater_than_fn<float> const& pred, float const* in, std::size_t n, float* out){
+    __m256 const value = _mm256_set1_ps(pred.value);
+    return compact_avx2([value](__m256 v){
+        return _mm256_cmp_ps(v, value, _CMP_GT_OQ);
+    }, pred, in, n, out);
+}
+
+inline std::size_t compact(less_than_fn<float> const& pred, float const* in, std::size_t n, float* out){
+    __m256 const value = _mm256_set1_ps(pred.value);
+    return compact_avx2([value](__m256 v){
+        return _mm256_cmp_ps(v, value, _CMP_LT_OQ);
+    }, pred, in, n, out);
+}
+
+inline std::size_t compact(greater_than_fn<int> const& pred, int const* in, std::size_t n, int* out){
+    __m256i const value = _mm256_set1_epi32(pred.value);
+    return compact_avx2([value](__m256 v){
+        return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_castps_si256(v), value));
+    }, pred, in, n, out);
+}
+
+inline std::size_t compact(less_than_fn<int> const& pred, int const* in, std::size_t n, int* out){
+    __m256i const value = _mm256_set1_epi32(pred.value);
+    return compact_avx2([value](__m256 v){
+        return _mm256_castsi256_ps(_mm256_cmpgt_epi32(value, _mm256_castps_si256(v)));
+    }, pred, in, n, out);
+}
+#endif
+
+/**
+ * Whether compact has a SIMD version for Predicate on T, for explain().
+ */
+template<typename Predicate, typename T>
+struct simd_compact : std::false_type{};
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+template<typename T>
+struct simd_compact<greater_than_fn<T>, T> : std::integral_constant<bool,
+    std::is_same<T, float>::value || std::is_same<T, int>::value>{};
+
+template<typename T>
+struct simd_compact<less_than_fn<T>, T> : std::integral_constant<bool,
+    std::is_same<T, float>::value || std::is_same<T, int>::value>{};
+#endif
+}
+
+/**
+ * A stream of the elements of source that satisfy pred, in order.
+ *
+ * Each read pulls a block from the source and compacts it straight into the
+ * caller's buffer. A block is never bigger than the room left in that buffer,
+ * so even if every element passes there's nowhere it could overflow to and
+ * nothing has to be held back for the next read.
+ */
+template<typename Predicate, typename Source>
+class filter_proxy{
+    Predicate pred;
+    Source source;
+    bool done = false;
+    public:
+    using type = typename Source::type;
+    filter_proxy(Predicate const& pred, Source const& source):
+        pred{pred},
+        source{source}
+    {}
+    std::tuple<Source const&> children() const {
+        return std::tie(source);
+    }
+    std::size_t read(type* out, std::size_t count){
+        PROXY_PROFILE_EVAL(count);
+        type buffer[detail::block_size];
+        std::size_t produced = 0;
+        while(produced < count && !done){
+            std::size_t const want = std::min(detail::block_size, count - produced);
+            std::size_t const got = source.read(buffer, want);
+            done = got < want;
+            produced += detail::compact(pred, static_cast<type const*>(buffer), got, out + produced);
+        }
+        return produced;
+    }
+};
+
+/**
+ * The elements of p (a proxy or a stream) that satisfy pred. The result is
+ * a stream, since there's no telling how many elements it has or where the
+ * i-th one is without going through everything before it.
+ */
+template<typename Predicate, typename Source, detail::enable_if_proxy_or_stream<Source> = 0>
+filter_proxy<Predicate, detail::stream_of<Source>> filter(Predicate const& pred, Source const& p){
+    return {pred, as_stream(p)};
+}
+
+namespace detail{
+template<typename T, typename Stream>
+std::size_t read_as(Stream& s, T* out, std::size_t count, std::true_type){
+    return s.read(out, count);
+}
+
+template<typename T, typename Stream>
+std::size_t read_as(Stream& s, T* out, std::size_t count, std::false_type){
+    typename Stream::type buffer[block_size];
+    std::size_t produced = 0;
+    while(produced < count){
+        std::size_t const want = std::min(block_size, count - produced);
+        std::size_t const got = s.read(buffer, want);
+        std::copy_n(buffer, got, out + produced);
+        produced += got;
+        if(got < want)
+            break;
+    }
+    return produced;
+}
+
+/**
+ * s.read, but converting the elements to T on the way out, like evaluate_as.
+ */
+template<typename T, typename Stream>
+std::size_t read_as(Stream& s, T* out, std::size_t count){
+    return read_as<T>(s, out, count, std::is_same<T, typename Stream::type>{});
+}
+}
+
+/**
+ * s1 + s2 and s1 * s2 when at least one side is a stream (a proxy on the
+ * other side is read through a cursor_stream). Each read takes a block from
+ * the left, asks the right for the same number of elements and combines them,
+ * so the result ends where the shorter side does, and the right side is never
+ * read past the end of the left.
+ */
+template<typename Op, typename S1, typename S2>
+class elementwise_stream{
+    S1 s1;
+    S2 s2;
+    bool done = false;
+    public:
+    using type = typename std::common_type<
+        typename S1::type,
+        typename S2::type
+        >::type;
+    elementwise_stream(S1 const& s1, S2 const& s2):
+        s1{s1},
+        s2{s2}
+    {}
+    std::tuple<S1 const&, S2 const&> children() const {
+        return std::tie(s1, s2);
+    }
+    std::size_t read(type* out, std::size_t count){
+        PROXY_PROFILE_EVAL(count);
+        Op const op{};
+        typename S1::type lhs[detail::block_size];
+        typename S2::type rhs[detail::block_size];
+        std::size_t produced = 0;
+        while(produced < count && !done){
+            std::size_t const want = std::min(detail::block_size, count - produced);
+            std::size_t const got = s2.read(rhs, s1.read(lhs, want));
+            done = got < want;
+            for(std::size_t j = 0; j < got; ++j){
+                out[produced + j] = op(type(lhs[j]), type(rhs[j]));
+            }
+            produced += got;
+        }
+        return produced;
+    }
+};
+
+/**
+ * s1 | s2 when at least one side is a stream: everything s1 has, then
+ * everything s2 has.
+ */
+template<typename S1, typename S2>
+class pipe_stream{
+    S1 s1;
+    S2 s2;
+    bool first_done = false;
+    public:
+    using type = typename std::common_type<
+        typename S1::type,
+        typename S2::type
+        >::type;
+    pipe_stream(S1 const& s1, S2 const& s2):
+        s1{s1},
+        s2{s2}
+    {}
+    std::tuple<S1 const&, S2 const&> children() const {
+        return std::tie(s1, s2);
+    }
+    std::size_t read(type* out, std::size_t count){
+        PROXY_PROFILE_EVAL(count);
+        std::size_t got = 0;
+        if(!first_done){
+            got = detail::read_as<type>(s1, out, count);
+            first_done = got < count;
+        }
+        if(got < count)
+            got += detail::read_as<type>(s2, out + got, count - got);
+        return got;
+    }
+};
+
+template<typename S1, typename S2>
+using stream_adder = elementwise_stream<std::plus<typename std::common_type<
+    typename S1::type, typename S2::type>::type>, S1, S2>;
+
+template<typename S1, typename S2>
+using stream_product = elementwise_stream<std::multiplies<typename std::common_type<
+    typename S1::type, typename S2::type>::type>, S1, S2>;
+
+template<typename S1, typename S2, detail::enable_if_streams<S1, S2> = 0>
+stream_adder<detail::stream_of<S1>, detail::stream_of<S2>>
+operator+(S1 const& s1, S2 const& s2){
+    return {as_stream(s1), as_stream(s2)};
+}
+
+template<typename S, typename T, detail::enable_if_stream_and_scalar<S, T> = 0>
+stream_adder<S, cursor_stream<scalar_proxy<T>>>
+operator+(S const& s, T t){
+    return {s, as_stream(scalar_proxy<T>{t})};
+}
+
+template<typename T, typename S, detail::enable_if_stream_and_scalar<S, T> = 0>
+stream_adder<cursor_stream<scalar_proxy<T>>, S>
+operator+(T t, S const& s){
+    return {as_stream(scalar_proxy<T>{t}), s};
+}
+
+template<typename S1, typename S2, detail::enable_if_streams<S1, S2> = 0>
+stream_product<detail::stream_of<S1>, detail::stream_of<S2>>
+operator*(S1 const& s1, S2 const& s2){
+    return {as_stream(s1), as_stream(s2)};
+}
+
+template<typename S, typename T, detail::enable_if_stream_and_scalar<S, T> = 0>
+stream_product<S, cursor_stream<scalar_proxy<T>>>
+operator*(S const& s, T t){
+    return {s, as_stream(scalar_proxy<T>{t})};
+}
+
+template<typename T, typename S, detail::enable_if_stream_and_scalar<S, T> = 0>
+stream_product<cursor_stream<scalar_proxy<T>>, S>
+operator*(T t, S const& s){
+    return {as_stream(scalar_proxy<T>{t}), s};
+}
+
+template<typename S1, typename S2, detail::enable_if_streams<S1, S2> = 0>
+pipe_stream<detail::stream_of<S1>, detail::stream_of<S2>>
+operator|(S1 const& s1, S2 const& s2){
+    return {as_stream(s1), as_stream(s2)};
+}
+
+namespace detail{
+template<typename Proxy, typename Container>
+void fill_container(Proxy const& p, Container& c, std::true_type){
+    // ask for the size once, make room for everything, then let the
+    // proxy fill the whole range in one go
+    // (&c[0] rather than data(), which std::string only has const until C++17)
+    c.resize(p.size());
+    if(!c.empty())
+        evaluate_as<typename Container::value_type>(p, 0, c.size(), &c[0]);
+}
+
+// std::vector<bool> packs its elements into bits and a std::deque keeps
+// them in pieces, so there's no one pointer to write to - go through a
+// buffer instead
+template<typename Proxy, typename Container>
+void fill_container(Proxy const& p, Container& c, std::false_type){
+    typename Proxy::type buffer[block_size];
+    std::size_t const size = p.size();
+    for(std::size_t i = 0; i < size; i += block_size){
+        std::size_t const n = std::min(block_size, size - i);
+        evaluate(p, i, n, buffer);
+        c.insert(c.end(), buffer, buffer + n);
+    }
+}
+
+/**
+ * A stream doesn't know its size, so read it in chunks straight into the end
+ * of the container, doubling the chunk each time so there are only a
+ * logarithmic number of reads and reallocations.
+ */
+template<typename Stream, typename Container>
+void read_into_container(Stream& s, Container& c, std::true_type){
+    for(std::size_t chunk = block_size;; chunk = std::max(chunk, c.size())){
+        std::size_t const old = c.size();
+        c.resize(old + chunk);
+        std::size_t const got = s.read(&c[old], chunk);
+        c.resize(old + got);
+        if(got < chunk)
+            return;
+    }
+}
+
+template<typename Stream, typename Container>
+void read_into_container(Stream& s, Container& c, std::false_type){
+    typename Stream::type buffer[block_size];
+    std::size_t got;
+    do{
+        got = s.read(buffer, block_size);
+        c.insert(c.end(), buffer, buffer + got);
+    }while(got == block_size);
+}
+
+template<typename Container, typename Proxy>
+Container make_container(Proxy const& p, typename Container::allocator_type const& alloc, random_access_tag){
+    static_assert(!is_unbounded<Proxy>::value, "make_vector needs a proxy with a size");
+    Container c(alloc);
+    fill_container(p, c, is_contiguous<Container>{});
+    return c;
+}
+
+template<typename Container, typename Stream>
+Container make_container(Stream const& stream, typename Container::allocator_type const& alloc, stream_tag){
+    Stream s = stream;
+    Container c(alloc);
+    read_into_container(s, c, std::integral_constant<bool, is_contiguous<Container>::value &&
+        std::is_same<typename Container::value_type, typename Stream::type>::value>{});
+    return c;
+}
+}
+
+/**
+ * Takes a proxy (or a stream) and converts it to a Container - a
+ * std::vector with some other allocator, a std::deque, a std::string, a
+ * std::pmr::vector with a memory resource, anything with an allocator and
+ * insert(end, first, last). The container is made with alloc, and the
+ * elements are converted to its value_type as if one at a time.
+ *
+ * Containers with data() and resize() are sized once and written in place,
+ * anything else is appended to a block at a time.
+ */
+template<typename Container, typename Source>
+Container make_container(Source const& p,
+                         typename Container::allocator_type const& alloc = typename Container::allocator_type()){
+    return detail::make_container<Container>(p, alloc, detail::category_of<Source>{});
+}
+
+/**
+ * Takes a proxy and converts it to a vector.
+ */
+template<typename Proxy>
+std::vector<typename Proxy::type>
+make_vector(Proxy const& p){
+    return make_container<std::vector<typename Proxy::type>>(p);
+}
+
+/**
+ * The same, into a vector that gets its memory from alloc.
+ */
+template<typename Proxy, typename Allocator>
+std::vector<typename Proxy::type, Allocator>
+make_vector(Proxy const& p, Allocator const& alloc){
+    return make_container<std::vector<typename Proxy::type, Allocator>>(p, alloc);
+}
+
+namespace detail{
+template<typename Proxy, std::size_t... I>
+constexpr std::array<typename Proxy::type, sizeof...(I)>
+make_array(Proxy const& p, std::index_sequence<I...>){
+    return {{p.get(I)...}};
+}
+
+template<typename Proxy>
+using array_extent = std::integral_constant<std::size_t,
+    static_extent<Proxy>::value == dynamic_extent ? 0 : static_extent<Proxy>::value>;
+}
+
+/**
+ * Takes a proxy whose size is known at compile time (all of its leaves are
+ * std::arrays or native arrays) and converts it to a std::array. There's no
+ * loop: every element is its own get(I), so for the 3 and 4 element vectors
+ * of geometry code the compiler sees straight line code, and if the inputs
+ * are constexpr, so is the result.
+ */
+template<typename Proxy>
+constexpr std::array<typename Proxy::type, detail::array_extent<Proxy>::value>
+make_array(Proxy const& p){
+    static_assert(detail::static_extent<Proxy>::value != dynamic_extent,
+                  "make_array needs a proxy whose size is known at compile time");
+    return detail::make_array(p, std::make_index_sequence<detail::array_extent<Proxy>::value>{});
+}
+
+/**
+ * A pointer and a length - a view of somebody else's contiguous storage.
+ * std::span does this job from C++20 on; this is just enough of one to say
+ * "write the result here".
+ */
+template<typename T>
+class span{
+    T* first;
+    std::size_t count;
+    public:
+    using value_type = typename std::remove_cv<T>::type;
+    constexpr span(T* data, std::size_t size):
+        first{data},
+        count{size}
+    {}
+    template<std::size_t N>
+    constexpr span(T (&array)[N]):
+        first{array},
+        count{N}
+    {}
+    template<typename Container, typename = decltype(
+        static_cast<T*>(std::declval<Container&>().data()))>
+    constexpr span(Container& container):
+        first{container.data()},
+        count{container.size()}
+    {}
+    constexpr T* data() const {
+        return first;
+    }
+    constexpr std::size_t size() const {
+        return count;
+    }
+    constexpr T* begin() const {
+        return first;
+    }
+    constexpr T* end() const {
+        return first + count;
+    }
+    constexpr T& operator[](std::size_t pos) const {
+        return first[pos];
+    }
+};
+
+namespace detail{
+template<typename T, typename Proxy>
+bool reads_in_step(Proxy const& p, T const* dest, std::size_t n);
+
+template<typename T, typename Proxy>
+bool leaf_in_step(Proxy const& p, T const* dest, std::size_t n, std::true_type){
+    return !may_alias(p, dest, dest + n) ||
+        (static_cast<void const*>(p.data()) == dest && sizeof(*p.data()) == sizeof(T));
+}
+
+template<typename T, typename Proxy>
+bool leaf_in_step(Proxy const& p, T const* dest, std::size_t n, std::false_type){
+    return !may_alias(p, dest, dest + n);
+}
+
+template<typename T, typename Children, std::size_t... I>
+bool children_in_step(Children const& children, T const* dest, std::size_t n, std::index_sequence<I...>){
+    bool const each[] = {true, reads_in_step(std::get<I>(children), dest, n)...};
+    return std::all_of(std::begin(each), std::end(each), [](bool b){ return b; });
+}
+
+template<typename T, typename Proxy>
+bool reads_in_step(Proxy const& p, T const* dest, std::size_t n, std::true_type){
+    auto const& children = p.children();
+    return children_in_step(children, dest, n,
+        std::make_index_sequence<std::tuple_size<typename std::decay<decltype(children)>::type>::value>{});
+}
+
+template<typename T, typename Proxy>
+bool reads_in_step(Proxy const& p, T const* dest, std::size_t n, std::false_type){
+    return leaf_in_step(p, dest, n, has_data<Proxy>{});
+}
+
+/**
+ * Whether every leaf of p that reads from dest reads element i from dest[i]
+ * itself. For an elementwise p, that makes it safe to write dest a block at
+ * a time: nothing reads a block of dest again once it's evaluated.
+ */
+template<typename T, typename Proxy>
+bool reads_in_step(Proxy const& p, T const* dest, std::size_t n){
+    return reads_in_step(p, dest, n, has_children<Proxy>{});
+}
+
+template<typename T, typename Proxy>
+void evaluate_into(Proxy const& p, std::size_t n, T* dest){
+    if(!may_alias(p, dest, dest + n)){
+        evaluate_as<T>(p, 0, n, dest);
+    }else if(is_elementwise<Proxy>::value && reads_in_step(p, static_cast<T const*>(dest), n)){
+        T buffer[block_size];
+        for(std::size_t i = 0; i < n; i += block_size){
+            std::size_t const k = std::min(block_size, n - i);
+            evaluate_as<T>(p, i, k, buffer);
+            std::copy_n(buffer, k, dest + i);
+        }
+    }else{
+        std::vector<T> temporary(n);
+        evaluate_as<T>(p, 0, n, temporary.data());
+        std::copy(temporary.begin(), temporary.end(), dest);
+    }
+}
+}
+
+/**
+ * Evaluates p straight into dest, which has to have room for p.size()
+ * elements (std::length_error if it doesn't). Nothing is allocated, unless
+ * dest is also one of p's inputs in a way that matters:
+ * - if p is elementwise and reads dest in step with writing it (a = a + b),
+ *   element i only depends on element i of the inputs, so each block is
+ *   evaluated into a small buffer on the stack and then copied over - by
+ *   then nothing will read that part of dest again.
+ * - otherwise (a = b | a, or an input that overlaps dest shifted by a few
+ *   elements), the result goes through a temporary vector first.
+ * Returns the number of elements written.
+ */
+template<typename T, typename Proxy>
+std::size_t evaluate_into(span<T> dest, Proxy const& p){
+    static_assert(!detail::is_unbounded<Proxy>::value,
+                  "evaluate_into needs a proxy with a size (into(dest) = p fills dest)");
+    std::size_t const n = p.size();
+    if(n > dest.size())
+        throw std::length_error("proxy::evaluate_into: destination is too small");
+    detail::evaluate_into(p, n, dest.data());
+    return n;
+}
+
+template<typename Container, typename Proxy>
+std::size_t evaluate_into(Container& dest, Proxy const& p){
+    return evaluate_into(span<typename Container::value_type>(dest), p);
+}
+
+/**
+ * dest = p, for a resizable container like std::vector. dest is resized to
+ * p.size(), which doesn't allocate as long as it has the capacity.
+ */
+template<typename Container, typename Proxy>
+void assign(Container& dest, Proxy const& p){
+    std::size_t const n = p.size();
+    if(dest.size() != n){
+        if(detail::may_alias(p, dest.data(), dest.data() + dest.size())){
+            // resizing would move the elements p is about to read
+            Container result(n);
+            evaluate_into(result, p);
+            dest.swap(result);
+            return;
+        }
+        dest.resize(n);
+    }
+    evaluate_into(dest, p);
+}
+
+/**
+ * A place to evaluate into, with compound assignment:
+ *
+ *     into(a) = make_proxy(b) + make_proxy(c);
+ *     into(a) += make_proxy(b);
+ *     into(a) *= make_proxy(b);
+ *
+ * The destination's size never changes - the right hand side has to have
+ * at least as many elements (std::length_error otherwise).
+ */
+template<typename T>
+class destination{
+    span<T> dest;
+
+    template<typename Proxy>
+    void check_size(Proxy const& p) const {
+        if(p.size() < dest.size())
+            throw std::length_error("proxy::destination: not enough elements to assign");
+    }
+    public:
+    constexpr destination(span<T> dest):
+        dest{dest}
+    {}
+    template<typename Proxy>
+    destination& operator=(Proxy const& p){
+        check_size(p);
+        detail::evaluate_into(p, dest.size(), dest.data());
+        return *this;
+    }
+    template<typename Proxy>
+    destination& operator+=(Proxy const& p){
+        check_size(p);
+        detail::evaluate_into(make_proxy(dest) + p, dest.size(), dest.data());
+        return *this;
+    }
+    template<typename Proxy>
+    destination& operator*=(Proxy const& p){
+        check_size(p);
+        detail::evaluate_into(make_proxy(dest) * p, dest.size(), dest.data());
+        return *this;
+    }
+};
+
+template<typename Container>
+destination<typename Container::value_type> into(Container& dest){
+    return {span<typename Container::value_type>(dest)};
+}
+
+template<typename T>
+destination<T> into(span<T> dest){
+    return {dest};
+}
+
+/**
+ * Reductions.
+ *
+ * These work on proxies and streams alike. They go through an expression a
+ * block at a time, so nothing the size of the whole sequence is ever
+ * allocated - sum(make_proxy(a)*make_proxy(b)) is a single pass over a and
+ * b, i.e. a dot product.
+ *
+ * Each block is folded into reduction_lanes independent accumulators instead
+ * of one. With a single accumulator every addition has to wait for the one
+ * before it to finish; with several, the CPU can keep a few in flight at once
+ * and the compiler can put them side by side in SIMD registers. The lanes are
+ * combined pairwise at the end. For floating point this means the result can
+ * differ in the last bits from adding the elements strictly left to right
+ * (it's usually more accurate, not less).
+ */
+constexpr std::size_t reduction_lanes = 8;
+
+namespace detail{
+/**
+ * A reducer describes a reduction to reduce():
+ * - result_type : what it accumulates into
+ * - identity() : the value each lane starts from
+ * - accumulate(acc, x) : folds one element into a lane
+ * - accumulate_n(acc, x, n) : folds in n copies of x (zero or more)
+ * - combine(a, b) : merges two partial results
+ */
+template<typename Reducer>
+class lanes{
+    using result_type = typename Reducer::result_type;
+    Reducer const& r;
+    result_type acc[reduction_lanes];
+    public:
+    lanes(Reducer const& r):
+        r{r}
+    {
+        std::fill(acc, acc + reduction_lanes, r.identity());
+    }
+    template<typename T>
+    void add(T const* data, std::size_t n){
+        std::size_t j = 0;
+        for(; j + reduction_lanes <= n; j += reduction_lanes){
+            for(std::size_t k = 0; k < reduction_lanes; ++k){
+                r.accumulate(acc[k], data[j + k]);
+            }
+        }
+        for(; j < n; ++j){
+            r.accumulate(acc[j % reduction_lanes], data[j]);
+        }
+    }
+    result_type result(){
+        for(std::size_t width = reduction_lanes / 2; width > 0; width /= 2){
+            for(std::size_t k = 0; k < width; ++k){
+                acc[k] = r.combine(acc[k], acc[k + width]);
+            }
+        }
+        return acc[0];
+    }
+};
+
+template<typename Reducer, typename Proxy>
+typename Reducer::result_type
+reduce(Proxy const& p, std::size_t pos, std::size_t count, Reducer const& r){
+    lanes<Reducer> l(r);
+    typename Proxy::type buffer[block_size];
+    for(std::size_t i = 0; i < count; i += block_size){
+        std::size_t const n = std::min(block_size, count - i);
+        evaluate(p, pos + i, n, buffer);
+        l.add(static_cast<typename Proxy::type const*>(buffer), n);
+    }
+    return l.result();
+}
+
+/**
+ * Reduces the whole of p, proxy or stream, and sets count to how many
+ * elements that was.
+ */
+template<typename Reducer, typename Proxy>
+typename Reducer::result_type
+reduce_all(Proxy const& p, Reducer const& r, std::size_t& count, random_access_tag){
+    static_assert(!is_unbounded<Proxy>::value, "reducing needs a proxy with a size");
+    count = p.size();
+    return reduce(p, 0, count, r);
+}
+
+template<typename Reducer, typename Stream>
+typename Reducer::result_type
+reduce_all(Stream const& stream, Reducer const& r, std::size_t& count, stream_tag){
+    Stream s = stream;
+    lanes<Reducer> l(r);
+    typename Stream::type buffer[block_size];
+    count = 0;
+    std::size_t got;
+    do{
+        got = s.read(buffer, block_size);
+        l.add(static_cast<typename Stream::type const*>(buffer), got);
+        count += got;
+    }while(got == block_size);
+    return l.result();
+}
+
+/**
+ * A sparse proxy only has to visit the elements it stores. All the others
+ * are zero, and they're folded in at the end in one go with accumulate_n.
+ */
+template<typename Reducer, typename Proxy>
+typename Reducer::result_type
+reduce_all(Proxy const& p, Reducer const& r, std::size_t& count, sparse_tag){
+    using T = typename Proxy::type;
+    count = p.size();
+    lanes<Reducer> l(r);
+    T buffer[block_size];
+    std::size_t stored = 0;
+    std::size_t n;
+    auto c = p.begin_at(0);
+    do{
+        for(n = 0; n < block_size && !c.done() && c.index() < count; c.next()){
+            buffer[n++] = c.value();
+        }
+        l.add(static_cast<T const*>(buffer), n);
+        stored += n;
+    }while(n == block_size);
+    auto result = l.result();
+    r.accumulate_n(result, T(0), count - stored);
+    return result;
+}
+
+/**
+ * A run-length proxy is folded in a run at a time with accumulate_n, so it
+ * takes time proportional to the number of runs, not the size.
+ */
+template<typename Reducer, typename Proxy>
+typename Reducer::result_type
+reduce_all(Proxy const& p, Reducer const& r, std::size_t& count, run_length_tag){
+    count = p.size();
+    auto result = r.identity();
+    std::size_t pos = 0;
+    for(auto c = p.runs_at(0); pos < count; c.next()){
+        std::size_t const end = std::min(c.end(), count);
+        r.accumulate_n(result, c.value(), end - pos);
+        pos = end;
+    }
+    return result;
+}
+
+template<typename Reducer, typename Proxy>
+typename Reducer::result_type
+reduce_all(Proxy const& p, Reducer const& r){
+    std::size_t count;
+    return reduce_all(p, r, count, category_of<Proxy>{});
+}
+
+template<typename Result, typename Default>
+using result_or = typename std::conditional<
+    std::is_void<Result>::value, Default, Result>::type;
+
+/**
+ * What sum() accumulates in when you don't say: the element type itself,
+ * except for types that are only meant for storage, like half in
+ * proxy_narrow.hpp, which specialise this to the type they compute in.
+ */
+template<typename T>
+struct accumulator_of{
+    using type = T;
+};
+
+template<typename T>
+using accumulator_t = typename accumulator_of<T>::type;
+
+template<typename T>
+struct sum_reducer{
+    using result_type = T;
+    T identity() const { return T(0); }
+    template<typename U>
+    void accumulate(T& acc, U const& x) const { acc += x; }
+    template<typename U>
+    void accumulate_n(T& acc, U const& x, std::size_t n) const {
+        if(n > 0)
+            acc += T(x) * T(n);
+    }
+    T combine(T a, T b) const { return a + b; }
+};
+
+template<typename T>
+struct min_reducer{
+    using result_type = T;
+    T identity() const {
+        return std::numeric_limits<T>::has_infinity ?
+            std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+    }
+    void accumulate(T& acc, T const& x) const { acc = std::min(acc, x); }
+    void accumulate_n(T& acc, T const& x, std::size_t n) const {
+        if(n > 0)
+            accumulate(acc, x);
+    }
+    T combine(T a, T b) const { return std::min(a, b); }
+};
+
+template<typename T>
+struct max_reducer{
+    using result_type = T;
+    T identity() const {
+        return std::numeric_limits<T>::has_infinity ?
+            T(-std::numeric_limits<T>::infinity()) : std::numeric_limits<T>::lowest();
+    }
+    void accumulate(T& acc, T const& x) const { acc = std::max(acc, x); }
+    void accumulate_n(T& acc, T const& x, std::size_t n) const {
+        if(n > 0)
+            accumulate(acc, x);
+    }
+    T combine(T a, T b) const { return std::max(a, b); }
+};
+
+template<typename Predicate>
+struct count_reducer{
+    using result_type = std::size_t;
+    Predicate pred;
+    std::size_t identity() const { return 0; }
+    template<typename U>
+    void accumulate(std::size_t& acc, U const& x) const { acc += pred(x) ? 1 : 0; }
+    template<typename U>
+    void accumulate_n(std::size_t& acc, U const& x, std::size_t n) const { acc += pred(x) ? n : 0; }
+    std::size_t combine(std::size_t a, std::size_t b) const { return a + b; }
+};
+
+template<typename Proxy>
+void require_nonempty(Proxy const& p, char const* what){
+    if(p.size() == 0)
+        throw std::invalid_argument(std::string(what) + " of an empty proxy");
+}
+
+template<typename Reducer, typename Proxy>
+typename Reducer::result_type
+reduce_nonempty(Proxy const& p, Reducer const& r, char const* what){
+    std::size_t count;
+    auto const result = reduce_all(p, r, count, category_of<Proxy>{});
+    if(count == 0)
+        throw std::invalid_argument(std::string(what) + " of an empty proxy");
+    return result;
+}
+}
+
+/**
+ * Adds up every element of p. The sum is accumulated in p's own type (or
+ * its detail::accumulator_of) unless you ask for another one, e.g.
+ * sum<long long>(p) for a long sequence of ints.
+ */
+template<typename Result = void, typename Proxy>
+detail::result_or<Result, detail::accumulator_t<typename Proxy::type>>
+sum(Proxy const& p){
+    using result_type = detail::result_or<Result, detail::accumulator_t<typename Proxy::type>>;
+    return detail::reduce_all(p, detail::sum_reducer<result_type>{});
+}
+
+/**
+ * The dot product of two proxies - just sum(p1*p2), which never builds the
+ * products as a sequence.
+ */
+template<typename Result = void, typename P1, typename P2>
+detail::result_or<Result, detail::accumulator_t<typename product_proxy<P1, P2>::type>>
+dot(P1 const& p1, P2 const& p2){
+    return sum<Result>(p1*p2);
+}
+
+/**
+ * The smallest and largest elements of p. There's no sensible answer for an
+ * empty proxy, so that throws std::invalid_argument.
+ */
+template<typename Proxy>
+typename Proxy::type min(Proxy const& p){
+    return detail::reduce_nonempty(p, detail::min_reducer<typename Proxy::type>{}, "min");
+}
+
+template<typename Proxy>
+typename Proxy::type max(Proxy const& p){
+    return detail::reduce_nonempty(p, detail::max_reducer<typename Proxy::type>{}, "max");
+}
+
+/**
+ * How many elements of p satisfy pred. Cheaper than going through
+ * filter(pred, p), since nothing has to be compacted.
+ */
+template<typename Proxy, typename Predicate>
+std::size_t count_if(Proxy const& p, Predicate pred){
+    return detail::reduce_all(p, detail::count_reducer<Predicate>{pred});
+}
+
+namespace detail{
+/**
+ * Keeps the k first elements in Compare order it has seen, as a heap with
+ * the last of them on top. Once it's full, an element that doesn't beat the
+ * top is one comparison, which is nearly all of them on a long input.
+ */
+template<typename T, typename Compare>
+struct selection_reducer{
+    using result_type = std::vector<T>;
+    std::size_t k;
+    Compare comp;
+    std::vector<T> identity() const { return {}; }
+    void accumulate(std::vector<T>& acc, T const& x) const {
+        if(acc.size() < k){
+            acc.push_back(x);
+            std::push_heap(acc.begin(), acc.end(), comp);
+        }else if(!acc.empty() && comp(x, acc.front())){
+            std::pop_heap(acc.begin(), acc.end(), comp);
+            acc.back() = x;
+            std::push_heap(acc.begin(), acc.end(), comp);
+        }
+    }
+    void accumulate_n(std::vector<T>& acc, T const& x, std::size_t n) const {
+        for(std::size_t i = 0; i < std::min(n, k); ++i){
+            accumulate(acc, x);
+        }
+    }
+    std::vector<T> combine(std::vector<T> a, std::vector<T> const& b) const {
+        for(T const& x : b){
+            accumulate(a, x);
+        }
+        return a;
+    }
+};
+
+template<typename T, typename Compare>
+std::vector<T> sorted_selection(std::vector<T> heap, Compare comp){
+    std::sort(heap.begin(), heap.end(), comp);
+    return heap;
+}
+
+/**
+ * Maps numbers to unsigned integers in the same order, so that they can be
+ * told apart a byte at a time from the top: the sign bit is flipped for
+ * signed integers, and for floating point negative numbers have all their
+ * bits flipped (they're stored as sign and magnitude) and the others just
+ * the sign bit.
+ */
+template<typename T, typename = void>
+struct order_key{
+    using key_type = typename std::make_unsigned<T>::type;
+    static constexpr key_type flip = std::is_signed<T>::value
+        ? key_type(key_type(1) << (8 * sizeof(T) - 1)) : key_type(0);
+    static key_type to_key(T x){ return key_type(key_type(x) ^ flip); }
+    static T from_key(key_type k){ return T(key_type(k ^ flip)); }
+};
+
+template<typename T>
+struct order_key<T, typename std::enable_if<std::is_floating_point<T>::value>::type>{
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8, "float or double");
+    using key_type = typename std::conditional<sizeof(T) == 4, std::uint32_t, std::uint64_t>::type;
+    static constexpr key_type sign = key_type(1) << (8 * sizeof(T) - 1);
+    static key_type to_key(T x){
+        key_type bits;
+        std::memcpy(&bits, &x, sizeof(T));
+        return (bits & sign) ? key_type(~bits) : key_type(bits | sign);
+    }
+    static T from_key(key_type k){
+        key_type const bits = (k & sign) ? key_type(k & ~sign) : key_type(~k);
+        T x;
+        std::memcpy(&x, &bits, sizeof(T));
+        return x;
+    }
+};
+
+/**
+ * quantile() narrows down on its answer a byte of the key at a time: the
+ * elements whose keys start with the prefix found so far are the
+ * candidates, and each pass counts them by their next byte.
+ */
+template<typename T>
+struct key_prefix{
+    using key_type = typename order_key<T>::key_type;
+    static constexpr unsigned bits = 8 * sizeof(key_type);
+    key_type prefix;
+    unsigned known;
+    bool matches(key_type k) const {
+        return known == 0 || key_type(k >> (bits - known)) == prefix;
+    }
+    std::size_t next_byte(key_type k) const {
+        return std::size_t(k >> (bits - known - 8)) & 0xff;
+    }
+};
+
+template<typename T>
+struct histogram_reducer{
+    using result_type = std::array<std::size_t, 256>;
+    key_prefix<T> candidates;
+    result_type identity() const {
+        result_type counts;
+        counts.fill(0);
+        return counts;
+    }
+    void accumulate_n(result_type& acc, T const& x, std::size_t n) const {
+        auto const k = order_key<T>::to_key(x);
+        if(candidates.matches(k))
+            acc[candidates.next_byte(k)] += n;
+    }
+    void accumulate(result_type& acc, T const& x) const {
+        accumulate_n(acc, x, 1);
+    }
+    result_type combine(result_type a, result_type const& b) const {
+        for(std::size_t i = 0; i < a.size(); ++i){
+            a[i] += b[i];
+        }
+        return a;
+    }
+};
+
+template<typename T>
+struct candidates_reducer{
+    using result_type = std::vector<T>;
+    key_prefix<T> candidates;
+    std::vector<T> identity() const { return {}; }
+    void accumulate(std::vector<T>& acc, T const& x) const {
+        if(candidates.matches(order_key<T>::to_key(x)))
+            acc.push_back(x);
+    }
+    void accumulate_n(std::vector<T>& acc, T const& x, std::size_t n) const {
+        if(candidates.matches(order_key<T>::to_key(x)))
+            acc.insert(acc.end(), n, x);
+    }
+    std::vector<T> combine(std::vector<T> a, std::vector<T> const& b) const {
+        a.insert(a.end(), b.begin(), b.end());
+        return a;
+    }
+};
+
+/**
+ * Once there are no more candidates than this, they're collected and the
+ * answer is picked out with std::nth_element.
+ */
+constexpr std::size_t selection_collect_limit = std::size_t{1} << 16;
+
+/**
+ * The element that would be at position rank if all of them were sorted.
+ * reduce_with(reducer) has to reduce the whole input with reducer, which
+ * it's asked to do once per byte of the key at most (and usually two or
+ * three times in all): each pass counts the candidates by their next byte,
+ * and keeps the byte that rank falls in.
+ */
+template<typename T, typename ReduceWith>
+T select_rank(std::size_t rank, ReduceWith const& reduce_with){
+    using key = order_key<T>;
+    key_prefix<T> candidates{0, 0};
+    for(;;){
+        auto const counts = reduce_with(histogram_reducer<T>{candidates});
+        std::size_t byte = 0;
+        while(rank >= counts[byte]){
+            rank -= counts[byte];
+            ++byte;
+        }
+        candidates.prefix = typename key::key_type((candidates.known == 0 ? 0 : candidates.prefix << 8) | byte);
+        candidates.known += 8;
+        if(candidates.known == key_prefix<T>::bits)
+            return key::from_key(candidates.prefix);
+        if(counts[byte] <= selection_collect_limit){
+            std::vector<T> found = reduce_with(candidates_reducer<T>{candidates});
+            auto const by_key = [](T const& a, T const& b){ return key::to_key(a) < key::to_key(b); };
+            std::nth_element(found.begin(), found.begin() + std::ptrdiff_t(rank), found.end(), by_key);
+            return found[rank];
+        }
+    }
+}
+
+template<typename Proxy>
+std::size_t quantile_rank(Proxy const& p, double q){
+    static_assert(std::is_arithmetic<typename Proxy::type>::value &&
+                  !std::is_same<typename Proxy::type, bool>::value, "quantile() needs numbers");
+    static_assert(!is_stream<Proxy>::value, "quantile() reads its input more than once, so it can't take a stream");
+    require_nonempty(p, "quantile");
+    if(!(q >= 0 && q <= 1))
+        throw std::invalid_argument("quantile: q has to be between 0 and 1");
+    return static_cast<std::size_t>(q * double(p.size() - 1));
+}
+}
+
+/**
+ * The k first elements of p in comp's order (the k smallest, by default),
+ * sorted - what std::partial_sort would leave at the front of p if it were
+ * a vector. Only k elements are ever kept (well, k for each of the
+ * reduction lanes), so this is cheap for small k however long p is. If p
+ * has fewer than k elements, you get all of them.
+ */
+template<typename Proxy, typename Compare = std::less<typename Proxy::type>>
+std::vector<typename Proxy::type> partial_sort(Proxy const& p, std::size_t k, Compare comp = Compare{}){
+    using T = typename Proxy::type;
+    if(k == 0)
+        return {};
+    return detail::sorted_selection(detail::reduce_all(p, detail::selection_reducer<T, Compare>{k, comp}), comp);
+}
+
+/**
+ * The k largest elements of p, largest first.
+ */
+template<typename Proxy>
+std::vector<typename Proxy::type> top_k(Proxy const& p, std::size_t k){
+    return partial_sort(p, k, std::greater<typename Proxy::type>{});
+}
+
+/**
+ * The q quantile of p (0 <= q <= 1): the element that would be at position
+ * q*(size - 1), rounded down, if p were sorted, like std::nth_element would
+ * find. So quantile(p, 0.5) is the median (the lower one of the middle two
+ * for an even size). It doesn't sort anything, or keep p: it goes through p
+ * a few times counting elements by their leading bytes to narrow down where
+ * the answer is (see detail::select_rank), which needs a proxy, not a
+ * stream. NaNs have no place in the order, so p shouldn't have any.
+ */
+template<typename Proxy>
+typename Proxy::type quantile(Proxy const& p, double q){
+    return detail::select_rank<typename Proxy::type>(detail::quantile_rank(p, q),
+        [&p](auto const& reducer){ return detail::reduce_all(p, reducer); });
 }
 
 }
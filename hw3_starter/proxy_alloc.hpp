@@ -0,0 +1,348 @@
+#pragma once
+
+#include "proxy.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define PROXY_HAS_MEMORY_RESOURCE 1
+#endif
+#endif
+
+/**
+ * Where results go.
+ *
+ * make_vector() gets its memory from the heap like any std::vector, which is
+ * fine for one big result, but when a computation evaluates lots of small
+ * expressions and throws them all away together, asking the heap for each
+ * one (and giving it back) can cost more than evaluating them. This header
+ * has the pieces for putting results somewhere else:
+ * - arena : takes big blocks from the heap and hands out pieces of them by
+ *   bumping a pointer. Nothing is given back one at a time; reset() makes
+ *   the whole arena free again at once, and keeps the blocks for next time.
+ * - arena_allocator : an allocator over an arena, for any container.
+ *   make_vector(p, arena) is the short way to use it
+ * - aligned_allocator : the heap, with every allocation aligned to
+ *   simd_alignment (or more)
+ * - default_init_allocator : the heap like std::allocator, but a vector's
+ *   new elements aren't zeroed first, for results that are about to be
+ *   written over (make_vector_parallel's)
+ * - arena_resource : with C++17, an arena as a std::pmr::memory_resource,
+ *   for std::pmr::vector and friends
+ * All of them but default_init_allocator start their allocations on a
+ * simd_alignment boundary, so the results can be read and written with
+ * aligned vector instructions.
+ * make_container (proxy.hpp) takes any of them.
+ */
+
+namespace proxy{
+
+/**
+ * A cache line, and the widest vector register (AVX-512) there is.
+ */
+constexpr std::size_t simd_alignment = 64;
+
+namespace detail{
+inline std::uintptr_t align_up(std::uintptr_t p, std::size_t align){
+    return (p + align - 1) & ~std::uintptr_t(align - 1);
+}
+}
+
+/**
+ * A bump-pointer arena. allocate() is a few instructions as long as the
+ * current block has room; when it doesn't, the arena moves on to its next
+ * block, taking a new one from the heap (twice as big as the last) only
+ * once all of the ones it has are used up.
+ *
+ * Not thread safe: give each thread (or each request) its own.
+ */
+class arena{
+    struct block{
+        block* next;
+        std::size_t size;
+    };
+    block* first = nullptr;
+    block* current = nullptr;
+    std::uintptr_t cursor = 0;
+    std::uintptr_t limit = 0;
+    std::size_t next_size;
+    std::size_t reserved = 0;
+
+    static std::uintptr_t start_of(block* b){
+        return reinterpret_cast<std::uintptr_t>(b + 1);
+    }
+
+    void* refill(std::size_t bytes, std::size_t align){
+        std::size_t const needed = bytes + align;
+        block* next = current ? current->next : first;
+        while(next && next->size < needed){
+            next = next->next;
+        }
+        if(!next){
+            std::size_t const size = std::max(next_size, needed);
+            next = static_cast<block*>(::operator new(sizeof(block) + size));
+            next->size = size;
+            if(current){
+                next->next = current->next;
+                current->next = next;
+            }else{
+                next->next = first;
+                first = next;
+            }
+            reserved += size;
+            next_size = std::max(next_size, size) * 2;
+        }
+        current = next;
+        cursor = start_of(next);
+        limit = cursor + next->size;
+        return allocate(bytes, align);
+    }
+
+    public:
+    /**
+     * first_block is the size of the first block taken from the heap; the
+     * blocks after it double in size.
+     */
+    explicit arena(std::size_t first_block = std::size_t{64} << 10):
+        next_size{std::max(first_block, std::size_t{1})}
+    {}
+    arena(arena const&) = delete;
+    arena& operator=(arena const&) = delete;
+    ~arena(){
+        release();
+    }
+
+    /**
+     * bytes from the arena, aligned to align (a power of two).
+     */
+    void* allocate(std::size_t bytes, std::size_t align = alignof(std::max_align_t)){
+        // every allocation gets an address of its own
+        bytes = std::max(bytes, std::size_t{1});
+        std::uintptr_t const p = detail::align_up(cursor, align);
+        if(p + bytes > limit)
+            return refill(bytes, align);
+        cursor = p + bytes;
+        return reinterpret_cast<void*>(p);
+    }
+
+    /**
+     * Everything allocated so far is free again; the blocks are kept.
+     * Anything still using the memory (a vector from make_vector(p, *this)
+     * say) mustn't be used after this. Destroying it is still fine if its
+     * elements have trivial destructors; otherwise destroy it first.
+     */
+    void reset(){
+        current = nullptr;
+        cursor = limit = 0;
+    }
+
+    /**
+     * Like reset(), and gives the blocks back to the heap as well.
+     */
+    void release(){
+        while(first){
+            block* const next = first->next;
+            ::operator delete(first);
+            first = next;
+        }
+        reset();
+        reserved = 0;
+    }
+
+    /**
+     * How many bytes the arena has taken from the heap.
+     */
+    std::size_t capacity() const {
+        return reserved;
+    }
+};
+
+/**
+ * An allocator that takes its memory from an arena, aligned to at least
+ * simd_alignment. deallocate() does nothing: the memory comes back when the
+ * arena is reset. Allocators of the same arena are equal, so containers
+ * using it can swap and move their storage.
+ */
+template<typename T>
+class arena_allocator{
+    arena* source;
+    template<typename U>
+    friend class arena_allocator;
+    public:
+    using value_type = T;
+
+    arena_allocator(arena& source) noexcept:
+        source{&source}
+    {}
+    template<typename U>
+    arena_allocator(arena_allocator<U> const& other) noexcept:
+        source{other.source}
+    {}
+
+    T* allocate(std::size_t n){
+        if(n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+            throw std::bad_alloc{};
+        return static_cast<T*>(source->allocate(n * sizeof(T), std::max(alignof(T), simd_alignment)));
+    }
+    void deallocate(T*, std::size_t) noexcept {}
+
+    arena& resource() const {
+        return *source;
+    }
+
+    template<typename U>
+    bool operator==(arena_allocator<U> const& other) const {
+        return source == other.source;
+    }
+    template<typename U>
+    bool operator!=(arena_allocator<U> const& other) const {
+        return source != other.source;
+    }
+};
+
+/**
+ * An allocator that takes its memory from the heap like std::allocator,
+ * aligned to Align bytes (a power of two). There's an aligned operator new
+ * from C++17 on; this works before that, at the cost of Align and a
+ * pointer's worth of extra bytes per allocation.
+ */
+template<typename T, std::size_t Align = simd_alignment>
+class aligned_allocator{
+    static_assert(Align != 0 && (Align & (Align - 1)) == 0, "Align has to be a power of two");
+    static constexpr std::size_t alignment = Align < alignof(T) ? alignof(T) : Align;
+    static constexpr std::size_t overhead = alignment + sizeof(void*);
+    public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+    template<typename U>
+    struct rebind{
+        using other = aligned_allocator<U, Align>;
+    };
+
+    aligned_allocator() = default;
+    template<typename U>
+    aligned_allocator(aligned_allocator<U, Align> const&) noexcept {}
+
+    T* allocate(std::size_t n){
+        if(n > (std::numeric_limits<std::size_t>::max() - overhead) / sizeof(T))
+            throw std::bad_alloc{};
+        void* const raw = ::operator new(n * sizeof(T) + overhead);
+        // the pointer to give back to operator delete goes just before
+        std::uintptr_t const p = detail::align_up(reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*), alignment);
+        reinterpret_cast<void**>(p)[-1] = raw;
+        return reinterpret_cast<T*>(p);
+    }
+    void deallocate(T* p, std::size_t) noexcept {
+        ::operator delete(reinterpret_cast<void**>(p)[-1]);
+    }
+
+    template<typename U>
+    bool operator==(aligned_allocator<U, Align> const&) const {
+        return true;
+    }
+    template<typename U>
+    bool operator!=(aligned_allocator<U, Align> const&) const {
+        return false;
+    }
+};
+
+template<typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+/**
+ * std::allocator, except that elements made without a value are
+ * default-initialized rather than value-initialized: resize(n) and
+ * vector(n) leave numbers unwritten instead of zeroing them. That saves a
+ * pass over memory that's about to be written anyway, and leaves the
+ * first write to each page to whichever thread evaluates it.
+ */
+template<typename T>
+class default_init_allocator{
+    public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+    template<typename U>
+    struct rebind{
+        using other = default_init_allocator<U>;
+    };
+
+    default_init_allocator() = default;
+    template<typename U>
+    default_init_allocator(default_init_allocator<U> const&) noexcept {}
+
+    T* allocate(std::size_t n){
+        return std::allocator<T>{}.allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) noexcept {
+        std::allocator<T>{}.deallocate(p, n);
+    }
+    template<typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value){
+        ::new(static_cast<void*>(p)) U;
+    }
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args){
+        ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template<typename U>
+    bool operator==(default_init_allocator<U> const&) const {
+        return true;
+    }
+    template<typename U>
+    bool operator!=(default_init_allocator<U> const&) const {
+        return false;
+    }
+};
+
+template<typename T>
+using uninitialized_vector = std::vector<T, default_init_allocator<T>>;
+
+/**
+ * Converts p to a vector in the arena a. The vector doesn't own its memory:
+ * it's good until a is reset.
+ */
+template<typename Source>
+std::vector<typename Source::type, arena_allocator<typename Source::type>>
+make_vector(Source const& p, arena& a){
+    return make_container<std::vector<typename Source::type, arena_allocator<typename Source::type>>>(p, a);
+}
+
+#ifdef PROXY_HAS_MEMORY_RESOURCE
+/**
+ * An arena as a memory resource, for the std::pmr containers:
+ *
+ *     proxy::arena a;
+ *     proxy::arena_resource r{a};
+ *     auto v = make_container<std::pmr::vector<float>>(p, &r);
+ *
+ * Allocations are aligned to at least simd_alignment.
+ */
+class arena_resource : public std::pmr::memory_resource{
+    arena& source;
+
+    void* do_allocate(std::size_t bytes, std::size_t align) override {
+        return source.allocate(bytes, std::max(align, simd_alignment));
+    }
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+        return this == &other;
+    }
+    public:
+    explicit arena_resource(arena& source):
+        source{source}
+    {}
+};
+#endif
+
+}
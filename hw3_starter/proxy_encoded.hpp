@@ -0,0 +1,534 @@
+#pragma once
+
+#include "proxy_scan.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Proxies for sequences stored compressed, in two encodings that suit a lot
+ * of real data:
+ *
+ * - run-length (rle_vector): a run of equal elements is stored once, with
+ *   where it ends. Good for states, flags and prices that change now and
+ *   then. A run-length proxy can list its runs (see the run_length member
+ *   in proxy.hpp), and the nodes here work on runs instead of positions:
+ *   the sum or product of two run-length proxies, or of one and a number,
+ *   is made of runs too, one wherever either side starts one. make_rle()
+ *   of such an expression and the reductions (sum, min, max, count_if) go
+ *   a run at a time, so they take time proportional to the number of runs
+ *   and never see the elements one by one.
+ *
+ * - delta (delta_vector): integers stored as the differences between
+ *   neighbours, for sequences that mostly go up (or down) by a little, like
+ *   timestamps and ids. Each block of detail::block_size elements keeps its
+ *   first value and the smallest difference in it (its frame of reference),
+ *   and the differences from that in as few bytes as they need - none at
+ *   all for evenly spaced values. Decoding widens the block's differences
+ *   and adds them up with the SIMD prefix sums of proxy_scan.hpp.
+ *
+ * Either is a leaf like any other, and anything else over it (a map, a sum
+ * with a plain vector) sees an ordinary proxy whose eval() decodes.
+ */
+
+namespace proxy{
+
+/**
+ * A sequence of runs: values[k] is repeated up to (not including) position
+ * ends[k], starting where run k - 1 ended. ends has to be strictly
+ * increasing.
+ */
+template<typename T>
+struct rle_vector{
+    std::vector<T> values;
+    std::vector<std::size_t> ends;
+
+    std::size_t size() const {
+        return ends.empty() ? 0 : ends.back();
+    }
+};
+
+namespace detail{
+template<typename P1, typename P2>
+using enable_if_run_lengths = typename std::enable_if<
+    is_run_length<P1>::value && is_run_length<P2>::value, int>::type;
+
+template<typename P, typename T>
+using enable_if_run_length_and_scalar = typename std::enable_if<
+    is_run_length<P>::value && std::is_arithmetic<T>::value, int>::type;
+
+/**
+ * eval() for a run-length proxy, in terms of its runs.
+ */
+template<typename Proxy>
+void run_eval(Proxy const& p, std::size_t pos, std::size_t count, typename Proxy::type* out){
+    std::size_t const last = pos + count;
+    for(auto c = p.runs_at(pos); pos < last; c.next()){
+        std::size_t const end = std::min(c.end(), last);
+        std::fill_n(out, end - pos, c.value());
+        out += end - pos;
+        pos = end;
+    }
+}
+
+/**
+ * A number next to a run-length proxy is one run that never ends.
+ */
+template<typename T>
+class scalar_runs{
+    T v;
+    public:
+    explicit scalar_runs(T v):
+        v{v}
+    {}
+    T value() const {
+        return v;
+    }
+    std::size_t end() const {
+        return std::numeric_limits<std::size_t>::max();
+    }
+    void next(){}
+};
+
+template<typename Proxy>
+auto runs_at(Proxy const& p, std::size_t pos) -> decltype(p.runs_at(pos)){
+    return p.runs_at(pos);
+}
+
+template<typename T>
+scalar_runs<T> runs_at(scalar_proxy<T> const& p, std::size_t){
+    return scalar_runs<T>{p.get(0)};
+}
+}
+
+/**
+ * The leaf: holds a reference to an rle_vector, which has to outlive it.
+ * Like sequence_proxy, it goes through that reference every time, so an
+ * expression over it can be kept while runs are appended to the vector.
+ */
+template<typename T>
+class rle_proxy{
+    rle_vector<T> const& v;
+    public:
+    using type = T;
+    static constexpr bool run_length = true;
+
+    class cursor{
+        T const* values;
+        std::size_t const* ends;
+        std::size_t k;
+        public:
+        cursor(T const* values, std::size_t const* ends, std::size_t k):
+            values{values},
+            ends{ends},
+            k{k}
+        {}
+        T value() const {
+            return values[k];
+        }
+        std::size_t end() const {
+            return ends[k];
+        }
+        void next(){
+            ++k;
+        }
+    };
+
+    rle_proxy(rle_vector<T> const& v):
+        v(v)
+    {}
+    std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        std::size_t const runs = run_count();
+        return runs == 0 ? 0 : v.ends[runs - 1];
+    }
+    std::size_t run_count() const {
+        return std::min(v.values.size(), v.ends.size());
+    }
+    cursor runs_at(std::size_t pos) const {
+        std::size_t const* const ends = v.ends.data();
+        return {v.values.data(), ends, std::size_t(std::upper_bound(ends, ends + run_count(), pos) - ends)};
+    }
+    T get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return runs_at(pos).value();
+    }
+    void eval(std::size_t pos, std::size_t count, T* out) const {
+        PROXY_PROFILE_EVAL(count);
+        detail::run_eval(*this, pos, count, out);
+    }
+    bool aliases(void const* first, void const* last) const {
+        std::size_t const runs = run_count();
+        return runs != 0 && (
+            detail::overlaps(v.values.data(), v.values.data() + runs, first, last) ||
+            detail::overlaps(v.ends.data(), v.ends.data() + runs, first, last));
+    }
+};
+
+template<typename T>
+rle_proxy<T> make_proxy(rle_vector<T> const& v){
+    return {v};
+}
+
+template<typename T>
+void make_proxy(rle_vector<T> const&& v) = delete;
+
+/**
+ * Op applied to two run-length proxies (or one and a scalar_proxy), run by
+ * run: a run ends wherever a run of either side does. Made by + and * (and
+ * type is what adder_proxy and product_proxy would give).
+ */
+template<typename Op, typename P1, typename P2>
+class run_merge{
+    P1 p1;
+    P2 p2;
+    public:
+    using type = typename std::common_type<
+        typename P1::type,
+        typename P2::type
+        >::type;
+    static constexpr bool run_length = true;
+
+    class cursor{
+        decltype(detail::runs_at(std::declval<P1 const&>(), 0)) c1;
+        decltype(detail::runs_at(std::declval<P2 const&>(), 0)) c2;
+        public:
+        cursor(P1 const& p1, P2 const& p2, std::size_t pos):
+            c1{detail::runs_at(p1, pos)},
+            c2{detail::runs_at(p2, pos)}
+        {}
+        type value() const {
+            return type(Op{}(type(c1.value()), type(c2.value())));
+        }
+        std::size_t end() const {
+            return std::min(c1.end(), c2.end());
+        }
+        void next(){
+            std::size_t const e1 = c1.end();
+            std::size_t const e2 = c2.end();
+            if(e1 <= e2)
+                c1.next();
+            if(e2 <= e1)
+                c2.next();
+        }
+    };
+
+    run_merge(P1 const& p1, P2 const& p2):
+        p1{p1},
+        p2{p2}
+    {}
+    std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return std::min(p1.size(), p2.size());
+    }
+    cursor runs_at(std::size_t pos) const {
+        return {p1, p2, pos};
+    }
+    type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return runs_at(pos).value();
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        detail::run_eval(*this, pos, count, out);
+    }
+    std::tuple<P1 const&, P2 const&> children() const {
+        return std::tie(p1, p2);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p1, first, last) || detail::may_alias(p2, first, last);
+    }
+};
+
+template<typename P1, typename P2, detail::enable_if_run_lengths<P1, P2> = 0>
+run_merge<std::plus<>, P1, P2> operator+(P1 const& p1, P2 const& p2){
+    return {p1, p2};
+}
+
+template<typename P1, typename P2, detail::enable_if_run_lengths<P1, P2> = 0>
+run_merge<std::multiplies<>, P1, P2> operator*(P1 const& p1, P2 const& p2){
+    return {p1, p2};
+}
+
+template<typename P, typename T, detail::enable_if_run_length_and_scalar<P, T> = 0>
+run_merge<std::plus<>, P, scalar_proxy<T>> operator+(P const& p, T t){
+    return {p, scalar_proxy<T>{t}};
+}
+
+template<typename T, typename P, detail::enable_if_run_length_and_scalar<P, T> = 0>
+run_merge<std::plus<>, scalar_proxy<T>, P> operator+(T t, P const& p){
+    return {scalar_proxy<T>{t}, p};
+}
+
+template<typename P, typename T, detail::enable_if_run_length_and_scalar<P, T> = 0>
+run_merge<std::multiplies<>, P, scalar_proxy<T>> operator*(P const& p, T t){
+    return {p, scalar_proxy<T>{t}};
+}
+
+template<typename T, typename P, detail::enable_if_run_length_and_scalar<P, T> = 0>
+run_merge<std::multiplies<>, scalar_proxy<T>, P> operator*(T t, P const& p){
+    return {scalar_proxy<T>{t}, p};
+}
+
+namespace detail{
+template<typename T>
+void append_run(rle_vector<T>& v, T const& value, std::size_t end){
+    if(!v.values.empty() && v.values.back() == value){
+        v.ends.back() = end;
+    }else{
+        v.values.push_back(value);
+        v.ends.push_back(end);
+    }
+}
+
+template<typename T>
+void append_runs(rle_vector<T>& v, T const* data, std::size_t n, std::size_t pos){
+    for(std::size_t i = 0; i < n; ++i){
+        append_run(v, data[i], pos + i + 1);
+    }
+}
+
+template<typename Proxy>
+void make_rle(Proxy const& p, rle_vector<typename Proxy::type>& v, run_length_tag){
+    std::size_t const size = p.size();
+    std::size_t pos = 0;
+    for(auto c = p.runs_at(0); pos < size; c.next()){
+        pos = std::min(c.end(), size);
+        append_run(v, c.value(), pos);
+    }
+}
+
+template<typename Proxy>
+void make_rle(Proxy const& p, rle_vector<typename Proxy::type>& v, random_access_tag){
+    static_assert(!is_unbounded<Proxy>::value, "make_rle needs a proxy with a size");
+    typename Proxy::type buffer[block_size];
+    std::size_t const size = p.size();
+    for(std::size_t i = 0; i < size; i += block_size){
+        std::size_t const n = std::min(block_size, size - i);
+        evaluate(p, i, n, buffer);
+        append_runs(v, static_cast<typename Proxy::type const*>(buffer), n, i);
+    }
+}
+
+template<typename Stream>
+void make_rle(Stream const& stream, rle_vector<typename Stream::type>& v, stream_tag){
+    Stream s = stream;
+    typename Stream::type buffer[block_size];
+    std::size_t pos = 0;
+    std::size_t got;
+    do{
+        got = s.read(buffer, block_size);
+        append_runs(v, static_cast<typename Stream::type const*>(buffer), got, pos);
+        pos += got;
+    }while(got == block_size);
+}
+}
+
+/**
+ * Evaluates p (a proxy or a stream) into runs. For a run-length expression
+ * that goes a run at a time; anything else is evaluated in full, and
+ * neighbours that are equal are merged.
+ */
+template<typename Source, detail::enable_if_proxy_or_stream<Source> = 0>
+rle_vector<typename Source::type> make_rle(Source const& p){
+    rle_vector<typename Source::type> v;
+    detail::make_rle(p, v, detail::category_of<Source>{});
+    return v;
+}
+
+/**
+ * A sequence of integers stored a block of detail::block_size at a time,
+ * as the block's first value and the differences between neighbours, less
+ * the block's reference (its smallest difference), in width bytes each
+ * (0, 1, 2, 4 or 8). The differences are taken modulo 2^N, so any sequence
+ * can be stored; it's only small if the differences are.
+ */
+template<typename T>
+struct delta_vector{
+    static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value,
+                  "delta_vector stores integers");
+    using unsigned_type = typename std::make_unsigned<T>::type;
+
+    struct block{
+        unsigned_type first;
+        unsigned_type reference;
+        std::size_t offset;
+        unsigned char width;
+    };
+
+    std::size_t length = 0;
+    std::vector<block> blocks;
+    std::vector<unsigned char> packed;
+
+    std::size_t size() const {
+        return length;
+    }
+
+    /**
+     * How much memory the encoding takes, for comparing with length *
+     * sizeof(T).
+     */
+    std::size_t bytes() const {
+        return blocks.size() * sizeof(block) + packed.size();
+    }
+};
+
+namespace detail{
+template<typename W, typename U>
+void widen(unsigned char const* packed, std::size_t n, U reference, U* out){
+    W narrow[block_size];
+    std::memcpy(narrow, packed, n * sizeof(W));
+    for(std::size_t i = 0; i < n; ++i){
+        out[i] = U(U(narrow[i]) + reference);
+    }
+}
+
+template<typename W, typename U>
+void narrow(U const* offsets, std::size_t n, std::vector<unsigned char>& packed){
+    W narrow[block_size];
+    for(std::size_t i = 0; i < n; ++i){
+        narrow[i] = W(offsets[i]);
+    }
+    unsigned char const* const bytes = reinterpret_cast<unsigned char const*>(narrow);
+    packed.insert(packed.end(), bytes, bytes + n * sizeof(W));
+}
+
+/**
+ * The first n elements of a block: the differences widened back, then
+ * added up from the first value.
+ */
+template<typename U, typename Block>
+void decode_block(Block const& b, unsigned char const* packed, std::size_t n, U* out){
+    out[0] = b.first;
+    if(n < 2)
+        return;
+    unsigned char const* const data = packed + b.offset;
+    switch(b.width){
+        case 0: std::fill_n(out + 1, n - 1, b.reference); break;
+        case 1: widen<std::uint8_t>(data, n - 1, b.reference, out + 1); break;
+        case 2: widen<std::uint16_t>(data, n - 1, b.reference, out + 1); break;
+        case 4: widen<std::uint32_t>(data, n - 1, b.reference, out + 1); break;
+        default: widen<std::uint64_t>(data, n - 1, b.reference, out + 1); break;
+    }
+    scan_sum(out + 1, n - 1, out + 1, b.first);
+}
+
+template<typename U, typename Block>
+void encode_block(U const* values, std::size_t n, std::vector<Block>& blocks, std::vector<unsigned char>& packed){
+    using S = typename std::make_signed<U>::type;
+    U offsets[block_size];
+    S reference = 0;
+    for(std::size_t i = 1; i < n; ++i){
+        S const d = S(U(values[i] - values[i - 1]));
+        reference = i == 1 ? d : std::min(reference, d);
+    }
+    U largest = 0;
+    for(std::size_t i = 1; i < n; ++i){
+        offsets[i - 1] = U(U(values[i] - values[i - 1]) - U(reference));
+        largest = std::max(largest, offsets[i - 1]);
+    }
+    unsigned char const width = largest == 0 ? 0 :
+        std::uint64_t(largest) <= 0xff ? 1 :
+        std::uint64_t(largest) <= 0xffff ? 2 :
+        std::uint64_t(largest) <= 0xffffffff ? 4 : 8;
+    blocks.push_back({values[0], U(reference), packed.size(), width});
+    switch(width){
+        case 0: break;
+        case 1: narrow<std::uint8_t>(offsets, n - 1, packed); break;
+        case 2: narrow<std::uint16_t>(offsets, n - 1, packed); break;
+        case 4: narrow<std::uint32_t>(offsets, n - 1, packed); break;
+        default: narrow<std::uint64_t>(offsets, n - 1, packed); break;
+    }
+}
+}
+
+/**
+ * The leaf: holds a reference to a delta_vector, which has to outlive it,
+ * like rle_proxy. get() decodes as much of a block as it needs, so use
+ * eval() (or make_vector, sum, ...) rather than a loop over get().
+ */
+template<typename T>
+class delta_proxy{
+    using unsigned_type = typename delta_vector<T>::unsigned_type;
+    delta_vector<T> const& v;
+    public:
+    using type = T;
+
+    delta_proxy(delta_vector<T> const& v):
+        v(v)
+    {}
+    std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return v.length;
+    }
+    T get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        unsigned_type buffer[detail::block_size];
+        std::size_t const j = pos % detail::block_size;
+        detail::decode_block(v.blocks[pos / detail::block_size], v.packed.data(), j + 1, buffer);
+        return T(buffer[j]);
+    }
+    void eval(std::size_t pos, std::size_t count, T* out) const {
+        PROXY_PROFILE_EVAL(count);
+        // T and its unsigned version can be used for each other
+        unsigned_type* dest = reinterpret_cast<unsigned_type*>(out);
+        while(count > 0){
+            std::size_t const b = pos / detail::block_size;
+            std::size_t const j = pos % detail::block_size;
+            std::size_t const in_block = std::min(detail::block_size, v.length - b * detail::block_size);
+            std::size_t const n = std::min(count, in_block - j);
+            if(j == 0){
+                // straight into out, and the prefix sums run in place
+                detail::decode_block(v.blocks[b], v.packed.data(), n, dest);
+            }else{
+                unsigned_type buffer[detail::block_size];
+                detail::decode_block(v.blocks[b], v.packed.data(), j + n, buffer);
+                std::copy_n(buffer + j, n, dest);
+            }
+            pos += n;
+            dest += n;
+            count -= n;
+        }
+    }
+    bool aliases(void const* first, void const* last) const {
+        return (!v.blocks.empty() && detail::overlaps(v.blocks.data(), v.blocks.data() + v.blocks.size(), first, last)) ||
+            (!v.packed.empty() && detail::overlaps(v.packed.data(), v.packed.data() + v.packed.size(), first, last));
+    }
+};
+
+template<typename T>
+delta_proxy<T> make_proxy(delta_vector<T> const& v){
+    return {v};
+}
+
+template<typename T>
+void make_proxy(delta_vector<T> const&& v) = delete;
+
+/**
+ * Evaluates p, a proxy of integers, into a delta_vector.
+ */
+template<typename Proxy, detail::enable_if_proxies<Proxy> = 0>
+delta_vector<typename Proxy::type> make_delta(Proxy const& p){
+    static_assert(!detail::is_unbounded<Proxy>::value, "make_delta needs a proxy with a size");
+    using T = typename Proxy::type;
+    using U = typename delta_vector<T>::unsigned_type;
+    delta_vector<T> v;
+    v.length = p.size();
+    v.blocks.reserve((v.length + detail::block_size - 1) / detail::block_size);
+    T buffer[detail::block_size];
+    for(std::size_t i = 0; i < v.length; i += detail::block_size){
+        std::size_t const n = std::min(detail::block_size, v.length - i);
+        detail::evaluate(p, i, n, buffer);
+        detail::encode_block(reinterpret_cast<U const*>(buffer), n, v.blocks, v.packed);
+    }
+    return v;
+}
+
+}
@@ -0,0 +1,349 @@
+#pragma once
+
+#include "proxy_parallel.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+#ifdef PROXY_PROFILE
+#include <mutex>
+#endif
+
+/**
+ * explain(p) describes how p will be evaluated, one line per node with its
+ * children indented under it:
+ *
+ *     product_proxy<adder_proxy<...>, sequence_proxy<...>> [double, size 1000]: block
+ *     |- adder_proxy<pipe_proxy<...>, sequence_proxy<...>> [double, size 1000]: block
+ *     ...
+ *
+ * Each line has the node's type (without namespaces, and with template
+ * arguments more than a level deep left out), the type of its elements, its
+ * size, and how it produces its elements:
+ * - scalar : it has no eval(), so its elements are asked for one get() at a
+ *   time
+ * - block : eval() produces whole runs, a block of detail::block_size at a
+ *   time, with plain loops (which the compiler may still vectorize)
+ * - SIMD : the block loop is written with SIMD instructions for this node
+ *   and element type - fused multiply-adds, the map() functors proxy.hpp
+ *   knows, and filter()'s compaction
+ * - stream : read front to back
+ * The last line says whether make_vector_parallel and the pool reductions
+ * would split p between threads, and into how many chunks.
+ *
+ * Children are found through the nodes' children() (see proxy.hpp); a node
+ * without one is shown as a leaf.
+ *
+ * To see what evaluating p actually costs, build with PROXY_PROFILE (see
+ * proxy_profile.hpp) and look at profile_report() or print_profile(), at
+ * the bottom of this file.
+ */
+
+namespace proxy{
+
+namespace detail{
+/**
+ * The name of T as written in the source, where the compiler can tell us.
+ */
+inline std::string demangle(char const* name){
+#if defined(__GNUG__)
+    int status = 0;
+    std::unique_ptr<char, void(*)(void*)> readable{
+        abi::__cxa_demangle(name, nullptr, nullptr, &status), std::free};
+    if(status == 0 && readable)
+        return readable.get();
+#endif
+    return name;
+}
+
+template<typename T>
+std::string type_name(){
+    return demangle(typeid(T).name());
+}
+
+/**
+ * type_name<T>() without namespaces, and with template arguments more than
+ * depth levels deep left out. Node types get long quickly.
+ */
+inline std::string short_type_name(std::string const& name, std::size_t depth = 3){
+    std::string result;
+    std::size_t level = 0;
+    for(std::size_t i = 0; i < name.size(); ++i){
+        char const c = name[i];
+        if(c == '<'){
+            if(level++ >= depth){
+                if(level == depth + 1)
+                    result += "<...";
+                continue;
+            }
+        }else if(c == '>'){
+            if(level-- > depth){
+                if(level == depth)
+                    result += '>';
+                continue;
+            }
+        }else if(level > depth){
+            continue;
+        }
+        if(c == ':' && i + 1 < name.size() && name[i + 1] == ':'){
+            // drop the namespace that's just been copied
+            std::string const anonymous = "(anonymous namespace)";
+            std::size_t start = result.size();
+            if(result.size() >= anonymous.size() &&
+               result.compare(result.size() - anonymous.size(), anonymous.size(), anonymous) == 0){
+                start -= anonymous.size();
+            }
+            while(start > 0 && (std::isalnum(static_cast<unsigned char>(result[start - 1])) || result[start - 1] == '_')){
+                --start;
+            }
+            result.erase(start);
+            ++i;
+            continue;
+        }
+        result += c;
+    }
+    return result;
+}
+
+template<typename Source>
+std::string strategy_of(Source const&, random_access_tag){
+    return has_eval<Source>::value ? "block" : "scalar (get() per element)";
+}
+
+template<typename Source>
+std::string strategy_of(Source const&, stream_tag){
+    return "stream";
+}
+
+template<typename Source>
+std::string strategy_of(Source const& p){
+    return strategy_of(p, category_of<Source>{});
+}
+
+template<typename T, typename Sequence>
+std::string strategy_of(sequence_proxy<T, Sequence> const&){
+    return is_contiguous<Sequence>::value ? "block (copy)" : "block (copy through iterators)";
+}
+
+template<typename T>
+std::string strategy_of(scalar_proxy<T> const&){
+    return "block (fill)";
+}
+
+template<typename P1, typename P2>
+std::string strategy_of(adder_proxy<P1, P2> const&){
+    using type = typename adder_proxy<P1, P2>::type;
+    if(std::is_same<fusion_of<type, P1, P2>, no_fusion>::value)
+        return "block";
+    return simd_fma<type>::value ? "SIMD (fused multiply-add)" : "block (fused multiply-add)";
+}
+
+template<typename F, typename... Proxies>
+std::string strategy_of(map_proxy<F, Proxies...> const&){
+    using type = typename map_proxy<F, Proxies...>::type;
+    return simd_map<F, type(typename Proxies::type...)>::value ? "SIMD" : "block";
+}
+
+template<typename Predicate, typename Source>
+std::string strategy_of(filter_proxy<Predicate, Source> const&){
+    return simd_compact<Predicate, typename Source::type>::value ? "stream (SIMD compaction)" : "stream";
+}
+
+template<typename Source>
+std::string size_of(Source const& p, random_access_tag){
+    if(is_unbounded<Source>::value)
+        return "unbounded";
+    std::string size = "size " + std::to_string(p.size());
+    if(static_extent<Source>::value != dynamic_extent)
+        size += " (static)";
+    if(is_sparse<Source>::value)
+        size += ", sparse";
+    return size;
+}
+
+template<typename Source>
+std::string size_of(Source const&, stream_tag){
+    return "size unknown";
+}
+
+template<typename Source>
+std::string describe(Source const& p){
+    return short_type_name(type_name<Source>(), 1) +
+        " [" + short_type_name(type_name<typename Source::type>(), 1) + ", " +
+        size_of(p, category_of<Source>{}) + "]: " + strategy_of(p);
+}
+
+template<typename Source>
+void explain_node(std::ostream& out, Source const& p, std::string const& lead, std::string const& indent);
+
+template<typename Children, std::size_t... I>
+void explain_children(std::ostream& out, Children const& children, std::string const& indent,
+                      std::index_sequence<I...>){
+    int const expand[] = {0, (explain_node(out, std::get<I>(children),
+        indent + (I + 1 == sizeof...(I) ? "`- " : "|- "),
+        indent + (I + 1 == sizeof...(I) ? "   " : "|  ")), 0)...};
+    (void)expand;
+}
+
+template<typename Source>
+void explain_children(std::ostream& out, Source const& p, std::string const& indent, std::true_type){
+    auto const& children = p.children();
+    explain_children(out, children, indent,
+        std::make_index_sequence<std::tuple_size<typename std::decay<decltype(children)>::type>::value>{});
+}
+
+template<typename Source>
+void explain_children(std::ostream&, Source const&, std::string const&, std::false_type){}
+
+template<typename Source>
+void explain_node(std::ostream& out, Source const& p, std::string const& lead, std::string const& indent){
+    out << lead << describe(p) << '\n';
+    explain_children(out, p, indent, has_children<Source>{});
+}
+
+template<typename Source>
+std::string evaluation_of(Source const& p, random_access_tag){
+    if(is_unbounded<Source>::value)
+        return "unbounded, only evaluated as part of something with a size";
+    std::size_t const size = p.size();
+    if(size < parallel_threshold){
+        return "on one thread (" + std::to_string(size) + " elements is below parallel_threshold, " +
+            std::to_string(parallel_threshold) + ")";
+    }
+    std::size_t const chunk = parallel_chunk_size<typename Source::type>();
+    return "in parallel with make_vector_parallel and the pool reductions, " +
+        std::to_string((size + chunk - 1) / chunk) + " chunks of up to " + std::to_string(chunk) + " elements";
+}
+
+template<typename Source>
+std::string evaluation_of(Source const&, stream_tag){
+    return "on one thread, front to back";
+}
+}
+
+/**
+ * Writes the description of p (a proxy or a stream) to out; see the top of
+ * this file.
+ */
+template<typename Source, detail::enable_if_proxy_or_stream<Source> = 0>
+std::ostream& explain(Source const& p, std::ostream& out){
+    detail::explain_node(out, p, "", "");
+    return out << "evaluated " << detail::evaluation_of(p, detail::category_of<Source>{}) << '\n';
+}
+
+template<typename Source, detail::enable_if_proxy_or_stream<Source> = 0>
+std::string explain(Source const& p){
+    std::ostringstream out;
+    explain(p, out);
+    return out.str();
+}
+
+/**
+ * What was counted for one type of node.
+ */
+struct profile_entry{
+    std::string node;
+    std::uint64_t gets = 0;
+    std::uint64_t sizes = 0;
+    std::uint64_t evals = 0;
+    std::uint64_t elements = 0;
+    std::uint64_t total_ns = 0;
+    std::uint64_t self_ns = 0;
+};
+
+#ifdef PROXY_PROFILE
+
+/**
+ * Everything counted since the start (or the last reset_profile()), the
+ * nodes that took longest first.
+ */
+inline std::vector<profile_entry> profile_report(){
+    detail::profile_registry& registry = detail::profile_nodes();
+    std::vector<profile_entry> report;
+    {
+        std::lock_guard<std::mutex> hold{registry.lock};
+        for(detail::node_counters const& c : registry.nodes){
+            profile_entry e;
+            e.node = detail::short_type_name(detail::demangle(c.type.name()));
+            e.gets = c.gets.load(std::memory_order_relaxed);
+            e.sizes = c.sizes.load(std::memory_order_relaxed);
+            e.evals = c.evals.load(std::memory_order_relaxed);
+            e.elements = c.elements.load(std::memory_order_relaxed);
+            e.total_ns = c.total_ns.load(std::memory_order_relaxed);
+            e.self_ns = c.self_ns.load(std::memory_order_relaxed);
+            if(e.gets || e.sizes || e.evals)
+                report.push_back(e);
+        }
+    }
+    std::stable_sort(report.begin(), report.end(), [](profile_entry const& a, profile_entry const& b){
+        return a.total_ns > b.total_ns;
+    });
+    return report;
+}
+
+inline void reset_profile(){
+    detail::profile_registry& registry = detail::profile_nodes();
+    std::lock_guard<std::mutex> hold{registry.lock};
+    for(detail::node_counters& c : registry.nodes){
+        c.gets = 0;
+        c.sizes = 0;
+        c.evals = 0;
+        c.elements = 0;
+        c.total_ns = 0;
+        c.self_ns = 0;
+    }
+}
+
+inline void print_profile(std::ostream& out){
+    auto const report = profile_report();
+    std::size_t width = 4;
+    for(profile_entry const& e : report){
+        width = std::max(width, e.node.size());
+    }
+    auto const flags = out.flags();
+    auto const precision = out.precision();
+    out << std::left << std::setw(int(width)) << "node" << std::right
+        << std::setw(12) << "get()" << std::setw(12) << "size()" << std::setw(10) << "eval()"
+        << std::setw(12) << "elements" << std::setw(12) << "total ms" << std::setw(12) << "self ms" << '\n';
+    for(profile_entry const& e : report){
+        out << std::left << std::setw(int(width)) << e.node << std::right
+            << std::setw(12) << e.gets << std::setw(12) << e.sizes << std::setw(10) << e.evals
+            << std::setw(12) << e.elements << std::fixed << std::setprecision(3)
+            << std::setw(12) << double(e.total_ns) / 1e6 << std::setw(12) << double(e.self_ns) / 1e6 << '\n';
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+#else
+
+inline std::vector<profile_entry> profile_report(){
+    return {};
+}
+
+inline void reset_profile(){}
+
+inline void print_profile(std::ostream& out){
+    out << "proxy: profiling is off, build with PROXY_PROFILE defined to turn it on\n";
+}
+
+#endif
+
+}
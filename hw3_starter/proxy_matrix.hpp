@@ -0,0 +1,712 @@
+#pragma once
+
+#include "proxy.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Proxies for matrices.
+ *
+ * These work like the sequence proxies, with two indices instead of one: a
+ * matrix proxy has
+ * - type : the element type
+ * - rows(), cols() : its shape
+ * - get(r, c) : the element in row r, column c
+ * and can also have
+ * - eval_tile(r0, c0, nr, nc, out, ld) : writes the nr x nc tile starting at
+ *   (r0, c0) to out, row by row, with rows ld elements apart. nr and nc are
+ *   at most matrix_tile.
+ * - aliases(first, last) : as for sequences
+ *
+ * Everything is evaluated in square tiles of matrix_tile x matrix_tile
+ * elements. That matters as soon as a column-major matrix or a transpose is
+ * involved: going along a row of one of those jumps a whole column ahead in
+ * memory every element, and by the end of a long row the cache lines from
+ * the start are gone, so each one is read again for the next row. A tile's
+ * worth of columns fits in L1, so within a tile each line is read once.
+ *
+ * matmul() is the exception: it's not elementwise, and it's a terminal - it
+ * evaluates straight to a matrix. It's the usual blocked GEMM: blocks of
+ * both operands are evaluated (in tiles), packed into panels that the
+ * micro-kernel reads front to back, and the micro-kernel keeps a small block
+ * of the result in registers for the whole length of the panels.
+ */
+
+namespace proxy{
+
+/**
+ * Elements per side of the tiles matrices are evaluated in: 32x32 doubles
+ * is 8 KiB, so an elementwise node's operands and result fit in L1 together.
+ */
+constexpr std::size_t matrix_tile = 32;
+
+/**
+ * A matrix stored row by row: the element in row r and column c is
+ * values[r*cols + c].
+ */
+template<typename T>
+struct matrix{
+    std::size_t rows = 0;
+    std::size_t cols = 0;
+    std::vector<T> values;
+};
+
+struct row_major{};
+struct col_major{};
+
+namespace detail{
+template<typename Matrix, typename = void>
+struct is_matrix : std::false_type{};
+
+template<typename Matrix>
+struct is_matrix<Matrix, void_t<
+    typename Matrix::type,
+    decltype(std::declval<Matrix const&>().rows()),
+    decltype(std::declval<Matrix const&>().cols()),
+    decltype(std::declval<Matrix const&>().get(std::size_t{}, std::size_t{}))>> : std::true_type{};
+
+template<typename M1, typename M2>
+using enable_if_matrices = typename std::enable_if<
+    is_matrix<M1>::value && is_matrix<M2>::value, int>::type;
+
+template<typename Matrix, typename = void>
+struct has_eval_tile : std::false_type{};
+
+template<typename Matrix>
+struct has_eval_tile<Matrix, void_t<decltype(std::declval<Matrix const&>().eval_tile(
+    std::size_t{}, std::size_t{}, std::size_t{}, std::size_t{},
+    std::declval<typename Matrix::type*>(), std::size_t{}))>> : std::true_type{};
+
+template<typename Matrix>
+void eval_tile(Matrix const& m, std::size_t r0, std::size_t c0, std::size_t nr, std::size_t nc,
+               typename Matrix::type* out, std::size_t ld, std::true_type){
+    m.eval_tile(r0, c0, nr, nc, out, ld);
+}
+
+template<typename Matrix>
+void eval_tile(Matrix const& m, std::size_t r0, std::size_t c0, std::size_t nr, std::size_t nc,
+               typename Matrix::type* out, std::size_t ld, std::false_type){
+    for(std::size_t i = 0; i < nr; ++i){
+        for(std::size_t j = 0; j < nc; ++j){
+            out[i * ld + j] = m.get(r0 + i, c0 + j);
+        }
+    }
+}
+
+/**
+ * Writes one tile (at most matrix_tile x matrix_tile) of m to out, as T.
+ */
+template<typename T, typename Matrix>
+void eval_tile_as(Matrix const& m, std::size_t r0, std::size_t c0, std::size_t nr, std::size_t nc,
+                  T* out, std::size_t ld, std::true_type){
+    eval_tile(m, r0, c0, nr, nc, out, ld, has_eval_tile<Matrix>{});
+}
+
+template<typename T, typename Matrix>
+void eval_tile_as(Matrix const& m, std::size_t r0, std::size_t c0, std::size_t nr, std::size_t nc,
+                  T* out, std::size_t ld, std::false_type){
+    typename Matrix::type tile[matrix_tile * matrix_tile];
+    eval_tile(m, r0, c0, nr, nc, tile, nc, has_eval_tile<Matrix>{});
+    for(std::size_t i = 0; i < nr; ++i){
+        for(std::size_t j = 0; j < nc; ++j){
+            out[i * ld + j] = T(tile[i * nc + j]);
+        }
+    }
+}
+
+template<typename T, typename Matrix>
+void eval_tile_as(Matrix const& m, std::size_t r0, std::size_t c0, std::size_t nr, std::size_t nc,
+                  T* out, std::size_t ld){
+    eval_tile_as<T>(m, r0, c0, nr, nc, out, ld, std::is_same<T, typename Matrix::type>{});
+}
+
+/**
+ * Writes the nr x nc block of m starting at (r0, c0) to out, with rows ld
+ * apart, a tile at a time.
+ */
+template<typename T, typename Matrix>
+void evaluate_block(Matrix const& m, std::size_t r0, std::size_t c0, std::size_t nr, std::size_t nc,
+                    T* out, std::size_t ld){
+    for(std::size_t i = 0; i < nr; i += matrix_tile){
+        std::size_t const tr = std::min(matrix_tile, nr - i);
+        for(std::size_t j = 0; j < nc; j += matrix_tile){
+            std::size_t const tc = std::min(matrix_tile, nc - j);
+            eval_tile_as<T>(m, r0 + i, c0 + j, tr, tc, out + i * ld + j, ld);
+        }
+    }
+}
+}
+
+namespace detail{
+template<typename Sequence>
+auto contiguous_data(Sequence const& sequence) -> decltype(sequence.data()){
+    return sequence.data();
+}
+
+template<typename T, std::size_t N>
+T const* contiguous_data(T const (&sequence)[N]){
+    return sequence;
+}
+
+/**
+ * Where a matrix_proxy finds its elements, and their shape as they're
+ * stored: rows*cols elements of a contiguous sequence, stored in Layout
+ * order. It holds a reference to the sequence; the shape is the one it
+ * was given.
+ */
+template<typename T, typename Sequence = matrix<T>, typename Layout = row_major>
+class matrix_source{
+    Sequence const& sequence;
+    std::size_t r;
+    std::size_t c;
+    public:
+    using layout = Layout;
+    constexpr matrix_source(Sequence const& sequence, std::size_t rows, std::size_t cols):
+        sequence(sequence),
+        r{rows},
+        c{cols}
+    {}
+    constexpr std::size_t rows() const {
+        return r;
+    }
+    constexpr std::size_t cols() const {
+        return c;
+    }
+    T const* data() const {
+        return contiguous_data(sequence);
+    }
+};
+
+/**
+ * A matrix has its shape with it, so that's read on each call too, and an
+ * expression that's kept sees the matrix as it is now.
+ */
+template<typename T>
+class matrix_source<T, matrix<T>, row_major>{
+    matrix<T> const& m;
+    public:
+    using layout = row_major;
+    constexpr explicit matrix_source(matrix<T> const& m):
+        m(m)
+    {}
+    constexpr std::size_t rows() const {
+        return m.rows;
+    }
+    constexpr std::size_t cols() const {
+        return m.cols;
+    }
+    T const* data() const {
+        return m.values.data();
+    }
+};
+}
+
+/**
+ * The leaf: refers to rows*cols elements stored row by row (row_major) or
+ * column by column (col_major). Like sequence_proxy it holds a reference
+ * (to a matrix, or to the sequence make_matrix_proxy was given), which has
+ * to outlive it, and reads the elements through it on each call. Source
+ * is where they're stored; a Layout other than the source's own is its
+ * transpose.
+ */
+template<typename T, typename Layout = row_major, typename Source = detail::matrix_source<T>>
+class matrix_proxy{
+    Source source;
+
+    static constexpr bool is_row_major = std::is_same<Layout, row_major>::value;
+    static constexpr bool transposed = !std::is_same<Layout, typename Source::layout>::value;
+
+    void eval_tile(std::size_t r0, std::size_t c0, std::size_t nr, std::size_t nc,
+                   T* out, std::size_t ld, row_major) const {
+        T const* const data = source.data();
+        std::size_t const c = cols();
+        for(std::size_t i = 0; i < nr; ++i){
+            std::copy_n(data + (r0 + i) * c + c0, nc, out + i * ld);
+        }
+    }
+    void eval_tile(std::size_t r0, std::size_t c0, std::size_t nr, std::size_t nc,
+                   T* out, std::size_t ld, col_major) const {
+        // read down the columns, which is contiguous, and write across the
+        // tile, which is in L1
+        T const* const data = source.data();
+        std::size_t const r = rows();
+        for(std::size_t j = 0; j < nc; ++j){
+            T const* const column = data + (c0 + j) * r + r0;
+            for(std::size_t i = 0; i < nr; ++i){
+                out[i * ld + j] = column[i];
+            }
+        }
+    }
+    public:
+    using type = T;
+    using layout = Layout;
+    constexpr explicit matrix_proxy(Source const& source):
+        source(source)
+    {}
+    constexpr std::size_t rows() const {
+        return transposed ? source.cols() : source.rows();
+    }
+    constexpr std::size_t cols() const {
+        return transposed ? source.rows() : source.cols();
+    }
+    constexpr Source const& storage() const {
+        return source;
+    }
+    T get(std::size_t row, std::size_t col) const {
+        PROXY_PROFILE_CALL(gets);
+        return is_row_major ? source.data()[row * cols() + col] : source.data()[col * rows() + row];
+    }
+    void eval_tile(std::size_t r0, std::size_t c0, std::size_t nr, std::size_t nc,
+                   T* out, std::size_t ld) const {
+        PROXY_PROFILE_EVAL(nr * nc);
+        eval_tile(r0, c0, nr, nc, out, ld, Layout{});
+    }
+    bool aliases(void const* first, void const* last) const {
+        std::size_t const n = source.rows() * source.cols();
+        return n != 0 && detail::overlaps(source.data(), source.data() + n, first, last);
+    }
+};
+
+/**
+ * A matrix proxy over the elements of a contiguous sequence (a vector, an
+ * array, ...), which has to have at least rows*cols of them
+ * (std::length_error otherwise). make_matrix_proxy<col_major>(...) reads
+ * them column by column.
+ */
+template<typename Layout = row_major, typename Sequence,
+         typename T = typename std::remove_cv<typename std::remove_reference<
+             decltype(*std::begin(std::declval<Sequence const&>()))>::type>::type>
+matrix_proxy<T, Layout, detail::matrix_source<T, Sequence, Layout>>
+make_matrix_proxy(Sequence const& sequence, std::size_t rows, std::size_t cols){
+    static_assert(detail::is_contiguous<Sequence>::value, "matrix proxies need contiguous data");
+    if(std::end(sequence) - std::begin(sequence) < static_cast<std::ptrdiff_t>(rows * cols))
+        throw std::length_error("proxy::make_matrix_proxy: not enough elements");
+    return matrix_proxy<T, Layout, detail::matrix_source<T, Sequence, Layout>>{{sequence, rows, cols}};
+}
+
+/**
+ * A temporary sequence would be gone before the proxy is used, so that
+ * isn't allowed.
+ */
+template<typename Layout = row_major, typename Sequence>
+void make_matrix_proxy(Sequence const&& sequence, std::size_t rows, std::size_t cols) = delete;
+
+/**
+ * A proxy over m. It checks m has the elements for its shape now
+ * (std::length_error otherwise); m has to keep them if it changes.
+ */
+template<typename T>
+matrix_proxy<T> make_proxy(matrix<T> const& m){
+    if(m.values.size() < m.rows * m.cols)
+        throw std::length_error("proxy::make_proxy: not enough elements for the matrix");
+    return matrix_proxy<T>{detail::matrix_source<T>{m}};
+}
+
+template<typename T>
+void make_proxy(matrix<T> const&& m) = delete;
+
+/**
+ * m1 + m2 and m1 * m2 (elementwise), for matrices of the same shape
+ * (std::invalid_argument otherwise).
+ */
+template<typename Op, typename M1, typename M2>
+class matrix_elementwise{
+    M1 m1;
+    M2 m2;
+    public:
+    using type = typename std::common_type<
+        typename M1::type,
+        typename M2::type
+        >::type;
+    matrix_elementwise(M1 const& m1, M2 const& m2):
+        m1{m1},
+        m2{m2}
+    {
+        if(m1.rows() != m2.rows() || m1.cols() != m2.cols())
+            throw std::invalid_argument("proxy: matrices of different shapes");
+    }
+    std::size_t rows() const {
+        return m1.rows();
+    }
+    std::size_t cols() const {
+        return m1.cols();
+    }
+    type get(std::size_t r, std::size_t c) const {
+        PROXY_PROFILE_CALL(gets);
+        return Op{}(type(m1.get(r, c)), type(m2.get(r, c)));
+    }
+    void eval_tile(std::size_t r0, std::size_t c0, std::size_t nr, std::size_t nc,
+                   type* out, std::size_t ld) const {
+        PROXY_PROFILE_EVAL(nr * nc);
+        Op const op{};
+        type rhs[matrix_tile * matrix_tile];
+        detail::eval_tile_as<type>(m1, r0, c0, nr, nc, out, ld);
+        detail::eval_tile_as<type>(m2, r0, c0, nr, nc, rhs, nc);
+        for(std::size_t i = 0; i < nr; ++i){
+            for(std::size_t j = 0; j < nc; ++j){
+                out[i * ld + j] = op(out[i * ld + j], rhs[i * nc + j]);
+            }
+        }
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(m1, first, last) || detail::may_alias(m2, first, last);
+    }
+};
+
+template<typename M1, typename M2>
+using matrix_adder = matrix_elementwise<std::plus<typename std::common_type<
+    typename M1::type, typename M2::type>::type>, M1, M2>;
+
+template<typename M1, typename M2>
+using matrix_product = matrix_elementwise<std::multiplies<typename std::common_type<
+    typename M1::type, typename M2::type>::type>, M1, M2>;
+
+template<typename M1, typename M2, detail::enable_if_matrices<M1, M2> = 0>
+matrix_adder<M1, M2> operator+(M1 const& m1, M2 const& m2){
+    return {m1, m2};
+}
+
+template<typename M1, typename M2, detail::enable_if_matrices<M1, M2> = 0>
+matrix_product<M1, M2> operator*(M1 const& m1, M2 const& m2){
+    return {m1, m2};
+}
+
+/**
+ * The transpose of m, without moving anything: get(r, c) is m.get(c, r).
+ * A tile of it is the transpose of a tile of m, which is small enough to
+ * turn around in L1.
+ */
+template<typename M>
+class transpose_proxy{
+    M m;
+    public:
+    using type = typename M::type;
+    constexpr transpose_proxy(M const& m):
+        m{m}
+    {}
+    constexpr M const& inner() const {
+        return m;
+    }
+    std::size_t rows() const {
+        return m.cols();
+    }
+    std::size_t cols() const {
+        return m.rows();
+    }
+    type get(std::size_t r, std::size_t c) const {
+        PROXY_PROFILE_CALL(gets);
+        return m.get(c, r);
+    }
+    void eval_tile(std::size_t r0, std::size_t c0, std::size_t nr, std::size_t nc,
+                   type* out, std::size_t ld) const {
+        PROXY_PROFILE_EVAL(nr * nc);
+        type tile[matrix_tile * matrix_tile];
+        detail::eval_tile_as<type>(m, c0, r0, nc, nr, tile, nr);
+        for(std::size_t i = 0; i < nr; ++i){
+            for(std::size_t j = 0; j < nc; ++j){
+                out[i * ld + j] = tile[j * nr + i];
+            }
+        }
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(m, first, last);
+    }
+};
+
+/**
+ * transpose(m) is a transpose_proxy, except for the cases where there's
+ * something simpler: the transpose of a leaf is the same data read in the
+ * other order, and the transpose of a transpose is the original.
+ */
+template<typename M, typename std::enable_if<detail::is_matrix<M>::value, int>::type = 0>
+transpose_proxy<M> transpose(M const& m){
+    return {m};
+}
+
+template<typename T, typename Source>
+matrix_proxy<T, col_major, Source> transpose(matrix_proxy<T, row_major, Source> const& m){
+    return matrix_proxy<T, col_major, Source>{m.storage()};
+}
+
+template<typename T, typename Source>
+matrix_proxy<T, row_major, Source> transpose(matrix_proxy<T, col_major, Source> const& m){
+    return matrix_proxy<T, row_major, Source>{m.storage()};
+}
+
+template<typename M>
+M transpose(transpose_proxy<M> const& m){
+    return m.inner();
+}
+
+/**
+ * Evaluates a matrix expression into a matrix, a tile at a time.
+ */
+template<typename M, typename std::enable_if<detail::is_matrix<M>::value, int>::type = 0>
+matrix<typename M::type> make_matrix(M const& m){
+    matrix<typename M::type> result{m.rows(), m.cols(), {}};
+    result.values.resize(m.rows() * m.cols());
+    detail::evaluate_block(m, 0, 0, m.rows(), m.cols(), result.values.data(), m.cols());
+    return result;
+}
+
+namespace detail{
+/**
+ * The micro-kernel: c += a*b for an mr x nr block of c (rows ldc apart),
+ * where a is a packed panel of mr rows (kc steps of mr elements, one from
+ * each row) and b a packed panel of nr columns (kc steps of nr elements).
+ * acc is small enough that the compiler keeps it in registers.
+ */
+template<typename T>
+struct gemm_kernel{
+    static constexpr std::size_t mr = 4;
+    static constexpr std::size_t nr = 8;
+    static void run(std::size_t kc, T const* a, T const* b, T* c, std::size_t ldc){
+        T acc[mr][nr] = {};
+        for(std::size_t p = 0; p < kc; ++p){
+            for(std::size_t i = 0; i < mr; ++i){
+                for(std::size_t j = 0; j < nr; ++j){
+                    acc[i][j] += a[i] * b[j];
+                }
+            }
+            a += mr;
+            b += nr;
+        }
+        for(std::size_t i = 0; i < mr; ++i){
+            for(std::size_t j = 0; j < nr; ++j){
+                c[i * ldc + j] += acc[i][j];
+            }
+        }
+    }
+};
+
+#if defined(__AVX2__) && defined(__FMA__)
+/**
+ * 6 rows x 2 vectors of accumulators is 12 of the 16 ymm registers, which
+ * leaves room for the two vectors of b and a broadcast element of a. Each
+ * step is 12 independent fmas on 3 loads, enough to keep both FMA units busy.
+ */
+template<>
+struct gemm_kernel<float>{
+    static constexpr std::size_t mr = 6;
+    static constexpr std::size_t nr = 16;
+    static void run(std::size_t kc, float const* a, float const* b, float* c, std::size_t ldc){
+        __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+        __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+        __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+        __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+        __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+        __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+        for(std::size_t p = 0; p < kc; ++p){
+            __m256 const b0 = _mm256_loadu_ps(b);
+            __m256 const b1 = _mm256_loadu_ps(b + 8);
+            __m256 x = _mm256_broadcast_ss(a);
+            c00 = _mm256_fmadd_ps(x, b0, c00); c01 = _mm256_fmadd_ps(x, b1, c01);
+            x = _mm256_broadcast_ss(a + 1);
+            c10 = _mm256_fmadd_ps(x, b0, c10); c11 = _mm256_fmadd_ps(x, b1, c11);
+            x = _mm256_broadcast_ss(a + 2);
+            c20 = _mm256_fmadd_ps(x, b0, c20); c21 = _mm256_fmadd_ps(x, b1, c21);
+            x = _mm256_broadcast_ss(a + 3);
+            c30 = _mm256_fmadd_ps(x, b0, c30); c31 = _mm256_fmadd_ps(x, b1, c31);
+            x = _mm256_broadcast_ss(a + 4);
+            c40 = _mm256_fmadd_ps(x, b0, c40); c41 = _mm256_fmadd_ps(x, b1, c41);
+            x = _mm256_broadcast_ss(a + 5);
+            c50 = _mm256_fmadd_ps(x, b0, c50); c51 = _mm256_fmadd_ps(x, b1, c51);
+            a += mr;
+            b += nr;
+        }
+        __m256 const acc[mr][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                                   {c30, c31}, {c40, c41}, {c50, c51}};
+        for(std::size_t i = 0; i < mr; ++i){
+            float* const row = c + i * ldc;
+            _mm256_storeu_ps(row, _mm256_add_ps(_mm256_loadu_ps(row), acc[i][0]));
+            _mm256_storeu_ps(row + 8, _mm256_add_ps(_mm256_loadu_ps(row + 8), acc[i][1]));
+        }
+    }
+};
+
+template<>
+struct gemm_kernel<double>{
+    static constexpr std::size_t mr = 6;
+    static constexpr std::size_t nr = 8;
+    static void run(std::size_t kc, double const* a, double const* b, double* c, std::size_t ldc){
+        __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+        __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+        __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+        __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+        __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+        __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+        for(std::size_t p = 0; p < kc; ++p){
+            __m256d const b0 = _mm256_loadu_pd(b);
+            __m256d const b1 = _mm256_loadu_pd(b + 4);
+            __m256d x = _mm256_broadcast_sd(a);
+            c00 = _mm256_fmadd_pd(x, b0, c00); c01 = _mm256_fmadd_pd(x, b1, c01);
+            x = _mm256_broadcast_sd(a + 1);
+            c10 = _mm256_fmadd_pd(x, b0, c10); c11 = _mm256_fmadd_pd(x, b1, c11);
+            x = _mm256_broadcast_sd(a + 2);
+            c20 = _mm256_fmadd_pd(x, b0, c20); c21 = _mm256_fmadd_pd(x, b1, c21);
+            x = _mm256_broadcast_sd(a + 3);
+            c30 = _mm256_fmadd_pd(x, b0, c30); c31 = _mm256_fmadd_pd(x, b1, c31);
+            x = _mm256_broadcast_sd(a + 4);
+            c40 = _mm256_fmadd_pd(x, b0, c40); c41 = _mm256_fmadd_pd(x, b1, c41);
+            x = _mm256_broadcast_sd(a + 5);
+            c50 = _mm256_fmadd_pd(x, b0, c50); c51 = _mm256_fmadd_pd(x, b1, c51);
+            a += mr;
+            b += nr;
+        }
+        __m256d const acc[mr][2] = {{c00, c01}, {c10, c11}, {c20, c21},
+                                    {c30, c31}, {c40, c41}, {c50, c51}};
+        for(std::size_t i = 0; i < mr; ++i){
+            double* const row = c + i * ldc;
+            _mm256_storeu_pd(row, _mm256_add_pd(_mm256_loadu_pd(row), acc[i][0]));
+            _mm256_storeu_pd(row + 4, _mm256_add_pd(_mm256_loadu_pd(row + 4), acc[i][1]));
+        }
+    }
+};
+#endif
+
+/**
+ * Block sizes for the loops around the micro-kernel: a kc x nr panel of b
+ * stays in L1 while the kernel goes down the mc rows of the packed block
+ * of a, which stays in L2, and the kc x nc block of b is reused for all the
+ * rows of a, from L3.
+ */
+constexpr std::size_t gemm_kc = 256;
+
+template<typename T>
+struct gemm_blocks{
+    static constexpr std::size_t mc = gemm_kernel<T>::mr * 16;
+    static constexpr std::size_t nc = gemm_kernel<T>::nr * 128;
+};
+
+/**
+ * Packs rows [0, mc) x columns [0, kc) of block (row-major, ld apart) into
+ * panels of mr rows, padding the last one with zeros.
+ */
+template<std::size_t mr, typename T>
+void pack_rows(T const* block, std::size_t ld, std::size_t mc, std::size_t kc, T* packed){
+    for(std::size_t i = 0; i < mc; i += mr){
+        std::size_t const rows = std::min(mr, mc - i);
+        for(std::size_t p = 0; p < kc; ++p){
+            for(std::size_t ii = 0; ii < mr; ++ii){
+                *packed++ = ii < rows ? block[(i + ii) * ld + p] : T(0);
+            }
+        }
+    }
+}
+
+/**
+ * Packs rows [0, kc) x columns [0, nc) of block (row-major, ld apart) into
+ * panels of nr columns, padding the last one with zeros.
+ */
+template<std::size_t nr, typename T>
+void pack_cols(T const* block, std::size_t ld, std::size_t kc, std::size_t nc, T* packed){
+    for(std::size_t j = 0; j < nc; j += nr){
+        std::size_t const cols = std::min(nr, nc - j);
+        for(std::size_t p = 0; p < kc; ++p){
+            T const* const row = block + p * ld + j;
+            std::size_t jj = 0;
+            for(; jj < cols; ++jj){
+                *packed++ = row[jj];
+            }
+            for(; jj < nr; ++jj){
+                *packed++ = T(0);
+            }
+        }
+    }
+}
+
+/**
+ * c = a*b, with c m x n, row-major, rows ldc apart.
+ */
+template<typename T, typename M1, typename M2>
+void gemm(M1 const& a, M2 const& b, T* c, std::size_t ldc){
+    using kernel = gemm_kernel<T>;
+    constexpr std::size_t mr = kernel::mr;
+    constexpr std::size_t nr = kernel::nr;
+    constexpr std::size_t mc_max = gemm_blocks<T>::mc;
+    constexpr std::size_t nc_max = gemm_blocks<T>::nc;
+    std::size_t const m = a.rows();
+    std::size_t const k = a.cols();
+    std::size_t const n = b.cols();
+    for(std::size_t i = 0; i < m; ++i){
+        std::fill(c + i * ldc, c + i * ldc + n, T(0));
+    }
+    if(m == 0 || n == 0 || k == 0)
+        return;
+
+    std::vector<T> a_block(mc_max * gemm_kc);
+    std::vector<T> a_packed(mc_max * gemm_kc);
+    std::vector<T> b_block(gemm_kc * std::min(nc_max, n));
+    std::vector<T> b_packed(gemm_kc * ((std::min(nc_max, n) + nr - 1) / nr * nr));
+    T edge[mr * nr];
+
+    for(std::size_t jc = 0; jc < n; jc += nc_max){
+        std::size_t const nc = std::min(nc_max, n - jc);
+        for(std::size_t pc = 0; pc < k; pc += gemm_kc){
+            std::size_t const kc = std::min(gemm_kc, k - pc);
+            evaluate_block(b, pc, jc, kc, nc, b_block.data(), nc);
+            pack_cols<nr>(b_block.data(), nc, kc, nc, b_packed.data());
+            for(std::size_t ic = 0; ic < m; ic += mc_max){
+                std::size_t const mc = std::min(mc_max, m - ic);
+                evaluate_block(a, ic, pc, mc, kc, a_block.data(), kc);
+                pack_rows<mr>(a_block.data(), kc, mc, kc, a_packed.data());
+                for(std::size_t jr = 0; jr < nc; jr += nr){
+                    T const* const b_panel = b_packed.data() + jr * kc;
+                    std::size_t const cols = std::min(nr, nc - jr);
+                    for(std::size_t ir = 0; ir < mc; ir += mr){
+                        T const* const a_panel = a_packed.data() + ir * kc;
+                        std::size_t const rows = std::min(mr, mc - ir);
+                        T* const out = c + (ic + ir) * ldc + jc + jr;
+                        if(rows == mr && cols == nr){
+                            kernel::run(kc, a_panel, b_panel, out, ldc);
+                            continue;
+                        }
+                        // at the edges, the kernel works on a full block
+                        // and only the part that's in c is added
+                        std::fill(edge, edge + mr * nr, T(0));
+                        kernel::run(kc, a_panel, b_panel, edge, nr);
+                        for(std::size_t i = 0; i < rows; ++i){
+                            for(std::size_t j = 0; j < cols; ++j){
+                                out[i * ldc + j] += edge[i * nr + j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+}
+
+/**
+ * The matrix product a*b (a.cols() has to be b.rows(), std::invalid_argument
+ * otherwise). Either side can be any matrix expression - blocks of them are
+ * evaluated as they're needed, so transposes and column-major leaves cost no
+ * more than row-major ones.
+ *
+ * With AVX2 and FMA (e.g. -march=native) floats and doubles use a hand
+ * written micro-kernel; anything else uses a plain C++ one that the compiler
+ * vectorizes as well as it can.
+ */
+template<typename M1, typename M2, detail::enable_if_matrices<M1, M2> = 0>
+matrix<typename std::common_type<typename M1::type, typename M2::type>::type>
+matmul(M1 const& a, M2 const& b){
+    using type = typename std::common_type<typename M1::type, typename M2::type>::type;
+    if(a.cols() != b.rows())
+        throw std::invalid_argument("proxy::matmul: inner dimensions differ");
+    matrix<type> result{a.rows(), b.cols(), {}};
+    result.values.resize(a.rows() * b.cols());
+    detail::gemm<type>(a, b, result.values.data(), b.cols());
+    return result;
+}
+
+}
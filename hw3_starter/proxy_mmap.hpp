@@ -0,0 +1,262 @@
+#pragma once
+
+#include "proxy.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Proxies over files, for sequences that don't fit in memory (POSIX only).
+ *
+ * mmap_proxy maps a file of raw values (say a few GB of floats) and is a leaf
+ * like any other, so it can go anywhere make_proxy(vector) can. The kernel
+ * pages the file in as the expression reads it. evaluate_to_file is the
+ * other end: it evaluates an expression a chunk at a time and writes each
+ * chunk out, so the result never has to exist in memory all at once either.
+ */
+
+namespace proxy{
+
+/**
+ * How an mmap_proxy is going to be read, passed on to the kernel:
+ * - normal : no idea, let the kernel guess
+ * - sequential : front to back, so read far ahead (MADV_SEQUENTIAL)
+ * - streaming : front to back, once. As well as reading ahead, pages that
+ *   have been read are dropped from the process (MADV_DONTNEED) every
+ *   streaming_window bytes, so resident memory stays bounded no matter how
+ *   big the file is. Reading something that was dropped is still fine, it
+ *   just comes from the page cache (or disk) again.
+ */
+enum class access{
+    normal,
+    sequential,
+    streaming
+};
+
+constexpr std::size_t streaming_window = std::size_t{64} << 20;
+
+namespace detail{
+class file_descriptor{
+    int fd;
+    public:
+    explicit file_descriptor(int fd):
+        fd{fd}
+    {}
+    file_descriptor(file_descriptor const&) = delete;
+    file_descriptor& operator=(file_descriptor const&) = delete;
+    ~file_descriptor(){
+        if(fd >= 0)
+            ::close(fd);
+    }
+    int get() const {
+        return fd;
+    }
+    int release(){
+        int const result = fd;
+        fd = -1;
+        return result;
+    }
+};
+
+inline std::system_error file_error(char const* what, std::string const& path){
+    return std::system_error(errno, std::generic_category(), std::string(what) + " " + path);
+}
+
+/**
+ * A read-only mapping of a whole file. mmap_proxy shares one of these
+ * between all of its copies, and it's unmapped when the last one goes.
+ */
+class mapping{
+    void* address = nullptr;
+    std::size_t length = 0;
+    access pattern;
+    std::atomic<std::size_t> released{0};
+    public:
+    mapping(std::string const& path, access pattern):
+        pattern{pattern}
+    {
+        file_descriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if(fd.get() < 0)
+            throw file_error("can't open", path);
+        struct stat info;
+        if(::fstat(fd.get(), &info) != 0)
+            throw file_error("can't stat", path);
+        length = static_cast<std::size_t>(info.st_size);
+        // mmap doesn't do empty mappings, but an empty file is a fine sequence
+        if(length == 0)
+            return;
+        address = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd.get(), 0);
+        if(address == MAP_FAILED){
+            address = nullptr;
+            throw file_error("can't map", path);
+        }
+        if(pattern != access::normal){
+            // only a hint, so it doesn't matter if it fails
+            ::madvise(address, length, MADV_SEQUENTIAL);
+        }
+    }
+    mapping(mapping const&) = delete;
+    mapping& operator=(mapping const&) = delete;
+    ~mapping(){
+        if(address)
+            ::munmap(address, length);
+    }
+    void const* data() const {
+        return address;
+    }
+    std::size_t size() const {
+        return length;
+    }
+    /**
+     * Called after bytes [0, end) have been read. In streaming mode, drops
+     * the whole pages before end once there's a window's worth of them.
+     */
+    void read_up_to(std::size_t end){
+        if(pattern != access::streaming)
+            return;
+        std::size_t const page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        std::size_t const target = end / page * page;
+        std::size_t from = released.load(std::memory_order_relaxed);
+        if(target < from + streaming_window)
+            return;
+        if(released.compare_exchange_strong(from, target)){
+            ::madvise(static_cast<char*>(address) + from, target - from, MADV_DONTNEED);
+        }
+    }
+};
+}
+
+/**
+ * A leaf proxy over a file of raw Ts, in the machine's byte order, with no
+ * header. Trailing bytes that don't make up a whole T are ignored. Copies
+ * share the mapping, so they're cheap to put in expressions.
+ */
+template<typename T>
+class mmap_proxy{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "mmap_proxy reads raw bytes, so T has to be trivially copyable");
+    std::shared_ptr<detail::mapping> map;
+    T const* first = nullptr;
+    std::size_t count = 0;
+    public:
+    using type = T;
+    static constexpr bool elementwise = true;
+    explicit mmap_proxy(std::string const& path, access pattern = access::sequential):
+        map{std::make_shared<detail::mapping>(path, pattern)},
+        first{static_cast<T const*>(map->data())},
+        count{map->size() / sizeof(T)}
+    {}
+    std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return count;
+    }
+    T get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return first[pos];
+    }
+    void eval(std::size_t pos, std::size_t n, T* out) const {
+        PROXY_PROFILE_EVAL(n);
+        std::memcpy(out, first + pos, n * sizeof(T));
+        map->read_up_to((pos + n) * sizeof(T));
+    }
+    bool aliases(void const* begin, void const* end) const {
+        return count != 0 && detail::overlaps(first, first + count, begin, end);
+    }
+    T const* data() const {
+        return first;
+    }
+};
+
+/**
+ * Every chunk evaluate_to_file writes is this many bytes (except the last),
+ * from a page aligned buffer.
+ */
+constexpr std::size_t file_chunk_bytes = std::size_t{4} << 20;
+
+namespace detail{
+struct free_deleter{
+    void operator()(void* p) const {
+        std::free(p);
+    }
+};
+
+inline void write_all(int fd, void const* data, std::size_t bytes, std::string const& path){
+    char const* from = static_cast<char const*>(data);
+    while(bytes > 0){
+        ssize_t const written = ::write(fd, from, bytes);
+        if(written < 0){
+            if(errno == EINTR)
+                continue;
+            throw file_error("can't write", path);
+        }
+        from += written;
+        bytes -= static_cast<std::size_t>(written);
+    }
+}
+
+template<typename T, typename Proxy>
+std::size_t fill_chunk(Proxy const& p, std::size_t pos, T* out, std::size_t max, random_access_tag){
+    static_assert(!is_unbounded<Proxy>::value, "evaluate_to_file needs a proxy with a size");
+    std::size_t const n = std::min(max, p.size() - pos);
+    evaluate(p, pos, n, out);
+    return n;
+}
+
+template<typename T, typename Stream>
+std::size_t fill_chunk(Stream& s, std::size_t, T* out, std::size_t max, stream_tag){
+    return s.read(out, max);
+}
+}
+
+/**
+ * Evaluates p (a proxy or a stream) into the file at path, as raw values of
+ * p's type, replacing anything that was there. Memory use is one chunk of
+ * file_chunk_bytes whatever the size of the result. Returns the number of
+ * elements written.
+ */
+template<typename Proxy>
+std::size_t evaluate_to_file(Proxy const& p, std::string const& path){
+    using T = typename Proxy::type;
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "evaluate_to_file writes raw bytes, so the type has to be trivially copyable");
+    std::size_t const chunk = std::max<std::size_t>(file_chunk_bytes / sizeof(T), 1);
+
+    void* memory = nullptr;
+    if(::posix_memalign(&memory, 4096, chunk * sizeof(T)) != 0)
+        throw std::bad_alloc();
+    std::unique_ptr<void, detail::free_deleter> buffer(memory);
+
+    detail::file_descriptor fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if(fd.get() < 0)
+        throw detail::file_error("can't create", path);
+
+    Proxy source = p;
+    std::size_t total = 0;
+    for(;;){
+        std::size_t const n = detail::fill_chunk(
+            source, total, static_cast<T*>(memory), chunk, detail::category_of<Proxy>{});
+        detail::write_all(fd.get(), memory, n * sizeof(T), path);
+        total += n;
+        if(n < chunk)
+            break;
+    }
+    if(::close(fd.release()) != 0)
+        throw detail::file_error("can't close", path);
+    return total;
+}
+
+}
@@ -0,0 +1,486 @@
+#pragma once
+
+#include "proxy.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Narrow storage, wide compute.
+ *
+ * Most expressions spend their time waiting for memory, not computing, so
+ * storing the data in 1 or 2 bytes per element instead of 4 makes them
+ * 2-4x faster. The catch is that adder_proxy and product_proxy compute in
+ * the common type of their inputs, and for two int8 sequences that's int8,
+ * which overflows as soon as you add 100 and 100. So the narrow types are
+ * only used at the edges of an expression:
+ * - widen(p) (or cast<T>(p)) reads narrow data and converts it to the type
+ *   the expression should compute in: int32 for 8 and 16 bit integers, float
+ *   for half. Blocks are converted with vector instructions (vpmovsx for
+ *   integers, F16C for half), so it costs nothing next to the memory saved.
+ * - saturate<T>(p) converts the result back to a narrow integer type on the
+ *   way out, clamping anything that doesn't fit instead of wrapping around.
+ * - cast<half>(p) rounds the result to half precision.
+ * Reductions pick their accumulator the same way: sum<int>(p) for int8
+ * data, and sums of half always accumulate in float.
+ */
+
+namespace proxy{
+
+namespace detail{
+// IEEE 754 binary16 <-> binary32 without hardware support, rounding to
+// nearest even (after Fabian Giesen's branch-light versions)
+inline std::uint16_t half_from_float(float f){
+    std::uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    std::uint32_t const sign = x & 0x80000000u;
+    x ^= sign;
+    std::uint32_t result;
+    if(x >= 0x47800000u){
+        // too big for a half (2^16 and up), infinity or NaN
+        result = x > 0x7f800000u ? 0x7e00u : 0x7c00u;
+    }else if(x < 0x38800000u){
+        // a subnormal half or zero: line the mantissa up at the bottom of a
+        // float by adding a magic number, and let the FPU do the rounding
+        float const magic = 0.5f;
+        float g;
+        std::memcpy(&g, &x, sizeof(g));
+        g += magic;
+        std::memcpy(&result, &g, sizeof(result));
+        result -= 0x3f000000u;
+    }else{
+        std::uint32_t const odd = (x >> 13) & 1;
+        x += 0xc8000fffu + odd;
+        result = x >> 13;
+    }
+    return static_cast<std::uint16_t>(result | (sign >> 16));
+}
+
+inline float float_from_half(std::uint16_t h){
+    std::uint32_t x = static_cast<std::uint32_t>(h & 0x7fff) << 13;
+    std::uint32_t const exponent = x & 0x0f800000u;
+    x += 0x38000000u;
+    if(exponent == 0x0f800000u){
+        // infinity or NaN
+        x += 0x38000000u;
+    }else if(exponent == 0){
+        // zero or subnormal, renormalise
+        x += 0x00800000u;
+        float f;
+        std::memcpy(&f, &x, sizeof(f));
+        f -= 6.103515625e-05f;
+        std::memcpy(&x, &f, sizeof(x));
+    }
+    x |= static_cast<std::uint32_t>(h & 0x8000) << 16;
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+}
+
+/**
+ * An IEEE half precision float, for storage. It converts to float for free
+ * (so any arithmetic on it happens in float), and from anything arithmetic
+ * explicitly, rounding to nearest. With F16C the conversions are single
+ * instructions.
+ */
+class half{
+    std::uint16_t value;
+    public:
+    half() = default;
+    explicit half(float f){
+#if defined(__F16C__)
+        value = static_cast<std::uint16_t>(_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT));
+#else
+        value = detail::half_from_float(f);
+#endif
+    }
+    operator float() const {
+#if defined(__F16C__)
+        return _cvtsh_ss(value);
+#else
+        return detail::float_from_half(value);
+#endif
+    }
+    std::uint16_t bits() const {
+        return value;
+    }
+    static half from_bits(std::uint16_t bits){
+        half h;
+        h.value = bits;
+        return h;
+    }
+};
+
+namespace detail{
+template<>
+struct accumulator_of<half>{
+    using type = float;
+};
+}
+
+/**
+ * The type widen() computes in: int32 for 8 and 16 bit integers (which is
+ * what C++ promotes them to anyway), float for half, and the type itself
+ * for everything else.
+ */
+template<typename T>
+struct widened{
+    using type = typename std::conditional<
+        std::is_integral<T>::value && sizeof(T) < sizeof(std::int32_t),
+        std::int32_t, T>::type;
+};
+
+template<>
+struct widened<half>{
+    using type = float;
+};
+
+template<typename T>
+using widened_t = typename widened<T>::type;
+
+namespace detail{
+/**
+ * Converts a block of n elements from one type to another. The generic one
+ * is a plain loop, which the compiler may or may not vectorise; widening
+ * the narrow integers (with AVX2) and half (with F16C) have their own.
+ */
+template<typename To, typename From>
+void convert_block(From const* in, To* out, std::size_t n){
+    for(std::size_t i = 0; i < n; ++i){
+        out[i] = static_cast<To>(in[i]);
+    }
+}
+
+#if defined(__AVX2__)
+// vpmovsx/vpmovzx: 8 narrow integers to 8 int32s in one instruction
+inline void convert_block(std::int8_t const* in, std::int32_t* out, std::size_t n){
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m128i const x = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cvtepi8_epi32(x));
+    }
+    for(; i < n; ++i){
+        out[i] = in[i];
+    }
+}
+
+inline void convert_block(std::uint8_t const* in, std::int32_t* out, std::size_t n){
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m128i const x = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cvtepu8_epi32(x));
+    }
+    for(; i < n; ++i){
+        out[i] = in[i];
+    }
+}
+
+inline void convert_block(std::int16_t const* in, std::int32_t* out, std::size_t n){
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m128i const x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cvtepi16_epi32(x));
+    }
+    for(; i < n; ++i){
+        out[i] = in[i];
+    }
+}
+
+inline void convert_block(std::uint16_t const* in, std::int32_t* out, std::size_t n){
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m128i const x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cvtepu16_epi32(x));
+    }
+    for(; i < n; ++i){
+        out[i] = in[i];
+    }
+}
+#endif
+
+#if defined(__F16C__) && defined(__AVX__)
+inline void convert_block(half const* in, float* out, std::size_t n){
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m128i const h = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+    }
+    for(; i < n; ++i){
+        out[i] = in[i];
+    }
+}
+
+inline void convert_block(float const* in, half* out, std::size_t n){
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m128i const h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+    }
+    for(; i < n; ++i){
+        out[i] = half(in[i]);
+    }
+}
+#else
+inline void convert_block(half const* in, float* out, std::size_t n){
+    for(std::size_t i = 0; i < n; ++i){
+        out[i] = in[i];
+    }
+}
+
+inline void convert_block(float const* in, half* out, std::size_t n){
+    for(std::size_t i = 0; i < n; ++i){
+        out[i] = half(in[i]);
+    }
+}
+#endif
+
+// anything else to or from half goes through float
+template<typename To>
+void convert_block(half const* in, To* out, std::size_t n){
+    float buffer[block_size];
+    for(std::size_t i = 0; i < n; i += block_size){
+        std::size_t const m = std::min(block_size, n - i);
+        convert_block(in + i, buffer, m);
+        convert_block(static_cast<float const*>(buffer), out + i, m);
+    }
+}
+
+template<typename From>
+void convert_block(From const* in, half* out, std::size_t n){
+    float buffer[block_size];
+    for(std::size_t i = 0; i < n; i += block_size){
+        std::size_t const m = std::min(block_size, n - i);
+        convert_block(in + i, buffer, m);
+        convert_block(static_cast<float const*>(buffer), out + i, m);
+    }
+}
+
+// and the cases that would otherwise be ambiguous between the two above
+inline void convert_block(half const* in, half* out, std::size_t n){
+    std::copy_n(in, n, out);
+}
+}
+
+/**
+ * p's elements converted to T, one block at a time.
+ */
+template<typename T, typename P>
+class cast_proxy{
+    P p;
+    public:
+    using type = T;
+    constexpr cast_proxy(P const& p):
+        p{p}
+    {}
+    static constexpr bool elementwise = detail::is_elementwise<P>::value;
+    static constexpr std::size_t extent = detail::static_extent<P>::value;
+    static constexpr bool unbounded = detail::is_unbounded<P>::value;
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p, first, last);
+    }
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return p.size();
+    }
+    type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return static_cast<T>(p.get(pos));
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        typename P::type buffer[detail::block_size];
+        for(std::size_t i = 0; i < count; i += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, count - i);
+            detail::evaluate(p, pos + i, n, buffer);
+            detail::convert_block(static_cast<typename P::type const*>(buffer), out + i, n);
+        }
+    }
+};
+
+template<typename T, typename P, detail::enable_if_proxies<P> = 0>
+constexpr cast_proxy<T, P> cast(P const& p){
+    return {p};
+}
+
+/**
+ * p converted to the type it should be computed in, see widened.
+ */
+template<typename P, detail::enable_if_proxies<P> = 0>
+constexpr cast_proxy<widened_t<typename P::type>, P> widen(P const& p){
+    return {p};
+}
+
+namespace detail{
+/**
+ * What saturate compares in: something that can hold every value of both
+ * the source type and the target type, preferring the source type itself
+ * so the clamp vectorises at the source's width.
+ */
+template<typename T, typename U>
+using saturate_compare_type = typename std::conditional<
+    std::is_floating_point<U>::value ||
+        (std::is_signed<U>::value &&
+         (sizeof(T) < sizeof(U) || (sizeof(T) == sizeof(U) && std::is_signed<T>::value))),
+    U, long long>::type;
+
+template<typename T, typename U>
+T saturate_value(U x, std::true_type){
+    // NaN has no sensible place to go, make it 0
+    if(!(x == x))
+        return T(0);
+    U const lo = static_cast<U>(std::numeric_limits<T>::lowest());
+    U const hi = static_cast<U>(std::numeric_limits<T>::max());
+    // hi can round up when U is float (2^31 for int32), hence >=
+    return x <= lo ? std::numeric_limits<T>::lowest() :
+           x >= hi ? std::numeric_limits<T>::max() : static_cast<T>(x);
+}
+
+template<typename T, typename U>
+T saturate_value(U x, std::false_type){
+    using W = saturate_compare_type<T, U>;
+    W const lo = static_cast<W>(std::numeric_limits<T>::lowest());
+    W const hi = static_cast<W>(std::numeric_limits<T>::max());
+    return static_cast<T>(std::min(std::max(static_cast<W>(x), lo), hi));
+}
+
+template<typename T, typename U>
+T saturate_value(U x){
+    return saturate_value<T>(x, std::is_floating_point<U>{});
+}
+
+template<typename T, typename U>
+void saturate_block(U const* in, T* out, std::size_t n){
+    for(std::size_t i = 0; i < n; ++i){
+        out[i] = saturate_value<T>(in[i]);
+    }
+}
+
+#if defined(__SSE2__)
+// the pack instructions saturate as they narrow, which is exactly this
+inline void saturate_block(std::int32_t const* in, std::int16_t* out, std::size_t n){
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+        __m128i const b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(a, b));
+    }
+    for(; i < n; ++i){
+        out[i] = saturate_value<std::int16_t>(in[i]);
+    }
+}
+
+// int32 -> int16 -> int8 (or uint8): clamping twice is the same as once
+inline __m128i pack_16(std::int32_t const* in){
+    __m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in));
+    __m128i const b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + 4));
+    return _mm_packs_epi32(a, b);
+}
+
+inline void saturate_block(std::int32_t const* in, std::int8_t* out, std::size_t n){
+    std::size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        __m128i const x = _mm_packs_epi16(pack_16(in + i), pack_16(in + i + 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+    }
+    for(; i < n; ++i){
+        out[i] = saturate_value<std::int8_t>(in[i]);
+    }
+}
+
+inline void saturate_block(std::int32_t const* in, std::uint8_t* out, std::size_t n){
+    std::size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        __m128i const x = _mm_packus_epi16(pack_16(in + i), pack_16(in + i + 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+    }
+    for(; i < n; ++i){
+        out[i] = saturate_value<std::uint8_t>(in[i]);
+    }
+}
+#endif
+}
+
+/**
+ * p's elements converted to the integer type T, with anything outside T's
+ * range clamped to the nearest end of it (and NaN to 0). Floating point
+ * values are truncated like static_cast does. half is read as float first.
+ */
+template<typename T, typename P>
+class saturate_proxy{
+    static_assert(std::is_integral<T>::value && sizeof(T) < sizeof(long long),
+                  "saturate narrows to 8, 16 or 32 bit integers");
+    using source = widened_t<typename P::type>;
+    static_assert(!std::is_unsigned<source>::value || sizeof(source) < sizeof(long long),
+                  "saturate can't compare 64 bit unsigned values to the target's range");
+    P p;
+    public:
+    using type = T;
+    constexpr saturate_proxy(P const& p):
+        p{p}
+    {}
+    static constexpr bool elementwise = detail::is_elementwise<P>::value;
+    static constexpr std::size_t extent = detail::static_extent<P>::value;
+    static constexpr bool unbounded = detail::is_unbounded<P>::value;
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p, first, last);
+    }
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return p.size();
+    }
+    type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return detail::saturate_value<T>(static_cast<source>(p.get(pos)));
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        source buffer[detail::block_size];
+        for(std::size_t i = 0; i < count; i += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, count - i);
+            detail::evaluate_as<source>(p, pos + i, n, buffer);
+            detail::saturate_block(static_cast<source const*>(buffer), out + i, n);
+        }
+    }
+};
+
+template<typename T, typename P, detail::enable_if_proxies<P> = 0>
+constexpr saturate_proxy<T, P> saturate(P const& p){
+    return {p};
+}
+
+}
+
+namespace std{
+template<>
+class numeric_limits<proxy::half>{
+    public:
+    static constexpr bool is_specialized = true;
+    static constexpr bool is_signed = true;
+    static constexpr bool is_integer = false;
+    static constexpr bool has_infinity = true;
+    static constexpr bool has_quiet_NaN = true;
+    static constexpr int digits = 11;
+    static proxy::half min(){ return proxy::half::from_bits(0x0400); }
+    static proxy::half max(){ return proxy::half::from_bits(0x7bff); }
+    static proxy::half lowest(){ return proxy::half::from_bits(0xfbff); }
+    static proxy::half epsilon(){ return proxy::half::from_bits(0x1400); }
+    static proxy::half infinity(){ return proxy::half::from_bits(0x7c00); }
+    static proxy::half quiet_NaN(){ return proxy::half::from_bits(0x7e00); }
+};
+}
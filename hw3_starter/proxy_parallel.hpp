@@ -0,0 +1,375 @@
+#pragma once
+
+#include "proxy_alloc.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Multi-threaded evaluation of proxies.
+ *
+ * Proxy expressions are embarrassingly parallel: element i never depends on
+ * element j, and eval() is const, so any number of threads can fill disjoint
+ * parts of the output at once. All that's needed is somewhere to run them,
+ * which is what thread_pool is for.
+ */
+
+namespace proxy{
+
+/**
+ * A small work-stealing thread pool.
+ *
+ * The only thing it knows how to do is parallel_for: run f(i) for every i in
+ * [0, count). The index space is split evenly between the participants (the
+ * worker threads plus the calling thread, which helps instead of sitting idle).
+ * Each participant takes indices off the front of its own range, and when that
+ * runs dry it steals the back half of someone else's. That way a participant
+ * that gets unlucky with slow chunks (or a descheduled thread) doesn't hold
+ * everyone up.
+ *
+ * One parallel_for runs at a time per pool. Calling parallel_for from inside
+ * a task just runs the nested loop on the current thread.
+ */
+class thread_pool{
+    struct range{
+        std::mutex m;
+        std::size_t begin = 0;
+        std::size_t end = 0;
+    };
+    struct job{
+        std::function<void(std::size_t)> f;
+        std::unique_ptr<range[]> ranges;
+        std::size_t participants;
+        std::mutex error_m;
+        std::exception_ptr error;
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex submit_m;
+    std::mutex m;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    job* current = nullptr;
+    std::size_t generation = 0;
+    std::size_t joined = 0;
+    std::size_t active = 0;
+    bool stopping = false;
+
+    static bool& inside_task(){
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    static bool pop(range& r, std::size_t& i){
+        std::lock_guard<std::mutex> l(r.m);
+        if(r.begin == r.end)
+            return false;
+        i = r.begin++;
+        return true;
+    }
+
+    static bool steal(job& j, std::size_t self, std::size_t& i){
+        for(std::size_t k = 1; k < j.participants; ++k){
+            range& victim = j.ranges[(self + k) % j.participants];
+            std::size_t begin, end;
+            {
+                std::lock_guard<std::mutex> l(victim.m);
+                if(victim.begin == victim.end)
+                    continue;
+                begin = victim.begin + (victim.end - victim.begin) / 2;
+                end = victim.end;
+                victim.end = begin;
+            }
+            i = begin;
+            range& mine = j.ranges[self];
+            std::lock_guard<std::mutex> l(mine.m);
+            mine.begin = begin + 1;
+            mine.end = end;
+            return true;
+        }
+        return false;
+    }
+
+    static void work(job& j, std::size_t self){
+        inside_task() = true;
+        std::size_t i;
+        try{
+            while(pop(j.ranges[self], i) || steal(j, self, i)){
+                j.f(i);
+            }
+        }catch(...){
+            std::lock_guard<std::mutex> l(j.error_m);
+            if(!j.error)
+                j.error = std::current_exception();
+            // drain everything so the other participants finish quickly
+            for(std::size_t k = 0; k < j.participants; ++k){
+                std::lock_guard<std::mutex> rl(j.ranges[k].m);
+                j.ranges[k].begin = j.ranges[k].end;
+            }
+        }
+        inside_task() = false;
+    }
+
+    void run_worker(std::size_t self){
+        std::size_t seen = 0;
+        std::unique_lock<std::mutex> l(m);
+        for(;;){
+            wake.wait(l, [&]{ return stopping || generation != seen; });
+            if(stopping)
+                return;
+            seen = generation;
+            job* j = current;
+            ++joined;
+            ++active;
+            l.unlock();
+            work(*j, self);
+            l.lock();
+            --active;
+            idle.notify_all();
+        }
+    }
+
+    public:
+    /**
+     * threads is the total number of threads that run a parallel_for,
+     * counting the caller. thread_pool(1) doesn't start any threads at all.
+     */
+    explicit thread_pool(std::size_t threads = std::thread::hardware_concurrency()){
+        threads = std::max<std::size_t>(threads, 1);
+        workers.reserve(threads - 1);
+        for(std::size_t i = 1; i < threads; ++i){
+            workers.emplace_back([this, i]{ run_worker(i); });
+        }
+    }
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+    ~thread_pool(){
+        {
+            std::lock_guard<std::mutex> l(m);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto& t : workers){
+            t.join();
+        }
+    }
+
+    std::size_t concurrency() const {
+        return workers.size() + 1;
+    }
+
+    /**
+     * Calls f(i) once for every i in [0, count), spread over the pool, and
+     * returns when all of them are done. If any call throws, the remaining
+     * indices are abandoned and the first exception is rethrown here.
+     */
+    template<typename F>
+    void parallel_for(std::size_t count, F&& f){
+        if(count == 0)
+            return;
+        if(count == 1 || workers.empty() || inside_task()){
+            for(std::size_t i = 0; i < count; ++i){
+                f(i);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> submit(submit_m);
+        job j;
+        j.f = std::ref(f);
+        j.participants = concurrency();
+        j.ranges.reset(new range[j.participants]);
+        for(std::size_t k = 0; k < j.participants; ++k){
+            j.ranges[k].begin = count * k / j.participants;
+            j.ranges[k].end = count * (k + 1) / j.participants;
+        }
+        {
+            std::lock_guard<std::mutex> l(m);
+            current = &j;
+            joined = 0;
+            ++generation;
+        }
+        wake.notify_all();
+        work(j, 0);
+        {
+            // every worker has to have picked the job up and put it down
+            // again before it's safe to let j go out of scope
+            std::unique_lock<std::mutex> l(m);
+            idle.wait(l, [&]{ return joined == workers.size() && active == 0; });
+            current = nullptr;
+        }
+        if(j.error)
+            std::rethrow_exception(j.error);
+    }
+};
+
+/**
+ * A process-wide pool with one thread per core, for when you don't want
+ * to manage one yourself.
+ */
+inline thread_pool& default_pool(){
+    static thread_pool pool;
+    return pool;
+}
+
+/**
+ * Below this many elements make_vector_parallel doesn't bother waking the
+ * pool: waking the workers and handing out the work costs tens of
+ * microseconds, which is about what one core needs to evaluate a simple
+ * expression this long.
+ */
+constexpr std::size_t parallel_threshold = std::size_t{1} << 16;
+
+/**
+ * Work is handed out in chunks of about this many bytes of output, so each
+ * chunk (and the inputs it reads) fits comfortably in a core's L2 and there
+ * are still plenty of chunks to steal.
+ */
+constexpr std::size_t parallel_chunk_bytes = std::size_t{64} << 10;
+
+namespace detail{
+template<typename T>
+constexpr std::size_t parallel_chunk_size(){
+    return std::max(block_size, parallel_chunk_bytes / sizeof(T));
+}
+
+/**
+ * Fills out[0, count) with p's elements [pos, pos + count) using the pool,
+ * or on this thread if it isn't worth splitting up.
+ */
+template<typename Proxy>
+void evaluate_parallel(Proxy const& p, std::size_t pos, std::size_t count,
+                       typename Proxy::type* out, thread_pool& pool){
+    static_assert(!is_unbounded<Proxy>::value, "make_vector_parallel needs a proxy with a size");
+    using T = typename Proxy::type;
+    if(count < parallel_threshold || pool.concurrency() == 1){
+        evaluate(p, pos, count, out);
+        return;
+    }
+    std::size_t const chunk = parallel_chunk_size<T>();
+    std::size_t const chunks = (count + chunk - 1) / chunk;
+    pool.parallel_for(chunks, [&](std::size_t c){
+        std::size_t const begin = c * chunk;
+        evaluate(p, pos + begin, std::min(chunk, count - begin), out + begin);
+    });
+}
+}
+
+/**
+ * make_vector, but evaluated on a thread pool. The result is allocated up
+ * front without being written to, and each chunk is evaluated in place, so
+ * every page is first written by the thread that evaluates it, and only
+ * once. That's why it's an uninitialized_vector (proxy_alloc.hpp) rather
+ * than a std::vector with the default allocator, which would zero the
+ * whole result on this thread first.
+ */
+template<typename Proxy>
+uninitialized_vector<typename Proxy::type>
+make_vector_parallel(Proxy const& p, thread_pool& pool){
+    uninitialized_vector<typename Proxy::type> v(p.size());
+    detail::evaluate_parallel(p, 0, v.size(), v.data(), pool);
+    return v;
+}
+
+template<typename Proxy>
+uninitialized_vector<typename Proxy::type>
+make_vector_parallel(Proxy const& p){
+    return make_vector_parallel(p, default_pool());
+}
+
+namespace detail{
+/**
+ * reduce() over the pool. Each chunk is reduced on its own, then the partial
+ * results are combined as a balanced tree in chunk order. The chunks don't
+ * depend on the number of threads, so neither does the result - even for
+ * floating point, you get the same bits on 1 core or 64.
+ */
+template<typename Reducer, typename Proxy>
+typename Reducer::result_type
+reduce_parallel(Proxy const& p, std::size_t pos, std::size_t count,
+                Reducer const& r, thread_pool& pool){
+    static_assert(!is_unbounded<Proxy>::value, "reducing needs a proxy with a size");
+    if(count < parallel_threshold)
+        return reduce(p, pos, count, r);
+    std::size_t const chunk = parallel_chunk_size<typename Proxy::type>();
+    std::size_t const chunks = (count + chunk - 1) / chunk;
+    std::vector<typename Reducer::result_type> partial(chunks);
+    pool.parallel_for(chunks, [&](std::size_t c){
+        std::size_t const begin = c * chunk;
+        partial[c] = reduce(p, pos + begin, std::min(chunk, count - begin), r);
+    });
+    for(std::size_t width = 1; width < chunks; width *= 2){
+        for(std::size_t c = 0; c + width < chunks; c += 2 * width){
+            partial[c] = r.combine(partial[c], partial[c + width]);
+        }
+    }
+    return partial[0];
+}
+}
+
+/**
+ * The reductions from proxy.hpp, evaluated on a thread pool.
+ */
+template<typename Result = void, typename Proxy>
+detail::result_or<Result, detail::accumulator_t<typename Proxy::type>>
+sum(Proxy const& p, thread_pool& pool){
+    using result_type = detail::result_or<Result, detail::accumulator_t<typename Proxy::type>>;
+    return detail::reduce_parallel(p, 0, p.size(), detail::sum_reducer<result_type>{}, pool);
+}
+
+template<typename Result = void, typename P1, typename P2>
+detail::result_or<Result, detail::accumulator_t<typename product_proxy<P1, P2>::type>>
+dot(P1 const& p1, P2 const& p2, thread_pool& pool){
+    return sum<Result>(p1*p2, pool);
+}
+
+template<typename Proxy>
+typename Proxy::type min(Proxy const& p, thread_pool& pool){
+    detail::require_nonempty(p, "min");
+    return detail::reduce_parallel(p, 0, p.size(), detail::min_reducer<typename Proxy::type>{}, pool);
+}
+
+template<typename Proxy>
+typename Proxy::type max(Proxy const& p, thread_pool& pool){
+    detail::require_nonempty(p, "max");
+    return detail::reduce_parallel(p, 0, p.size(), detail::max_reducer<typename Proxy::type>{}, pool);
+}
+
+template<typename Proxy, typename Predicate>
+std::size_t count_if(Proxy const& p, Predicate pred, thread_pool& pool){
+    return detail::reduce_parallel(p, 0, p.size(), detail::count_reducer<Predicate>{pred}, pool);
+}
+
+/**
+ * Each chunk keeps its own k best, and they're merged pairwise at the end.
+ */
+template<typename Proxy, typename Compare = std::less<typename Proxy::type>>
+std::vector<typename Proxy::type> partial_sort(Proxy const& p, std::size_t k, thread_pool& pool,
+                                               Compare comp = Compare{}){
+    using T = typename Proxy::type;
+    if(k == 0)
+        return {};
+    return detail::sorted_selection(
+        detail::reduce_parallel(p, 0, p.size(), detail::selection_reducer<T, Compare>{k, comp}, pool), comp);
+}
+
+template<typename Proxy>
+std::vector<typename Proxy::type> top_k(Proxy const& p, std::size_t k, thread_pool& pool){
+    return partial_sort(p, k, pool, std::greater<typename Proxy::type>{});
+}
+
+template<typename Proxy>
+typename Proxy::type quantile(Proxy const& p, double q, thread_pool& pool){
+    return detail::select_rank<typename Proxy::type>(detail::quantile_rank(p, q),
+        [&p, &pool](auto const& reducer){ return detail::reduce_parallel(p, 0, p.size(), reducer, pool); });
+}
+
+}
@@ -0,0 +1,599 @@
+#pragma once
+
+#include "proxy_alloc.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iomanip>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Pipelined evaluation: a chain of transforms, each on a thread of its own.
+ *
+ *     auto p = make_pipeline(make_stream<float>(fd),
+ *                            [](auto x){ return x * 2.f + 1.f; },
+ *                            [](auto x){ return filter(greater_than(0.f), x); },
+ *                            [](auto x){ return sqrt(x); });
+ *     std::vector<float> result = p.run();
+ *
+ * The source (a proxy or a stream) is read a chunk at a time. Each transform
+ * is called once per chunk with a proxy over it, and returns the expression
+ * for what the chunk becomes - anything at all, a stream included, as long
+ * as it's a function of the chunk. Its result is evaluated straight into a
+ * chunk for the next stage. So while stage 2 works on chunk k, stage 1 can
+ * already be on chunk k + 1 and the source reading chunk k + 2, which is
+ * what helps when the source is slow (a pipe, a file, a socket) or the
+ * chain is long. For a plain expression over data that's already in
+ * memory, make_vector_parallel does better: it splits the data instead.
+ *
+ * Stages hand chunks on through fixed rings of queue_depth chunks each,
+ * without locks: each ring has one writer and one reader, and the chunks are
+ * allocated once and reused. A chunk is chunk_size elements (4096 by
+ * default, 16 KiB of floats), so one coming in and one going out fit in a
+ * core's L1 or L2 along with the stage's own state. A stage that has nothing
+ * to do spins briefly, then yields, then sleeps.
+ *
+ * After a run, stats() has what each stage did: how many chunks and
+ * elements it produced, how long it was busy, and how long it waited for
+ * input (starved) or for room in the next ring (blocked). The stage that's
+ * never starved or blocked is the one to make faster.
+ */
+
+namespace proxy{
+
+/**
+ * What one stage of a pipeline did in the last run().
+ */
+struct stage_stats{
+    std::string stage;
+    std::size_t chunks = 0;
+    std::size_t elements = 0;
+    std::uint64_t busy_ns = 0;
+    std::uint64_t starved_ns = 0;
+    std::uint64_t blocked_ns = 0;
+
+    /**
+     * Elements produced per second of busy time.
+     */
+    double throughput() const {
+        return busy_ns ? double(elements) * 1e9 / double(busy_ns) : 0;
+    }
+};
+
+constexpr std::size_t pipeline_chunk_size = 4096;
+constexpr std::size_t pipeline_queue_depth = 4;
+
+namespace detail{
+using pipeline_clock = std::chrono::steady_clock;
+
+inline std::uint64_t nanoseconds_since(pipeline_clock::time_point start){
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(pipeline_clock::now() - start).count());
+}
+
+/**
+ * Waiting on another thread: spin for a bit, then yield, then sleep, so a
+ * stage that waits for long (on a slow source, say) doesn't keep a core
+ * busy doing it.
+ */
+class backoff{
+    unsigned tries = 0;
+    public:
+    void pause(){
+        if(tries < 64){
+            ++tries;
+        }else if(tries < 128){
+            ++tries;
+            std::this_thread::yield();
+        }else{
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+    }
+};
+
+struct queue_shape{
+    std::size_t capacity;
+    std::size_t depth;
+};
+
+/**
+ * A ring of depth chunks of up to capacity elements each, between exactly
+ * one producer and one consumer. The producer fills the chunk acquire()
+ * gives it and publish()es it; the consumer reads the chunk front() gives
+ * it and pop()s it, which hands the chunk back to the producer.
+ *
+ * The two indices are on cache lines of their own, and each side keeps the
+ * last value it saw of the other's, so it only reads the other side's cache
+ * line when the ring looks full (or empty).
+ */
+template<typename T>
+class chunk_queue{
+    std::size_t const capacity;
+    std::size_t const depth;
+    std::size_t const stride;
+    std::unique_ptr<std::size_t[]> counts;
+    aligned_allocator<T> allocator;
+    T* storage;
+
+    char before[simd_alignment];
+    std::atomic<std::size_t> tail{0};
+    std::size_t seen_head = 0;
+    char between[simd_alignment];
+    std::atomic<std::size_t> head{0};
+    std::size_t seen_tail = 0;
+    char after[simd_alignment];
+    std::atomic<bool> finished{false};
+
+    // chunks start on cache lines of their own where the element size allows
+    static std::size_t stride_for(std::size_t capacity){
+        std::size_t stride = capacity;
+        while((stride * sizeof(T)) % simd_alignment != 0 && stride < capacity + simd_alignment){
+            ++stride;
+        }
+        return (stride * sizeof(T)) % simd_alignment == 0 ? stride : capacity;
+    }
+
+    T* slot(std::size_t index) const {
+        return storage + index % depth * stride;
+    }
+
+    public:
+    explicit chunk_queue(queue_shape shape):
+        capacity{shape.capacity},
+        depth{shape.depth},
+        stride{stride_for(capacity)},
+        counts{new std::size_t[depth]},
+        storage{allocator.allocate(depth * stride)}
+    {
+        std::size_t i = 0;
+        try{
+            for(; i < depth * stride; ++i){
+                ::new(static_cast<void*>(storage + i)) T();
+            }
+        }catch(...){
+            while(i > 0) storage[--i].~T();
+            allocator.deallocate(storage, depth * stride);
+            throw;
+        }
+    }
+    chunk_queue(chunk_queue const&) = delete;
+    chunk_queue& operator=(chunk_queue const&) = delete;
+    ~chunk_queue(){
+        for(std::size_t i = 0; i < depth * stride; ++i){
+            storage[i].~T();
+        }
+        allocator.deallocate(storage, depth * stride);
+    }
+
+    std::size_t chunk_capacity() const {
+        return capacity;
+    }
+
+    /**
+     * The next chunk to fill, once there's room for it; nullptr if the
+     * pipeline is stopped first. Time spent waiting is added to waited_ns.
+     */
+    T* acquire(std::atomic<bool> const& stop, std::uint64_t& waited_ns){
+        std::size_t const t = tail.load(std::memory_order_relaxed);
+        if(t - seen_head == depth){
+            seen_head = head.load(std::memory_order_acquire);
+            if(t - seen_head == depth){
+                auto const start = pipeline_clock::now();
+                backoff wait;
+                do{
+                    if(stop.load(std::memory_order_relaxed))
+                        return nullptr;
+                    wait.pause();
+                    seen_head = head.load(std::memory_order_acquire);
+                }while(t - seen_head == depth);
+                waited_ns += nanoseconds_since(start);
+            }
+        }
+        return slot(t);
+    }
+
+    void publish(std::size_t count){
+        std::size_t const t = tail.load(std::memory_order_relaxed);
+        counts[t % depth] = count;
+        tail.store(t + 1, std::memory_order_release);
+    }
+
+    /**
+     * No more chunks are coming.
+     */
+    void finish(){
+        finished.store(true, std::memory_order_release);
+    }
+
+    /**
+     * The next chunk to read, once there is one. false when the producer
+     * has finished and everything it published has been read, or if the
+     * pipeline is stopped first.
+     */
+    bool front(T const*& data, std::size_t& count, std::atomic<bool> const& stop, std::uint64_t& waited_ns){
+        std::size_t const h = head.load(std::memory_order_relaxed);
+        if(h == seen_tail){
+            seen_tail = tail.load(std::memory_order_acquire);
+            if(h == seen_tail){
+                auto const start = pipeline_clock::now();
+                backoff wait;
+                while(h == seen_tail){
+                    if(stop.load(std::memory_order_relaxed))
+                        return false;
+                    if(finished.load(std::memory_order_acquire)){
+                        // it may have published something just before finishing
+                        seen_tail = tail.load(std::memory_order_acquire);
+                        if(h == seen_tail)
+                            return false;
+                        break;
+                    }
+                    wait.pause();
+                    seen_tail = tail.load(std::memory_order_acquire);
+                }
+                waited_ns += nanoseconds_since(start);
+            }
+        }
+        data = slot(h);
+        count = counts[h % depth];
+        return true;
+    }
+
+    void pop(){
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+template<typename In, typename Transform>
+using stage_output = typename decltype(std::declval<Transform const&>()(
+    make_proxy(std::declval<span<In const> const&>())))::type;
+
+/**
+ * The element types along the pipeline: the source's, then each stage's.
+ */
+template<typename In, typename... Transforms>
+struct stage_types{
+    using type = std::tuple<In>;
+};
+
+template<typename In, typename Transform, typename... Transforms>
+struct stage_types<In, Transform, Transforms...>{
+    using type = decltype(std::tuple_cat(std::declval<std::tuple<In>>(),
+        std::declval<typename stage_types<stage_output<In, Transform>, Transforms...>::type>()));
+};
+
+template<typename Types>
+struct queues_of;
+
+template<typename... Ts>
+struct queues_of<std::tuple<Ts...>>{
+    using type = std::tuple<chunk_queue<Ts>...>;
+};
+
+/**
+ * Evaluates a stage's expression into as many chunks as it takes. false if
+ * the pipeline was stopped.
+ */
+template<typename Expression, typename T>
+bool emit(Expression const& e, chunk_queue<T>& out, std::atomic<bool> const& stop, stage_stats& stats,
+          random_access_tag){
+    static_assert(!is_unbounded<Expression>::value, "a pipeline stage has to have a size");
+    std::size_t const size = e.size();
+    for(std::size_t pos = 0; pos < size; pos += out.chunk_capacity()){
+        std::size_t const n = std::min(out.chunk_capacity(), size - pos);
+        T* const dest = out.acquire(stop, stats.blocked_ns);
+        if(!dest)
+            return false;
+        evaluate(e, pos, n, dest);
+        out.publish(n);
+        ++stats.chunks;
+        stats.elements += n;
+    }
+    return true;
+}
+
+template<typename Expression, typename T>
+bool emit(Expression const& e, chunk_queue<T>& out, std::atomic<bool> const& stop, stage_stats& stats,
+          stream_tag){
+    Expression s = e;
+    for(;;){
+        T* const dest = out.acquire(stop, stats.blocked_ns);
+        if(!dest)
+            return false;
+        std::size_t const got = s.read(dest, out.chunk_capacity());
+        if(got){
+            out.publish(got);
+            ++stats.chunks;
+            stats.elements += got;
+        }
+        if(got < out.chunk_capacity())
+            return true;
+    }
+}
+
+/**
+ * Whatever of a stage's time since start wasn't spent waiting was spent
+ * working.
+ */
+inline void count_busy_time(stage_stats& stats, pipeline_clock::time_point start){
+    std::uint64_t const total = nanoseconds_since(start);
+    std::uint64_t const waited = stats.starved_ns + stats.blocked_ns;
+    stats.busy_ns = total > waited ? total - waited : 0;
+}
+
+/**
+ * Calls finish() on the way out, however that is, so the next stage
+ * doesn't wait forever.
+ */
+template<typename T>
+struct finish_on_exit{
+    chunk_queue<T>& queue;
+    ~finish_on_exit(){
+        queue.finish();
+    }
+};
+
+template<typename Source, typename = void>
+struct has_interrupt : std::false_type{};
+
+template<typename Source>
+struct has_interrupt<Source, void_t<decltype(std::declval<Source const&>().interrupt())>>
+    : std::true_type{};
+
+template<typename Source>
+void interrupt_reads(Source const& source);
+
+template<typename Children, std::size_t... I>
+void interrupt_children(Children const& children, std::index_sequence<I...>){
+    int const expand[] = {0, (interrupt_reads(std::get<I>(children)), 0)...};
+    (void)expand;
+}
+
+template<typename Source>
+void interrupt_reads(Source const& source, std::false_type, std::true_type){
+    auto const& children = source.children();
+    interrupt_children(children,
+        std::make_index_sequence<std::tuple_size<typename std::decay<decltype(children)>::type>::value>{});
+}
+
+template<typename Source>
+void interrupt_reads(Source const&, std::false_type, std::false_type){}
+
+template<typename Source, typename HasChildren>
+void interrupt_reads(Source const& source, std::true_type, HasChildren){
+    source.interrupt();
+}
+
+/**
+ * Interrupts every stream in source that can be waiting for input (the
+ * ones with an interrupt(), like input_stream), so that the source thread
+ * isn't stuck in a read when the pipeline stops.
+ */
+template<typename Source>
+void interrupt_reads(Source const& source){
+    interrupt_reads(source, has_interrupt<Source>{}, has_children<Source>{});
+}
+
+template<typename Source, typename T>
+void read_source(Source const& source, chunk_queue<T>& out, std::atomic<bool> const& stop, stage_stats& stats){
+    finish_on_exit<T> const finish{out};
+    emit(as_stream(source), out, stop, stats, stream_tag{});
+}
+
+template<typename Transform, typename In, typename Out>
+void run_stage(Transform const& transform, chunk_queue<In>& in, chunk_queue<Out>& out,
+               std::atomic<bool> const& stop, stage_stats& stats){
+    finish_on_exit<Out> const finish{out};
+    In const* data;
+    std::size_t count;
+    while(in.front(data, count, stop, stats.starved_ns)){
+        span<In const> const chunk{data, count};
+        auto const e = transform(make_proxy(chunk));
+        if(!emit(e, out, stop, stats, category_of<typename std::decay<decltype(e)>::type>{}))
+            return;
+        in.pop();
+    }
+}
+}
+
+/**
+ * A source and a chain of transforms, run with run(); see the top of this
+ * file. Made with make_pipeline.
+ */
+template<typename Source, typename... Transforms>
+class pipeline{
+    using types = typename detail::stage_types<typename Source::type, Transforms...>::type;
+    using queues = typename detail::queues_of<types>::type;
+    static constexpr std::size_t stages = sizeof...(Transforms);
+
+    Source source;
+    std::tuple<Transforms...> transforms;
+    std::size_t chunk = pipeline_chunk_size;
+    std::size_t depth = pipeline_queue_depth;
+    std::vector<stage_stats> last;
+
+    // the queues can't be moved (or copied), so they're made in place
+    template<std::size_t... I>
+    static std::unique_ptr<queues> make_queues(detail::queue_shape shape, std::index_sequence<I...>){
+        return std::unique_ptr<queues>{new queues((void(I), shape)...)};
+    }
+
+    template<std::size_t I>
+    void start_stage(std::vector<std::thread>& threads, queues& q, std::atomic<bool>& stop,
+               std::vector<std::exception_ptr>& errors){
+        threads.emplace_back([this, &q, &stop, &errors]{
+            auto const start = detail::pipeline_clock::now();
+            try{
+                detail::run_stage(std::get<I>(transforms), std::get<I>(q), std::get<I + 1>(q), stop, last[I + 1]);
+            }catch(...){
+                errors[I + 1] = std::current_exception();
+                stop = true;
+            }
+            detail::count_busy_time(last[I + 1], start);
+        });
+    }
+
+    template<typename Consume, std::size_t... I>
+    void execute(Consume& consume, std::index_sequence<I...>){
+        std::unique_ptr<queues> q = make_queues({chunk, depth}, std::make_index_sequence<stages + 1>{});
+        last.assign(stages + 2, stage_stats{});
+        last.front().stage = "source";
+        for(std::size_t i = 1; i <= stages; ++i){
+            last[i].stage = "stage " + std::to_string(i);
+        }
+        last.back().stage = "sink";
+
+        std::atomic<bool> stop{false};
+        std::vector<std::exception_ptr> errors(stages + 2);
+        std::vector<std::thread> threads;
+        threads.reserve(stages + 1);
+        auto const start = detail::pipeline_clock::now();
+        try{
+            threads.emplace_back([this, &q, &stop, &errors]{
+                auto const start = detail::pipeline_clock::now();
+                try{
+                    detail::read_source(source, std::get<0>(*q), stop, last[0]);
+                }catch(...){
+                    errors[0] = std::current_exception();
+                    stop = true;
+                }
+                detail::count_busy_time(last[0], start);
+            });
+            int const expand[] = {0, (start_stage<I>(threads, *q, stop, errors), 0)...};
+            (void)expand;
+
+            using T = typename std::tuple_element<stages, types>::type;
+            detail::chunk_queue<T>& in = std::get<stages>(*q);
+            stage_stats& stats = last.back();
+            T const* data;
+            std::size_t count;
+            while(in.front(data, count, stop, stats.starved_ns)){
+                consume(span<T const>{data, count});
+                ++stats.chunks;
+                stats.elements += count;
+                in.pop();
+            }
+        }catch(...){
+            errors.back() = std::current_exception();
+            stop = true;
+        }
+        detail::count_busy_time(last.back(), start);
+        if(stop){
+            detail::interrupt_reads(source);
+        }
+        for(std::thread& t : threads){
+            t.join();
+        }
+        for(std::exception_ptr const& e : errors){
+            if(e)
+                std::rethrow_exception(e);
+        }
+    }
+
+    public:
+    using type = typename std::tuple_element<stages, types>::type;
+
+    pipeline(Source const& source, Transforms const&... transforms):
+        source{source},
+        transforms{transforms...}
+    {}
+
+    /**
+     * Elements per chunk (4096 by default).
+     */
+    pipeline& chunk_size(std::size_t n){
+        if(n == 0)
+            throw std::invalid_argument("proxy::pipeline: chunks have to hold something");
+        chunk = n;
+        return *this;
+    }
+
+    /**
+     * Chunks in each ring between two stages (4 by default): how far a
+     * stage can get ahead of the next one.
+     */
+    pipeline& queue_depth(std::size_t n){
+        if(n == 0)
+            throw std::invalid_argument("proxy::pipeline: queues have to hold something");
+        depth = n;
+        return *this;
+    }
+
+    /**
+     * Runs the pipeline, calling consume with a proxy over each chunk of the
+     * result, in order, on the calling thread. If any stage (or consume)
+     * throws, the pipeline stops and the first stage's exception is
+     * rethrown here. Stopping interrupts the streams in the source that
+     * can be (see input_stream::interrupt), so a source waiting on an idle
+     * pipe doesn't keep run() waiting too.
+     */
+    template<typename Consume>
+    void run(Consume consume){
+        auto to_proxy = [&consume](span<type const> chunk){
+            consume(make_proxy(chunk));
+        };
+        execute(to_proxy, std::make_index_sequence<stages>{});
+    }
+
+    /**
+     * Runs the pipeline and returns the whole result.
+     */
+    std::vector<type> run(){
+        std::vector<type> result;
+        auto append = [&result](span<type const> chunk){
+            result.insert(result.end(), chunk.begin(), chunk.end());
+        };
+        execute(append, std::make_index_sequence<stages>{});
+        return result;
+    }
+
+    /**
+     * What each stage did in the last run(): the source, the transforms in
+     * order, then the sink (whoever consumed the result).
+     */
+    std::vector<stage_stats> const& stats() const {
+        return last;
+    }
+
+    void print_stats(std::ostream& out) const {
+        auto const flags = out.flags();
+        auto const precision = out.precision();
+        out << std::left << std::setw(10) << "stage" << std::right << std::setw(10) << "chunks"
+            << std::setw(12) << "elements" << std::setw(12) << "busy ms" << std::setw(12) << "starved ms"
+            << std::setw(12) << "blocked ms" << std::setw(14) << "M elements/s" << '\n';
+        for(stage_stats const& s : last){
+            out << std::left << std::setw(10) << s.stage << std::right << std::setw(10) << s.chunks
+                << std::setw(12) << s.elements << std::fixed << std::setprecision(3)
+                << std::setw(12) << double(s.busy_ns) / 1e6 << std::setw(12) << double(s.starved_ns) / 1e6
+                << std::setw(12) << double(s.blocked_ns) / 1e6 << std::setw(14) << s.throughput() / 1e6 << '\n';
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+/**
+ * A pipeline from source (a proxy or a stream) through transforms, each a
+ * function from a proxy over a chunk to an expression. The source is copied
+ * into the pipeline, but like any proxy it refers to its data, which has to
+ * outlive the pipeline's runs. A stream source is copied afresh for every
+ * run().
+ */
+template<typename Source, typename... Transforms, detail::enable_if_proxy_or_stream<Source> = 0>
+pipeline<Source, Transforms...> make_pipeline(Source const& source, Transforms const&... transforms){
+    return {source, transforms...};
+}
+
+}
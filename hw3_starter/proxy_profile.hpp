@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <type_traits>
+#include <typeinfo>
+
+/**
+ * Counting what an expression costs.
+ *
+ * Build with PROXY_PROFILE defined and every node in proxy.hpp counts the
+ * calls to its get(), size() and eval() (read() for streams), per node
+ * type, and times each eval()/read(). The type of a node spells out the
+ * whole subtree under it, so in ((a|b)+c)*d the pipe, the adder and the
+ * product are each counted on their own. Leaves of the same type share
+ * their counts.
+ *
+ * profile_report() (in proxy_explain.hpp) lists what was counted so far,
+ * print_profile() prints it as a table, and reset_profile() starts again
+ * from zero. Times are reported twice: total is everything inside the
+ * node's eval(), its children included, and self is total minus the time
+ * spent in its children's eval(). Work on other threads is added up, so
+ * with the parallel functions the totals are CPU time, not wall time.
+ *
+ * The counters are atomic and the timer reads the clock twice per eval(),
+ * so a profiled build runs a good deal slower - get() most of all, as each
+ * call is counted - and its get() and size() can't be used in constant
+ * expressions. Without PROXY_PROFILE proxy.hpp doesn't include this file at
+ * all, the macros below compile to nothing, and profile_report() is always
+ * empty.
+ *
+ * Nodes in other headers can count themselves with the same macros:
+ * PROXY_PROFILE_CALL(gets) or PROXY_PROFILE_CALL(sizes) at the top of
+ * get() or size(), and PROXY_PROFILE_EVAL(count) at the top of eval().
+ */
+
+namespace proxy{
+
+namespace detail{
+/**
+ * The counts for one type of node. Its name is only worked out (demangled)
+ * when there's a report to make.
+ */
+struct node_counters{
+    std::type_info const& type;
+    std::atomic<std::uint64_t> gets{0};
+    std::atomic<std::uint64_t> sizes{0};
+    std::atomic<std::uint64_t> evals{0};
+    std::atomic<std::uint64_t> elements{0};
+    std::atomic<std::uint64_t> total_ns{0};
+    std::atomic<std::uint64_t> self_ns{0};
+    explicit node_counters(std::type_info const& type):
+        type(type)
+    {}
+};
+
+struct profile_registry{
+    std::mutex lock;
+    // a deque, so that the counters never move once they're handed out
+    std::deque<node_counters> nodes;
+};
+
+inline profile_registry& profile_nodes(){
+    static profile_registry registry;
+    return registry;
+}
+
+inline node_counters& register_node(std::type_info const& type){
+    profile_registry& registry = profile_nodes();
+    std::lock_guard<std::mutex> hold{registry.lock};
+    registry.nodes.emplace_back(type);
+    return registry.nodes.back();
+}
+
+template<typename Node>
+node_counters& counters_of(){
+    static node_counters& counters = register_node(typeid(Node));
+    return counters;
+}
+
+/**
+ * Times one eval() or read() for the lifetime of the object. Scopes on the
+ * same thread nest, and each one tells its parent how long it took, so the
+ * parent can leave that out of its self time.
+ */
+class profile_scope{
+    using clock = std::chrono::steady_clock;
+    node_counters& counters;
+    profile_scope* parent;
+    clock::time_point start;
+    std::uint64_t children_ns = 0;
+
+    static profile_scope*& innermost(){
+        static thread_local profile_scope* scope = nullptr;
+        return scope;
+    }
+    public:
+    profile_scope(node_counters& counters, std::size_t count):
+        counters{counters},
+        parent{innermost()}
+    {
+        counters.evals.fetch_add(1, std::memory_order_relaxed);
+        counters.elements.fetch_add(count, std::memory_order_relaxed);
+        innermost() = this;
+        start = clock::now();
+    }
+    profile_scope(profile_scope const&) = delete;
+    profile_scope& operator=(profile_scope const&) = delete;
+    ~profile_scope(){
+        auto const ns = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+        counters.total_ns.fetch_add(ns, std::memory_order_relaxed);
+        counters.self_ns.fetch_add(ns > children_ns ? ns - children_ns : 0, std::memory_order_relaxed);
+        if(parent)
+            parent->children_ns += ns;
+        innermost() = parent;
+    }
+};
+}
+
+#define PROXY_PROFILE_NODE \
+    ::proxy::detail::counters_of<typename std::decay<decltype(*this)>::type>()
+#define PROXY_PROFILE_CALL(event) \
+    PROXY_PROFILE_NODE.event.fetch_add(1, std::memory_order_relaxed)
+#define PROXY_PROFILE_EVAL(count) \
+    ::proxy::detail::profile_scope const proxy_profile_scope{PROXY_PROFILE_NODE, (count)}
+
+}
@@ -0,0 +1,808 @@
+#pragma once
+
+#include "proxy.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Expressions that aren't known until the program runs.
+ *
+ * Everything in proxy.hpp is a template, so every shape of expression has to
+ * be written down in the source and compiled. formula is for the ones that
+ * arrive as text, like "a + b*c | d": it parses the text once into a small
+ * bytecode program over named inputs, and bind() attaches sequences to the
+ * names to get an ordinary proxy.
+ *
+ * The interpreter works on blocks of detail::block_size elements, the same
+ * as the template proxies' eval(). Each instruction is dispatched once per
+ * block and then runs a tight loop over it, so the cost of interpreting is
+ * spread over hundreds of elements, and what's left is the same memory
+ * traffic the templates would have.
+ *
+ * The grammar, loosest first:
+ *   a | b            a, then b (like pipe_proxy)
+ *   a + b   a - b
+ *   a * b   a / b
+ *   -a
+ *   numbers, names, (a), abs(a), sqrt(a), min(a, b), max(a, b)
+ * Numbers are broadcast like make_scalar, and any part of a formula that's
+ * only numbers is worked out once when it's parsed. A formula has to use at
+ * least one input, and can't pipe a plain number (it would never end).
+ */
+
+namespace proxy{
+
+/**
+ * A sequence given to a formula for one of its names. Anything that's a
+ * proxy will do (its elements are converted to T), and so will a vector of
+ * Ts. Vectors, and proxies with a data() pointer like mmap_proxy, are read
+ * in place, everything else is evaluated a block at a time.
+ */
+template<typename T>
+class formula_input{
+    std::function<std::size_t()> size_of;
+    std::function<T const*()> data_of;
+    std::function<void(std::size_t, std::size_t, T*)> evaluate_block;
+    std::function<bool(void const*, void const*)> aliases_of;
+
+    template<typename P>
+    void set_data(P const& p, std::true_type){
+        data_of = [p]{ return static_cast<T const*>(p.data()); };
+    }
+    template<typename P>
+    void set_data(P const&, std::false_type){}
+
+    template<typename P, typename = void>
+    struct has_data : std::false_type{};
+    template<typename P>
+    struct has_data<P, detail::void_t<decltype(std::declval<P const&>().data())>>
+        : std::integral_constant<bool,
+            std::is_same<typename P::type, T>::value &&
+            std::is_convertible<decltype(std::declval<P const&>().data()), T const*>::value>{};
+
+    public:
+    formula_input(std::vector<T> const& v):
+        size_of{[&v]{ return v.size(); }},
+        data_of{[&v]{ return v.data(); }},
+        aliases_of{[&v](void const* first, void const* last){
+            return !v.empty() && detail::overlaps(v.data(), v.data() + v.size(), first, last);
+        }}
+    {}
+    template<typename P, detail::enable_if_proxies<P> = 0>
+    formula_input(P const& p):
+        size_of{[p]{ return p.size(); }},
+        evaluate_block{[p](std::size_t pos, std::size_t count, T* out){
+            detail::evaluate_as<T>(p, pos, count, out);
+        }},
+        aliases_of{[p](void const* first, void const* last){
+            return detail::may_alias(p, first, last);
+        }}
+    {
+        set_data(p, has_data<P>{});
+    }
+    std::size_t size() const {
+        return size_of();
+    }
+    // where elements [pos, pos + count) are: in place if possible, otherwise
+    // evaluated into buffer
+    T const* read(std::size_t pos, std::size_t count, T* buffer) const {
+        if(data_of)
+            return data_of() + pos;
+        evaluate_block(pos, count, buffer);
+        return buffer;
+    }
+    bool aliases(void const* first, void const* last) const {
+        return aliases_of(first, last);
+    }
+};
+
+namespace detail{
+/**
+ * Block buffers for the interpreter, kept per thread so that evaluating a
+ * formula doesn't allocate. A formula whose input is another formula runs
+ * one inside the other, so each nesting level gets its own frame.
+ */
+template<typename T>
+class scratch_frame{
+    struct pool{
+        std::vector<std::unique_ptr<T[]>> frames;
+        std::vector<std::size_t> sizes;
+        std::size_t depth = 0;
+    };
+    static pool& local(){
+        static thread_local pool p;
+        return p;
+    }
+    T* memory;
+    public:
+    explicit scratch_frame(std::size_t n){
+        pool& p = local();
+        if(p.depth == p.frames.size()){
+            p.frames.emplace_back();
+            p.sizes.push_back(0);
+        }
+        if(p.sizes[p.depth] < n){
+            p.frames[p.depth].reset(new T[n]);
+            p.sizes[p.depth] = n;
+        }
+        memory = p.frames[p.depth++].get();
+    }
+    scratch_frame(scratch_frame const&) = delete;
+    scratch_frame& operator=(scratch_frame const&) = delete;
+    ~scratch_frame(){
+        --local().depth;
+    }
+    T* get() const {
+        return memory;
+    }
+};
+
+enum class opcode : std::uint8_t{
+    load,       // slot dst = input arg
+    fill,       // slot dst = constant arg
+    neg, abs, sqrt,
+    add, sub, mul, div, min, max,
+    // the same with constant arg as the right operand, or the left for rsub/rdiv
+    add_k, sub_k, rsub_k, mul_k, div_k, rdiv_k, min_k, max_k,
+    pipe        // slot dst = program arg, then program arg2
+};
+
+/**
+ * One instruction. Operands and results live in slots, which hold a block
+ * each; a and b are the operand slots.
+ */
+struct instruction{
+    opcode op;
+    std::uint8_t dst;
+    std::uint8_t a;
+    std::uint8_t b;
+    std::uint32_t arg;
+    std::uint32_t arg2;
+};
+
+/**
+ * A straight-line list of instructions that leaves its result in slot 0.
+ * Each side of a | gets one of these, since it's evaluated at different
+ * positions from the rest.
+ */
+struct program{
+    std::vector<instruction> code;
+    std::size_t slots = 1;
+    std::size_t scratch_offset = 0;
+};
+
+constexpr std::size_t max_formula_slots = 64;
+
+/**
+ * How deep a formula can go: brackets, calls and minus signs inside each
+ * other, and the parsed tree under any node (for a + b + c + ... that's the
+ * number of terms). Parsing and compiling recurse that deep, so without a
+ * limit a long enough run of '(' would overflow the stack.
+ */
+constexpr std::size_t max_formula_depth = 1000;
+
+template<typename T>
+class formula_plan{
+    static_assert(std::is_floating_point<T>::value, "formulas compute in float or double");
+
+    // the parse tree, only kept while compiling
+    struct node{
+        enum kind_t{ number, name, unary, binary, pipe } kind;
+        char op = 0;
+        T value = 0;
+        std::size_t input = 0;
+        std::size_t left = 0;
+        std::size_t right = 0;
+        // the longest path down from here, and slots needed (see need())
+        std::size_t depth = 1;
+        std::size_t slots = 1;
+    };
+
+    class parser{
+        std::string const& text;
+        std::size_t pos = 0;
+        std::size_t nesting = 0;
+        formula_plan& plan;
+        std::vector<node>& nodes;
+
+        // counts a level of nesting for as long as it's alive
+        class nested{
+            parser& p;
+            public:
+            explicit nested(parser& p):
+                p(p)
+            {
+                if(++p.nesting > max_formula_depth)
+                    p.fail("too deeply nested");
+            }
+            nested(nested const&) = delete;
+            nested& operator=(nested const&) = delete;
+            ~nested(){
+                --p.nesting;
+            }
+        };
+
+        [[noreturn]] void fail(std::string const& what) const {
+            throw std::invalid_argument(
+                "formula: " + what + " at " + std::to_string(pos) + " in \"" + text + "\"");
+        }
+        void skip_space(){
+            while(pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n'))
+                ++pos;
+        }
+        bool accept(char c){
+            skip_space();
+            if(pos < text.size() && text[pos] == c){
+                ++pos;
+                return true;
+            }
+            return false;
+        }
+        void expect(char c){
+            if(!accept(c))
+                fail(std::string("expected '") + c + "'");
+        }
+        static bool is_name_char(char c, bool first){
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+                (!first && c >= '0' && c <= '9');
+        }
+        std::size_t add(node n){
+            if(n.kind == node::unary || n.kind == node::binary || n.kind == node::pipe){
+                n.depth = 1 + nodes[n.left].depth;
+                if(n.kind != node::unary)
+                    n.depth = std::max(n.depth, 1 + nodes[n.right].depth);
+            }
+            if(n.depth > max_formula_depth)
+                fail("too deeply nested");
+            n.slots = need(nodes, n);
+            nodes.push_back(n);
+            return nodes.size() - 1;
+        }
+        bool is_number(std::size_t n) const {
+            return nodes[n].kind == node::number;
+        }
+        std::size_t number(T value){
+            node n{node::number};
+            n.value = value;
+            return add(n);
+        }
+        std::size_t make_unary(char op, std::size_t child){
+            if(is_number(child))
+                return number(apply(op, nodes[child].value, T(0)));
+            node n{node::unary};
+            n.op = op;
+            n.left = child;
+            return add(n);
+        }
+        std::size_t make_binary(char op, std::size_t left, std::size_t right){
+            if(is_number(left) && is_number(right))
+                return number(apply(op, nodes[left].value, nodes[right].value));
+            node n{node::binary};
+            n.op = op;
+            n.left = left;
+            n.right = right;
+            return add(n);
+        }
+
+        std::size_t parse_pipe(){
+            std::size_t left = parse_sum();
+            while(accept('|')){
+                std::size_t const right = parse_sum();
+                if(is_number(left) || is_number(right))
+                    fail("can't pipe a number");
+                node n{node::pipe};
+                n.left = left;
+                n.right = right;
+                left = add(n);
+            }
+            return left;
+        }
+        std::size_t parse_sum(){
+            std::size_t left = parse_product();
+            for(;;){
+                if(accept('+'))
+                    left = make_binary('+', left, parse_product());
+                else if(accept('-'))
+                    left = make_binary('-', left, parse_product());
+                else
+                    return left;
+            }
+        }
+        std::size_t parse_product(){
+            std::size_t left = parse_unary();
+            for(;;){
+                if(accept('*'))
+                    left = make_binary('*', left, parse_unary());
+                else if(accept('/'))
+                    left = make_binary('/', left, parse_unary());
+                else
+                    return left;
+            }
+        }
+        std::size_t parse_unary(){
+            if(accept('-')){
+                nested const level(*this);
+                return make_unary('n', parse_unary());
+            }
+            return parse_primary();
+        }
+        std::size_t parse_primary(){
+            skip_space();
+            if(pos == text.size())
+                fail("unexpected end");
+            if(accept('(')){
+                nested const level(*this);
+                std::size_t const inside = parse_pipe();
+                expect(')');
+                return inside;
+            }
+            char const c = text[pos];
+            if((c >= '0' && c <= '9') || c == '.'){
+                char const* const begin = text.c_str() + pos;
+                char* end;
+                double const value = std::strtod(begin, &end);
+                if(end == begin)
+                    fail("bad number");
+                pos += static_cast<std::size_t>(end - begin);
+                return number(static_cast<T>(value));
+            }
+            if(!is_name_char(c, true))
+                fail(std::string("unexpected '") + c + "'");
+            std::size_t const begin = pos;
+            while(pos < text.size() && is_name_char(text[pos], false))
+                ++pos;
+            std::string const word = text.substr(begin, pos - begin);
+            if(accept('(')){
+                nested const level(*this);
+                return parse_call(word);
+            }
+            node n{node::name};
+            n.input = plan.input_index(word);
+            return add(n);
+        }
+        std::size_t parse_call(std::string const& function){
+            std::size_t const first = parse_pipe();
+            if(function == "abs" || function == "sqrt"){
+                expect(')');
+                return make_unary(function == "abs" ? 'a' : 's', first);
+            }
+            if(function == "min" || function == "max"){
+                expect(',');
+                std::size_t const second = parse_pipe();
+                expect(')');
+                return make_binary(function == "min" ? 'm' : 'M', first, second);
+            }
+            fail("unknown function '" + function + "'");
+        }
+
+        public:
+        parser(std::string const& text, formula_plan& plan, std::vector<node>& nodes):
+            text(text),
+            plan(plan),
+            nodes(nodes)
+        {}
+        std::size_t parse(){
+            std::size_t const root = parse_pipe();
+            skip_space();
+            if(pos != text.size())
+                fail("unexpected '" + std::string(1, text[pos]) + "'");
+            return root;
+        }
+    };
+
+    static T apply(char op, T x, T y){
+        switch(op){
+            case 'n': return -x;
+            case 'a': return std::abs(x);
+            case 's': return std::sqrt(x);
+            case '+': return x + y;
+            case '-': return x - y;
+            case '*': return x * y;
+            case '/': return x / y;
+            case 'm': return std::min(x, y);
+            default: return std::max(x, y);
+        }
+    }
+
+    std::vector<std::string> input_names;
+    std::vector<T> constants;
+    std::vector<program> programs;
+    std::size_t scratch = 0;
+
+    std::size_t input_index(std::string const& name){
+        auto const found = std::find(input_names.begin(), input_names.end(), name);
+        if(found != input_names.end())
+            return static_cast<std::size_t>(found - input_names.begin());
+        input_names.push_back(name);
+        return input_names.size() - 1;
+    }
+
+    std::uint32_t constant(T value){
+        constants.push_back(value);
+        return static_cast<std::uint32_t>(constants.size() - 1);
+    }
+
+    /**
+     * How many slots evaluating x takes (Sethi-Ullman numbering): with the
+     * side that needs more done first, a binary node needs one more slot
+     * than its children only if they need the same number. Worked out once
+     * per node as it's parsed, from its children's.
+     */
+    static std::size_t need(std::vector<node> const& nodes, node const& x){
+        switch(x.kind){
+            case node::number:
+            case node::name:
+            case node::pipe:
+                return 1;
+            case node::unary:
+                return nodes[x.left].slots;
+            default:
+                break;
+        }
+        bool const left_number = nodes[x.left].kind == node::number;
+        bool const right_number = nodes[x.right].kind == node::number;
+        if(left_number || right_number)
+            return nodes[left_number ? x.right : x.left].slots;
+        std::size_t const l = nodes[x.left].slots;
+        std::size_t const r = nodes[x.right].slots;
+        return l == r ? l + 1 : std::max(l, r);
+    }
+
+    static opcode binary_op(char op){
+        switch(op){
+            case '+': return opcode::add;
+            case '-': return opcode::sub;
+            case '*': return opcode::mul;
+            case '/': return opcode::div;
+            case 'm': return opcode::min;
+            default: return opcode::max;
+        }
+    }
+
+    // op with a constant on the right, or on the left if constant_left
+    static opcode constant_op(char op, bool constant_left){
+        switch(op){
+            case '+': return opcode::add_k;
+            case '-': return constant_left ? opcode::rsub_k : opcode::sub_k;
+            case '*': return opcode::mul_k;
+            case '/': return constant_left ? opcode::rdiv_k : opcode::div_k;
+            case 'm': return opcode::min_k;
+            default: return opcode::max_k;
+        }
+    }
+
+    static instruction make(opcode op, std::size_t dst, std::size_t a = 0, std::size_t b = 0,
+                            std::size_t arg = 0, std::size_t arg2 = 0){
+        return {op, static_cast<std::uint8_t>(dst), static_cast<std::uint8_t>(a),
+                static_cast<std::uint8_t>(b), static_cast<std::uint32_t>(arg),
+                static_cast<std::uint32_t>(arg2)};
+    }
+
+    // emits the code that leaves node n in slot, using the slots above it
+    void emit(std::vector<node> const& nodes, std::size_t n, std::size_t slot, program& p){
+        if(slot >= max_formula_slots)
+            throw std::invalid_argument("formula: too deeply nested");
+        p.slots = std::max(p.slots, slot + 1);
+        node const& x = nodes[n];
+        switch(x.kind){
+            case node::number:
+                p.code.push_back(make(opcode::fill, slot, 0, 0, constant(x.value)));
+                return;
+            case node::name:
+                p.code.push_back(make(opcode::load, slot, 0, 0, x.input));
+                return;
+            case node::unary:
+                emit(nodes, x.left, slot, p);
+                p.code.push_back(make(
+                    x.op == 'n' ? opcode::neg : x.op == 'a' ? opcode::abs : opcode::sqrt,
+                    slot, slot));
+                return;
+            case node::pipe:{
+                std::size_t const left = compile(nodes, x.left);
+                std::size_t const right = compile(nodes, x.right);
+                p.code.push_back(make(opcode::pipe, slot, 0, 0, left, right));
+                return;
+            }
+            case node::binary:
+                break;
+        }
+        bool const left_number = nodes[x.left].kind == node::number;
+        bool const right_number = nodes[x.right].kind == node::number;
+        if(left_number || right_number){
+            emit(nodes, left_number ? x.right : x.left, slot, p);
+            T const k = nodes[left_number ? x.left : x.right].value;
+            p.code.push_back(make(constant_op(x.op, left_number), slot, slot, 0, constant(k)));
+            return;
+        }
+        if(nodes[x.right].slots > nodes[x.left].slots){
+            emit(nodes, x.right, slot, p);
+            emit(nodes, x.left, slot + 1, p);
+            p.code.push_back(make(binary_op(x.op), slot, slot + 1, slot));
+        }else{
+            emit(nodes, x.left, slot, p);
+            emit(nodes, x.right, slot + 1, p);
+            p.code.push_back(make(binary_op(x.op), slot, slot, slot + 1));
+        }
+    }
+
+    // compiles the tree under n into a new program, and returns its index
+    std::size_t compile(std::vector<node> const& nodes, std::size_t n){
+        std::size_t const index = programs.size();
+        programs.emplace_back();
+        program p;
+        emit(nodes, n, 0, p);
+        p.scratch_offset = scratch;
+        // slot 0 is always the caller's output, it needs no buffer
+        scratch += (p.slots - 1) * block_size;
+        programs[index] = std::move(p);
+        return index;
+    }
+
+    void run_block(program const& p, std::size_t pos, std::size_t n, T* const* buffers,
+                   T const** slots, T* scratch_memory, std::vector<formula_input<T>> const& inputs) const {
+        for(instruction const& i : p.code){
+            T* const out = buffers[i.dst];
+            T const* const a = slots[i.a];
+            T const* const b = slots[i.b];
+            T const k = i.op >= opcode::add_k && i.op <= opcode::max_k ? constants[i.arg] : T(0);
+            switch(i.op){
+                case opcode::load:
+                    slots[i.dst] = inputs[i.arg].read(pos, n, out);
+                    continue;
+                case opcode::fill:
+                    std::fill(out, out + n, constants[i.arg]);
+                    break;
+                case opcode::neg:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = -a[j];
+                    break;
+                case opcode::abs:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = std::abs(a[j]);
+                    break;
+                case opcode::sqrt:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = std::sqrt(a[j]);
+                    break;
+                case opcode::add:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = a[j] + b[j];
+                    break;
+                case opcode::sub:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = a[j] - b[j];
+                    break;
+                case opcode::mul:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = a[j] * b[j];
+                    break;
+                case opcode::div:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = a[j] / b[j];
+                    break;
+                case opcode::min:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = std::min(a[j], b[j]);
+                    break;
+                case opcode::max:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = std::max(a[j], b[j]);
+                    break;
+                case opcode::add_k:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = a[j] + k;
+                    break;
+                case opcode::sub_k:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = a[j] - k;
+                    break;
+                case opcode::rsub_k:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = k - a[j];
+                    break;
+                case opcode::mul_k:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = a[j] * k;
+                    break;
+                case opcode::div_k:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = a[j] / k;
+                    break;
+                case opcode::rdiv_k:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = k / a[j];
+                    break;
+                case opcode::min_k:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = std::min(a[j], k);
+                    break;
+                case opcode::max_k:
+                    for(std::size_t j = 0; j < n; ++j) out[j] = std::max(a[j], k);
+                    break;
+                case opcode::pipe:{
+                    // same as pipe_proxy::eval
+                    std::size_t const size1 = size(i.arg, inputs);
+                    std::size_t const size2 = size(i.arg2, inputs);
+                    std::size_t left = 0;
+                    if(pos < size1){
+                        left = std::min(n, size1 - pos);
+                        run(i.arg, pos, left, out, scratch_memory, inputs);
+                    }
+                    std::size_t right = 0;
+                    std::size_t const pos2 = pos + left - size1;
+                    if(left < n && pos2 < size2){
+                        right = std::min(n - left, size2 - pos2);
+                        run(i.arg2, pos2, right, out + left, scratch_memory, inputs);
+                    }
+                    std::fill(out + left + right, out + n, T(0));
+                    break;
+                }
+            }
+            slots[i.dst] = out;
+        }
+    }
+
+    public:
+    explicit formula_plan(std::string const& text){
+        std::vector<node> nodes;
+        std::size_t const root = parser(text, *this, nodes).parse();
+        if(input_names.empty())
+            throw std::invalid_argument("formula: \"" + text + "\" doesn't use any inputs");
+        compile(nodes, root);
+    }
+
+    std::vector<std::string> const& names() const {
+        return input_names;
+    }
+
+    std::size_t scratch_size() const {
+        return scratch;
+    }
+
+    std::size_t size(std::size_t program_index, std::vector<formula_input<T>> const& inputs) const {
+        program const& p = programs[program_index];
+        std::size_t sizes[max_formula_slots];
+        for(instruction const& i : p.code){
+            switch(i.op){
+                case opcode::load:
+                    sizes[i.dst] = inputs[i.arg].size();
+                    break;
+                case opcode::fill:
+                    sizes[i.dst] = std::numeric_limits<std::size_t>::max();
+                    break;
+                case opcode::pipe:
+                    sizes[i.dst] = size(i.arg, inputs) + size(i.arg2, inputs);
+                    break;
+                case opcode::add:
+                case opcode::sub:
+                case opcode::mul:
+                case opcode::div:
+                case opcode::min:
+                case opcode::max:
+                    sizes[i.dst] = std::min(sizes[i.a], sizes[i.b]);
+                    break;
+                default:
+                    sizes[i.dst] = sizes[i.a];
+                    break;
+            }
+        }
+        return sizes[0];
+    }
+
+    /**
+     * Writes elements [pos, pos + count) of program program_index to out,
+     * a block at a time. The program's slots other than 0 are its part of
+     * scratch_memory; slot 0 is out itself, so the last instruction usually
+     * writes the result straight to where it's wanted.
+     */
+    void run(std::size_t program_index, std::size_t pos, std::size_t count, T* out,
+             T* scratch_memory, std::vector<formula_input<T>> const& inputs) const {
+        program const& p = programs[program_index];
+        T* buffers[max_formula_slots];
+        T const* slots[max_formula_slots];
+        for(std::size_t s = 1; s < p.slots; ++s){
+            buffers[s] = scratch_memory + p.scratch_offset + (s - 1) * block_size;
+        }
+        for(std::size_t i = 0; i < count; i += block_size){
+            std::size_t const n = std::min(block_size, count - i);
+            buffers[0] = out + i;
+            run_block(p, pos + i, n, buffers, slots, scratch_memory, inputs);
+            if(slots[0] != buffers[0])
+                std::copy_n(slots[0], n, buffers[0]);
+        }
+    }
+};
+}
+
+template<typename T>
+class formula;
+
+/**
+ * A formula with a sequence for each of its names: an ordinary proxy, so it
+ * can be evaluated, reduced, or used inside a bigger (template) expression.
+ */
+template<typename T>
+class bound_formula{
+    std::shared_ptr<detail::formula_plan<T> const> plan;
+    std::vector<formula_input<T>> inputs;
+    public:
+    using type = T;
+    bound_formula(std::shared_ptr<detail::formula_plan<T> const> plan,
+                  std::vector<formula_input<T>> inputs):
+        plan{std::move(plan)},
+        inputs(std::move(inputs))
+    {}
+    std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return plan->size(0, inputs);
+    }
+    void eval(std::size_t pos, std::size_t count, T* out) const {
+        PROXY_PROFILE_EVAL(count);
+        detail::scratch_frame<T> scratch(plan->scratch_size());
+        plan->run(0, pos, count, out, scratch.get(), inputs);
+    }
+    T get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        T x;
+        eval(pos, 1, &x);
+        return x;
+    }
+    bool aliases(void const* first, void const* last) const {
+        for(auto const& input : inputs){
+            if(input.aliases(first, last))
+                return true;
+        }
+        return false;
+    }
+};
+
+/**
+ * A parsed formula, computing in T (float or double). Parsing throws
+ * std::invalid_argument, with the position, if the text isn't a formula.
+ * Copies share the parsed program.
+ */
+template<typename T>
+class formula{
+    std::shared_ptr<detail::formula_plan<T> const> plan;
+    public:
+    explicit formula(std::string const& text):
+        plan{std::make_shared<detail::formula_plan<T>>(text)}
+    {}
+    /**
+     * The names the formula uses, in the order they first appear.
+     */
+    std::vector<std::string> const& names() const {
+        return plan->names();
+    }
+    /**
+     * Binds a sequence to every name, in the order of names().
+     */
+    bound_formula<T> bind(std::vector<formula_input<T>> inputs) const {
+        if(inputs.size() != names().size())
+            throw std::invalid_argument("formula: expected " + std::to_string(names().size()) +
+                                        " inputs, got " + std::to_string(inputs.size()));
+        return {plan, std::move(inputs)};
+    }
+    /**
+     * Binds sequences by name, e.g. f.bind({{"a", a}, {"b", make_proxy(b)}}).
+     * Every name has to be given exactly once.
+     */
+    bound_formula<T> bind(std::initializer_list<std::pair<std::string, formula_input<T>>> named) const {
+        std::vector<formula_input<T>> inputs;
+        inputs.reserve(names().size());
+        for(auto const& name : names()){
+            auto const found = std::find_if(named.begin(), named.end(),
+                [&](std::pair<std::string, formula_input<T>> const& x){ return x.first == name; });
+            if(found == named.end())
+                throw std::invalid_argument("formula: no input for '" + name + "'");
+            inputs.push_back(found->second);
+        }
+        if(named.size() != names().size())
+            throw std::invalid_argument("formula: inputs given that it doesn't use, or given twice");
+        return {plan, std::move(inputs)};
+    }
+};
+
+template<typename T = double>
+formula<T> parse_formula(std::string const& text){
+    return formula<T>(text);
+}
+
+}
@@ -0,0 +1,364 @@
+#pragma once
+
+#include "proxy_parallel.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Prefix scans: scan(op, p).get(i) is p[0] op p[1] op ... op p[i].
+ *
+ * Written on get() alone that's O(i) per element. Below parallel_threshold
+ * elements scan() simply works out the whole scan up front, which stays in
+ * cache. For anything longer a temporary as long as p would cost a trip
+ * through memory of its own, so scan() does the first half of a two-pass
+ * parallel scan up front instead: it works out the total of every block of
+ * detail::block_size elements, on the pool, and keeps just
+ * the running totals at the block boundaries. That's one value per 256
+ * elements. The second pass happens whenever the scan is evaluated: eval()
+ * picks up the running total at the nearest boundary and scans from there,
+ * writing straight to where the result is wanted. Any part of the scan can
+ * be evaluated independently, so make_vector_parallel and the parallel
+ * reductions split it up like any other proxy, and get() costs at most one
+ * block.
+ *
+ * op has to be associative (blocks are combined out of order). p is read
+ * when scan() is called, and if it's long, again when the result is
+ * evaluated, so it mustn't change in between. Like the reductions, floating
+ * point sums are added in a different order than strictly left to right
+ * (within a block, four at a time with SIMD), so results can differ in the
+ * last bits.
+ */
+
+namespace proxy{
+
+namespace detail{
+template<typename Op, typename T>
+struct is_plus_of : std::integral_constant<bool,
+    std::is_same<Op, std::plus<T>>::value || std::is_same<Op, std::plus<void>>::value>{};
+
+/**
+ * out[i] = carry op in[0] op ... op in[i], or without carry if has_carry is
+ * false. in and out may be the same.
+ */
+template<typename Op, typename T>
+void scan_block(Op const& op, T const* in, std::size_t n, T* out, T carry, bool has_carry, std::false_type){
+    std::size_t i = 0;
+    if(!has_carry && n != 0){
+        carry = in[0];
+        out[0] = carry;
+        i = 1;
+    }
+    for(; i < n; ++i){
+        carry = static_cast<T>(op(carry, in[i]));
+        out[i] = carry;
+    }
+}
+
+// with + there's always a carry: -0.0 (or 0) adds nothing
+template<typename T>
+void scan_sum(T const* in, std::size_t n, T* out, T carry){
+    for(std::size_t i = 0; i < n; ++i){
+        carry += in[i];
+        out[i] = carry;
+    }
+}
+
+#if defined(__SSE2__)
+/**
+ * Four partial sums at once: after adding x shifted by one element, then by
+ * two, each lane holds the sum of itself and the lanes before it, and the
+ * carry from the previous four goes on top. The only dependency from one
+ * group to the next is that last add.
+ */
+inline void scan_sum(float const* in, std::size_t n, float* out, float carry){
+    __m128 c = _mm_set1_ps(carry);
+    std::size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        __m128 x = _mm_loadu_ps(in + i);
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+        x = _mm_add_ps(x, c);
+        _mm_storeu_ps(out + i, x);
+        c = _mm_shuffle_ps(x, x, 0xff);
+    }
+    carry = _mm_cvtss_f32(c);
+    for(; i < n; ++i){
+        carry += in[i];
+        out[i] = carry;
+    }
+}
+
+inline void scan_sum(double const* in, std::size_t n, double* out, double carry){
+    __m128d c = _mm_set1_pd(carry);
+    std::size_t i = 0;
+    for(; i + 2 <= n; i += 2){
+        __m128d x = _mm_loadu_pd(in + i);
+        x = _mm_add_pd(x, _mm_castsi128_pd(_mm_slli_si128(_mm_castpd_si128(x), 8)));
+        x = _mm_add_pd(x, c);
+        _mm_storeu_pd(out + i, x);
+        c = _mm_unpackhi_pd(x, x);
+    }
+    carry = _mm_cvtsd_f64(c);
+    for(; i < n; ++i){
+        carry += in[i];
+        out[i] = carry;
+    }
+}
+
+// 32 bit integers, signed or not - the adds wrap either way
+template<typename T>
+void scan_sum_epi32(T const* in, std::size_t n, T* out, T carry){
+    __m128i c = _mm_set1_epi32(static_cast<std::int32_t>(carry));
+    std::size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, c);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+        c = _mm_shuffle_epi32(x, 0xff);
+    }
+    carry = i ? out[i - 1] : carry;
+    for(; i < n; ++i){
+        carry += in[i];
+        out[i] = carry;
+    }
+}
+
+inline void scan_sum(std::int32_t const* in, std::size_t n, std::int32_t* out, std::int32_t carry){
+    scan_sum_epi32(in, n, out, carry);
+}
+
+inline void scan_sum(std::uint32_t const* in, std::size_t n, std::uint32_t* out, std::uint32_t carry){
+    scan_sum_epi32(in, n, out, carry);
+}
+
+// and two 64 bit ones at a time
+template<typename T>
+void scan_sum_epi64(T const* in, std::size_t n, T* out, T carry){
+    __m128i c = _mm_set1_epi64x(static_cast<long long>(carry));
+    std::size_t i = 0;
+    for(; i + 2 <= n; i += 2){
+        __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+        x = _mm_add_epi64(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi64(x, c);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+        c = _mm_unpackhi_epi64(x, x);
+    }
+    carry = i ? out[i - 1] : carry;
+    for(; i < n; ++i){
+        carry += in[i];
+        out[i] = carry;
+    }
+}
+
+inline void scan_sum(std::int64_t const* in, std::size_t n, std::int64_t* out, std::int64_t carry){
+    scan_sum_epi64(in, n, out, carry);
+}
+
+inline void scan_sum(std::uint64_t const* in, std::size_t n, std::uint64_t* out, std::uint64_t carry){
+    scan_sum_epi64(in, n, out, carry);
+}
+#endif
+
+template<typename Op, typename T>
+void scan_block(Op const&, T const* in, std::size_t n, T* out, T carry, bool has_carry, std::true_type){
+    scan_sum(in, n, out, has_carry ? carry : T(-T(0)));
+}
+
+template<typename Op, typename T>
+void scan_block(Op const& op, T const* in, std::size_t n, T* out, T carry, bool has_carry){
+    scan_block(op, in, n, out, carry, has_carry, is_plus_of<Op, T>{});
+}
+
+/**
+ * p[begin] op ... op p[begin + count - 1], for the first pass. Sums are
+ * plain reductions, which don't have to write anything back.
+ */
+template<typename T, typename Op, typename P>
+T scan_total(Op const& op, P const& p, std::size_t begin, std::size_t count, std::false_type){
+    T buffer[block_size];
+    evaluate_as<T>(p, begin, count, buffer);
+    scan_block(op, buffer, count, buffer, T{}, false);
+    return buffer[count - 1];
+}
+
+template<typename T, typename Op, typename P>
+T scan_total(Op const&, P const& p, std::size_t begin, std::size_t count, std::true_type){
+    return reduce(p, begin, count, sum_reducer<T>{});
+}
+}
+
+/**
+ * The scan of p with op. Made by scan() and exclusive_scan(), which do the
+ * first pass; see the top of this file.
+ */
+template<typename Op, typename P>
+class scan_proxy{
+    public:
+    using type = detail::accumulator_t<typename P::type>;
+    private:
+    P p;
+    Op op;
+    // either the whole scan (for short p), or carries[b] is the scan up to
+    // the end of block b - 1 (carries[0] is unused)
+    std::shared_ptr<std::vector<type> const> carries;
+    bool complete;
+    bool exclusive;
+    type init;
+
+    void inclusive(std::size_t pos, std::size_t count, type* out) const {
+        if(complete){
+            std::copy_n(carries->data() + pos, count, out);
+            return;
+        }
+        std::size_t const b = pos / detail::block_size;
+        std::size_t const start = b * detail::block_size;
+        type carry = b == 0 ? type{} : (*carries)[b];
+        bool has_carry = b != 0;
+        if(start < pos){
+            type warm_up[detail::block_size];
+            detail::evaluate_as<type>(p, start, pos - start, warm_up);
+            detail::scan_block(op, warm_up, pos - start, warm_up, carry, has_carry);
+            carry = warm_up[pos - start - 1];
+            has_carry = true;
+        }
+        for(std::size_t i = 0; i < count; i += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, count - i);
+            detail::evaluate_as<type>(p, pos + i, n, out + i);
+            detail::scan_block(op, out + i, n, out + i, carry, has_carry);
+            carry = out[i + n - 1];
+            has_carry = true;
+        }
+    }
+
+    public:
+    scan_proxy(Op const& op, P const& p, bool exclusive, type init, thread_pool& pool):
+        p{p},
+        op{op},
+        complete{p.size() < parallel_threshold},
+        exclusive{exclusive},
+        init{init}
+    {
+        std::size_t const n = p.size();
+        if(complete){
+            // short enough to stay in cache, so it's cheaper to keep it all
+            // than to read p again
+            std::vector<type> values(n);
+            for(std::size_t i = 0; i < n; i += detail::block_size){
+                std::size_t const count = std::min(detail::block_size, n - i);
+                detail::evaluate_as<type>(p, i, count, values.data() + i);
+                detail::scan_block(op, values.data() + i, count, values.data() + i,
+                                   i == 0 ? type{} : values[i - 1], i != 0);
+            }
+            carries = std::make_shared<std::vector<type> const>(std::move(values));
+            return;
+        }
+        std::size_t const blocks = (n + detail::block_size - 1) / detail::block_size;
+        std::vector<type> totals(blocks);
+        auto const total = [&](std::size_t b){
+            std::size_t const begin = b * detail::block_size;
+            totals[b] = detail::scan_total<type>(op, p, begin, std::min(detail::block_size, n - begin),
+                                                 detail::is_plus_of<Op, type>{});
+        };
+        if(pool.concurrency() == 1){
+            for(std::size_t b = 0; b < blocks; ++b){
+                total(b);
+            }
+        }else{
+            std::size_t const per_chunk = detail::parallel_chunk_size<type>() / detail::block_size;
+            pool.parallel_for((blocks + per_chunk - 1) / per_chunk, [&](std::size_t c){
+                for(std::size_t b = c * per_chunk; b < std::min(blocks, (c + 1) * per_chunk); ++b){
+                    total(b);
+                }
+            });
+        }
+        // running totals at the block boundaries, shifted along by one
+        for(std::size_t b = blocks; b-- > 1;){
+            totals[b] = totals[b - 1];
+        }
+        for(std::size_t b = 2; b < blocks; ++b){
+            totals[b] = static_cast<type>(op(totals[b - 1], totals[b]));
+        }
+        carries = std::make_shared<std::vector<type> const>(std::move(totals));
+    }
+    std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return p.size();
+    }
+    type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        type x;
+        eval(pos, 1, &x);
+        return x;
+    }
+    /**
+     * An exclusive scan is init op (the inclusive scan one position back),
+     * and just init at the start.
+     */
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        if(!exclusive){
+            inclusive(pos, count, out);
+            return;
+        }
+        if(count == 0)
+            return;
+        std::size_t first = 0;
+        if(pos == 0){
+            out[0] = init;
+            inclusive(0, count - 1, out + 1);
+            first = 1;
+        }else{
+            inclusive(pos - 1, count, out);
+        }
+        for(std::size_t i = first; i < count; ++i){
+            out[i] = static_cast<type>(op(init, out[i]));
+        }
+    }
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p, first, last);
+    }
+};
+
+/**
+ * The inclusive scan of p with op, e.g. scan(std::plus<>{}, p) for running
+ * sums or scan(max_fn{}, p) for the running maximum. For long p the first
+ * pass runs on pool (by default, default_pool()).
+ */
+template<typename Op, typename P, detail::enable_if_proxies<P> = 0>
+scan_proxy<Op, P> scan(Op const& op, P const& p, thread_pool& pool){
+    return {op, p, false, typename scan_proxy<Op, P>::type{}, pool};
+}
+
+template<typename Op, typename P, detail::enable_if_proxies<P> = 0>
+scan_proxy<Op, P> scan(Op const& op, P const& p){
+    return scan(op, p, default_pool());
+}
+
+/**
+ * The exclusive scan: init, init op p[0], init op p[0] op p[1], ... - as
+ * long as p, so p's last element isn't in it.
+ */
+template<typename Op, typename P, detail::enable_if_proxies<P> = 0>
+scan_proxy<Op, P> exclusive_scan(Op const& op, P const& p, typename scan_proxy<Op, P>::type init,
+                                 thread_pool& pool){
+    return {op, p, true, init, pool};
+}
+
+template<typename Op, typename P, detail::enable_if_proxies<P> = 0>
+scan_proxy<Op, P> exclusive_scan(Op const& op, P const& p, typename scan_proxy<Op, P>::type init){
+    return exclusive_scan(op, p, init, default_pool());
+}
+
+}
@@ -0,0 +1,428 @@
+#pragma once
+
+#include "proxy.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Records with several fields.
+ *
+ * zip(p1, p2, ...) is a proxy of std::tuples: zip(a, b).get(i) is
+ * (a[i], b[i]). It's elementwise, and as long as the shortest proxy in it.
+ * element<I>(p) goes the other way and picks field I out of each tuple of
+ * p. For a zip that's just the I-th proxy that went in, so
+ * element<0>(zip(a, b)) * 2 is exactly a * 2.
+ *
+ * soa_vector<Ts...> keeps records as a struct of arrays: one std::vector
+ * per field. Its columns are plain leaves (column<I>(s)), so an expression
+ * over them evaluates like one over separate vectors, a block at a time
+ * with loops the compiler can vectorize. make_proxy(s) zips all of them.
+ *
+ * Records kept the other way round, as an array of structs (std::vector<S>),
+ * can be read a field at a time with make_member_proxy(v, &S::field),
+ * converted with make_soa(v, &S::a, &S::b, ...) and converted back with
+ * make_aos<S>(s, &S::a, &S::b, ...). Doing that one column at a time would
+ * go through the whole array once per field. The conversions work a block
+ * of detail::block_size records at a time instead, and do every field of
+ * the block while it's in L1. Each field is then a loop with a fixed
+ * stride, which is the kind of loop GCC and Clang vectorize at -O3 or with
+ * -march=native.
+ */
+
+namespace proxy{
+
+template<typename... Ts>
+struct soa_vector;
+
+/**
+ * The proxies zipped together, yielding a tuple of their elements at each
+ * position. Made by zip().
+ */
+template<typename... Proxies>
+class zip_proxy{
+    std::tuple<Proxies...> ps;
+    public:
+    using type = std::tuple<typename Proxies::type...>;
+    private:
+    template<std::size_t... I>
+    constexpr std::size_t size(std::index_sequence<I...>) const {
+        std::size_t result = std::numeric_limits<std::size_t>::max();
+        std::size_t const sizes[] = {std::get<I>(ps).size()...};
+        for(std::size_t s : sizes){
+            result = s < result ? s : result;
+        }
+        return result;
+    }
+    template<std::size_t... I>
+    constexpr type get(std::size_t pos, std::index_sequence<I...>) const {
+        return type{std::get<I>(ps).get(pos)...};
+    }
+    template<std::size_t... I>
+    bool aliases(void const* first, void const* last, std::index_sequence<I...>) const {
+        bool const each[] = {false, detail::may_alias(std::get<I>(ps), first, last)...};
+        return std::find(std::begin(each), std::end(each), true) != std::end(each);
+    }
+    public:
+    static constexpr bool elementwise =
+        detail::all_of<detail::is_elementwise<Proxies>::value...>::value;
+    static constexpr std::size_t extent = detail::elementwise_extent<Proxies...>::value;
+    static constexpr bool unbounded =
+        detail::all_of<detail::is_unbounded<Proxies>::value...>::value;
+    constexpr zip_proxy(Proxies const&... ps):
+        ps{ps...}
+    {}
+    constexpr std::tuple<Proxies...> const& children() const {
+        return ps;
+    }
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return extent != dynamic_extent ? extent : size(std::index_sequence_for<Proxies...>{});
+    }
+    constexpr type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return get(pos, std::index_sequence_for<Proxies...>{});
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const;
+    bool aliases(void const* first, void const* last) const {
+        return aliases(first, last, std::index_sequence_for<Proxies...>{});
+    }
+};
+
+template<typename P, typename... Proxies, detail::enable_if_proxies<P, Proxies...> = 0>
+constexpr zip_proxy<P, Proxies...> zip(P const& p, Proxies const&... ps){
+    return {p, ps...};
+}
+
+namespace detail{
+template<typename Proxy, typename F, std::size_t I>
+void visit_field(Proxy const& p, std::size_t pos, std::size_t count, F const& f,
+                 std::integral_constant<std::size_t, I> field){
+    typename Proxy::type values[block_size];
+    evaluate(p, pos, count, values);
+    f(field, static_cast<typename Proxy::type const*>(values));
+}
+
+template<std::size_t I, typename Tuple, typename F>
+void visit_member(Tuple const* tuples, std::size_t count, F const& f){
+    using T = typename std::tuple_element<I, Tuple>::type;
+    T values[block_size];
+    for(std::size_t j = 0; j < count; ++j){
+        values[j] = std::get<I>(tuples[j]);
+    }
+    f(std::integral_constant<std::size_t, I>{}, static_cast<T const*>(values));
+}
+
+template<typename... Proxies, typename F, std::size_t... I>
+void visit_fields(zip_proxy<Proxies...> const& z, std::size_t pos, std::size_t count, F const& f,
+                  std::index_sequence<I...>){
+    int const expand[] = {0, (visit_field(std::get<I>(z.children()), pos, count, f,
+                                          std::integral_constant<std::size_t, I>{}), 0)...};
+    (void)expand;
+}
+
+template<typename Proxy, typename F, std::size_t... I>
+void visit_fields(Proxy const& p, std::size_t pos, std::size_t count, F const& f,
+                  std::index_sequence<I...>){
+    typename Proxy::type tuples[block_size];
+    evaluate(p, pos, count, tuples);
+    int const expand[] = {0, (visit_member<I>(static_cast<typename Proxy::type const*>(tuples), count, f), 0)...};
+    (void)expand;
+}
+
+/**
+ * Calls f(field, values) once for each field of the tuples p yields, where
+ * field is std::integral_constant<std::size_t, I> for field I and values
+ * points to that field of the elements [pos, pos + count) of p. count is
+ * at most block_size. A zip's fields come straight from the proxies in it,
+ * without making any tuples; anything else is evaluated and taken apart.
+ */
+template<typename Proxy, typename F>
+void visit_fields(Proxy const& p, std::size_t pos, std::size_t count, F const& f){
+    visit_fields(p, pos, count, f,
+                 std::make_index_sequence<std::tuple_size<typename Proxy::type>::value>{});
+}
+
+template<typename Tuple>
+struct soa_of;
+
+template<typename... Ts>
+struct soa_of<std::tuple<Ts...>>{
+    using type = soa_vector<Ts...>;
+};
+
+template<typename T1, typename T2>
+struct soa_of<std::pair<T1, T2>>{
+    using type = soa_vector<T1, T2>;
+};
+}
+
+template<typename... Proxies>
+void zip_proxy<Proxies...>::eval(std::size_t pos, std::size_t count, type* out) const {
+    PROXY_PROFILE_EVAL(count);
+    for(std::size_t i = 0; i < count; i += detail::block_size){
+        std::size_t const n = std::min(detail::block_size, count - i);
+        detail::visit_fields(*this, pos + i, n, [out, i, n](auto field, auto const* values){
+            for(std::size_t j = 0; j < n; ++j){
+                std::get<decltype(field)::value>(out[i + j]) = values[j];
+            }
+        });
+    }
+}
+
+/**
+ * Field I of each element of p, which yields tuples (or pairs).
+ */
+template<std::size_t I, typename P>
+class element_proxy{
+    P p;
+    public:
+    using type = typename std::tuple_element<I, typename P::type>::type;
+    static constexpr bool elementwise = detail::is_elementwise<P>::value;
+    static constexpr std::size_t extent = detail::static_extent<P>::value;
+    static constexpr bool unbounded = detail::is_unbounded<P>::value;
+    constexpr element_proxy(P const& p):
+        p{p}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return p.size();
+    }
+    constexpr type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return std::get<I>(p.get(pos));
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        typename P::type tuples[detail::block_size];
+        for(std::size_t i = 0; i < count; i += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, count - i);
+            detail::evaluate(p, pos + i, n, tuples);
+            for(std::size_t j = 0; j < n; ++j){
+                out[i + j] = std::get<I>(tuples[j]);
+            }
+        }
+    }
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p, first, last);
+    }
+};
+
+template<std::size_t I, typename P, detail::enable_if_proxies<P> = 0>
+constexpr element_proxy<I, P> element(P const& p){
+    return {p};
+}
+
+template<std::size_t I, typename... Proxies>
+constexpr typename std::tuple_element<I, std::tuple<Proxies...>>::type
+element(zip_proxy<Proxies...> const& z){
+    return std::get<I>(z.children());
+}
+
+/**
+ * One field of an array of structs: get(pos) is records[pos].*member. Like
+ * sequence_proxy it holds a reference to the records, so an expression
+ * that's kept sees them as they are when it's evaluated, grown or moved.
+ */
+template<typename Sequence, typename S, typename M>
+class member_proxy{
+    Sequence const& records;
+    M S::* member;
+
+    S const* first() const {
+        return std::addressof(*std::begin(records));
+    }
+    public:
+    using type = typename std::remove_cv<M>::type;
+    static constexpr bool elementwise = true;
+    constexpr member_proxy(Sequence const& records, M S::* member):
+        records(records),
+        member{member}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return static_cast<std::size_t>(std::distance(std::begin(records), std::end(records)));
+    }
+    constexpr type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return records[pos].*member;
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        if(count == 0)
+            return;
+        S const* const in = first() + pos;
+        for(std::size_t i = 0; i < count; ++i){
+            out[i] = in[i].*member;
+        }
+    }
+    bool aliases(void const* begin, void const* end) const {
+        std::size_t const n = size();
+        return n != 0 && detail::overlaps(first(), first() + n, begin, end);
+    }
+};
+
+template<typename Sequence, typename S, typename M>
+member_proxy<Sequence, S, M> make_member_proxy(Sequence const& records, M S::* member){
+    static_assert(detail::is_contiguous<Sequence>::value, "make_member_proxy needs contiguous records");
+    static_assert(std::is_same<typename std::decay<decltype(*std::begin(records))>::type, S>::value,
+                  "the member has to be one of the records'");
+    static_assert(!std::is_function<M>::value, "the member has to be a data member");
+    return {records, member};
+}
+
+template<typename Sequence, typename S, typename M>
+void make_member_proxy(Sequence const&& records, M S::* member) = delete;
+
+/**
+ * Records stored as a struct of arrays, one std::vector for each field.
+ * columns is yours to use directly; the rest keeps the columns the same
+ * length.
+ */
+template<typename... Ts>
+struct soa_vector{
+    static_assert(sizeof...(Ts) > 0, "a record needs at least one field");
+    std::tuple<std::vector<Ts>...> columns;
+
+    std::size_t size() const {
+        return std::get<0>(columns).size();
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+    void resize(std::size_t n){
+        resize(n, std::index_sequence_for<Ts...>{});
+    }
+    void reserve(std::size_t n){
+        reserve(n, std::index_sequence_for<Ts...>{});
+    }
+    void push_back(Ts const&... values){
+        push_back(std::index_sequence_for<Ts...>{}, values...);
+    }
+    std::tuple<Ts...> get(std::size_t pos) const {
+        return get(pos, std::index_sequence_for<Ts...>{});
+    }
+    template<std::size_t I>
+    typename std::tuple_element<I, std::tuple<std::vector<Ts>...>>::type& column(){
+        return std::get<I>(columns);
+    }
+    template<std::size_t I>
+    typename std::tuple_element<I, std::tuple<std::vector<Ts>...>>::type const& column() const {
+        return std::get<I>(columns);
+    }
+    private:
+    template<std::size_t... I>
+    void resize(std::size_t n, std::index_sequence<I...>){
+        int const expand[] = {0, (std::get<I>(columns).resize(n), 0)...};
+        (void)expand;
+    }
+    template<std::size_t... I>
+    void reserve(std::size_t n, std::index_sequence<I...>){
+        int const expand[] = {0, (std::get<I>(columns).reserve(n), 0)...};
+        (void)expand;
+    }
+    template<std::size_t... I>
+    void push_back(std::index_sequence<I...>, Ts const&... values){
+        int const expand[] = {0, (std::get<I>(columns).push_back(values), 0)...};
+        (void)expand;
+    }
+    template<std::size_t... I>
+    std::tuple<Ts...> get(std::size_t pos, std::index_sequence<I...>) const {
+        return std::tuple<Ts...>{std::get<I>(columns)[pos]...};
+    }
+};
+
+/**
+ * Column I of s as a leaf.
+ */
+template<std::size_t I, typename... Ts>
+auto column(soa_vector<Ts...> const& s) -> decltype(make_proxy(s.template column<I>())){
+    return make_proxy(s.template column<I>());
+}
+
+template<std::size_t I, typename... Ts>
+void column(soa_vector<Ts...> const&& s) = delete;
+
+namespace detail{
+template<typename... Ts, std::size_t... I>
+zip_proxy<sequence_proxy<Ts, std::vector<Ts>>...> zip_columns(soa_vector<Ts...> const& s, std::index_sequence<I...>){
+    return {make_proxy(std::get<I>(s.columns))...};
+}
+}
+
+/**
+ * All the columns of s, zipped.
+ */
+template<typename... Ts>
+zip_proxy<sequence_proxy<Ts, std::vector<Ts>>...> make_proxy(soa_vector<Ts...> const& s){
+    return detail::zip_columns(s, std::index_sequence_for<Ts...>{});
+}
+
+template<typename... Ts>
+void make_proxy(soa_vector<Ts...> const&& s) = delete;
+
+/**
+ * Evaluates a proxy of tuples (a zip, usually) into a soa_vector.
+ */
+template<typename Proxy, detail::enable_if_proxies<Proxy> = 0>
+typename detail::soa_of<typename Proxy::type>::type make_soa(Proxy const& p){
+    typename detail::soa_of<typename Proxy::type>::type result;
+    std::size_t const size = p.size();
+    result.resize(size);
+    for(std::size_t i = 0; i < size; i += detail::block_size){
+        std::size_t const n = std::min(detail::block_size, size - i);
+        detail::visit_fields(p, i, n, [&result, i, n](auto field, auto const* values){
+            std::copy_n(values, n, std::get<decltype(field)::value>(result.columns).data() + i);
+        });
+    }
+    return result;
+}
+
+/**
+ * The given members of an array of structs, as a soa_vector with one column
+ * for each.
+ */
+template<typename Sequence, typename S, typename... M>
+soa_vector<typename std::remove_cv<M>::type...> make_soa(Sequence const& records, M S::*... members){
+    return make_soa(zip(make_member_proxy(records, members)...));
+}
+
+/**
+ * Evaluates a proxy of tuples into an array of S, one field into each of
+ * the members, in order. The other members of S are value-initialized.
+ */
+template<typename S, typename Proxy, typename... M, detail::enable_if_proxies<Proxy> = 0>
+std::vector<S> make_aos(Proxy const& p, M S::*... members){
+    static_assert(sizeof...(M) == std::tuple_size<typename Proxy::type>::value,
+                  "make_aos needs a member for each field");
+    std::tuple<M S::*...> const to{members...};
+    std::size_t const size = p.size();
+    std::vector<S> result(size);
+    for(std::size_t i = 0; i < size; i += detail::block_size){
+        std::size_t const n = std::min(detail::block_size, size - i);
+        S* const out = result.data() + i;
+        detail::visit_fields(p, i, n, [&to, out, n](auto field, auto const* values){
+            auto const member = std::get<decltype(field)::value>(to);
+            for(std::size_t j = 0; j < n; ++j){
+                out[j].*member = values[j];
+            }
+        });
+    }
+    return result;
+}
+
+template<typename S, typename... Ts, typename... M>
+std::vector<S> make_aos(soa_vector<Ts...> const& s, M S::*... members){
+    return make_aos<S>(make_proxy(s), members...);
+}
+
+}
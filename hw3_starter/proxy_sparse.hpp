@@ -0,0 +1,483 @@
+#pragma once
+
+#include "proxy.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Proxies for sequences that are almost all zeros.
+ *
+ * A sparse sequence stores only its nonzero elements, as a sorted list of
+ * positions and a list of values. Going through a million zeros to add up
+ * ten thousand numbers is a waste, so sparse proxies also offer a cursor
+ * over just the stored elements (see the sparse member in proxy.hpp) and the
+ * nodes here combine cursors instead of positions:
+ * - sparse + sparse merges the two lists of positions (a position is stored
+ *   in the result if it's stored in either side)
+ * - sparse * sparse only keeps the positions stored in both, skipping ahead
+ *   through the longer list with a galloping search
+ * - sparse * dense (or a number) only looks at the dense side where the
+ *   sparse one is stored
+ * Anything else (sparse + dense, sparse | anything, map, ...) is dense, and
+ * is handled by the ordinary proxies, which see a sparse proxy as a proxy
+ * that's zero almost everywhere.
+ *
+ * make_sparse() evaluates an expression to a sparse_vector, and the reductions
+ * (sum, dot, min, max, count_if) only visit the stored elements, so they all
+ * take time proportional to the number of nonzeros, not the size. make_vector()
+ * still gives a dense vector, which costs a pass over the zeros as well.
+ */
+
+namespace proxy{
+
+/**
+ * A sparse sequence of size length: values[k] is at position indices[k], and
+ * every other position is zero. indices has to be strictly increasing.
+ */
+template<typename T>
+struct sparse_vector{
+    std::size_t length = 0;
+    std::vector<std::size_t> indices;
+    std::vector<T> values;
+};
+
+namespace detail{
+template<typename P1, typename P2>
+using enable_if_sparse = typename std::enable_if<
+    is_sparse<P1>::value && is_sparse<P2>::value, int>::type;
+
+template<typename S, typename D>
+using enable_if_sparse_and_dense = typename std::enable_if<
+    is_sparse<S>::value && is_proxy<D>::value && !is_sparse<D>::value, int>::type;
+
+template<typename S, typename T>
+using enable_if_sparse_and_scalar = typename std::enable_if<
+    is_sparse<S>::value && std::is_arithmetic<T>::value, int>::type;
+
+/**
+ * get() and eval() for a sparse proxy, in terms of its cursor: zero
+ * everywhere, except where there's a stored element.
+ */
+template<typename Proxy>
+typename Proxy::type sparse_get(Proxy const& p, std::size_t pos){
+    auto const c = p.begin_at(pos);
+    return !c.done() && c.index() == pos ? c.value() : typename Proxy::type(0);
+}
+
+template<typename Proxy>
+void sparse_eval(Proxy const& p, std::size_t pos, std::size_t count, typename Proxy::type* out){
+    std::fill(out, out + count, typename Proxy::type(0));
+    for(auto c = p.begin_at(pos); !c.done() && c.index() < pos + count; c.next()){
+        out[c.index() - pos] = c.value();
+    }
+}
+}
+
+/**
+ * The leaf: holds a reference to a sparse_vector, which has to outlive it,
+ * like sequence_proxy. It looks at the vector's storage only when it's
+ * used, so the vector can change (and grow) in between.
+ */
+template<typename T>
+class sparse_proxy{
+    sparse_vector<T> const& v;
+
+    std::size_t stored() const {
+        return std::min(v.indices.size(), v.values.size());
+    }
+    public:
+    using type = T;
+    static constexpr bool sparse = true;
+
+    class cursor{
+        std::size_t const* indices;
+        T const* values;
+        std::size_t k;
+        std::size_t stored;
+        public:
+        cursor(std::size_t const* indices, T const* values, std::size_t k, std::size_t stored):
+            indices{indices},
+            values{values},
+            k{k},
+            stored{stored}
+        {}
+        bool done() const {
+            return k == stored;
+        }
+        std::size_t index() const {
+            return indices[k];
+        }
+        T value() const {
+            return values[k];
+        }
+        void next(){
+            ++k;
+        }
+        /**
+         * Galloping search: look 1, 2, 4, ... entries ahead until we're
+         * past pos, then binary search the last step. Skipping over m
+         * entries costs O(log m), so a short list can be intersected with
+         * a long one without walking all of the long one.
+         */
+        void seek(std::size_t pos){
+            if(done() || indices[k] >= pos)
+                return;
+            std::size_t step = 1;
+            while(k + step < stored && indices[k + step] < pos){
+                k += step;
+                step *= 2;
+            }
+            k = std::lower_bound(indices + k + 1, indices + std::min(stored, k + step + 1), pos) - indices;
+        }
+    };
+
+    sparse_proxy(sparse_vector<T> const& v):
+        v(v)
+    {}
+    std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return v.length;
+    }
+    std::size_t nonzeros() const {
+        return stored();
+    }
+    cursor begin_at(std::size_t pos) const {
+        std::size_t const n = stored();
+        std::size_t const* const indices = v.indices.data();
+        std::size_t const k = std::lower_bound(indices, indices + n, pos) - indices;
+        return {indices, v.values.data(), k, n};
+    }
+    T get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return detail::sparse_get(*this, pos);
+    }
+    void eval(std::size_t pos, std::size_t count, T* out) const {
+        PROXY_PROFILE_EVAL(count);
+        detail::sparse_eval(*this, pos, count, out);
+    }
+    bool aliases(void const* first, void const* last) const {
+        std::size_t const n = stored();
+        return n != 0 && (
+            detail::overlaps(v.indices.data(), v.indices.data() + n, first, last) ||
+            detail::overlaps(v.values.data(), v.values.data() + n, first, last));
+    }
+};
+
+template<typename T>
+sparse_proxy<T> make_proxy(sparse_vector<T> const& v){
+    return {v};
+}
+
+template<typename T>
+void make_proxy(sparse_vector<T> const&& v) = delete;
+
+/**
+ * s1 + s2 for two sparse proxies: stored wherever either side is.
+ */
+template<typename P1, typename P2>
+class sparse_adder{
+    P1 p1;
+    P2 p2;
+    public:
+    using type = typename std::common_type<
+        typename P1::type,
+        typename P2::type
+        >::type;
+    static constexpr bool sparse = true;
+
+    class cursor{
+        typename P1::cursor c1;
+        typename P2::cursor c2;
+        bool at1() const {
+            return !c1.done() && (c2.done() || c1.index() <= c2.index());
+        }
+        bool at2() const {
+            return !c2.done() && (c1.done() || c2.index() <= c1.index());
+        }
+        public:
+        cursor(typename P1::cursor const& c1, typename P2::cursor const& c2):
+            c1{c1},
+            c2{c2}
+        {}
+        bool done() const {
+            return c1.done() && c2.done();
+        }
+        std::size_t index() const {
+            return at1() ? c1.index() : c2.index();
+        }
+        type value() const {
+            bool const a = at1();
+            bool const b = at2();
+            if(a && b)
+                return type(c1.value()) + type(c2.value());
+            return a ? type(c1.value()) : type(c2.value());
+        }
+        void next(){
+            bool const a = at1();
+            bool const b = at2();
+            if(a)
+                c1.next();
+            if(b)
+                c2.next();
+        }
+        void seek(std::size_t pos){
+            c1.seek(pos);
+            c2.seek(pos);
+        }
+    };
+
+    sparse_adder(P1 const& p1, P2 const& p2):
+        p1{p1},
+        p2{p2}
+    {}
+    std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return std::min(p1.size(), p2.size());
+    }
+    cursor begin_at(std::size_t pos) const {
+        return {p1.begin_at(pos), p2.begin_at(pos)};
+    }
+    type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return type(p1.get(pos)) + type(p2.get(pos));
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        detail::sparse_eval(*this, pos, count, out);
+    }
+    std::tuple<P1 const&, P2 const&> children() const {
+        return std::tie(p1, p2);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p1, first, last) || detail::may_alias(p2, first, last);
+    }
+};
+
+/**
+ * s1 * s2 for two sparse proxies: only stored where both sides are. The
+ * cursor keeps the two sides lined up by making whichever is behind seek
+ * to the other, so it runs in about the time of the shorter list.
+ */
+template<typename P1, typename P2>
+class sparse_product{
+    P1 p1;
+    P2 p2;
+    public:
+    using type = typename std::common_type<
+        typename P1::type,
+        typename P2::type
+        >::type;
+    static constexpr bool sparse = true;
+
+    class cursor{
+        typename P1::cursor c1;
+        typename P2::cursor c2;
+        void line_up(){
+            while(!c1.done() && !c2.done() && c1.index() != c2.index()){
+                if(c1.index() < c2.index())
+                    c1.seek(c2.index());
+                else
+                    c2.seek(c1.index());
+            }
+        }
+        public:
+        cursor(typename P1::cursor const& c1, typename P2::cursor const& c2):
+            c1{c1},
+            c2{c2}
+        {
+            line_up();
+        }
+        bool done() const {
+            return c1.done() || c2.done();
+        }
+        std::size_t index() const {
+            return c1.index();
+        }
+        type value() const {
+            return type(c1.value()) * type(c2.value());
+        }
+        void next(){
+            c1.next();
+            c2.next();
+            line_up();
+        }
+        void seek(std::size_t pos){
+            c1.seek(pos);
+            c2.seek(pos);
+            line_up();
+        }
+    };
+
+    sparse_product(P1 const& p1, P2 const& p2):
+        p1{p1},
+        p2{p2}
+    {}
+    std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return std::min(p1.size(), p2.size());
+    }
+    cursor begin_at(std::size_t pos) const {
+        return {p1.begin_at(pos), p2.begin_at(pos)};
+    }
+    type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return detail::sparse_get(*this, pos);
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        detail::sparse_eval(*this, pos, count, out);
+    }
+    std::tuple<P1 const&, P2 const&> children() const {
+        return std::tie(p1, p2);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p1, first, last) || detail::may_alias(p2, first, last);
+    }
+};
+
+/**
+ * s * d for a sparse proxy s and a dense proxy (or a number) d: stored
+ * where s is, and d is only asked for the elements at those positions.
+ */
+template<typename S, typename D>
+class sparse_scaled{
+    S s;
+    D d;
+    public:
+    using type = typename std::common_type<
+        typename S::type,
+        typename D::type
+        >::type;
+    static constexpr bool sparse = true;
+
+    class cursor{
+        typename S::cursor c;
+        D const* d;
+        public:
+        cursor(typename S::cursor const& c, D const* d):
+            c{c},
+            d{d}
+        {}
+        bool done() const {
+            return c.done();
+        }
+        std::size_t index() const {
+            return c.index();
+        }
+        type value() const {
+            return type(c.value()) * type(d->get(c.index()));
+        }
+        void next(){
+            c.next();
+        }
+        void seek(std::size_t pos){
+            c.seek(pos);
+        }
+    };
+
+    sparse_scaled(S const& s, D const& d):
+        s{s},
+        d{d}
+    {}
+    std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return std::min(s.size(), d.size());
+    }
+    // the cursor points back at d, so it can't outlive this node
+    cursor begin_at(std::size_t pos) const {
+        return {s.begin_at(pos), &d};
+    }
+    type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return detail::sparse_get(*this, pos);
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        detail::sparse_eval(*this, pos, count, out);
+    }
+    std::tuple<S const&, D const&> children() const {
+        return std::tie(s, d);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(s, first, last) || detail::may_alias(d, first, last);
+    }
+};
+
+template<typename P1, typename P2, detail::enable_if_sparse<P1, P2> = 0>
+sparse_adder<P1, P2> operator+(P1 const& p1, P2 const& p2){
+    return {p1, p2};
+}
+
+template<typename P1, typename P2, detail::enable_if_sparse<P1, P2> = 0>
+sparse_product<P1, P2> operator*(P1 const& p1, P2 const& p2){
+    return {p1, p2};
+}
+
+template<typename S, typename D, detail::enable_if_sparse_and_dense<S, D> = 0>
+sparse_scaled<S, D> operator*(S const& s, D const& d){
+    return {s, d};
+}
+
+// multiplication commutes, so d * s is the same node as s * d
+template<typename D, typename S, detail::enable_if_sparse_and_dense<S, D> = 0>
+sparse_scaled<S, D> operator*(D const& d, S const& s){
+    return {s, d};
+}
+
+template<typename S, typename T, detail::enable_if_sparse_and_scalar<S, T> = 0>
+sparse_scaled<S, scalar_proxy<T>> operator*(S const& s, T t){
+    return {s, scalar_proxy<T>{t}};
+}
+
+template<typename T, typename S, detail::enable_if_sparse_and_scalar<S, T> = 0>
+sparse_scaled<S, scalar_proxy<T>> operator*(T t, S const& s){
+    return {s, scalar_proxy<T>{t}};
+}
+
+namespace detail{
+template<typename Proxy>
+void make_sparse(Proxy const& p, sparse_vector<typename Proxy::type>& v, sparse_tag){
+    for(auto c = p.begin_at(0); !c.done() && c.index() < v.length; c.next()){
+        auto const x = c.value();
+        // cancellations (1 + -1) come out as stored zeros, drop them
+        if(x != typename Proxy::type(0)){
+            v.indices.push_back(c.index());
+            v.values.push_back(x);
+        }
+    }
+}
+
+template<typename Proxy>
+void make_sparse(Proxy const& p, sparse_vector<typename Proxy::type>& v, random_access_tag){
+    typename Proxy::type buffer[block_size];
+    for(std::size_t i = 0; i < v.length; i += block_size){
+        std::size_t const n = std::min(block_size, v.length - i);
+        evaluate(p, i, n, buffer);
+        for(std::size_t j = 0; j < n; ++j){
+            if(buffer[j] != typename Proxy::type(0)){
+                v.indices.push_back(i + j);
+                v.values.push_back(buffer[j]);
+            }
+        }
+    }
+}
+}
+
+/**
+ * Evaluates p into a sparse_vector, keeping only the nonzero elements. For a
+ * sparse expression this only visits the stored elements; a dense one is
+ * evaluated in full and its zeros are left out.
+ */
+template<typename Proxy, detail::enable_if_proxies<Proxy> = 0>
+sparse_vector<typename Proxy::type> make_sparse(Proxy const& p){
+    sparse_vector<typename Proxy::type> v;
+    v.length = p.size();
+    detail::make_sparse(p, v, detail::category_of<Proxy>{});
+    return v;
+}
+
+}
@@ -0,0 +1,447 @@
+#pragma once
+
+#include "proxy.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+/**
+ * Streams that read from outside the program: a file descriptor (a pipe, a
+ * socket, a file) or a std::istream. They have no size and can't seek, so
+ * they're streams rather than proxies, and go anywhere filter() does: in
+ * +, *, | with other streams and proxies, make_vector, the reductions and
+ * evaluate_to_file.
+ *
+ * Reading is double buffered. A background thread fills one buffer while the
+ * expression works through the other, so as long as evaluating a buffer is
+ * quicker than reading one, the whole pipeline runs at the speed of the input.
+ * A buffer is handed over with whatever one read() brought in, so values
+ * from a pipe or a socket that sends slowly are passed on as they come.
+ */
+
+namespace proxy{
+
+/**
+ * How the values are written down in the input:
+ * - binary : raw values in the machine's byte order, like mmap_proxy
+ * - text : numbers separated by whitespace, like you'd read with >>
+ */
+enum class encoding{
+    binary,
+    text
+};
+
+/**
+ * Each of the two buffers holds up to this many bytes of values, and each
+ * read() system call asks for that much. Big enough that a read() costs
+ * nothing next to the data, small enough that both buffers sit in L2 while
+ * they're used.
+ */
+constexpr std::size_t stream_buffer_bytes = std::size_t{256} << 10;
+
+namespace detail{
+template<typename T>
+using if_integral = typename std::enable_if<std::is_integral<T>::value, bool>::type;
+
+template<typename T>
+using if_floating = typename std::enable_if<std::is_floating_point<T>::value, bool>::type;
+
+template<typename T, if_integral<T> = true>
+bool parse_number(std::string const& token, T& out){
+    char* end;
+    errno = 0;
+    if(std::is_signed<T>::value){
+        long long const x = std::strtoll(token.c_str(), &end, 10);
+        out = static_cast<T>(x);
+        return static_cast<long long>(out) == x && errno == 0 && *end == '\0';
+    }
+    unsigned long long const x = std::strtoull(token.c_str(), &end, 10);
+    out = static_cast<T>(x);
+    return token[0] != '-' && static_cast<unsigned long long>(out) == x
+        && errno == 0 && *end == '\0';
+}
+
+template<typename T, if_floating<T> = true>
+bool parse_number(std::string const& token, T& out){
+    char* end;
+    out = static_cast<T>(std::strtold(token.c_str(), &end));
+    return *end == '\0';
+}
+
+inline bool is_space(char c){
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+/**
+ * Thrown out of a read that was interrupted (see wakeup).
+ */
+struct read_interrupted{};
+
+/**
+ * A pipe to interrupt reads with: once signal() has been called, its fd()
+ * is readable for good, and read_some gives up instead of waiting for
+ * input.
+ */
+class wakeup{
+    int fds[2];
+    public:
+    wakeup(){
+        if(::pipe(fds) != 0)
+            throw std::system_error(errno, std::generic_category(), "can't make a pipe");
+        ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    }
+    wakeup(wakeup const&) = delete;
+    wakeup& operator=(wakeup const&) = delete;
+    ~wakeup(){
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+    int fd() const {
+        return fds[0];
+    }
+    void signal(){
+        char const c = 0;
+        while(::write(fds[1], &c, 1) < 0 && errno == EINTR){}
+    }
+};
+
+/**
+ * One read(2) of up to bytes bytes: returns how many it got, which is 0 only
+ * at the end of the input. First it waits for fd or interrupt to be readable
+ * (a pipe or a socket can keep it waiting for ever), and throws
+ * read_interrupted if it's interrupt.
+ */
+inline std::size_t read_some(int fd, char* out, std::size_t bytes, int interrupt){
+    for(;;){
+        pollfd ready[2] = {{fd, POLLIN, 0}, {interrupt, POLLIN, 0}};
+        if(::poll(ready, 2, -1) < 0){
+            if(errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::generic_category(), "can't wait for stream");
+        }
+        if(ready[1].revents != 0)
+            throw read_interrupted{};
+        ssize_t const got = ::read(fd, out, bytes);
+        if(got < 0){
+            if(errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::generic_category(), "can't read from stream");
+        }
+        return static_cast<std::size_t>(got);
+    }
+}
+
+/**
+ * Where the reader thread gets its values from: fill(out, count, interrupt)
+ * writes up to count values and returns how many. It returns as soon as it
+ * has some, and 0 only at the end of the input. It gives up with
+ * read_interrupted if the interrupt fd becomes readable while it waits.
+ */
+template<typename T>
+class fd_source{
+    int fd;
+    encoding format;
+    // the start of a value that's been read, but not the rest of it yet
+    char carried[sizeof(T)];
+    std::size_t carried_bytes = 0;
+    std::vector<char> text;
+    std::size_t text_pos = 0;
+    bool text_done = false;
+    std::string partial;
+
+    std::size_t fill_binary(T* out, std::size_t count, int interrupt){
+        char* const bytes = reinterpret_cast<char*>(out);
+        std::size_t have = carried_bytes;
+        std::copy_n(carried, carried_bytes, bytes);
+        while(have < sizeof(T)){
+            std::size_t const got = read_some(fd, bytes + have, count * sizeof(T) - have, interrupt);
+            if(got == 0){
+                // a partial value at the very end is dropped, like mmap_proxy does
+                carried_bytes = 0;
+                return 0;
+            }
+            have += got;
+        }
+        std::size_t const n = have / sizeof(T);
+        carried_bytes = have - n * sizeof(T);
+        std::copy_n(bytes + n * sizeof(T), carried_bytes, carried);
+        return n;
+    }
+
+    // the next whitespace separated token of text, or false at the end. A
+    // token runs on to the whitespace after it, so one at the end of what's
+    // been read so far waits in partial; without wait, that's where it's
+    // left rather than reading more.
+    bool next_token(std::string& token, int interrupt, bool wait){
+        for(;;){
+            if(text_pos == text.size()){
+                if(text_done || !wait){
+                    if(!text_done || partial.empty())
+                        return false;
+                    token.swap(partial);
+                    partial.clear();
+                    return true;
+                }
+                text.resize(stream_buffer_bytes);
+                text.resize(read_some(fd, text.data(), text.size(), interrupt));
+                text_pos = 0;
+                text_done = text.empty();
+                continue;
+            }
+            char const c = text[text_pos++];
+            if(!is_space(c)){
+                partial += c;
+            }else if(!partial.empty()){
+                token.swap(partial);
+                partial.clear();
+                return true;
+            }
+        }
+    }
+    public:
+    fd_source(int fd, encoding format):
+        fd{fd},
+        format{format}
+    {}
+    std::size_t fill(T* out, std::size_t count, int interrupt){
+        if(format == encoding::binary)
+            return fill_binary(out, count, interrupt);
+        // waits for the first value, then takes the others that are in
+        std::string token;
+        std::size_t n = 0;
+        for(; n < count && next_token(token, interrupt, n == 0); ++n){
+            if(!parse_number(token, out[n]))
+                throw std::invalid_argument("not a number in stream: " + token);
+        }
+        return n;
+    }
+};
+
+/**
+ * An istream has no way to wait for input that can be interrupted, or to
+ * tell how much has come in, so this one ignores the interrupt fd and fills
+ * as much of out as it can: a read that's waiting for input finishes when
+ * the input comes or ends.
+ */
+template<typename T>
+class istream_source{
+    std::istream& in;
+    encoding format;
+    public:
+    istream_source(std::istream& in, encoding format):
+        in(in),
+        format{format}
+    {}
+    std::size_t fill(T* out, std::size_t count, int){
+        if(format == encoding::binary){
+            in.read(reinterpret_cast<char*>(out), static_cast<std::streamsize>(count * sizeof(T)));
+            return static_cast<std::size_t>(in.gcount()) / sizeof(T);
+        }
+        std::size_t n = 0;
+        while(n < count && in >> out[n]){
+            ++n;
+        }
+        if(n < count && !in.eof())
+            throw std::invalid_argument("not a number in stream");
+        return n;
+    }
+};
+
+/**
+ * The two buffers and the thread that fills them. The reader and the
+ * consumer pass the buffers back and forth: the reader only touches a buffer
+ * that's empty, the consumer only one that's full, and the mutex is only
+ * taken to hand one over, never while copying values.
+ *
+ * interrupt() (and the destructor) stop the reader even in the middle of a
+ * read that's waiting for input, through a wakeup pipe.
+ */
+template<typename T>
+class double_buffer{
+    struct buffer{
+        std::vector<T> values;
+        std::size_t count = 0;
+        bool full = false;
+        bool last = false;
+    };
+
+    buffer buffers[2];
+    std::function<std::size_t(T*, std::size_t, int)> fill;
+    wakeup interrupted;
+    std::mutex m;
+    std::condition_variable changed;
+    std::exception_ptr error;
+    bool stopping = false;
+    std::size_t current = 0;
+    std::size_t pos = 0;
+    bool finished = false;
+    std::thread reader;
+
+    void run(){
+        for(std::size_t next = 0;; next ^= 1){
+            buffer& b = buffers[next];
+            {
+                std::unique_lock<std::mutex> l(m);
+                changed.wait(l, [&]{ return stopping || !b.full; });
+                if(stopping)
+                    return;
+            }
+            std::size_t got = 0;
+            std::exception_ptr failed;
+            try{
+                got = fill(b.values.data(), b.values.size(), interrupted.fd());
+            }catch(...){
+                failed = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> l(m);
+                if(stopping)
+                    return;
+                b.count = got;
+                b.last = failed || got == 0;
+                b.full = true;
+                error = failed;
+            }
+            changed.notify_all();
+            if(b.last)
+                return;
+        }
+    }
+
+    public:
+    template<typename Source>
+    explicit double_buffer(Source source):
+        fill{[source](T* out, std::size_t count, int interrupt) mutable {
+            return source.fill(out, count, interrupt);
+        }}
+    {
+        std::size_t const capacity = std::max<std::size_t>(stream_buffer_bytes / sizeof(T), 1);
+        buffers[0].values.resize(capacity);
+        buffers[1].values.resize(capacity);
+        reader = std::thread([this]{ run(); });
+    }
+    double_buffer(double_buffer const&) = delete;
+    double_buffer& operator=(double_buffer const&) = delete;
+    ~double_buffer(){
+        interrupt();
+        reader.join();
+    }
+    /**
+     * Stops the reader, and makes read() return what it has from now on, as
+     * if the input ended there.
+     */
+    void interrupt(){
+        {
+            std::lock_guard<std::mutex> l(m);
+            if(stopping)
+                return;
+            stopping = true;
+        }
+        interrupted.signal();
+        changed.notify_all();
+    }
+    std::size_t read(T* out, std::size_t count){
+        std::size_t produced = 0;
+        while(produced < count && !finished){
+            buffer& b = buffers[current];
+            {
+                std::unique_lock<std::mutex> l(m);
+                changed.wait(l, [&]{ return b.full || stopping; });
+                if(!b.full){
+                    finished = true;
+                    break;
+                }
+                if(b.last && error)
+                    std::rethrow_exception(error);
+            }
+            std::size_t const n = std::min(count - produced, b.count - pos);
+            std::copy_n(b.values.data() + pos, n, out + produced);
+            produced += n;
+            pos += n;
+            if(pos == b.count){
+                if(b.last){
+                    finished = true;
+                    break;
+                }
+                {
+                    std::lock_guard<std::mutex> l(m);
+                    b.full = false;
+                }
+                changed.notify_all();
+                current ^= 1;
+                pos = 0;
+            }
+        }
+        return produced;
+    }
+};
+}
+
+/**
+ * A stream of Ts read from a file descriptor or a std::istream. Copies share
+ * the input (and the reader thread), so once an input_stream has been read by
+ * make_vector or a reduction, it's used up.
+ *
+ * The file descriptor or istream isn't owned: it has to stay open for as long
+ * as any copy of the stream is around. Dropping the last copy stops the
+ * reader thread, even if it's waiting on a pipe or a socket that's open but
+ * idle (an istream has to give it some input, or end, first).
+ */
+template<typename T>
+class input_stream{
+    static_assert(std::is_arithmetic<T>::value, "input_stream reads numbers");
+    std::shared_ptr<detail::double_buffer<T>> buffers;
+    public:
+    using type = T;
+    input_stream(int fd, encoding format = encoding::binary):
+        buffers{std::make_shared<detail::double_buffer<T>>(detail::fd_source<T>{fd, format})}
+    {}
+    input_stream(std::istream& in, encoding format = encoding::binary):
+        buffers{std::make_shared<detail::double_buffer<T>>(detail::istream_source<T>{in, format})}
+    {}
+    std::size_t read(T* out, std::size_t count){
+        return buffers->read(out, count);
+    }
+    /**
+     * Stops reading, for every copy: a read() that's waiting for input
+     * returns what it has, and the ones after it return 0, as if the input
+     * ended. make_pipeline calls it on its source when the pipeline stops.
+     */
+    void interrupt() const {
+        buffers->interrupt();
+    }
+};
+
+/**
+ * Starts reading Ts from fd (binary or text) straight away, on another thread.
+ */
+template<typename T>
+input_stream<T> make_stream(int fd, encoding format = encoding::binary){
+    return {fd, format};
+}
+
+template<typename T>
+input_stream<T> make_stream(std::istream& in, encoding format = encoding::binary){
+    return {in, format};
+}
+
+}
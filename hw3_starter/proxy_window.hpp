@@ -0,0 +1,336 @@
+#pragma once
+
+#include "proxy.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Sliding windows.
+ *
+ * shift(p, k) is p moved along by k positions, which is all a stencil needs:
+ *
+ *     shift(p, -1) + p + shift(p, 1)      // p[i-1] + p[i] + p[i+1]
+ *
+ * rolling_sum/mean/min/max(p, w) look at the window of the w elements
+ * ending at each position, p[i-w+1] .. p[i]. The first w-1 windows are cut
+ * short by the start of p (rolling_mean divides by the number of elements
+ * actually in the window), so every rolling proxy is as long as p and lines
+ * up with it and with its shifts.
+ *
+ * get() works out a window from scratch, which is O(w). eval() goes along
+ * the range keeping the window's state up to date instead - a running sum,
+ * or for min and max a monotonic deque of the elements that can still be
+ * the smallest (largest) of some window - so it's O(1) per element after
+ * the first window. Inside a bigger expression eval() is called a block at
+ * a time, and each call starts from a fresh window, which costs O(w) per
+ * block; evaluate the rolling proxy on its own first if w is much larger
+ * than detail::block_size.
+ */
+
+namespace proxy{
+
+/**
+ * shift(p, k).get(i) is p.get(i + k), or fill where that's outside p. It's
+ * as long as p.
+ */
+template<typename P>
+class shift_proxy{
+    public:
+    using type = typename P::type;
+    private:
+    P p;
+    std::ptrdiff_t offset;
+    type fill;
+    public:
+    constexpr shift_proxy(P const& p, std::ptrdiff_t offset, type fill):
+        p{p},
+        offset{offset},
+        fill{fill}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return p.size();
+    }
+    type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        std::ptrdiff_t const from = static_cast<std::ptrdiff_t>(pos) + offset;
+        return from >= 0 && static_cast<std::size_t>(from) < p.size()
+            ? p.get(static_cast<std::size_t>(from)) : fill;
+    }
+    // the part of the range that's inside p is passed on as one run
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        std::ptrdiff_t const n = static_cast<std::ptrdiff_t>(p.size());
+        std::ptrdiff_t const from = static_cast<std::ptrdiff_t>(pos) + offset;
+        std::ptrdiff_t const to = from + static_cast<std::ptrdiff_t>(count);
+        std::ptrdiff_t const first = std::min(std::max(from, std::ptrdiff_t{0}), to);
+        std::ptrdiff_t const last = std::max(std::min(to, n), first);
+        std::fill(out, out + (first - from), fill);
+        detail::evaluate(p, static_cast<std::size_t>(first), static_cast<std::size_t>(last - first),
+                         out + (first - from));
+        std::fill(out + (last - from), out + count, fill);
+    }
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p, first, last);
+    }
+};
+
+template<typename P, detail::enable_if_proxies<P> = 0>
+constexpr shift_proxy<P> shift(P const& p, std::ptrdiff_t k, typename P::type fill = typename P::type{}){
+    return {p, k, fill};
+}
+
+namespace detail{
+inline std::size_t check_window(std::size_t w){
+    if(w == 0)
+        throw std::invalid_argument("proxy: a window has to have at least one element");
+    return w;
+}
+
+// the first position in the window that ends at pos
+inline std::size_t window_start(std::size_t pos, std::size_t w){
+    return pos >= w - 1 ? pos - (w - 1) : 0;
+}
+}
+
+/**
+ * The sum of each window, in the type sum() would use. Going along, each
+ * step adds the element that comes in and takes away the one that drops
+ * out; with floating point those roundings add up, so results can differ
+ * in the last bits from adding each window up afresh.
+ */
+template<typename P>
+class rolling_sum_proxy{
+    P p;
+    std::size_t w;
+    public:
+    using type = detail::accumulator_t<typename P::type>;
+    rolling_sum_proxy(P const& p, std::size_t w):
+        p{p},
+        w{detail::check_window(w)}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return p.size();
+    }
+    constexpr std::size_t window() const {
+        return w;
+    }
+    type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        type acc = type(0);
+        for(std::size_t i = detail::window_start(pos, w); i <= pos; ++i){
+            acc += type(p.get(i));
+        }
+        return acc;
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        type in[detail::block_size];
+        type gone[detail::block_size];
+        // the window that ends just before pos
+        type acc = type(0);
+        for(std::size_t i = pos >= w ? pos - w : 0; i < pos; i += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, pos - i);
+            detail::evaluate_as<type>(p, i, n, in);
+            for(std::size_t j = 0; j < n; ++j){
+                acc += in[j];
+            }
+        }
+        for(std::size_t i = 0; i < count; i += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, count - i);
+            std::size_t const at = pos + i;
+            detail::evaluate_as<type>(p, at, n, in);
+            // p[at + j - w] drops out as p[at + j] comes in, once there's one
+            std::size_t const full = at >= w ? 0 : std::min(n, w - at);
+            if(full < n)
+                detail::evaluate_as<type>(p, at + full - w, n - full, gone + full);
+            for(std::size_t j = 0; j < full; ++j){
+                acc += in[j];
+                out[i + j] = acc;
+            }
+            for(std::size_t j = full; j < n; ++j){
+                acc += in[j] - gone[j];
+                out[i + j] = acc;
+            }
+        }
+    }
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p, first, last);
+    }
+};
+
+/**
+ * The mean of each window: floating point like the elements, or double for
+ * integers.
+ */
+template<typename P>
+class rolling_mean_proxy{
+    rolling_sum_proxy<P> sums;
+    using sum_type = typename rolling_sum_proxy<P>::type;
+    public:
+    using type = typename std::conditional<
+        std::is_floating_point<sum_type>::value, sum_type, double>::type;
+    rolling_mean_proxy(P const& p, std::size_t w):
+        sums{p, w}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return sums.size();
+    }
+    type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        return type(sums.get(pos)) / type(std::min(sums.window(), pos + 1));
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        std::size_t const w = sums.window();
+        sum_type buffer[detail::block_size];
+        for(std::size_t i = 0; i < count; i += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, count - i);
+            detail::evaluate_as<sum_type>(sums, pos + i, n, buffer);
+            for(std::size_t j = 0; j < n; ++j){
+                out[i + j] = type(buffer[j]) / type(std::min(w, pos + i + j + 1));
+            }
+        }
+    }
+    std::tuple<rolling_sum_proxy<P> const&> children() const {
+        return std::tie(sums);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return sums.aliases(first, last);
+    }
+};
+
+/**
+ * The smallest (Compare = std::less) or largest (std::greater) element of
+ * each window.
+ *
+ * Going along, it keeps a deque of the window's elements that are better
+ * than every element after them: anything an incoming element beats can
+ * never be the answer for a later window, so it's dropped from the back,
+ * and the front is the answer for the current window until it drops out.
+ * Every element goes in and out once, so that's O(1) per element.
+ */
+template<typename P, typename Compare>
+class rolling_extreme_proxy{
+    P p;
+    std::size_t w;
+    public:
+    using type = typename P::type;
+    rolling_extreme_proxy(P const& p, std::size_t w):
+        p{p},
+        w{detail::check_window(w)}
+    {}
+    constexpr std::size_t size() const {
+        PROXY_PROFILE_CALL(sizes);
+        return p.size();
+    }
+    type get(std::size_t pos) const {
+        PROXY_PROFILE_CALL(gets);
+        Compare const better{};
+        std::size_t const start = detail::window_start(pos, w);
+        type best = p.get(start);
+        for(std::size_t i = start + 1; i <= pos; ++i){
+            type const x = p.get(i);
+            if(better(x, best))
+                best = x;
+        }
+        return best;
+    }
+    void eval(std::size_t pos, std::size_t count, type* out) const {
+        PROXY_PROFILE_EVAL(count);
+        if(count == 0)
+            return;
+        Compare const better{};
+        std::size_t const start = detail::window_start(pos, w);
+        std::size_t const end = pos + count;
+        // the deque is a ring buffer; it never holds more than a window
+        std::size_t const capacity = std::min(w, end - start);
+        std::size_t small_positions[detail::block_size];
+        type small_values[detail::block_size];
+        std::vector<std::size_t> large_positions;
+        std::vector<type> large_values;
+        std::size_t* positions = small_positions;
+        type* values = small_values;
+        if(capacity > detail::block_size){
+            large_positions.resize(capacity);
+            large_values.resize(capacity);
+            positions = large_positions.data();
+            values = large_values.data();
+        }
+        std::size_t front = 0;
+        std::size_t length = 0;
+
+        type in[detail::block_size];
+        for(std::size_t at = start; at < end; at += detail::block_size){
+            std::size_t const n = std::min(detail::block_size, end - at);
+            detail::evaluate(p, at, n, in);
+            for(std::size_t j = 0; j < n; ++j){
+                std::size_t const i = at + j;
+                if(length != 0 && positions[front] + w <= i){
+                    front = front + 1 == capacity ? 0 : front + 1;
+                    --length;
+                }
+                while(length != 0){
+                    std::size_t back = front + length - 1;
+                    back = back >= capacity ? back - capacity : back;
+                    if(better(values[back], in[j]))
+                        break;
+                    --length;
+                }
+                std::size_t slot = front + length;
+                slot = slot >= capacity ? slot - capacity : slot;
+                positions[slot] = i;
+                values[slot] = in[j];
+                ++length;
+                if(i >= pos)
+                    out[i - pos] = values[front];
+            }
+        }
+    }
+    std::tuple<P const&> children() const {
+        return std::tie(p);
+    }
+    bool aliases(void const* first, void const* last) const {
+        return detail::may_alias(p, first, last);
+    }
+};
+
+/**
+ * The rolling proxies for windows of w elements (std::invalid_argument if w
+ * is 0). See the top of this file for how the windows line up.
+ */
+template<typename P, detail::enable_if_proxies<P> = 0>
+rolling_sum_proxy<P> rolling_sum(P const& p, std::size_t w){
+    return {p, w};
+}
+
+template<typename P, detail::enable_if_proxies<P> = 0>
+rolling_mean_proxy<P> rolling_mean(P const& p, std::size_t w){
+    return {p, w};
+}
+
+template<typename P, detail::enable_if_proxies<P> = 0>
+rolling_extreme_proxy<P, std::less<typename P::type>> rolling_min(P const& p, std::size_t w){
+    return {p, w};
+}
+
+template<typename P, detail::enable_if_proxies<P> = 0>
+rolling_extreme_proxy<P, std::greater<typename P::type>> rolling_max(P const& p, std::size_t w){
+    return {p, w};
+}
+
+}
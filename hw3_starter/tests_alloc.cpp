@@ -0,0 +1,148 @@
+#include "catch.hpp"
+#include "proxy_alloc.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <string>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+bool aligned(void const* p, std::size_t align){
+    return reinterpret_cast<std::uintptr_t>(p) % align == 0;
+}
+}
+
+TEST_CASE("make_container"){
+    std::vector<int> const a{1, 2, 3, 4, 5};
+    auto const p = make_proxy(a) * 2;
+    CHECK(make_container<std::deque<int>>(p) == std::deque<int>{2, 4, 6, 8, 10});
+    CHECK(make_container<std::list<int>>(p) == std::list<int>{2, 4, 6, 8, 10});
+    // the elements are converted as if one at a time
+    CHECK(make_container<std::vector<double>>(p) == std::vector<double>{2, 4, 6, 8, 10});
+    CHECK(make_container<std::vector<bool>>(make_proxy(a) + -3) ==
+          std::vector<bool>{true, true, false, true, true});
+    std::string const s{"abc"};
+    CHECK(make_container<std::string>(map([](char c){ return char(c - 32); }, make_proxy(s))) == "ABC");
+
+    // longer than a block, and streams too
+    std::vector<int> b(1000);
+    for(std::size_t i = 0; i < b.size(); ++i) b[i] = int(i);
+    auto const q = make_proxy(b) + 1;
+    auto const d = make_container<std::deque<int>>(q);
+    REQUIRE(d.size() == 1000);
+    CHECK(d[999] == 1000);
+    auto const kept = make_container<std::deque<long>>(filter(greater_than(500), make_proxy(b)));
+    REQUIRE(kept.size() == 499);
+    CHECK(kept.front() == 501);
+    CHECK(make_container<std::vector<int>>(as_stream(q)) == make_vector(q));
+    CHECK(make_container<std::list<int>>(as_stream(make_proxy(a))) == std::list<int>{1, 2, 3, 4, 5});
+}
+
+TEST_CASE("arena"){
+    arena a{1024};
+    CHECK(a.capacity() == 0);
+    void* const first = a.allocate(10, 1);
+    void* const second = a.allocate(100, 64);
+    CHECK(aligned(second, 64));
+    CHECK(static_cast<char*>(second) >= static_cast<char*>(first) + 10);
+    CHECK(a.allocate(0) != a.allocate(0));
+    std::size_t const one = a.capacity();
+    CHECK(one >= 1024);
+
+    // a request bigger than the block gets a block of its own
+    void* const big = a.allocate(5000, 64);
+    CHECK(aligned(big, 64));
+    std::size_t const two = a.capacity();
+    CHECK(two >= one + 5000);
+
+    // once reset, the same blocks are used again, from the start
+    a.reset();
+    CHECK(a.allocate(10, 1) == first);
+    CHECK(a.allocate(5000, 64) == big);
+    CHECK(a.capacity() == two);
+
+    a.release();
+    CHECK(a.capacity() == 0);
+    CHECK(a.allocate(8) != nullptr);
+}
+
+TEST_CASE("make_vector into an arena"){
+    std::vector<float> const x(300, 1.5f);
+    arena a;
+    for(int round = 0; round < 3; ++round){
+        std::size_t const before = a.capacity();
+        for(int i = 0; i < 100; ++i){
+            auto const v = make_vector(make_proxy(x) * float(i), a);
+            REQUIRE(v.size() == 300);
+            CHECK(v[299] == 1.5f * float(i));
+            CHECK(aligned(v.data(), simd_alignment));
+        }
+        // nothing more from the heap after the first round
+        if(round > 0)
+            CHECK(a.capacity() == before);
+        a.reset();
+    }
+
+    // any container with the arena's allocator
+    auto const d = make_container<std::deque<float, arena_allocator<float>>>(make_proxy(x) + 1.f, a);
+    CHECK(d[150] == 2.5f);
+    std::vector<char, arena_allocator<char>> small(a);
+    small.push_back('x');
+    CHECK(aligned(small.data(), simd_alignment));
+    CHECK(arena_allocator<int>(a) == arena_allocator<char>(a));
+    arena other;
+    CHECK(arena_allocator<int>(a) != arena_allocator<int>(other));
+}
+
+TEST_CASE("aligned_allocator"){
+    std::vector<double> const x{1, 2, 3};
+    for(int i = 0; i < 20; ++i){
+        auto const v = make_vector(make_proxy(x) + double(i), aligned_allocator<double>{});
+        static_assert(std::is_same<decltype(v), aligned_vector<double> const>::value, "");
+        CHECK(v == aligned_vector<double>{1.0 + i, 2.0 + i, 3.0 + i});
+        CHECK(aligned(v.data(), 64));
+    }
+    std::vector<char, aligned_allocator<char, 4096>> page(10);
+    CHECK(aligned(page.data(), 4096));
+}
+
+TEST_CASE("default_init_allocator"){
+    // as a vector it's like any other; only elements made without a value
+    // are left as they come
+    uninitialized_vector<int> v(1000);
+    std::fill(v.begin(), v.end(), 3);
+    v.resize(1500, 4);
+    v.push_back(5);
+    CHECK(v.size() == 1501);
+    CHECK(std::count(v.begin(), v.end(), 3) == 1000);
+    CHECK(std::count(v.begin(), v.end(), 4) == 500);
+    CHECK(v.back() == 5);
+
+    std::vector<std::string, default_init_allocator<std::string>> names(2);
+    CHECK(names[0].empty());
+    names.emplace_back(3, 'x');
+    CHECK(names[2] == "xxx");
+
+    std::vector<double> const x{1, 2, 3};
+    CHECK(make_vector(make_proxy(x) * 2.0, default_init_allocator<double>{}) ==
+          uninitialized_vector<double>{2, 4, 6});
+}
+
+#ifdef PROXY_HAS_MEMORY_RESOURCE
+TEST_CASE("std::pmr"){
+    std::vector<int> const x{3, 1, 4, 1, 5};
+    arena a;
+    arena_resource r{a};
+    auto const v = make_container<std::pmr::vector<int>>(make_proxy(x) + 1, &r);
+    CHECK(v == std::pmr::vector<int>{4, 2, 5, 2, 6});
+    CHECK(aligned(v.data(), simd_alignment));
+    CHECK(a.capacity() > 0);
+
+    std::pmr::monotonic_buffer_resource m;
+    CHECK(make_container<std::pmr::vector<double>>(make_proxy(x), &m).back() == 5.0);
+}
+#endif
@@ -0,0 +1,80 @@
+#include "catch.hpp"
+#include "proxy.hpp"
+#include <stdexcept>
+#include <vector>
+
+using namespace proxy;
+
+TEST_CASE("evaluate into existing storage"){
+    std::vector<int> a{1,2,3}, b{1,1,1};
+    std::vector<int> out(5, -1);
+    int const* const before = out.data();
+    CHECK(evaluate_into(out, make_proxy(a)+make_proxy(b)) == 3);
+    CHECK(out == std::vector<int>{2,3,4,-1,-1});
+    CHECK(out.data() == before);
+
+    int raw[2];
+    CHECK_THROWS_AS(evaluate_into(span<int>(raw), make_proxy(a)), std::length_error);
+}
+
+TEST_CASE("assign resizes"){
+    std::vector<float> a{1,2,3}, b{4,5}, out;
+    out.reserve(10);
+    float const* const before = out.data();
+    assign(out, make_proxy(a)|make_proxy(b));
+    CHECK(out == std::vector<float>{1,2,3,4,5});
+    assign(out, make_proxy(a)*make_proxy(a));
+    CHECK(out == std::vector<float>{1,4,9});
+    CHECK(out.data() == before);
+}
+
+TEST_CASE("compound assignment"){
+    std::vector<int> a{1,2,3}, b{10,20,30,40};
+    into(a) += make_proxy(b);
+    CHECK(a == std::vector<int>{11,22,33});
+    into(a) *= make_proxy(b)+make_proxy(b);
+    CHECK(a == std::vector<int>{220,880,1980});
+    into(a) = make_proxy(b);
+    CHECK(a == std::vector<int>{10,20,30});
+    std::vector<int> shorter{1};
+    CHECK_THROWS_AS(into(a) += make_proxy(shorter), std::length_error);
+}
+
+TEST_CASE("destination is also an input"){
+    std::vector<int> a(1000), b(1000, 1);
+    for(std::size_t i = 0; i < a.size(); ++i) a[i] = i;
+
+    // elementwise, evaluated block by block straight into a
+    assign(a, make_proxy(b)+make_proxy(a));
+    for(std::size_t i = 0; i < a.size(); ++i){
+        REQUIRE(a[i] == int(i) + 1);
+    }
+
+    // a's elements move, so this needs the temporary
+    std::vector<int> c{7,8}, d{1,2,3};
+    assign(d, make_proxy(c)|make_proxy(d));
+    CHECK(d == std::vector<int>{7,8,1,2,3});
+    into(d) = make_proxy(c)|make_proxy(d);
+    CHECK(d == std::vector<int>{7,8,7,8,1});
+}
+
+TEST_CASE("destination overlaps an input shifted"){
+    // elementwise, but dest[i] is src[i + 1]: every block would overwrite the
+    // first element of the next one before it's read
+    std::vector<int> a(1000);
+    for(std::size_t i = 0; i < a.size(); ++i) a[i] = int(i);
+    span<int> const src(a.data(), 999);
+    CHECK(evaluate_into(span<int>(a.data() + 1, 999), make_proxy(src) + 0) == 999);
+    CHECK(a[0] == 0);
+    for(std::size_t i = 1; i < a.size(); ++i){
+        REQUIRE(a[i] == int(i) - 1);
+    }
+
+    // and the other way
+    for(std::size_t i = 0; i < a.size(); ++i) a[i] = int(i);
+    span<int> const later(a.data() + 1, 999);
+    evaluate_into(span<int>(a.data(), 999), make_proxy(later) * make_proxy(later));
+    for(std::size_t i = 0; i < 999; ++i){
+        REQUIRE(a[i] == int((i + 1) * (i + 1)));
+    }
+}
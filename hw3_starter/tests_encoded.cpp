@@ -0,0 +1,237 @@
+#include "catch.hpp"
+#include "proxy_encoded.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+// runs of 1 to 7 elements, of values that repeat now and then
+std::vector<int> runs_of(std::size_t n, int seed){
+    std::vector<int> v;
+    int value = seed;
+    while(v.size() < n){
+        std::size_t const length = 1 + std::size_t(value * 7 + seed) % 7;
+        for(std::size_t i = 0; i < length && v.size() < n; ++i) v.push_back(value % 5);
+        value = value * 3 + 1;
+        value %= 1000;
+    }
+    return v;
+}
+
+template<typename T>
+std::vector<T> ramp(std::size_t n, T first, T step){
+    std::vector<T> v(n);
+    for(std::size_t i = 0; i < n; ++i) v[i] = T(first + T(i) * step);
+    return v;
+}
+}
+
+TEST_CASE("make_rle gives back the sequence, with equal neighbours merged"){
+    std::vector<int> const x = runs_of(1000, 1);
+    auto const r = make_rle(make_proxy(x));
+    CHECK(r.size() == x.size());
+    CHECK(r.values.size() < x.size());
+    for(std::size_t k = 1; k < r.values.size(); ++k){
+        CHECK(r.values[k] != r.values[k - 1]);
+        CHECK(r.ends[k] > r.ends[k - 1]);
+    }
+    auto const p = make_proxy(r);
+    CHECK(p.size() == x.size());
+    CHECK(p.run_count() == r.values.size());
+    CHECK(make_vector(p) == x);
+    for(std::size_t i = 0; i < x.size(); i += 37) CHECK(p.get(i) == x[i]);
+
+    // and from a stream
+    auto const streamed = make_rle(as_stream(make_proxy(x)));
+    CHECK(make_vector(make_proxy(streamed)) == x);
+
+    std::vector<int> const none;
+    auto const empty = make_rle(make_proxy(none));
+    CHECK(empty.size() == 0);
+    CHECK(make_vector(make_proxy(empty)).empty());
+}
+
+TEST_CASE("sums and products of run-length proxies are run-length"){
+    std::vector<int> const x = runs_of(1000, 1);
+    std::vector<int> const y = runs_of(900, 2);
+    auto const rx = make_rle(make_proxy(x));
+    auto const ry = make_rle(make_proxy(y));
+
+    auto const sum_xy = make_proxy(rx) + make_proxy(ry);
+    auto const product_xy = make_proxy(rx) * make_proxy(ry);
+    auto const affine = make_proxy(rx) * 2 + 1;
+    auto const affine_left = 1 + 2 * make_proxy(rx);
+    static_assert(detail::is_run_length<decltype(sum_xy)>::value, "");
+    static_assert(detail::is_run_length<decltype(product_xy)>::value, "");
+    static_assert(detail::is_run_length<decltype(affine)>::value, "");
+    static_assert(detail::is_run_length<decltype(affine_left)>::value, "");
+    static_assert(std::is_same<decltype(make_proxy(rx) * 0.5)::type, double>::value, "");
+
+    CHECK(sum_xy.size() == 900);
+    CHECK(make_vector(sum_xy) == make_vector(make_proxy(x) + make_proxy(y)));
+    CHECK(make_vector(product_xy) == make_vector(make_proxy(x) * make_proxy(y)));
+    CHECK(make_vector(affine) == make_vector(make_proxy(x) * 2 + 1));
+    CHECK(make_vector(affine_left) == make_vector(make_proxy(x) * 2 + 1));
+    CHECK(make_vector(make_proxy(rx) * 0.5) == make_vector(make_proxy(x) * 0.5));
+
+    // merging gives no more runs than the two sides have between them
+    auto const merged = make_rle(sum_xy);
+    CHECK(merged.values.size() <= rx.values.size() + ry.values.size());
+    CHECK(make_vector(make_proxy(merged)) == make_vector(sum_xy));
+    for(std::size_t i = 0; i < 900; i += 31) CHECK(sum_xy.get(i) == x[i] + y[i]);
+
+    // nested
+    auto const nested = (make_proxy(rx) + make_proxy(ry)) * make_proxy(rx) + 3;
+    static_assert(detail::is_run_length<decltype(nested)>::value, "");
+    CHECK(make_vector(nested) == make_vector((make_proxy(x) + make_proxy(y)) * make_proxy(x) + 3));
+
+    // with a dense proxy it's an ordinary sum
+    auto const mixed = make_proxy(rx) + make_proxy(y);
+    static_assert(!detail::is_run_length<decltype(mixed)>::value, "");
+    CHECK(make_vector(mixed) == make_vector(make_proxy(x) + make_proxy(y)));
+}
+
+TEST_CASE("run-length proxies evaluate anywhere and reduce a run at a time"){
+    std::vector<int> const x = runs_of(2000, 3);
+    auto const r = make_rle(make_proxy(x));
+    auto const p = make_proxy(r) * 3 + 1;
+    auto const dense = make_vector(make_proxy(x) * 3 + 1);
+
+    for(std::size_t pos : {0, 1, 5, 255, 1000, 1999}){
+        for(std::size_t count : {0, 1, 7, 300}){
+            if(pos + count > dense.size()) continue;
+            std::vector<int> out(count);
+            p.eval(pos, count, out.data());
+            CHECK(out == std::vector<int>(dense.begin() + pos, dense.begin() + pos + count));
+        }
+    }
+    CHECK(make_vector(slice(p, 100, 200)) == std::vector<int>(dense.begin() + 100, dense.begin() + 200));
+
+    CHECK(sum(p) == sum(make_proxy(dense)));
+    CHECK(sum<long long>(make_proxy(r)) == sum<long long>(make_proxy(x)));
+    CHECK(min(p) == min(make_proxy(dense)));
+    CHECK(max(p) == max(make_proxy(dense)));
+    CHECK(count_if(p, [](int v){ return v > 7; }) == count_if(make_proxy(dense), [](int v){ return v > 7; }));
+
+    rle_vector<int> const none;
+    CHECK(sum(make_proxy(none)) == 0);
+    CHECK_THROWS_AS(min(make_proxy(none)), std::invalid_argument);
+}
+
+TEST_CASE("encoded expressions see their vectors change"){
+    rle_vector<int> r{{1}, {2}};
+    auto const e = make_proxy(r) * 3 + 1;
+    CHECK(make_vector(e) == std::vector<int>{4, 4});
+    // enough runs that the storage moves
+    for(std::size_t k = 0; k < 1000; ++k){
+        r.values.push_back(int(k % 2));
+        r.ends.push_back(r.ends.back() + 1);
+    }
+    CHECK(e.size() == 1002);
+    CHECK(sum(e) == 8 + 500 * 1 + 500 * 4);
+
+    std::vector<int> const x = ramp<int>(10, 0, 1);
+    auto d = make_delta(make_proxy(x));
+    auto const p = make_proxy(d);
+    CHECK(sum(p) == 45);
+    std::vector<int> const longer = ramp<int>(2000, 0, 1);
+    d = make_delta(make_proxy(longer));
+    CHECK(p.size() == 2000);
+    CHECK(sum<long long>(p) == 1999000);
+}
+
+TEST_CASE("delta encoding gives back the sequence at every size"){
+    for(std::size_t n : {0, 1, 2, 255, 256, 257, 1000}){
+        std::vector<int> x(n);
+        for(std::size_t i = 0; i < n; ++i) x[i] = int(i * i % 97) - 40;
+        auto const d = make_delta(make_proxy(x));
+        CHECK(d.size() == n);
+        CHECK(d.blocks.size() == (n + 255) / 256);
+        auto const p = make_proxy(d);
+        CHECK(p.size() == n);
+        CHECK(make_vector(p) == x);
+        for(std::size_t i = 0; i < n; i += 13) CHECK(p.get(i) == x[i]);
+    }
+}
+
+TEST_CASE("delta encoding packs small differences small"){
+    // timestamps a millisecond or so apart
+    std::vector<std::int64_t> t(10000);
+    std::int64_t now = 1700000000000;
+    for(std::size_t i = 0; i < t.size(); ++i){
+        now += 1000 + std::int64_t(i * 7919 % 200);
+        t[i] = now;
+    }
+    auto const d = make_delta(make_proxy(t));
+    CHECK(d.packed.size() < t.size() + d.blocks.size());
+    CHECK(d.bytes() * 4 < t.size() * sizeof(std::int64_t));
+    CHECK(make_vector(make_proxy(d)) == t);
+    CHECK(sum(make_proxy(d)) == sum(make_proxy(t)));
+
+    // evenly spaced needs no differences at all
+    auto const even = ramp<std::int64_t>(1000, 5, 3);
+    auto const de = make_delta(make_proxy(even));
+    CHECK(de.packed.empty());
+    for(auto const& b : de.blocks) CHECK(b.width == 0);
+    CHECK(make_vector(make_proxy(de)) == even);
+
+    // falling is as good as rising
+    auto const falling = ramp<int>(1000, 100000, -3);
+    auto const df = make_delta(make_proxy(falling));
+    CHECK(df.packed.empty());
+    CHECK(make_vector(make_proxy(df)) == falling);
+}
+
+TEST_CASE("delta encoding copes with any differences and any integer type"){
+    std::vector<std::int64_t> const extremes{
+        std::numeric_limits<std::int64_t>::max(), std::numeric_limits<std::int64_t>::min(),
+        0, -1, std::numeric_limits<std::int64_t>::max(), 1, std::numeric_limits<std::int64_t>::min()};
+    auto const de = make_delta(make_proxy(extremes));
+    CHECK(de.blocks[0].width == 8);
+    CHECK(make_vector(make_proxy(de)) == extremes);
+
+    std::vector<std::uint8_t> bytes(600);
+    for(std::size_t i = 0; i < bytes.size(); ++i) bytes[i] = std::uint8_t(i * 37);
+    auto const db = make_delta(make_proxy(bytes));
+    CHECK(make_vector(make_proxy(db)) == bytes);
+
+    std::vector<std::int16_t> shorts(600);
+    for(std::size_t i = 0; i < shorts.size(); ++i) shorts[i] = std::int16_t(int(i % 50) * 1000 - 25000);
+    auto const ds = make_delta(make_proxy(shorts));
+    CHECK(ds.blocks[0].width == 2);
+    CHECK(make_vector(make_proxy(ds)) == shorts);
+
+    std::vector<std::uint32_t> words(600);
+    for(std::size_t i = 0; i < words.size(); ++i) words[i] = std::uint32_t(i * 2654435761u);
+    auto const dw = make_delta(make_proxy(words));
+    CHECK(make_vector(make_proxy(dw)) == words);
+
+    // from an expression
+    std::vector<int> const x = ramp<int>(700, 0, 2);
+    auto const dx = make_delta(make_proxy(x) + 5);
+    CHECK(make_vector(make_proxy(dx)) == make_vector(make_proxy(x) + 5));
+}
+
+TEST_CASE("delta proxies evaluate from anywhere"){
+    std::vector<int> x(1000);
+    for(std::size_t i = 0; i < x.size(); ++i) x[i] = int(i * 3 + i % 11);
+    auto const d = make_delta(make_proxy(x));
+    auto const p = make_proxy(d);
+    for(std::size_t pos : {0, 1, 100, 255, 256, 300, 999}){
+        for(std::size_t count : {0, 1, 2, 255, 256, 600}){
+            if(pos + count > x.size()) continue;
+            std::vector<int> out(count);
+            p.eval(pos, count, out.data());
+            CHECK(out == std::vector<int>(x.begin() + pos, x.begin() + pos + count));
+        }
+    }
+    CHECK(make_vector(slice(p, 250, 520)) == std::vector<int>(x.begin() + 250, x.begin() + 520));
+    CHECK(make_vector(p * 2 + make_proxy(x)) == make_vector(make_proxy(x) * 3));
+    CHECK(p.aliases(d.packed.data(), d.packed.data() + 1));
+    CHECK(!p.aliases(x.data(), x.data() + x.size()));
+}
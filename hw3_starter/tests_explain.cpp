@@ -0,0 +1,107 @@
+#include "catch.hpp"
+#include "proxy_explain.hpp"
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+std::vector<std::string> lines(std::string const& text){
+    std::vector<std::string> result;
+    std::istringstream in{text};
+    for(std::string line; std::getline(in, line);) result.push_back(line);
+    return result;
+}
+
+bool contains(std::string const& text, std::string const& part){
+    return text.find(part) != std::string::npos;
+}
+}
+
+TEST_CASE("explain draws the tree"){
+    std::vector<double> const a(1000, 1.0), b(1000, 2.0), c(1000, 3.0), d(1000, 4.0);
+    auto const e = ((make_proxy(a) | make_proxy(b)) + make_proxy(c)) * make_proxy(d);
+    auto const text = explain(e);
+    INFO(text);
+    auto const l = lines(text);
+    REQUIRE(l.size() == 8);
+    CHECK(l[0].compare(0, 14, "product_proxy<") == 0);
+    CHECK(contains(l[0], "[double, size 1000]: block"));
+    CHECK(l[1].compare(0, 15, "|- adder_proxy<") == 0);
+    CHECK(l[2].compare(0, 17, "|  |- pipe_proxy<") == 0);
+    CHECK(l[3].compare(0, 24, "|  |  |- sequence_proxy<") == 0);
+    CHECK(l[4].compare(0, 24, "|  |  `- sequence_proxy<") == 0);
+    CHECK(contains(l[4], ": block (copy)"));
+    CHECK(l[5].compare(0, 21, "|  `- sequence_proxy<") == 0);
+    CHECK(l[6].compare(0, 18, "`- sequence_proxy<") == 0);
+    CHECK(l[7] == "evaluated on one thread (1000 elements is below parallel_threshold, 65536)");
+    // namespaces are left out, and so are arguments deeper than a level
+    CHECK_FALSE(contains(text, "proxy::"));
+    CHECK_FALSE(contains(text, "std::"));
+    CHECK(contains(l[0], "<adder_proxy<...>, sequence_proxy<...> >"));
+}
+
+TEST_CASE("explain tells how each node is evaluated"){
+    std::vector<double> const a(100, 1.0), b(100, 2.0);
+    auto const fused = explain(make_proxy(a) * make_proxy(b) + 1.0);
+    INFO(fused);
+    CHECK(contains(lines(fused)[0], detail::fuse_multiply_add ? "(fused multiply-add)" : "]: block"));
+    CHECK(lines(fused)[4] == "`- scalar_proxy<double> [double, unbounded]: block (fill)");
+
+    auto const absolute = explain(abs(make_proxy(a)));
+    INFO(absolute);
+#if defined(__SSE2__)
+    CHECK(contains(lines(absolute)[0], ": SIMD"));
+#endif
+
+    std::vector<int> const v{1, 2, 3};
+    auto const unknown = explain(map([](int i){ return i + 1; }, make_proxy(v)));
+    CHECK(contains(lines(unknown)[0], "[int, size 3]: block"));
+
+    auto const plain = explain(repeat(make_proxy(v), 3));
+    CHECK(contains(lines(plain)[0], "[int, size 9]: "));
+
+    auto const kept = explain(filter(greater_than(1), make_proxy(v)));
+    INFO(kept);
+    auto const l = lines(kept);
+    REQUIRE(l.size() == 4);
+    CHECK(l[0].compare(0, 13, "filter_proxy<") == 0);
+    CHECK(contains(l[0], "[int, size unknown]: stream"));
+    CHECK(l[1].compare(0, 16, "`- cursor_stream") == 0);
+    CHECK(l[2].compare(0, 21, "   `- sequence_proxy<") == 0);
+    CHECK(l[3] == "evaluated on one thread, front to back");
+}
+
+TEST_CASE("explain says how a long expression is split"){
+    std::vector<float> const a(1000000, 1.f);
+    auto const text = explain(make_proxy(a) + 1.f);
+    INFO(text);
+    auto const l = lines(text);
+    CHECK(contains(l[0], "[float, size 1000000]"));
+    // 64 KiB chunks of floats
+    CHECK(l.back() == "evaluated in parallel with make_vector_parallel and the pool reductions, "
+                      "62 chunks of up to 16384 elements");
+
+    std::ostringstream out;
+    explain(make_proxy(a), out);
+    CHECK(lines(out.str()).size() == 2);
+    CHECK(lines(out.str()).back() == l.back());
+}
+
+TEST_CASE("type names are shortened"){
+    CHECK(detail::short_type_name("proxy::a<proxy::b<std::c<int> >, d>", 1) == "a<b<...>, d>");
+    CHECK(detail::short_type_name("proxy::a<proxy::b<std::c<int> >, d>", 2) == "a<b<c<...> >, d>");
+    CHECK(detail::short_type_name("(anonymous namespace)::f", 3) == "f");
+}
+
+#ifndef PROXY_PROFILE
+TEST_CASE("profiling is off by default"){
+    std::vector<int> const v{1, 2, 3};
+    CHECK(make_vector(make_proxy(v) + 1) == std::vector<int>{2, 3, 4});
+    CHECK(profile_report().empty());
+    std::ostringstream out;
+    print_profile(out);
+    CHECK(contains(out.str(), "profiling is off"));
+}
+#endif
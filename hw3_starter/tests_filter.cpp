@@ -0,0 +1,77 @@
+#include "catch.hpp"
+#include "proxy.hpp"
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+using namespace proxy;
+
+TEST_CASE("filter"){
+    std::vector<int> a{5,1,8,3,9,2,7};
+    CHECK(
+        make_vector(filter([](int x){ return x > 4; }, make_proxy(a)))
+        == std::vector<int>{5,8,9,7});
+    CHECK(make_vector(filter([](int){ return false; }, make_proxy(a))).empty());
+    CHECK(make_vector(filter(greater_than(100), make_proxy(a))).empty());
+}
+
+TEST_CASE("filter of an expression, read in pieces"){
+    std::vector<int> a(1000), b(1000, 1);
+    std::iota(a.begin(), a.end(), 0);
+    auto odd = filter([](int x){ return x % 2 == 1; }, make_proxy(a)+make_proxy(b));
+
+    std::vector<int> pieces;
+    int buffer[7];
+    std::size_t got;
+    while((got = odd.read(buffer, 7)) > 0){
+        pieces.insert(pieces.end(), buffer, buffer + got);
+    }
+    CHECK(odd.read(buffer, 7) == 0);
+    REQUIRE(pieces.size() == 500);
+    for(std::size_t i = 0; i < pieces.size(); ++i){
+        CHECK(pieces[i] == int(2 * i + 1));
+    }
+}
+
+TEST_CASE("filter of a filter"){
+    std::vector<int> a(100);
+    std::iota(a.begin(), a.end(), 0);
+    auto const f = filter(less_than(10), filter([](int x){ return x % 3 == 0; }, make_proxy(a)));
+    CHECK(make_vector(f) == std::vector<int>{0,3,6,9});
+    // consuming a stream works on a copy, so f can be used again
+    CHECK(make_vector(f).size() == 4);
+}
+
+TEST_CASE("SIMD compaction matches the scalar version"){
+    std::vector<float> a(1037);
+    std::vector<int> b(1037);
+    for(std::size_t i = 0; i < a.size(); ++i){
+        a[i] = std::sin(i * 0.37f) * 100;
+        b[i] = int(a[i]);
+    }
+    a[17] = std::numeric_limits<float>::quiet_NaN();
+
+    std::vector<float> above, below;
+    std::vector<int> int_above, int_below;
+    for(std::size_t i = 0; i < a.size(); ++i){
+        if(a[i] > 12.5f) above.push_back(a[i]);
+        if(a[i] < 12.5f) below.push_back(a[i]);
+        if(b[i] > -7) int_above.push_back(b[i]);
+        if(b[i] < -7) int_below.push_back(b[i]);
+    }
+    CHECK(make_vector(filter(greater_than(12.5f), make_proxy(a))) == above);
+    CHECK(make_vector(filter(less_than(12.5f), make_proxy(a))) == below);
+    CHECK(make_vector(filter(greater_than(-7), make_proxy(b))) == int_above);
+    CHECK(make_vector(filter(less_than(-7), make_proxy(b))) == int_below);
+}
+
+TEST_CASE("reductions over streams"){
+    std::vector<int> a{1,2,3,4,5,6,7,8,9,10};
+    auto const big = filter(greater_than(5), make_proxy(a));
+    CHECK(sum(big) == 40);
+    CHECK(min(big) == 6);
+    CHECK(max(big) == 10);
+    CHECK(count_if(big, [](int x){ return x % 2 == 0; }) == 3);
+    CHECK_THROWS_AS(min(filter(greater_than(50), make_proxy(a))), std::invalid_argument);
+}
@@ -0,0 +1,84 @@
+#include "catch.hpp"
+#include "proxy.hpp"
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace proxy;
+
+TEST_CASE("scalar broadcast"){
+    std::vector<float> a{1,2,3};
+    CHECK(make_vector(2.0f*make_proxy(a)) == std::vector<float>{2,4,6});
+    CHECK(make_vector(make_proxy(a)+1) == std::vector<float>{2,3,4});
+    CHECK(make_vector(1+make_proxy(a)*make_proxy(a)) == std::vector<float>{2,5,10});
+    CHECK((make_proxy(a)*3).size() == 3);
+
+    std::array<int, 4> b{{1,2,3,4}};
+    static_assert(decltype(make_proxy(b)*2)::extent == 4, "");
+    CHECK(make_array(make_proxy(b)*2+1) == (std::array<int, 4>{{3,5,7,9}}));
+}
+
+TEST_CASE("map"){
+    std::vector<int> a{1,2,3}, b{10,20,30,40};
+    CHECK(
+        make_vector(map([](int x){ return x * x; }, make_proxy(a)))
+        == std::vector<int>{1,4,9});
+    CHECK(
+        make_vector(map([](int x, int y, int z){ return x + y * z; },
+                        make_proxy(a), make_proxy(b), make_scalar(2)))
+        == std::vector<int>{21,42,63});
+    // a predicate gives a proxy of bools
+    CHECK(
+        make_vector(map([](int x){ return x % 2 == 1; }, make_proxy(b)|make_proxy(a)))
+        == std::vector<bool>{false,false,false,false,true,false,true});
+}
+
+TEST_CASE("known functors match their scalar versions"){
+    float const nan = std::numeric_limits<float>::quiet_NaN();
+    std::vector<float> a(300), b(300);
+    for(std::size_t i = 0; i < a.size(); ++i){
+        a[i] = (i % 2 ? -1.f : 1.f) * i / 7.f;
+        b[i] = 20.f - i / 5.f;
+    }
+    a[3] = nan;
+    a[10] = -0.f;
+    b[4] = nan;
+
+    auto const same = [](std::vector<float> const& v, std::vector<float> const& w){
+        for(std::size_t i = 0; i < v.size(); ++i){
+            if(!(v[i] == w[i] && std::signbit(v[i]) == std::signbit(w[i])) &&
+               !(std::isnan(v[i]) && std::isnan(w[i])))
+                return false;
+        }
+        return v.size() == w.size();
+    };
+    // make_vector goes through the block (SIMD) path, get() is one at a time
+    auto const one_at_a_time = [](auto const& p){
+        std::vector<float> v;
+        for(std::size_t i = 0; i < p.size(); ++i) v.push_back(p.get(i));
+        return v;
+    };
+
+    auto const absolute = abs(make_proxy(a));
+    auto const root = sqrt(abs(make_proxy(a)));
+    auto const low = minimum(make_proxy(a), make_proxy(b));
+    auto const high = maximum(make_proxy(a), make_proxy(b));
+    auto const clamped = clamp(make_proxy(a), -3.f, 4.f);
+    CHECK(same(make_vector(absolute), one_at_a_time(absolute)));
+    CHECK(make_vector(absolute)[10] == 0.f);
+    CHECK(!std::signbit(make_vector(absolute)[10]));
+    CHECK(same(make_vector(root), one_at_a_time(root)));
+    CHECK(same(make_vector(low), one_at_a_time(low)));
+    CHECK(same(make_vector(high), one_at_a_time(high)));
+    CHECK(same(make_vector(clamped), one_at_a_time(clamped)));
+    CHECK(max(clamped) == 4.f);
+}
+
+TEST_CASE("functors on doubles and ints"){
+    std::vector<double> a{-4, 9, -16};
+    CHECK(make_vector(sqrt(abs(make_proxy(a)))) == std::vector<double>{2,3,4});
+    std::vector<int> b{-4, 9, -16};
+    CHECK(make_vector(abs(make_proxy(b))) == std::vector<int>{4,9,16});
+    CHECK(make_vector(clamp(make_proxy(b), -5, 5)) == std::vector<int>{-4,5,-5});
+}
@@ -0,0 +1,171 @@
+#include "catch.hpp"
+#include "proxy_matrix.hpp"
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+template<typename T>
+matrix<T> numbered(std::size_t rows, std::size_t cols, int seed){
+    matrix<T> m{rows, cols, std::vector<T>(rows * cols)};
+    for(std::size_t i = 0; i < m.values.size(); ++i){
+        m.values[i] = T(int((i * 7 + std::size_t(seed) * 13) % 19) - 9);
+    }
+    return m;
+}
+
+template<typename M>
+matrix<typename M::type> by_elements(M const& m){
+    matrix<typename M::type> result{m.rows(), m.cols(), {}};
+    for(std::size_t r = 0; r < m.rows(); ++r){
+        for(std::size_t c = 0; c < m.cols(); ++c){
+            result.values.push_back(m.get(r, c));
+        }
+    }
+    return result;
+}
+
+template<typename M1, typename M2>
+matrix<typename M1::type> naive_matmul(M1 const& a, M2 const& b){
+    matrix<typename M1::type> c{a.rows(), b.cols(), std::vector<typename M1::type>(a.rows() * b.cols())};
+    for(std::size_t i = 0; i < a.rows(); ++i){
+        for(std::size_t j = 0; j < b.cols(); ++j){
+            typename M1::type x = 0;
+            for(std::size_t p = 0; p < a.cols(); ++p){
+                x += a.get(i, p) * b.get(p, j);
+            }
+            c.values[i * b.cols() + j] = x;
+        }
+    }
+    return c;
+}
+}
+
+TEST_CASE("matrix leaves"){
+    std::vector<int> const v{1, 2, 3, 4, 5, 6};
+    auto const rm = make_matrix_proxy(v, 2, 3);
+    auto const cm = make_matrix_proxy<col_major>(v, 2, 3);
+    CHECK(rm.get(1, 0) == 4);
+    CHECK(cm.get(1, 0) == 2);
+    CHECK(cm.get(0, 2) == 5);
+    CHECK(make_matrix(rm).values == v);
+    CHECK(make_matrix(cm).values == std::vector<int>{1, 3, 5, 2, 4, 6});
+    CHECK_THROWS_AS(make_matrix_proxy(v, 3, 3), std::length_error);
+
+    auto const m = numbered<double>(3, 4, 1);
+    CHECK(make_matrix(make_proxy(m)).values == m.values);
+}
+
+TEST_CASE("matrix expressions see their matrices change"){
+    auto m = numbered<int>(2, 3, 1);
+    auto const e = make_proxy(m) + make_proxy(m);
+    auto const t = transpose(make_proxy(m));
+    // bigger, so the storage moves
+    m = numbered<int>(40, 50, 2);
+    CHECK(e.rows() == 40);
+    CHECK(e.cols() == 50);
+    CHECK(t.rows() == 50);
+    CHECK(t.cols() == 40);
+    std::vector<int> doubled;
+    for(int x : m.values) doubled.push_back(2 * x);
+    CHECK(make_matrix(e).values == doubled);
+    CHECK(t.get(7, 3) == m.values[3 * 50 + 7]);
+    CHECK(make_matrix(t).values == by_elements(t).values);
+
+    std::vector<int> v{1, 2, 3, 4};
+    auto const rm = make_matrix_proxy(v, 2, 2);
+    v.assign({5, 6, 7, 8});
+    v.reserve(1000);
+    CHECK(make_matrix(rm).values == v);
+}
+
+TEST_CASE("transpose"){
+    auto const m = numbered<float>(45, 70, 2);
+    auto const t = transpose(make_proxy(m));
+    // the transpose of a leaf is a leaf in the other order
+    static_assert(std::is_same<decltype(t), matrix_proxy<float, col_major> const>::value, "");
+    static_assert(std::is_same<decltype(transpose(t)), matrix_proxy<float, row_major>>::value, "");
+    CHECK(t.rows() == 70);
+    CHECK(t.cols() == 45);
+    CHECK(t.get(3, 40) == m.values[40 * 70 + 3]);
+    CHECK(make_matrix(t).values == by_elements(t).values);
+
+    // and of anything else, a transpose_proxy
+    auto const e = transpose(make_proxy(m) + make_proxy(m));
+    static_assert(std::is_same<decltype(transpose(e)),
+                  matrix_adder<matrix_proxy<float>, matrix_proxy<float>>>::value, "");
+    CHECK(make_matrix(e).values == by_elements(e).values);
+    CHECK(make_matrix(transpose(e)).values == make_matrix(make_proxy(m) + make_proxy(m)).values);
+}
+
+TEST_CASE("elementwise operations"){
+    auto const a = numbered<double>(70, 45, 3);
+    auto const b = numbered<double>(45, 70, 4);
+    auto const c = numbered<int>(70, 45, 5);
+    // mixed layouts and element types, and sizes that aren't whole tiles
+    auto const e = (make_proxy(a) + transpose(make_proxy(b))) * make_proxy(c);
+    static_assert(std::is_same<decltype(e)::type, double>::value, "int and double make double");
+    auto const result = make_matrix(e);
+    CHECK(result.rows == 70);
+    CHECK(result.cols == 45);
+    CHECK(result.values == by_elements(e).values);
+    CHECK(result.values[45 + 2] == (a.values[45 + 2] + b.values[2 * 70 + 1]) * c.values[45 + 2]);
+
+    CHECK_THROWS_AS(make_proxy(a) + make_proxy(b), std::invalid_argument);
+}
+
+TEST_CASE("aliasing"){
+    auto const a = numbered<float>(4, 4, 6);
+    auto const b = numbered<float>(4, 4, 7);
+    auto const e = transpose(make_proxy(a) * make_proxy(b));
+    CHECK(e.aliases(a.values.data(), a.values.data() + 1));
+    CHECK(e.aliases(b.values.data() + 15, b.values.data() + 16));
+    CHECK_FALSE(e.aliases(b.values.data() + 16, b.values.data() + 17));
+}
+
+TEST_CASE("matmul"){
+    SECTION("small and odd sizes"){
+        for(std::size_t n : {1, 2, 5, 7, 17, 33}){
+            auto const a = numbered<double>(n, n + 3, 1);
+            auto const b = numbered<double>(n + 3, 2 * n + 1, 2);
+            CHECK(matmul(make_proxy(a), make_proxy(b)).values
+                  == naive_matmul(make_proxy(a), make_proxy(b)).values);
+        }
+    }
+    SECTION("bigger than one block in every direction"){
+        // small integers, so float is exact whatever the order of the sums
+        auto const a = numbered<float>(301, 530, 3);
+        auto const b = numbered<float>(530, 2100, 4);
+        auto const c = matmul(make_proxy(a), make_proxy(b));
+        CHECK(c.rows == 301);
+        CHECK(c.cols == 2100);
+        CHECK(c.values == naive_matmul(make_proxy(a), make_proxy(b)).values);
+    }
+    SECTION("transposed and expression operands"){
+        auto const a = numbered<double>(40, 90, 5);
+        auto const b = numbered<double>(40, 90, 6);
+        auto const c = numbered<double>(90, 40, 7);
+        auto const ab = matmul(make_proxy(a), transpose(make_proxy(b)));
+        CHECK(ab.values == naive_matmul(make_proxy(a), transpose(make_proxy(b))).values);
+        auto const e = matmul(transpose(make_proxy(a) + make_proxy(b)), transpose(make_proxy(c)));
+        CHECK(e.values == naive_matmul(transpose(make_proxy(a) + make_proxy(b)),
+                                       transpose(make_proxy(c))).values);
+    }
+    SECTION("integers"){
+        auto const a = numbered<int>(13, 300, 8);
+        auto const b = numbered<int>(300, 11, 9);
+        CHECK(matmul(make_proxy(a), make_proxy(b)).values
+              == naive_matmul(make_proxy(a), make_proxy(b)).values);
+    }
+    SECTION("empty and mismatched"){
+        auto const a = numbered<double>(3, 0, 1);
+        auto const b = numbered<double>(0, 4, 1);
+        auto const c = matmul(make_proxy(a), make_proxy(b));
+        CHECK(c.values == std::vector<double>(12, 0.0));
+        CHECK_THROWS_AS(matmul(make_proxy(a), make_proxy(a)), std::invalid_argument);
+    }
+}
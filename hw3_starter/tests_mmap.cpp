@@ -0,0 +1,75 @@
+#include "catch.hpp"
+#include "proxy_mmap.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace proxy;
+
+namespace{
+// a file in /tmp that's removed again at the end of the test
+struct temporary_file{
+    std::string path;
+    temporary_file(){
+        char name[] = "/tmp/proxy_mmap_XXXXXX";
+        int const fd = ::mkstemp(name);
+        REQUIRE(fd >= 0);
+        ::close(fd);
+        path = name;
+    }
+    ~temporary_file(){
+        std::remove(path.c_str());
+    }
+};
+
+template<typename T>
+void write_raw(std::string const& path, std::vector<T> const& v){
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<char const*>(v.data()), v.size() * sizeof(T));
+}
+}
+
+TEST_CASE("mmap leaf"){
+    temporary_file file;
+    std::vector<float> a(100000);
+    for(std::size_t i = 0; i < a.size(); ++i) a[i] = i * 0.5f;
+    write_raw(file.path, a);
+
+    mmap_proxy<float> const m(file.path);
+    CHECK(m.size() == a.size());
+    CHECK(make_vector(m) == a);
+    std::vector<float> ones(a.size(), 1);
+    CHECK(make_vector(m*2.f+make_proxy(ones)) == make_vector(make_proxy(a)*2.f+make_proxy(ones)));
+    CHECK(sum<double>(m) == sum<double>(make_proxy(a)));
+}
+
+TEST_CASE("mmap of ints, empty and missing files"){
+    temporary_file file;
+    write_raw(file.path, std::vector<std::int32_t>{1,-2,3});
+    CHECK(make_vector(mmap_proxy<std::int32_t>(file.path, access::normal)) == std::vector<std::int32_t>{1,-2,3});
+
+    temporary_file empty;
+    CHECK(mmap_proxy<double>(empty.path).size() == 0);
+    CHECK_THROWS_AS(mmap_proxy<int>("/nonexistent/proxy/file"), std::system_error);
+}
+
+TEST_CASE("evaluate to file"){
+    temporary_file in, out;
+    std::vector<std::int32_t> a(3 * file_chunk_bytes / sizeof(std::int32_t) + 5);
+    for(std::size_t i = 0; i < a.size(); ++i) a[i] = static_cast<std::int32_t>(i % 1000);
+    write_raw(in.path, a);
+
+    mmap_proxy<std::int32_t> const m(in.path, access::streaming);
+    CHECK(evaluate_to_file(m+m, out.path) == a.size());
+    CHECK(make_vector(mmap_proxy<std::int32_t>(out.path)) == make_vector(make_proxy(a)+make_proxy(a)));
+
+    // streams work too
+    CHECK(evaluate_to_file(filter(less_than(10), m), out.path)
+          == count_if(make_proxy(a), [](std::int32_t x){ return x < 10; }));
+    CHECK(max(mmap_proxy<std::int32_t>(out.path)) == 9);
+}
@@ -0,0 +1,146 @@
+#include "catch.hpp"
+#include "proxy_narrow.hpp"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+using namespace proxy;
+
+TEST_CASE("widen computes int8 in int32"){
+    std::vector<std::int8_t> a(1000), b(1000);
+    for(std::size_t i = 0; i < a.size(); ++i){
+        a[i] = static_cast<std::int8_t>(int(i * 37 % 256) - 128);
+        b[i] = static_cast<std::int8_t>(int(i * 91 % 256) - 128);
+    }
+    auto const e = widen(make_proxy(a)) * widen(make_proxy(b)) + widen(make_proxy(a));
+    static_assert(std::is_same<decltype(e)::type, std::int32_t>::value, "computes in int32");
+    std::vector<std::int32_t> const result = make_vector(e);
+    REQUIRE(result.size() == a.size());
+    for(std::size_t i = 0; i < a.size(); ++i){
+        CHECK(result[i] == int(a[i]) * int(b[i]) + int(a[i]));
+    }
+}
+
+TEST_CASE("saturate narrows without wrapping"){
+    std::vector<std::int32_t> a{-100000, -129, -128, -1, 0, 127, 128, 100000};
+    CHECK(make_vector(saturate<std::int8_t>(make_proxy(a)))
+          == std::vector<std::int8_t>{-128, -128, -128, -1, 0, 127, 127, 127});
+    CHECK(make_vector(saturate<std::uint8_t>(make_proxy(a)))
+          == std::vector<std::uint8_t>{0, 0, 0, 0, 0, 127, 128, 255});
+    CHECK(make_vector(saturate<std::int16_t>(make_proxy(a)))
+          == std::vector<std::int16_t>{-32768, -129, -128, -1, 0, 127, 128, 32767});
+
+    std::vector<std::uint32_t> big{0, 70000, 4000000000u};
+    CHECK(make_vector(saturate<std::int32_t>(make_proxy(big)))
+          == std::vector<std::int32_t>{0, 70000, 2147483647});
+
+    float const inf = std::numeric_limits<float>::infinity();
+    std::vector<float> f{-1e10f, -3.7f, 3.7f, 1e10f, inf, -inf, std::nanf("")};
+    CHECK(make_vector(saturate<std::int16_t>(make_proxy(f)))
+          == std::vector<std::int16_t>{-32768, -3, 3, 32767, 32767, -32768, 0});
+    CHECK(make_vector(saturate<std::int32_t>(make_proxy(f)))
+          == std::vector<std::int32_t>{
+              std::numeric_limits<std::int32_t>::min(), -3, 3,
+              std::numeric_limits<std::int32_t>::max(),
+              std::numeric_limits<std::int32_t>::max(),
+              std::numeric_limits<std::int32_t>::min(), 0});
+}
+
+TEST_CASE("block and element paths agree"){
+    std::vector<std::int32_t> a(1001);
+    std::vector<std::int16_t> b(1001);
+    std::vector<std::uint8_t> c(1001);
+    for(std::size_t i = 0; i < a.size(); ++i){
+        a[i] = int(i * 7919 % 200003) - 100001;
+        b[i] = static_cast<std::int16_t>(i * 131);
+        c[i] = static_cast<std::uint8_t>(i * 13);
+    }
+    auto const to8 = saturate<std::int8_t>(make_proxy(a));
+    auto const tou8 = saturate<std::uint8_t>(make_proxy(a));
+    auto const to16 = saturate<std::int16_t>(make_proxy(a));
+    auto const wide = widen(make_proxy(b)) + widen(make_proxy(c));
+    std::vector<std::int8_t> const v8 = make_vector(to8);
+    std::vector<std::uint8_t> const vu8 = make_vector(tou8);
+    std::vector<std::int16_t> const v16 = make_vector(to16);
+    std::vector<std::int32_t> const vw = make_vector(wide);
+    for(std::size_t i = 0; i < a.size(); ++i){
+        CHECK(v8[i] == to8.get(i));
+        CHECK(vu8[i] == tou8.get(i));
+        CHECK(v16[i] == to16.get(i));
+        CHECK(vw[i] == int(b[i]) + int(c[i]));
+    }
+}
+
+TEST_CASE("int8 round trip through a wide expression"){
+    std::vector<std::int8_t> a{100, -100, 50, 0};
+    std::vector<std::int8_t> b{100, -100, -60, 5};
+    // in int8 these would wrap around
+    CHECK(make_vector(saturate<std::int8_t>(widen(make_proxy(a)) + widen(make_proxy(b))))
+          == std::vector<std::int8_t>{127, -128, -10, 5});
+    CHECK(sum<int>(make_proxy(a)) == 50);
+}
+
+TEST_CASE("half conversions"){
+    CHECK(float(half(1.5f)) == 1.5f);
+    CHECK(float(half(-2.f)) == -2.f);
+    CHECK(float(half(65504.f)) == 65504.f);
+    CHECK(std::isinf(float(half(70000.f))));
+    CHECK(std::isnan(float(half(std::nanf("")))));
+    // 1 + 2^-11 is halfway between two halves, and rounds to the even one
+    CHECK(float(half(1.f + 1.f / 2048)) == 1.f);
+    CHECK(float(half(1.f + 3.f / 2048)) == 1.f + 4.f / 2048);
+    // the smallest subnormal
+    CHECK(float(half(5.9604645e-08f)) == 5.9604645e-08f);
+    CHECK(half(0.1f).bits() == 0x2e66);
+}
+
+TEST_CASE("software half matches the hardware"){
+    // every half converts to float and back to itself
+    for(std::uint32_t bits = 0; bits < 0x10000; ++bits){
+        std::uint16_t const h = static_cast<std::uint16_t>(bits);
+        float const f = detail::float_from_half(h);
+        if(std::isnan(f))
+            continue;
+        REQUIRE(detail::half_from_float(f) == h);
+        REQUIRE(half::from_bits(h) == f);
+    }
+    // and floats in between round the same way both ways
+    for(float f = 1e-8f; f < 70000.f; f *= 1.0001f){
+        REQUIRE(detail::half_from_float(f) == half(f).bits());
+        REQUIRE(detail::half_from_float(-f) == half(-f).bits());
+    }
+}
+
+TEST_CASE("half leaves"){
+    std::vector<half> a, b;
+    for(int i = 0; i < 1000; ++i){
+        a.push_back(half(i * 0.25f));
+        b.push_back(half(1.f - i * 0.5f));
+    }
+    auto const e = widen(make_proxy(a)) * widen(make_proxy(b)) + 1.f;
+    std::vector<float> const result = make_vector(e);
+    for(std::size_t i = 0; i < a.size(); ++i){
+        CHECK(result[i] == float(a[i]) * float(b[i]) + 1.f);
+    }
+    std::vector<half> const narrowed = make_vector(cast<half>(e));
+    for(std::size_t i = 0; i < a.size(); ++i){
+        CHECK(narrowed[i].bits() == half(result[i]).bits());
+    }
+
+    // sums of half accumulate in float
+    static_assert(std::is_same<decltype(sum(make_proxy(a))), float>::value, "half sums in float");
+    CHECK(sum(make_proxy(a)) == 0.25f * 999 * 1000 / 2);
+    CHECK(float(min(make_proxy(b))) == 1.f - 999 * 0.5f);
+    CHECK(float(max(make_proxy(b))) == 1.f);
+}
+
+TEST_CASE("cast"){
+    std::vector<double> a{1.5, -2.25, 3};
+    CHECK(make_vector(cast<int>(make_proxy(a))) == std::vector<int>{1, -2, 3});
+    std::vector<std::int16_t> b{-300, 200};
+    CHECK(make_vector(cast<double>(make_proxy(b))) == std::vector<double>{-300, 200});
+    CHECK(make_vector(cast<half>(make_proxy(b)))[0].bits() == half(-300.f).bits());
+    CHECK(make_vector(cast<int>(cast<half>(make_proxy(b)))) == std::vector<int>{-300, 200});
+}
@@ -0,0 +1,69 @@
+#include "catch.hpp"
+#include "proxy_parallel.hpp"
+#include <atomic>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+// make_vector_parallel's result, as a plain std::vector to compare
+template<typename T, typename Allocator>
+std::vector<T> plain(std::vector<T, Allocator> const& v){
+    return std::vector<T>(v.begin(), v.end());
+}
+}
+
+TEST_CASE("parallel_for visits every index once"){
+    thread_pool pool(4);
+    std::vector<std::atomic<int>> seen(10000);
+    for(auto& s : seen) s = 0;
+    pool.parallel_for(seen.size(), [&](std::size_t i){ ++seen[i]; });
+    for(auto& s : seen){
+        CHECK(s == 1);
+    }
+}
+
+TEST_CASE("parallel_for rethrows"){
+    thread_pool pool(3);
+    CHECK_THROWS_AS(
+        pool.parallel_for(100, [](std::size_t i){
+            if(i == 42) throw std::runtime_error("42");
+        }),
+        std::runtime_error);
+    // and the pool is still usable afterwards
+    std::atomic<int> count{0};
+    pool.parallel_for(100, [&](std::size_t){ ++count; });
+    CHECK(count == 100);
+}
+
+TEST_CASE("parallel matches serial"){
+    std::size_t const n = 3 * parallel_threshold + 17;
+    std::vector<float> a(n), b(n), c(2 * n);
+    for(std::size_t i = 0; i < n; ++i){
+        a[i] = i % 7;
+        b[i] = i % 13;
+    }
+    for(std::size_t i = 0; i < c.size(); ++i){
+        c[i] = i % 5;
+    }
+    auto const expected = make_vector(
+        (make_proxy(a)|make_proxy(b))+make_proxy(c)*make_proxy(c));
+    for(std::size_t threads : {1, 2, 4}){
+        thread_pool pool(threads);
+        CHECK(plain(make_vector_parallel(
+            (make_proxy(a)|make_proxy(b))+make_proxy(c)*make_proxy(c), pool))
+            == expected);
+    }
+}
+
+TEST_CASE("small inputs stay serial"){
+    static_assert(std::is_same<decltype(make_vector_parallel(make_proxy(std::declval<std::vector<int> const&>()))),
+                  uninitialized_vector<int>>::value, "the result isn't zeroed before it's evaluated");
+    std::vector<int> a{1,2,3}, b{1,1,1};
+    CHECK(
+        plain(make_vector_parallel(make_proxy(a)+make_proxy(b)))
+        == std::vector<int>{2,3,4});
+}
@@ -28,3 +28,24 @@ TEST_CASE("composite case"){
         == std::vector<int>{2,3,4,6,7,8});
 }
 
+
+TEST_CASE("composite case across blocks"){
+    std::vector<int> a(300), b(500), c(800, 1);
+    for(std::size_t i = 0; i < a.size(); ++i) a[i] = i;
+    for(std::size_t i = 0; i < b.size(); ++i) b[i] = 1000 + i;
+    auto const v = make_vector((make_proxy(a)|make_proxy(b))+make_proxy(c));
+    REQUIRE(v.size() == 800);
+    for(std::size_t i = 0; i < v.size(); ++i){
+        CHECK(v[i] == (i < 300 ? a[i] : b[i - 300]) + 1);
+    }
+}
+
+TEST_CASE("deep chain"){
+    std::vector<int> a{1,2}, b{}, c{3}, d{4,5,6};
+    CHECK(
+        make_vector(make_proxy(a)|make_proxy(b)|make_proxy(c)|make_proxy(d))
+        == std::vector<int>{1,2,3,4,5,6});
+    CHECK(
+        make_vector(make_proxy(a)|(make_proxy(c)|(make_proxy(d)|make_proxy(b))))
+        == std::vector<int>{1,2,3,4,5,6});
+}
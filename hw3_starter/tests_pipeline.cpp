@@ -0,0 +1,132 @@
+#include "catch.hpp"
+#include "proxy_pipeline.hpp"
+#include <cmath>
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+std::vector<float> ramp(std::size_t n){
+    std::vector<float> v(n);
+    for(std::size_t i = 0; i < n; ++i) v[i] = float(int(i % 101) - 50);
+    return v;
+}
+}
+
+TEST_CASE("a pipeline gives what the composed expression gives"){
+    std::vector<float> const x = ramp(10000);
+    auto const expected = make_vector(sqrt(make_proxy(x) * 2.f + 101.f) + 1.f);
+    for(std::size_t chunk : {1, 100, 4096, 20000}){
+        for(std::size_t depth : {1, 2, 4}){
+            auto p = make_pipeline(make_proxy(x),
+                                   [](auto c){ return c * 2.f + 101.f; },
+                                   [](auto c){ return sqrt(c); },
+                                   [](auto c){ return c + 1.f; });
+            p.chunk_size(chunk).queue_depth(depth);
+            CHECK(p.run() == expected);
+        }
+    }
+
+    // no transforms at all just reads the source
+    CHECK(make_pipeline(make_proxy(x)).run() == x);
+    std::vector<float> const none;
+    CHECK(make_pipeline(make_proxy(none), [](auto c){ return c + 1.f; }).run().empty());
+}
+
+TEST_CASE("stages can change the type and the length"){
+    std::vector<float> const x = ramp(5000);
+    auto p = make_pipeline(as_stream(make_proxy(x)),
+                           [](auto c){ return filter(greater_than(0.f), c); },
+                           [](auto c){ return map([](float f){ return double(f) / 2; }, c); },
+                           [](auto c){ return repeat(c, 3); });
+    p.chunk_size(1000);
+    static_assert(std::is_same<decltype(p)::type, double>::value, "");
+    std::vector<double> expected;
+    for(std::size_t start = 0; start < x.size(); start += 1000){
+        std::vector<double> kept;
+        for(std::size_t i = start; i < start + 1000; ++i){
+            if(x[i] > 0) kept.push_back(double(x[i]) / 2);
+        }
+        for(int r = 0; r < 3; ++r) expected.insert(expected.end(), kept.begin(), kept.end());
+    }
+    CHECK(p.run() == expected);
+
+    // repeat makes the stage's output longer than a chunk
+    auto const& stats = p.stats();
+    REQUIRE(stats.size() == 5);
+    CHECK(stats[3].elements == expected.size());
+    CHECK(stats[3].chunks > stats[2].chunks);
+}
+
+TEST_CASE("run(consume) sees every chunk in order"){
+    std::vector<float> const x = ramp(9999);
+    auto p = make_pipeline(make_proxy(x), [](auto c){ return c * c; });
+    p.chunk_size(1000);
+    double total = 0;
+    std::size_t seen = 0;
+    bool in_order = true;
+    p.run([&](auto chunk){
+        for(std::size_t i = 0; i < chunk.size(); ++i){
+            in_order = in_order && chunk.get(i) == x[seen + i] * x[seen + i];
+        }
+        seen += chunk.size();
+        total += sum(chunk);
+    });
+    CHECK(seen == x.size());
+    CHECK(in_order);
+    CHECK(total == Approx(sum(make_proxy(x) * make_proxy(x))));
+}
+
+TEST_CASE("pipeline stats"){
+    std::vector<float> const x = ramp(10000);
+    auto p = make_pipeline(make_proxy(x), [](auto c){ return c + 1.f; }, [](auto c){ return c * 3.f; });
+    p.chunk_size(512);
+    p.run();
+    auto const& stats = p.stats();
+    REQUIRE(stats.size() == 4);
+    CHECK(stats[0].stage == "source");
+    CHECK(stats[1].stage == "stage 1");
+    CHECK(stats[2].stage == "stage 2");
+    CHECK(stats[3].stage == "sink");
+    for(stage_stats const& s : stats){
+        CHECK(s.elements == x.size());
+        CHECK(s.chunks == 20);
+        CHECK(s.throughput() >= 0);
+    }
+    CHECK(stats[0].starved_ns == 0);
+    CHECK(stats[3].blocked_ns == 0);
+    std::ostringstream out;
+    out.precision(9);
+    p.print_stats(out);
+    CHECK(out.str().find("stage 2") != std::string::npos);
+    CHECK(out.precision() == 9);
+}
+
+TEST_CASE("an exception stops the pipeline"){
+    std::vector<float> const x = ramp(100000);
+    auto p = make_pipeline(make_proxy(x),
+                           [](auto c){ return c + 1.f; },
+                           [](auto c){
+                               if(c.get(0) > 40.f)
+                                   throw std::runtime_error("stage 2");
+                               return c * 2.f;
+                           });
+    p.chunk_size(7).queue_depth(2);
+    CHECK_THROWS_WITH(p.run(), "stage 2");
+
+    auto q = make_pipeline(make_proxy(x), [](auto c){ return c + 1.f; });
+    q.chunk_size(100);
+    std::size_t chunks = 0;
+    CHECK_THROWS_AS(q.run([&](auto){
+        if(++chunks == 3)
+            throw std::logic_error("sink");
+    }), std::logic_error);
+    CHECK(chunks == 3);
+
+    // and the pipeline can run again
+    CHECK(q.run().size() == x.size());
+    CHECK_THROWS_AS(q.chunk_size(0), std::invalid_argument);
+}
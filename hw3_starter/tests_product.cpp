@@ -1,5 +1,6 @@
 #include "catch.hpp"
 #include "proxy.hpp"
+#include <cmath>
 #include <vector>
 
 using namespace proxy;
@@ -27,3 +28,68 @@ TEST_CASE("sum and product"){
         == std::vector<float>{4*7+1, 5*8+2, 6*9+3});
 }
 
+
+#ifdef PROXY_TEST_FUSED
+static_assert(detail::fuse_multiply_add, "tests_product_fma is there to test the fused paths");
+#endif
+
+TEST_CASE("sum and product rounds once"){
+    // b*c is 1 - 2^-40, which rounds to 1 as a float; fused, a + b*c keeps the
+    // -2^-40, unfused it cancels to 0
+    float const e = std::ldexp(1.f, -20);
+    std::vector<float> a{-1, 2}, b{1 + e, 3}, c{1 - e, 4};
+    // without FMA on the target (or with PROXY_STRICT_FP) there's no fusing
+    float const expected = detail::fuse_multiply_add ? std::fma(1 + e, 1 - e, -1.f) : (1 + e) * (1 - e) - 1;
+    CHECK((expected != 0) == detail::fuse_multiply_add);
+    auto const left = make_vector(make_proxy(b)*make_proxy(c)+make_proxy(a));
+    auto const right = make_vector(make_proxy(a)+make_proxy(b)*make_proxy(c));
+    CHECK(left == std::vector<float>{expected, 14});
+    CHECK(right == left);
+    CHECK((make_proxy(a)+make_proxy(b)*make_proxy(c)).get(0) == expected);
+}
+
+TEST_CASE("sum and product of ints"){
+    std::vector<int> a(1000, 1), b(1000, 2), c(1000, 3);
+    CHECK(
+        make_vector(make_proxy(a)+make_proxy(b)*make_proxy(c))
+        == std::vector<int>(1000, 7));
+}
+
+TEST_CASE("fused get and eval agree with mixed element types"){
+    // 2^24 + 1 isn't a float: both have to convert it before multiplying
+    std::vector<float> const f{1, 1};
+    std::vector<int> const i{16777217, 3};
+    auto const p = make_proxy(f) + make_proxy(i) * make_proxy(f);
+    auto const v = make_vector(p);
+    CHECK(p.get(0) == v[0]);
+    CHECK(p.get(1) == v[1]);
+    CHECK(v[1] == 4);
+}
+
+TEST_CASE("fused eval matches fused get a block at a time"){
+    // long enough for the SIMD loops and their tails, in both orders
+    for(std::size_t n : {1, 7, 8, 9, 300, 1001}){
+        std::vector<float> a(n), b(n), c(n);
+        std::vector<double> x(n), y(n), z(n);
+        for(std::size_t i = 0; i < n; ++i){
+            a[i] = float(i % 17) - 8;
+            b[i] = 1 + std::ldexp(float(i % 5), -20);
+            c[i] = 1 - std::ldexp(float(i % 3), -20);
+            x[i] = double(i % 13) - 6;
+            y[i] = 1 + std::ldexp(double(i % 5), -40);
+            z[i] = 1 - std::ldexp(double(i % 3), -40);
+        }
+        auto const f = make_proxy(a) + make_proxy(b) * make_proxy(c);
+        auto const g = make_proxy(y) * make_proxy(z) + make_proxy(x);
+        auto const fv = make_vector(f);
+        auto const gv = make_vector(g);
+        for(std::size_t i = 0; i < n; ++i){
+            float const fe = detail::fuse_multiply_add ? std::fma(b[i], c[i], a[i]) : b[i] * c[i] + a[i];
+            double const ge = detail::fuse_multiply_add ? std::fma(y[i], z[i], x[i]) : y[i] * z[i] + x[i];
+            CHECK(fv[i] == fe);
+            CHECK(f.get(i) == fe);
+            CHECK(gv[i] == ge);
+            CHECK(g.get(i) == ge);
+        }
+    }
+}
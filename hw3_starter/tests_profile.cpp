@@ -0,0 +1,126 @@
+#include "catch.hpp"
+#include "proxy_explain.hpp"
+#include "proxy_matrix.hpp"
+#include "proxy_mmap.hpp"
+#include "proxy_narrow.hpp"
+#include "proxy_parallel.hpp"
+#include "proxy_runtime.hpp"
+#include "proxy_scan.hpp"
+#include "proxy_soa.hpp"
+#include "proxy_sparse.hpp"
+#include "proxy_window.hpp"
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+// make_vector_parallel's result, as a plain std::vector to compare
+template<typename T, typename Allocator>
+std::vector<T> plain(std::vector<T, Allocator> const& v){
+    return std::vector<T>(v.begin(), v.end());
+}
+
+profile_entry counted(std::string const& prefix){
+    for(profile_entry const& e : profile_report()){
+        if(e.node.compare(0, prefix.size(), prefix) == 0)
+            return e;
+    }
+    return profile_entry{};
+}
+}
+
+TEST_CASE("get() and size() are counted per node"){
+    reset_profile();
+    std::vector<int> const a{1, 2, 3}, b{4, 5};
+    auto const p = make_proxy(a) | make_proxy(b);
+    CHECK(p.get(3) == 4);
+    CHECK(p.get(0) == 1);
+    auto const pipe = counted("pipe_proxy<");
+    CHECK(pipe.gets == 2);
+    CHECK(pipe.evals == 0);
+    auto const leaf = counted("sequence_proxy<");
+    CHECK(leaf.gets == 2);
+    CHECK(leaf.sizes >= 2);
+}
+
+TEST_CASE("eval() is counted and timed"){
+    reset_profile();
+    std::vector<double> const a(1000, 1.0), b(1000, 2.0), c(1000, 3.0);
+    auto const e = (make_proxy(a) + make_proxy(b)) * make_proxy(c);
+    CHECK(make_vector(e) == std::vector<double>(1000, 9.0));
+    auto const product = counted("product_proxy<");
+    auto const adder = counted("adder_proxy<");
+    CHECK(product.evals > 0);
+    CHECK(product.elements == 1000);
+    CHECK(product.gets == 0);
+    // the product asks its children for a block at a time
+    CHECK(adder.evals >= product.evals);
+    CHECK(adder.elements == 1000);
+    CHECK(product.self_ns <= product.total_ns);
+    CHECK(adder.total_ns <= product.total_ns);
+    // the three leaves share a type, and so their counts
+    CHECK(counted("sequence_proxy<").elements == 3000);
+
+    // the longest first
+    auto const report = profile_report();
+    REQUIRE(report.size() == 3);
+    CHECK(report[0].node.compare(0, 14, "product_proxy<") == 0);
+
+    std::ostringstream out;
+    out.precision(9);
+    print_profile(out);
+    INFO(out.str());
+    // the caller's stream is left as it was
+    CHECK(out.precision() == 9);
+    CHECK((out.flags() & std::ios_base::floatfield) == std::ios_base::fmtflags{});
+    CHECK(out.str().compare(0, 4, "node") == 0);
+    CHECK(out.str().find("adder_proxy<") != std::string::npos);
+
+    reset_profile();
+    CHECK(profile_report().empty());
+}
+
+TEST_CASE("nodes from the other headers are counted too"){
+    reset_profile();
+    std::vector<double> const a(1000, 1.0), d(1000, 2.0);
+    auto const e = rolling_sum(make_proxy(a), 8) * make_proxy(d);
+    CHECK(make_vector(e)[999] == 16.0);
+    auto const window = counted("rolling_sum_proxy<");
+    CHECK(window.evals > 0);
+    CHECK(window.elements == 1000);
+    CHECK(e.get(3) == 8.0);
+    CHECK(counted("rolling_sum_proxy<").gets == 1);
+
+    std::vector<int> const v{1, 2, 3, 4, 5, 6};
+    auto const m = make_matrix_proxy(v, 2, 3);
+    CHECK(make_matrix(m + m).values == std::vector<int>{2, 4, 6, 8, 10, 12});
+    CHECK(counted("matrix_elementwise<").elements == 6);
+    CHECK(counted("matrix_proxy<").elements == 12);
+
+    CHECK(make_vector(scan(std::plus<int>{}, cast<int>(make_proxy(a)))).back() == 1000);
+    CHECK(counted("scan_proxy<").evals > 0);
+    CHECK(counted("cast_proxy<").elements >= 1000);
+}
+
+TEST_CASE("streams count their reads"){
+    reset_profile();
+    std::vector<int> const v{5, 1, 7, 2, 9};
+    CHECK(make_vector(filter(greater_than(4), make_proxy(v))) == std::vector<int>{5, 7, 9});
+    auto const kept = counted("filter_proxy<");
+    CHECK(kept.evals > 0);
+    CHECK(kept.elements > 0);
+}
+
+TEST_CASE("work on other threads is added up"){
+    reset_profile();
+    thread_pool pool{4};
+    std::vector<float> const a(std::size_t{1} << 18, 1.f);
+    auto const e = make_proxy(a) + 1.f;
+    CHECK(plain(make_vector_parallel(e, pool)) == std::vector<float>(a.size(), 2.f));
+    auto const adder = counted("adder_proxy<");
+    CHECK(adder.elements == a.size());
+    CHECK(adder.evals >= a.size() / detail::parallel_chunk_size<float>());
+}
@@ -0,0 +1,62 @@
+#include "catch.hpp"
+#include "proxy_parallel.hpp"
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+using namespace proxy;
+
+TEST_CASE("sum"){
+    std::vector<int> a{1,2,3,4,5,6,7,8,9,10,11}, b{};
+    CHECK(sum(make_proxy(a)) == 66);
+    CHECK(sum(make_proxy(b)) == 0);
+    CHECK(sum(make_proxy(a)|make_proxy(a)) == 132);
+}
+
+TEST_CASE("sum in a wider type"){
+    std::vector<int> a(1000, 1 << 30);
+    CHECK(sum<long long>(make_proxy(a)) == 1000LL << 30);
+}
+
+TEST_CASE("dot"){
+    std::vector<float> a{1,2,3}, b{4,5,6};
+    CHECK(dot(make_proxy(a), make_proxy(b)) == 32);
+    CHECK(sum(make_proxy(a)*make_proxy(b)) == 32);
+}
+
+TEST_CASE("min and max"){
+    std::vector<int> a(1000);
+    std::iota(a.begin(), a.end(), -500);
+    a[617] = 10000;
+    a[3] = -10000;
+    CHECK(min(make_proxy(a)) == -10000);
+    CHECK(max(make_proxy(a)) == 10000);
+    std::vector<double> empty;
+    CHECK_THROWS_AS(min(make_proxy(empty)), std::invalid_argument);
+}
+
+TEST_CASE("count_if"){
+    std::vector<int> a{1,2,3,4,5,6,7,8,9,10}, b{1,1,1,1,1,1,1,1,1,1};
+    CHECK(count_if(make_proxy(a)+make_proxy(b), [](int x){ return x % 2 == 0; }) == 5);
+}
+
+TEST_CASE("parallel reductions"){
+    std::size_t const n = 5 * parallel_threshold + 3;
+    std::vector<long long> a(n);
+    std::iota(a.begin(), a.end(), 0);
+    thread_pool pool(4);
+    CHECK(sum(make_proxy(a), pool) == sum(make_proxy(a)));
+    CHECK(dot(make_proxy(a), make_proxy(a), pool) == dot(make_proxy(a), make_proxy(a)));
+    CHECK(max(make_proxy(a), pool) == static_cast<long long>(n - 1));
+    CHECK(min(make_proxy(a), pool) == 0);
+    CHECK(count_if(make_proxy(a), [](long long x){ return x < 100; }, pool) == 100);
+}
+
+TEST_CASE("parallel float sum doesn't depend on the thread count"){
+    std::vector<float> a(4 * parallel_threshold);
+    for(std::size_t i = 0; i < a.size(); ++i){
+        a[i] = 1.f / (1 + i % 97);
+    }
+    thread_pool one(1), three(3);
+    CHECK(sum(make_proxy(a), one) == sum(make_proxy(a), three));
+}
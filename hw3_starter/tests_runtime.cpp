@@ -0,0 +1,180 @@
+#include "catch.hpp"
+#include "proxy_runtime.hpp"
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+std::vector<double> sequence(std::size_t n, double scale, double offset){
+    std::vector<double> v(n);
+    for(std::size_t i = 0; i < n; ++i){
+        v[i] = scale * double(i % 97) + offset;
+    }
+    return v;
+}
+}
+
+TEST_CASE("formulas match the template expressions"){
+    std::vector<double> const a = sequence(1001, 0.5, -20);
+    std::vector<double> const b = sequence(1001, -0.25, 3);
+    std::vector<double> const c = sequence(1001, 1.5, 1);
+    auto const pa = make_proxy(a), pb = make_proxy(b), pc = make_proxy(c);
+
+    formula<double> const f("a + b*c");
+    CHECK(f.names() == std::vector<std::string>{"a", "b", "c"});
+    CHECK(make_vector(f.bind({{"a", a}, {"b", b}, {"c", c}})) == make_vector(pa + pb * pc));
+    // the same, by position
+    CHECK(make_vector(f.bind({a, b, c})) == make_vector(pa + pb * pc));
+
+    auto const g = parse_formula("2*a*b + 0.5 + abs(c)*(a + b)").bind({a, b, c});
+    CHECK(make_vector(g) == make_vector(2.0 * pa * pb + 0.5 + map(abs_fn{}, pc) * (pa + pb)));
+
+    auto const h = parse_formula("max(a, b) + min(c, 3) + sqrt(abs(a))").bind({a, b, c});
+    CHECK(make_vector(h) == make_vector(map(max_fn{}, pa, pb) +
+                                        map(min_fn{}, pc, make_scalar(3.0)) +
+                                        map(sqrt_fn{}, map(abs_fn{}, pa))));
+}
+
+TEST_CASE("every operator"){
+    std::vector<double> const a{1, -2, 3.5, 4, -8};
+    std::vector<double> const b{2, 4, -0.5, 1, 16};
+    auto const run = [&](std::string const& text){
+        return make_vector(parse_formula(text).bind({{"a", a}, {"b", b}}));
+    };
+    CHECK(run("a - b") == std::vector<double>{-1, -6, 4, 3, -24});
+    CHECK(run("a / b") == std::vector<double>{0.5, -0.5, -7, 4, -0.5});
+    CHECK(run("a - 1 + 0*b") == std::vector<double>{0, -3, 2.5, 3, -9});
+    CHECK(run("10 - a + 0*b") == std::vector<double>{9, 12, 6.5, 6, 18});
+    CHECK(run("b / 2 + 0*a") == std::vector<double>{1, 2, -0.25, 0.5, 8});
+    CHECK(run("8 / b + 0*a") == std::vector<double>{4, 2, -16, 8, 0.5});
+    CHECK(run("-a + 0*b") == std::vector<double>{-1, 2, -3.5, -4, 8});
+    CHECK(run("--a + 0*b") == a);
+    CHECK(run("min(a, 0) + max(b, 2)") == std::vector<double>{2, 2, 2, 2, 8});
+    // the deeper side goes first, and the result has to come out the same
+    CHECK(run("a - (b - (a - (b - a)))") == std::vector<double>{-1, -14, 11.5, 10, -56});
+    CHECK(run("(a - b) / (b - (a - b) * (b - a))")
+          == make_vector(map([](double x, double y){ return (x - y) / (y - (x - y) * (y - x)); },
+                             make_proxy(a), make_proxy(b))));
+}
+
+TEST_CASE("constants are folded"){
+    std::vector<double> const a{1, 2, 3};
+    CHECK(make_vector(parse_formula("a * (2 + 3 * 4) - sqrt(16) / -2").bind({a}))
+          == std::vector<double>{16, 30, 44});
+    CHECK(make_vector(parse_formula("max(1, 2) + a * 1e-1").bind({a}))[2] == 2 + 3 * 1e-1);
+}
+
+TEST_CASE("pipes"){
+    std::vector<double> const a{1, 2, 3};
+    std::vector<double> const b{10, 20};
+    auto const f = parse_formula("a * 2 | b + 1 | a").bind({{"a", a}, {"b", b}});
+    CHECK(f.size() == 8);
+    CHECK(make_vector(f) == std::vector<double>{2, 4, 6, 11, 21, 1, 2, 3});
+    CHECK(f.get(4) == 21);
+    CHECK(make_vector(slice(f, 2, 6)) == std::vector<double>{6, 11, 21, 1});
+
+    // the size of an elementwise operation is the shorter side's, as usual
+    auto const g = parse_formula("(a | b) + (b | a)").bind({{"a", a}, {"b", b}});
+    CHECK(make_vector(g) == make_vector((make_proxy(a) | make_proxy(b)) + (make_proxy(b) | make_proxy(a))));
+
+    // and long pipes cross block boundaries
+    std::vector<double> const long_a = sequence(700, 1, 0);
+    std::vector<double> const long_b = sequence(300, -1, 0);
+    auto const h = parse_formula("a | b | a * b").bind({long_a, long_b});
+    auto const expected = make_vector(make_proxy(long_a) | make_proxy(long_b) |
+                                      make_proxy(long_a) * make_proxy(long_b));
+    CHECK(make_vector(h) == expected);
+    for(std::size_t pos : {0, 255, 256, 699, 700, 999, 1000, 1299}){
+        CHECK(h.get(pos) == expected[pos]);
+    }
+}
+
+TEST_CASE("sizes and partial evaluation"){
+    std::vector<double> const a = sequence(1000, 1, 0);
+    std::vector<double> const b = sequence(600, 2, 1);
+    auto const f = parse_formula("a * b - a").bind({a, b});
+    CHECK(f.size() == 600);
+    std::vector<double> out(300);
+    f.eval(250, 300, out.data());
+    for(std::size_t i = 0; i < out.size(); ++i){
+        CHECK(out[i] == a[250 + i] * b[250 + i] - a[250 + i]);
+    }
+}
+
+TEST_CASE("any proxy is an input"){
+    std::vector<int> const i{1, 2, 3, 4};
+    std::vector<float> const x{0.5f, 1.5f, 2.5f, 3.5f};
+    // int and float leaves are converted, and expressions are evaluated by block
+    auto const f = parse_formula<float>("a * b + c").bind({
+        {"a", make_proxy(i)},
+        {"b", make_proxy(x) + make_proxy(x)},
+        {"c", x}});
+    CHECK(make_vector(f) == std::vector<float>{1.5f, 7.5f, 17.5f, 31.5f});
+
+    // formulas are proxies, so they can be inputs to each other, and to templates
+    auto const g = parse_formula<float>("x - 1").bind({f});
+    CHECK(make_vector(g * make_proxy(x)) == std::vector<float>{0.25f, 9.75f, 41.25f, 106.75f});
+    CHECK(sum(g) == 0.5f + 6.5f + 16.5f + 30.5f);
+}
+
+TEST_CASE("deep but reasonable formulas"){
+    std::vector<double> const a{1, 2};
+    auto const nested = parse_formula(std::string(500, '(') + "a + 1" + std::string(500, ')'));
+    CHECK(make_vector(nested.bind({a})) == std::vector<double>{2, 3});
+    std::string terms = "a";
+    for(int i = 0; i < 500; ++i) terms += " + a";
+    CHECK(make_vector(parse_formula(terms).bind({a})) == std::vector<double>{501, 1002});
+}
+
+TEST_CASE("aliasing"){
+    std::vector<double> a{1, 2, 3};
+    std::vector<double> const b{1, 1, 1};
+    auto const f = parse_formula("a + b").bind({{"a", a}, {"b", b}});
+    CHECK(f.aliases(a.data(), a.data() + a.size()));
+    // so into() still gets it right when the output is an input
+    into(a) = f;
+    CHECK(a == std::vector<double>{2, 3, 4});
+}
+
+TEST_CASE("bad formulas"){
+    CHECK_THROWS_AS(parse_formula("a +"), std::invalid_argument);
+    CHECK_THROWS_AS(parse_formula("a + * b"), std::invalid_argument);
+    CHECK_THROWS_AS(parse_formula("(a + b"), std::invalid_argument);
+    CHECK_THROWS_AS(parse_formula("a b"), std::invalid_argument);
+    CHECK_THROWS_AS(parse_formula("cos(a)"), std::invalid_argument);
+    CHECK_THROWS_AS(parse_formula("min(a)"), std::invalid_argument);
+    CHECK_THROWS_AS(parse_formula("a $ b"), std::invalid_argument);
+    CHECK_THROWS_AS(parse_formula("1 + 2"), std::invalid_argument);
+    CHECK_THROWS_AS(parse_formula("a | 1"), std::invalid_argument);
+    CHECK_THROWS_AS(parse_formula(""), std::invalid_argument);
+    try{
+        parse_formula("a + b )");
+        FAIL("no exception");
+    }catch(std::invalid_argument const& e){
+        CHECK(std::string(e.what()).find("at 6") != std::string::npos);
+    }
+
+    // nesting is limited, rather than overflowing the stack
+    try{
+        parse_formula(std::string(200000, '(') + "a");
+        FAIL("no exception");
+    }catch(std::invalid_argument const& e){
+        CHECK(std::string(e.what()).find("too deeply nested at ") != std::string::npos);
+    }
+    CHECK_THROWS_AS(parse_formula(std::string(200000, '-') + "a"), std::invalid_argument);
+    CHECK_THROWS_AS(parse_formula(std::string(200000, '-') + "1 + a"), std::invalid_argument);
+    std::string terms = "a";
+    for(int i = 0; i < 5000; ++i) terms += " + a";
+    CHECK_THROWS_AS(parse_formula(terms), std::invalid_argument);
+
+    std::vector<double> const a{1};
+    auto const f = parse_formula("a + b");
+    CHECK_THROWS_AS(f.bind({a}), std::invalid_argument);
+    CHECK_THROWS_AS(f.bind({{"a", a}}), std::invalid_argument);
+    CHECK_THROWS_AS(f.bind({{"a", a}, {"c", a}}), std::invalid_argument);
+    CHECK_THROWS_AS(f.bind({{"a", a}, {"b", a}, {"c", a}}), std::invalid_argument);
+}
@@ -0,0 +1,126 @@
+#include "catch.hpp"
+#include "proxy_scan.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+// make_vector_parallel's result, as a plain std::vector to compare
+template<typename T, typename Allocator>
+std::vector<T> plain(std::vector<T, Allocator> const& v){
+    return std::vector<T>(v.begin(), v.end());
+}
+
+template<typename Proxy>
+std::vector<typename Proxy::type> one_at_a_time(Proxy const& p){
+    std::vector<typename Proxy::type> v;
+    for(std::size_t i = 0; i < p.size(); ++i) v.push_back(p.get(i));
+    return v;
+}
+
+template<typename T>
+std::vector<T> small_numbers(std::size_t n){
+    std::vector<T> v(n);
+    for(std::size_t i = 0; i < n; ++i){
+        v[i] = T(int(i * 7 % 11) - 5);
+    }
+    return v;
+}
+}
+
+TEST_CASE("running sums"){
+    std::vector<int> const a{3, 1, 4, 1, 5, 9, 2, 6};
+    CHECK(make_vector(scan(std::plus<int>{}, make_proxy(a))) == std::vector<int>{3, 4, 8, 9, 14, 23, 25, 31});
+    CHECK(make_vector(exclusive_scan(std::plus<int>{}, make_proxy(a), 0))
+          == std::vector<int>{0, 3, 4, 8, 9, 14, 23, 25});
+    CHECK(make_vector(exclusive_scan(std::plus<int>{}, make_proxy(a), 100))[2] == 104);
+    std::vector<int> const empty;
+    CHECK(make_vector(scan(std::plus<int>{}, make_proxy(empty))).empty());
+}
+
+TEST_CASE("scans match std::partial_sum at every size"){
+    for(std::size_t n : {1, 3, 4, 255, 256, 257, 1000, 70000, 300001}){
+        std::vector<std::int32_t> const a = small_numbers<std::int32_t>(n);
+        std::vector<std::int32_t> expected(n);
+        std::partial_sum(a.begin(), a.end(), expected.begin());
+        auto const s = scan(std::plus<>{}, make_proxy(a));
+        CHECK(make_vector(s) == expected);
+        CHECK(plain(make_vector_parallel(s)) == expected);
+
+        // small integers add up exactly in floating point too
+        std::vector<float> const f = small_numbers<float>(n);
+        std::vector<float> fexpected(n);
+        std::partial_sum(f.begin(), f.end(), fexpected.begin());
+        CHECK(make_vector(scan(std::plus<float>{}, make_proxy(f))) == fexpected);
+        std::vector<double> const d(f.begin(), f.end());
+        CHECK(make_vector(scan(std::plus<double>{}, make_proxy(d))) ==
+              std::vector<double>(fexpected.begin(), fexpected.end()));
+
+        // and in the other integer types, unsigned ones wrapping around
+        std::vector<std::int64_t> const l(a.begin(), a.end());
+        CHECK(make_vector(scan(std::plus<>{}, make_proxy(l))) ==
+              std::vector<std::int64_t>(expected.begin(), expected.end()));
+        std::vector<std::uint32_t> const u(a.begin(), a.end());
+        CHECK(make_vector(scan(std::plus<>{}, make_proxy(u))) ==
+              std::vector<std::uint32_t>(expected.begin(), expected.end()));
+        std::vector<std::uint64_t> const w(a.begin(), a.end());
+        CHECK(make_vector(scan(std::plus<>{}, make_proxy(w))) ==
+              std::vector<std::uint64_t>(expected.begin(), expected.end()));
+    }
+}
+
+TEST_CASE("random access and partial evaluation"){
+    std::vector<int> const a = small_numbers<int>(3000);
+    std::vector<int> expected(a.size());
+    std::partial_sum(a.begin(), a.end(), expected.begin());
+    auto const s = scan(std::plus<int>{}, make_proxy(a));
+    CHECK(one_at_a_time(s) == expected);
+    CHECK(make_vector(slice(s, 700, 1999)) == std::vector<int>(expected.begin() + 700, expected.begin() + 1999));
+
+    auto const e = exclusive_scan(std::plus<int>{}, make_proxy(a), 0);
+    CHECK(e.get(0) == 0);
+    CHECK(e.get(2999) == expected[2998]);
+    CHECK(make_vector(slice(e, 513, 600)) == std::vector<int>(expected.begin() + 512, expected.begin() + 599));
+}
+
+TEST_CASE("other operations"){
+    std::vector<double> const a{1, 2, 0.5, 4, 0.25};
+    CHECK(make_vector(scan(std::multiplies<double>{}, make_proxy(a))) == std::vector<double>{1, 2, 1, 4, 1});
+    std::vector<int> const b{3, 1, 4, 1, 5, 9, 2, 6};
+    CHECK(make_vector(scan(max_fn{}, make_proxy(b))) == std::vector<int>{3, 3, 4, 4, 5, 9, 9, 9});
+    CHECK(make_vector(scan(min_fn{}, make_proxy(b))) == std::vector<int>{3, 1, 1, 1, 1, 1, 1, 1});
+    CHECK(make_vector(exclusive_scan(std::multiplies<int>{}, make_proxy(b), 1))
+          == std::vector<int>{1, 3, 3, 12, 12, 60, 540, 1080});
+
+    // running maximum over something long enough to be split up
+    std::vector<int> const c = small_numbers<int>(200000);
+    auto const m = make_vector(scan(max_fn{}, make_proxy(c) * make_proxy(c)));
+    CHECK(m.front() == 25);
+    CHECK(m.back() == 25);
+}
+
+TEST_CASE("scans inside expressions"){
+    std::vector<int> const a = small_numbers<int>(100000);
+    std::vector<int> const b(a.rbegin(), a.rend());
+    std::vector<int> const c(a.size(), 1);
+    auto const e = scan(std::plus<>{}, make_proxy(a) * make_proxy(b)) + make_proxy(c);
+    std::vector<int> expected(a.size());
+    int total = 0;
+    for(std::size_t i = 0; i < a.size(); ++i){
+        total += a[i] * b[i];
+        expected[i] = total + 1;
+    }
+    CHECK(make_vector(e) == expected);
+    thread_pool pool(4);
+    CHECK(plain(make_vector_parallel(scan(std::plus<>{}, make_proxy(a) * make_proxy(b), pool) + make_proxy(c), pool))
+          == expected);
+    // and sum of a running sum is the same whichever way it's evaluated
+    CHECK(sum<long long>(scan(std::plus<>{}, make_proxy(a))) ==
+          sum<long long>(scan(std::plus<>{}, make_proxy(a)), pool));
+    static_assert(std::is_same<decltype(scan(std::plus<>{}, make_proxy(a)))::type, int>::value, "");
+}
@@ -0,0 +1,133 @@
+#include "catch.hpp"
+#include "proxy_parallel.hpp"
+#include "proxy_sparse.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+template<typename T>
+std::vector<T> scrambled(std::size_t n, int spread){
+    std::vector<T> v(n);
+    for(std::size_t i = 0; i < n; ++i){
+        v[i] = T(int((i * 7919) % std::size_t(2 * spread + 1)) - spread);
+    }
+    return v;
+}
+
+template<typename T>
+T nth(std::vector<T> v, double q){
+    auto const at = v.begin() + std::ptrdiff_t(q * double(v.size() - 1));
+    std::nth_element(v.begin(), at, v.end());
+    return *at;
+}
+
+template<typename T, typename Compare = std::less<T>>
+std::vector<T> first_k(std::vector<T> v, std::size_t k, Compare comp = Compare{}){
+    k = std::min(k, v.size());
+    std::partial_sort(v.begin(), v.begin() + std::ptrdiff_t(k), v.end(), comp);
+    v.resize(k);
+    return v;
+}
+}
+
+TEST_CASE("top_k and partial_sort"){
+    std::vector<int> const a{3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5};
+    CHECK(top_k(make_proxy(a), 3) == std::vector<int>{9, 6, 5});
+    CHECK(partial_sort(make_proxy(a), 4) == std::vector<int>{1, 1, 2, 3});
+    CHECK(partial_sort(make_proxy(a), 3, std::greater<int>{}) == std::vector<int>{9, 6, 5});
+    CHECK(top_k(make_proxy(a), 0).empty());
+    CHECK(top_k(make_proxy(a), 100) == first_k(a, 100, std::greater<int>{}));
+    std::vector<int> const empty;
+    CHECK(top_k(make_proxy(empty), 5).empty());
+}
+
+TEST_CASE("selections match std::partial_sort"){
+    for(std::size_t n : {1, 7, 8, 9, 255, 1000, 100000}){
+        std::vector<double> const a = scrambled<double>(n, 5000);
+        std::vector<double> const b = scrambled<double>(n, 3);
+        std::vector<double> const c(n, 0.5);
+        std::vector<double> e(n);
+        for(std::size_t i = 0; i < n; ++i) e[i] = a[i] * b[i] + c[i];
+        for(std::size_t k : {1, 5, 64, 1000}){
+            CHECK(top_k(make_proxy(a) * make_proxy(b) + make_proxy(c), k) == first_k(e, k, std::greater<double>{}));
+            CHECK(partial_sort(make_proxy(a) * make_proxy(b) + make_proxy(c), k) == first_k(e, k));
+        }
+    }
+}
+
+TEST_CASE("quantile matches std::nth_element"){
+    for(std::size_t n : {1, 2, 3, 256, 1001, 300000}){
+        for(double q : {0.0, 0.1, 0.5, 0.73, 0.999, 1.0}){
+            std::vector<int> const i = scrambled<int>(n, 1000000);
+            CHECK(quantile(make_proxy(i), q) == nth(i, q));
+            std::vector<unsigned> const u(i.begin(), i.end());
+            CHECK(quantile(make_proxy(u), q) == nth(u, q));
+            std::vector<float> const f = scrambled<float>(n, 100);
+            CHECK(quantile(make_proxy(f) * 0.25f, q) == nth(make_vector(make_proxy(f) * 0.25f), q));
+            std::vector<double> const d = scrambled<double>(n, 7);
+            CHECK(quantile(make_proxy(d) + make_proxy(f), q) == nth(make_vector(make_proxy(d) + make_proxy(f)), q));
+        }
+    }
+}
+
+TEST_CASE("quantile at the edges of the order"){
+    double const inf = std::numeric_limits<double>::infinity();
+    std::vector<double> const a{-0.0, 0.0, -inf, inf, 1e-300, -1e-300, std::numeric_limits<double>::max(),
+                                std::numeric_limits<double>::lowest(), std::numeric_limits<double>::denorm_min()};
+    for(double q : {0.0, 0.125, 0.25, 0.375, 0.5, 0.625, 0.75, 0.875, 1.0}){
+        CHECK(quantile(make_proxy(a), q) == nth(a, q));
+    }
+    std::vector<std::int64_t> const b{std::numeric_limits<std::int64_t>::min(), -1, 0, 1,
+                                      std::numeric_limits<std::int64_t>::max()};
+    CHECK(quantile(make_proxy(b), 0.0) == std::numeric_limits<std::int64_t>::min());
+    CHECK(quantile(make_proxy(b), 0.25) == -1);
+    CHECK(quantile(make_proxy(b), 1.0) == std::numeric_limits<std::int64_t>::max());
+    std::vector<short> const c{5, -3, 5, 5, -3};
+    CHECK(quantile(make_proxy(c), 0.5) == 5);
+    CHECK(quantile(make_proxy(c), 0.25) == -3);
+
+    std::vector<double> const empty;
+    CHECK_THROWS_AS(quantile(make_proxy(empty), 0.5), std::invalid_argument);
+    CHECK_THROWS_AS(quantile(make_proxy(a), 1.5), std::invalid_argument);
+    CHECK_THROWS_AS(quantile(make_proxy(a), -0.1), std::invalid_argument);
+    CHECK_THROWS_AS(quantile(make_proxy(a), std::numeric_limits<double>::quiet_NaN()), std::invalid_argument);
+}
+
+TEST_CASE("selections of sparse proxies and streams"){
+    sparse_vector<int> const sv{1000, {3, 500, 999}, {7, -4, 2}};
+    auto const s = make_proxy(sv);
+    CHECK(top_k(s, 4) == std::vector<int>{7, 2, 0, 0});
+    CHECK(partial_sort(s, 2) == std::vector<int>{-4, 0});
+    CHECK(quantile(s, 0.0) == -4);
+    CHECK(quantile(s, 0.5) == 0);
+    CHECK(quantile(s, 1.0) == 7);
+
+    std::vector<int> const a = scrambled<int>(5000, 400);
+    auto const odd = filter([](int x){ return x % 2 != 0; }, make_proxy(a));
+    std::vector<int> odds;
+    for(int x : a) if(x % 2 != 0) odds.push_back(x);
+    CHECK(top_k(odd, 10) == first_k(odds, 10, std::greater<int>{}));
+}
+
+TEST_CASE("selections on a thread pool"){
+    std::vector<float> const a = scrambled<float>(6 * parallel_threshold + 5, 1 << 20);
+    std::vector<float> const b(a.rbegin(), a.rend());
+    std::vector<float> e(a.size());
+    for(std::size_t i = 0; i < a.size(); ++i) e[i] = a[i] - b[i] * 0.5f;
+    auto const expr = make_proxy(a) + make_proxy(b) * -0.5f;
+    thread_pool pool(4);
+    CHECK(top_k(expr, 50, pool) == first_k(e, 50, std::greater<float>{}));
+    CHECK(partial_sort(expr, 50, pool) == first_k(e, 50));
+    CHECK(partial_sort(expr, 3, pool, std::greater<float>{}) == first_k(e, 3, std::greater<float>{}));
+    for(double q : {0.0, 0.01, 0.5, 0.99, 1.0}){
+        CHECK(quantile(expr, q, pool) == nth(e, q));
+        CHECK(quantile(expr, q) == nth(e, q));
+    }
+}
@@ -0,0 +1,156 @@
+#include "catch.hpp"
+#include "proxy_soa.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+struct trade{
+    double price;
+    float qty;
+    std::int64_t ts;
+    char side;
+};
+
+std::vector<trade> trades(std::size_t n){
+    std::vector<trade> v(n);
+    for(std::size_t i = 0; i < n; ++i){
+        v[i] = {double(int(i * 37 % 101)) / 4, float(i % 13), std::int64_t(1000 + i), i % 3 == 0 ? 'b' : 's'};
+    }
+    return v;
+}
+
+template<typename Proxy>
+std::vector<typename Proxy::type> one_at_a_time(Proxy const& p){
+    std::vector<typename Proxy::type> v;
+    for(std::size_t i = 0; i < p.size(); ++i) v.push_back(p.get(i));
+    return v;
+}
+}
+
+TEST_CASE("zip and element"){
+    std::vector<int> const a{1, 2, 3, 4};
+    std::vector<double> const b{0.5, 1.5, 2.5};
+    auto const z = zip(make_proxy(a), make_proxy(b) * 2.0);
+    static_assert(std::is_same<decltype(z)::type, std::tuple<int, double>>::value, "");
+    CHECK(z.size() == 3);
+    CHECK(z.get(1) == std::make_tuple(2, 3.0));
+    auto const v = make_vector(z);
+    CHECK(v == std::vector<std::tuple<int, double>>{{1, 1.0}, {2, 3.0}, {3, 5.0}});
+    CHECK(v == one_at_a_time(z));
+
+    // taking a zip apart gives back what went in
+    static_assert(std::is_same<decltype(element<0>(z)), decltype(make_proxy(a))>::value, "");
+    CHECK(make_vector(element<1>(z)) == std::vector<double>{1.0, 3.0, 5.0});
+    // anything else yielding tuples is evaluated and taken apart
+    auto const swapped = map([](std::tuple<int, double> t){ return std::make_tuple(std::get<1>(t), std::get<0>(t)); }, z);
+    CHECK(make_vector(element<0>(swapped)) == std::vector<double>{1.0, 3.0, 5.0});
+    CHECK(make_vector(element<1>(swapped) + make_proxy(a)) == std::vector<int>{2, 4, 6});
+
+    CHECK(z.aliases(a.data(), a.data() + 1));
+    CHECK_FALSE(z.aliases(a.data() + 4, a.data() + 5));
+}
+
+TEST_CASE("long zips are evaluated in blocks"){
+    std::vector<int> a(1000);
+    std::vector<short> b(1000);
+    for(std::size_t i = 0; i < a.size(); ++i){
+        a[i] = int(i);
+        b[i] = short(1000 - i);
+    }
+    auto const z = zip(make_proxy(a), make_proxy(b), make_proxy(a) + make_proxy(b));
+    auto const part = make_vector(slice(z, 250, 770));
+    CHECK(part.size() == 520);
+    CHECK(part[0] == std::make_tuple(250, short(750), 1000));
+    CHECK(part[519] == std::make_tuple(769, short(231), 1000));
+    CHECK(make_vector(z) == one_at_a_time(z));
+}
+
+TEST_CASE("soa_vector"){
+    soa_vector<double, int> s;
+    s.push_back(1.5, 2);
+    s.push_back(2.5, 3);
+    s.push_back(-1.0, 7);
+    CHECK(s.size() == 3);
+    CHECK(s.get(1) == std::make_tuple(2.5, 3));
+    CHECK(s.column<1>() == std::vector<int>{2, 3, 7});
+
+    // columns are leaves, so column expressions are ordinary expressions
+    CHECK(make_vector(column<0>(s) * column<1>(s)) == std::vector<double>{3.0, 7.5, -7.0});
+    CHECK(sum(column<1>(s)) == 12);
+    auto const p = make_proxy(s);
+    static_assert(std::is_same<decltype(element<1>(p)), decltype(column<1>(s))>::value, "");
+    CHECK(make_vector(p) == std::vector<std::tuple<double, int>>{{1.5, 2}, {2.5, 3}, {-1.0, 7}});
+
+    // a view of the columns sees later changes
+    s.column<0>()[2] = 4.0;
+    CHECK(make_vector(column<0>(s) + 1.0) == std::vector<double>{2.5, 3.5, 5.0});
+
+    // and a zip or any other proxy of tuples evaluates into one
+    std::vector<float> const x{1.f, 2.f, 3.f};
+    auto const t = make_soa(zip(make_proxy(x), make_proxy(x) * make_proxy(x)));
+    static_assert(std::is_same<decltype(t), soa_vector<float, float> const>::value, "");
+    CHECK(t.column<1>() == std::vector<float>{1.f, 4.f, 9.f});
+    auto const u = make_soa(map([](float f){ return std::make_pair(int(f), f / 2); }, make_proxy(x)));
+    CHECK(u.column<0>() == std::vector<int>{1, 2, 3});
+    CHECK(u.column<1>() == std::vector<float>{0.5f, 1.f, 1.5f});
+}
+
+TEST_CASE("member proxies"){
+    std::vector<trade> const v = trades(600);
+    auto const price = make_member_proxy(v, &trade::price);
+    auto const qty = make_member_proxy(v, &trade::qty);
+    CHECK(price.size() == 600);
+    CHECK(price.get(3) == v[3].price);
+    std::vector<double> notional;
+    for(trade const& t : v) notional.push_back(t.price * t.qty);
+    CHECK(make_vector(price * qty) == notional);
+    CHECK(make_vector(slice(price * qty, 300, 555)) ==
+          std::vector<double>(notional.begin() + 300, notional.begin() + 555));
+    CHECK(price.aliases(&v[599].side, &v[599].side + 1));
+    CHECK_FALSE(price.aliases(v.data() + 600, v.data() + 601));
+
+    std::vector<trade> const none;
+    CHECK(make_vector(make_member_proxy(none, &trade::ts)).empty());
+
+    // a kept expression sees the records grow, and move
+    std::vector<trade> w = trades(10);
+    auto const total = make_member_proxy(w, &trade::qty) * 2;
+    w = trades(3000);
+    CHECK(total.size() == 3000);
+    CHECK(total.get(2999) == w[2999].qty * 2);
+    CHECK(make_vector(total)[1234] == w[1234].qty * 2);
+}
+
+TEST_CASE("AoS to SoA and back"){
+    for(std::size_t n : {0, 1, 255, 256, 257, 3000}){
+        std::vector<trade> const v = trades(n);
+        auto const s = make_soa(v, &trade::price, &trade::qty, &trade::ts, &trade::side);
+        static_assert(std::is_same<decltype(s), soa_vector<double, float, std::int64_t, char> const>::value, "");
+        REQUIRE(s.size() == n);
+        for(std::size_t i = 0; i < n; ++i){
+            CHECK(s.get(i) == std::make_tuple(v[i].price, v[i].qty, v[i].ts, v[i].side));
+        }
+        std::vector<trade> const w = make_aos<trade>(s, &trade::price, &trade::qty, &trade::ts, &trade::side);
+        REQUIRE(w.size() == n);
+        for(std::size_t i = 0; i < n; ++i){
+            CHECK(w[i].price == v[i].price);
+            CHECK(w[i].qty == v[i].qty);
+            CHECK(w[i].ts == v[i].ts);
+            CHECK(w[i].side == v[i].side);
+        }
+    }
+
+    // fields can come from any expression, and in any order
+    std::vector<trade> const v = trades(500);
+    auto const s = make_soa(v, &trade::qty, &trade::price);
+    auto const doubled = make_aos<trade>(zip(column<1>(s) * 2.0, make_proxy(s.column<0>())), &trade::price, &trade::qty);
+    CHECK(doubled[499].price == 2 * v[499].price);
+    CHECK(doubled[499].qty == v[499].qty);
+    CHECK(doubled[499].ts == 0);
+}
@@ -0,0 +1,148 @@
+#include "catch.hpp"
+#include "proxy_sparse.hpp"
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+template<typename T>
+std::vector<T> dense(sparse_vector<T> const& s){
+    std::vector<T> v(s.length);
+    for(std::size_t k = 0; k < s.indices.size(); ++k){
+        v[s.indices[k]] = s.values[k];
+    }
+    return v;
+}
+
+// a proxy that counts how many of its elements were asked for
+struct counting_proxy{
+    using type = int;
+    std::size_t n;
+    std::size_t* calls;
+    std::size_t size() const { return n; }
+    int get(std::size_t pos) const { ++*calls; return int(pos); }
+};
+}
+
+TEST_CASE("sparse leaf"){
+    sparse_vector<int> a{10, {1, 4, 9}, {5, -2, 7}};
+    auto const p = make_proxy(a);
+    CHECK(p.size() == 10);
+    CHECK(p.nonzeros() == 3);
+    CHECK(make_vector(p) == std::vector<int>{0,5,0,0,-2,0,0,0,0,7});
+    CHECK(p.get(4) == -2);
+    CHECK(p.get(5) == 0);
+    CHECK(make_vector(slice(p, 3, 6)) == std::vector<int>{0,-2,0});
+}
+
+TEST_CASE("a sparse expression sees its vector change"){
+    sparse_vector<int> a{4, {1}, {5}};
+    auto const e = make_proxy(a) * 2;
+    CHECK(make_vector(e) == std::vector<int>{0,10,0,0});
+    // growing moves the storage the proxy would otherwise have kept
+    for(std::size_t i = 4; i < 1000; ++i){
+        a.indices.push_back(i);
+        a.values.push_back(1);
+    }
+    a.length = 1000;
+    CHECK(e.size() == 1000);
+    CHECK(sum(e) == 10 + 2 * 996);
+}
+
+TEST_CASE("sparse + sparse merges"){
+    sparse_vector<int> a{12, {0, 3, 5, 11}, {1, 2, 3, 4}};
+    sparse_vector<int> b{12, {3, 4, 5, 10}, {10, 20, -3, 40}};
+    auto const e = make_proxy(a) + make_proxy(b);
+    static_assert(detail::is_sparse<decltype(e)>::value, "sum of sparse proxies is sparse");
+    CHECK(make_vector(e) == std::vector<int>{1,0,0,12,20,0,0,0,0,0,40,4});
+
+    // 3 + -3 cancels, and make_sparse leaves it out
+    auto const s = make_sparse(e);
+    CHECK(s.length == 12);
+    CHECK(s.indices == std::vector<std::size_t>{0, 3, 4, 10, 11});
+    CHECK(s.values == std::vector<int>{1, 12, 20, 40, 4});
+}
+
+TEST_CASE("sparse * sparse intersects"){
+    sparse_vector<double> a{1000, {}, {}};
+    for(std::size_t i = 0; i < 1000; i += 2){
+        a.indices.push_back(i);
+        a.values.push_back(0.5 * i);
+    }
+    sparse_vector<double> b{1000, {3, 4, 500, 998, 999}, {1, 2, 3, 4, 5}};
+    auto const s = make_sparse(make_proxy(a) * make_proxy(b));
+    CHECK(s.indices == std::vector<std::size_t>{4, 500, 998});
+    CHECK(s.values == std::vector<double>{4, 750, 1996});
+    CHECK(make_vector(make_proxy(b) * make_proxy(a)) == dense(s));
+}
+
+TEST_CASE("sparse * dense only looks at the stored positions"){
+    sparse_vector<int> a{1000000, {7, 123456, 999999}, {2, 3, 4}};
+    std::size_t calls = 0;
+    counting_proxy d{1000000, &calls};
+    auto const e = make_proxy(a) * d;
+    static_assert(detail::is_sparse<decltype(e)>::value, "sparse * dense is sparse");
+    auto const s = make_sparse(e);
+    CHECK(s.values == std::vector<int>{14, 370368, 3999996});
+    CHECK(calls == 3);
+
+    calls = 0;
+    CHECK(sum<long long>(d * make_proxy(a)) == 14 + 370368 + 3999996LL);
+    CHECK(calls == 3);
+
+    auto const scaled = make_sparse(2 * make_proxy(a) * 3);
+    CHECK(scaled.values == std::vector<int>{12, 18, 24});
+}
+
+TEST_CASE("mixing sparse and dense"){
+    sparse_vector<float> a{5, {1, 3}, {1.5f, -1.f}};
+    std::vector<float> b{1, 2, 3, 4, 5};
+    // adding a dense sequence gives a dense result
+    auto const e = make_proxy(a) + make_proxy(b);
+    static_assert(!detail::is_sparse<decltype(e)>::value, "sparse + dense is dense");
+    CHECK(make_vector(e) == std::vector<float>{1, 3.5f, 3, 3, 5});
+    CHECK(make_vector(make_proxy(a) + 1.f) == std::vector<float>{1, 2.5f, 1, 0, 1});
+    CHECK(make_vector(make_proxy(a) | make_proxy(b)).size() == 10);
+
+    auto const s = make_sparse(make_proxy(b) * make_proxy(b) + make_proxy(a) * make_proxy(b));
+    CHECK(dense(s) == std::vector<float>{1, 7, 9, 12, 25});
+}
+
+TEST_CASE("reductions over sparse proxies"){
+    sparse_vector<int> a{100, {10, 20, 30}, {4, -6, 9}};
+    sparse_vector<int> b{100, {20, 30, 40}, {2, 2, 2}};
+    CHECK(sum(make_proxy(a)) == 7);
+    CHECK(dot(make_proxy(a), make_proxy(b)) == 6);
+    CHECK(min(make_proxy(a)) == -6);
+    CHECK(max(make_proxy(a) * -1) == 6);
+    // the implicit zeros count too
+    CHECK(count_if(make_proxy(a), [](int x){ return x == 0; }) == 97);
+    CHECK(min(make_proxy(b)) == 0);
+
+    sparse_vector<int> full{3, {0, 1, 2}, {5, 6, 7}};
+    CHECK(min(make_proxy(full)) == 5);
+    sparse_vector<int> empty{0, {}, {}};
+    CHECK_THROWS_AS(max(make_proxy(empty)), std::invalid_argument);
+    CHECK(sum(make_proxy(empty)) == 0);
+}
+
+TEST_CASE("sparse operands of different sizes"){
+    sparse_vector<int> a{5, {1, 4}, {1, 1}};
+    sparse_vector<int> b{8, {1, 6}, {2, 2}};
+    auto const s = make_sparse(make_proxy(a) + make_proxy(b));
+    CHECK(s.length == 5);
+    CHECK(s.indices == std::vector<std::size_t>{1, 4});
+    CHECK(s.values == std::vector<int>{3, 1});
+    CHECK(sum(make_proxy(a) + make_proxy(b)) == 4);
+}
+
+TEST_CASE("make_sparse of a dense expression"){
+    std::vector<int> a{0, 3, 0, 0, -1};
+    auto const s = make_sparse(make_proxy(a) * 2);
+    CHECK(s.length == 5);
+    CHECK(s.indices == std::vector<std::size_t>{1, 4});
+    CHECK(s.values == std::vector<int>{6, -2});
+}
@@ -0,0 +1,38 @@
+#include "catch.hpp"
+#include "proxy.hpp"
+#include <array>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+constexpr std::array<int, 3> a{{1,2,3}};
+constexpr std::array<int, 3> b{{4,5,6}};
+constexpr int c[2] = {7,8};
+}
+
+TEST_CASE("static extents"){
+    static_assert(decltype(make_proxy(a))::extent == 3, "");
+    static_assert(decltype(make_proxy(c))::extent == 2, "");
+    static_assert(decltype(make_proxy(a)+make_proxy(c))::extent == 2, "");
+    static_assert(decltype(make_proxy(a)|make_proxy(c))::extent == 5, "");
+    std::vector<int> v{1,2,3};
+    static_assert(decltype(make_proxy(a)*make_proxy(v))::extent == dynamic_extent, "");
+    static_assert(decltype(make_proxy(v)|make_proxy(a))::extent == dynamic_extent, "");
+    CHECK((make_proxy(v)|make_proxy(a)).size() == 6);
+}
+
+TEST_CASE("constexpr evaluation"){
+    constexpr auto sum = make_array(make_proxy(a)+make_proxy(b));
+    static_assert(sum[0] == 5 && sum[1] == 7 && sum[2] == 9, "");
+    constexpr auto mixed = make_array((make_proxy(a)|make_proxy(c))*(make_proxy(b)|make_proxy(b)));
+    static_assert(mixed.size() == 5, "");
+    CHECK(mixed == (std::array<int, 5>{{4,10,18,28,40}}));
+}
+
+TEST_CASE("small vector math"){
+    std::array<float, 4> p{{1,2,3,4}}, q{{0.5f,0.5f,0.5f,0.5f}}, r{{1,1,1,1}};
+    auto const result = make_array(make_proxy(p)*make_proxy(q)+make_proxy(r));
+    CHECK(result == (std::array<float, 4>{{1.5f,2,2.5f,3}}));
+    CHECK(make_vector(make_proxy(p)+make_proxy(r)) == std::vector<float>{2,3,4,5});
+}
@@ -0,0 +1,37 @@
+#include "catch.hpp"
+#include "proxy.hpp"
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+// an expression built once and kept around, only the data changes
+struct compiled{
+    std::vector<int> a, b, c;
+    decltype((make_proxy(a)|make_proxy(b))*make_proxy(c)) expression;
+
+    compiled():
+        a{1,2}, b{3}, c{2,2,2},
+        expression{(make_proxy(a)|make_proxy(b))*make_proxy(c)}
+    {}
+};
+}
+
+TEST_CASE("stored expression"){
+    std::vector<int> a{1,2,3}, b{1,1,1};
+    // the two make_proxy temporaries are gone after this line
+    auto const sum = make_proxy(a)+make_proxy(b);
+    CHECK(make_vector(sum) == std::vector<int>{2,3,4});
+
+    a = {5,5,5,5};
+    b[0] = 10;
+    CHECK(make_vector(sum) == std::vector<int>{15,6,6});
+}
+
+TEST_CASE("expression as a member"){
+    compiled x;
+    CHECK(make_vector(x.expression) == std::vector<int>{2,4,6});
+    x.c = {1,10,100,1000};
+    x.b.push_back(4);
+    CHECK(make_vector(x.expression) == std::vector<int>{1,20,300,4000});
+}
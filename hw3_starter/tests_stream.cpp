@@ -0,0 +1,223 @@
+#include "catch.hpp"
+#include "proxy_pipeline.hpp"
+#include "proxy_stream.hpp"
+#include <chrono>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace proxy;
+
+namespace{
+// a pipe with a thread writing data into it and closing it at the end,
+// like another process would; or, with keep_open, leaving it open and idle
+// until the pipe_writer goes
+struct pipe_writer{
+    int read_end;
+    int write_end;
+    bool keep_open;
+    std::thread writer;
+    pipe_writer(std::string data, bool keep_open = false):
+        keep_open{keep_open}
+    {
+        int fds[2];
+        REQUIRE(::pipe(fds) == 0);
+        read_end = fds[0];
+        write_end = fds[1];
+        writer = std::thread([this, data]{
+            // in small pieces, so reads come back short
+            for(std::size_t i = 0; i < data.size(); i += 1000){
+                std::size_t const n = std::min<std::size_t>(1000, data.size() - i);
+                if(::write(write_end, data.data() + i, n) < 0)
+                    break;
+            }
+            if(!this->keep_open)
+                ::close(write_end);
+        });
+    }
+    ~pipe_writer(){
+        writer.join();
+        if(keep_open)
+            ::close(write_end);
+        ::close(read_end);
+    }
+};
+
+template<typename T>
+std::string raw(std::vector<T> const& v){
+    return std::string(reinterpret_cast<char const*>(v.data()), v.size() * sizeof(T));
+}
+}
+
+TEST_CASE("binary values from a pipe"){
+    // several buffers' worth, plus a bit
+    std::vector<int> a(200001);
+    std::iota(a.begin(), a.end(), -7);
+    pipe_writer pipe(raw(a));
+    CHECK(make_vector(make_stream<int>(pipe.read_end)) == a);
+}
+
+TEST_CASE("text values from a pipe"){
+    pipe_writer pipe(" 1.5 -2\n3e2\t\t4.25\n");
+    CHECK(make_vector(make_stream<double>(pipe.read_end, encoding::text))
+          == std::vector<double>{1.5, -2, 300, 4.25});
+}
+
+TEST_CASE("istream"){
+    std::istringstream text("10 20 30\n40");
+    CHECK(make_vector(make_stream<int>(text, encoding::text)) == std::vector<int>{10,20,30,40});
+
+    std::vector<float> a{1.5f, 2.5f, -3.f};
+    std::istringstream binary(raw(a));
+    CHECK(make_vector(make_stream<float>(binary)) == a);
+
+    std::istringstream empty("");
+    CHECK(make_vector(make_stream<int>(empty, encoding::text)).empty());
+}
+
+TEST_CASE("bad text throws when it's read"){
+    std::istringstream text("1 2 three");
+    auto s = make_stream<int>(text, encoding::text);
+    CHECK_THROWS_AS(make_vector(s), std::invalid_argument);
+
+    pipe_writer pipe("1 2 300000000000");
+    CHECK_THROWS_AS(make_vector(make_stream<int>(pipe.read_end, encoding::text)), std::invalid_argument);
+}
+
+TEST_CASE("streams in expressions"){
+    std::vector<double> a(100000), b(100000);
+    for(std::size_t i = 0; i < a.size(); ++i){
+        a[i] = i * 0.25;
+        b[i] = 1.0 + i % 7;
+    }
+    pipe_writer pipe(raw(a));
+    auto const s = make_stream<double>(pipe.read_end);
+    std::vector<double> const result = make_vector(s * make_proxy(b) + 2.0);
+    REQUIRE(result.size() == a.size());
+    for(std::size_t i = 0; i < a.size(); ++i){
+        CHECK(result[i] == a[i] * b[i] + 2.0);
+    }
+}
+
+TEST_CASE("stream arithmetic ends with the shorter side"){
+    std::vector<int> a{1,2,3,4,5,6,7,8,9,10};
+    std::vector<int> b{10,20,30};
+    auto const evens = filter([](int x){ return x % 2 == 0; }, make_proxy(a));
+    CHECK(make_vector(evens + make_proxy(b)) == std::vector<int>{12,24,36});
+    CHECK(make_vector(make_proxy(b) * evens) == std::vector<int>{20,80,180});
+    CHECK(make_vector(evens * evens) == std::vector<int>{4,16,36,64,100});
+    CHECK(make_vector(2 * evens + 1) == std::vector<int>{5,9,13,17,21});
+    CHECK(make_vector(evens | make_proxy(b) | evens)
+          == std::vector<int>{2,4,6,8,10,10,20,30,2,4,6,8,10});
+}
+
+TEST_CASE("reductions over input streams"){
+    std::vector<long long> a(300000);
+    std::iota(a.begin(), a.end(), 1);
+    {
+        pipe_writer pipe(raw(a));
+        CHECK(sum(make_stream<long long>(pipe.read_end)) == 300000LL * 300001 / 2);
+    }
+    {
+        pipe_writer pipe(raw(a));
+        auto const s = make_stream<long long>(pipe.read_end);
+        CHECK(dot(s, make_proxy(a)) == 300000LL * 300001 * 600001 / 6);
+    }
+    {
+        std::istringstream text("5 -3 8 1");
+        CHECK(min(make_stream<int>(text, encoding::text)) == -3);
+    }
+    {
+        std::istringstream text("");
+        CHECK_THROWS_AS(max(make_stream<int>(text, encoding::text)), std::invalid_argument);
+    }
+}
+
+TEST_CASE("a stream that's never read"){
+    // the reader thread has to be stopped and joined cleanly
+    std::vector<int> a(1000000, 3);
+    pipe_writer pipe(raw(a));
+    {
+        auto s = make_stream<int>(pipe.read_end);
+        int first[4];
+        CHECK(s.read(first, 4) == 4);
+        CHECK(first[3] == 3);
+    }
+    // let the writer finish
+    char sink[4096];
+    while(::read(pipe.read_end, sink, sizeof(sink)) > 0){}
+}
+
+TEST_CASE("values are passed on as they come in"){
+    // a few values, and then nothing for a while: they're there to read
+    // without waiting for a whole buffer
+    std::vector<int> const a{4, -1, 7, 12345};
+    pipe_writer pipe(raw(a), true);
+    auto s = make_stream<int>(pipe.read_end);
+    std::vector<int> got(a.size());
+    CHECK(s.read(got.data(), got.size()) == a.size());
+    CHECK(got == a);
+
+    pipe_writer text("1.5 -2 300 ", true);
+    auto t = make_stream<double>(text.read_end, encoding::text);
+    std::vector<double> numbers(3);
+    CHECK(t.read(numbers.data(), 3) == 3);
+    CHECK(numbers == std::vector<double>{1.5, -2, 300});
+}
+
+TEST_CASE("a value split between reads"){
+    std::vector<double> const a{1.5, -2, 0.25};
+    std::string const bytes = raw(a);
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    // the first read can only get part of the first value
+    REQUIRE(::write(fds[1], bytes.data(), 5) == 5);
+    std::thread rest([&]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CHECK(::write(fds[1], bytes.data() + 5, 9) == 9);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        // and a partial value at the end, which is dropped
+        CHECK(::write(fds[1], bytes.data() + 14, bytes.size() - 17) == ssize_t(bytes.size() - 17));
+        ::close(fds[1]);
+    });
+    CHECK(make_vector(make_stream<double>(fds[0])) == std::vector<double>{1.5, -2});
+    rest.join();
+    ::close(fds[0]);
+}
+
+TEST_CASE("dropping a stream on an idle pipe"){
+    // the writer stays, but never writes again: the reader thread is waiting
+    // for input that isn't coming, and has to be interrupted
+    pipe_writer pipe(raw(std::vector<int>(10, 3)), true);
+    {
+        auto s = make_stream<int>(pipe.read_end);
+    }
+    {
+        auto s = make_stream<int>(pipe.read_end);
+        auto copy = s;
+        copy.interrupt();
+        int first[4];
+        CHECK(s.read(first, 4) == 0);
+    }
+}
+
+TEST_CASE("a pipeline that stops while its source waits on an idle pipe"){
+    // one stream buffer's worth of values and a few more: the source thread
+    // gets the whole first buffer, then waits for a second that never fills
+    std::size_t const buffered = stream_buffer_bytes / sizeof(int);
+    pipe_writer pipe(raw(std::vector<int>(buffered + 10, 1)), true);
+    std::size_t seen = 0;
+    auto p = make_pipeline(make_stream<int>(pipe.read_end), [](auto x){ return x * 2; })
+        .chunk_size(1024);
+    CHECK_THROWS_AS(p.run([&](auto chunk){
+        seen += chunk.size();
+        if(seen == buffered)
+            throw std::runtime_error("enough");
+    }), std::runtime_error);
+    CHECK(seen == buffered);
+}
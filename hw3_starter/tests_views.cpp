@@ -0,0 +1,68 @@
+#include "catch.hpp"
+#include "proxy.hpp"
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+template<typename Proxy>
+std::vector<typename Proxy::type> one_at_a_time(Proxy const& p){
+    std::vector<typename Proxy::type> v;
+    for(std::size_t i = 0; i < p.size(); ++i) v.push_back(p.get(i));
+    return v;
+}
+}
+
+TEST_CASE("slice"){
+    std::vector<int> a{0,1,2,3,4,5,6,7,8,9};
+    CHECK(make_vector(slice(make_proxy(a), 2, 5)) == std::vector<int>{2,3,4});
+    CHECK(make_vector(slice(make_proxy(a), 8, 100)) == std::vector<int>{8,9});
+    CHECK(make_vector(slice(make_proxy(a), 20, 30)).empty());
+    CHECK(make_vector(slice(make_proxy(a), 1, 3)+slice(make_proxy(a), 5, 7)) == std::vector<int>{6,8});
+}
+
+TEST_CASE("stride"){
+    std::vector<int> a(2000);
+    std::iota(a.begin(), a.end(), 0);
+    for(std::size_t step : {1, 2, 3, 7, 8, 9, 1000, 5000}){
+        auto const s = stride(make_proxy(a), step);
+        auto const v = make_vector(s);
+        CHECK(v.size() == (a.size() + step - 1) / step);
+        CHECK(v == one_at_a_time(s));
+    }
+    CHECK(make_vector(stride(make_proxy(a)|make_proxy(a), 1000)) == std::vector<int>{0,1000,0,1000});
+    CHECK_THROWS_AS(stride(make_proxy(a), 0), std::invalid_argument);
+}
+
+TEST_CASE("reverse"){
+    std::vector<int> a(600), b{1,2,3};
+    std::iota(a.begin(), a.end(), 0);
+    auto const r = reverse(make_proxy(a)|make_proxy(b));
+    auto const v = make_vector(r);
+    CHECK(v == one_at_a_time(r));
+    CHECK(v.front() == 3);
+    CHECK(v.back() == 0);
+    CHECK(make_vector(reverse(make_proxy(b))*make_proxy(b)) == std::vector<int>{3,4,3});
+}
+
+TEST_CASE("repeat"){
+    std::vector<int> a{1,2,3};
+    CHECK(make_vector(repeat(make_proxy(a), 3)) == std::vector<int>{1,2,3,1,2,3,1,2,3});
+    CHECK(make_vector(repeat(make_proxy(a), 0)).empty());
+    std::vector<int> const none;
+    CHECK(make_vector(repeat(make_proxy(none), 3)).empty());
+    CHECK(make_vector(repeat(make_proxy(none), 0)).empty());
+    std::vector<int> out;
+    CHECK(evaluate_into(out, repeat(make_proxy(none), 3)) == 0);
+    std::vector<int> big(1000, 1);
+    auto const r = slice(repeat(make_proxy(a), 500), 100, 1100)+make_proxy(big);
+    CHECK(make_vector(r) == one_at_a_time(r));
+}
+
+TEST_CASE("views assigned onto their own input"){
+    std::vector<int> a{1,2,3,4,5};
+    assign(a, reverse(make_proxy(a)));
+    CHECK(a == std::vector<int>{5,4,3,2,1});
+}
@@ -0,0 +1,130 @@
+#include "catch.hpp"
+#include "proxy_window.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+using namespace proxy;
+
+namespace{
+template<typename Proxy>
+std::vector<typename Proxy::type> one_at_a_time(Proxy const& p){
+    std::vector<typename Proxy::type> v;
+    for(std::size_t i = 0; i < p.size(); ++i) v.push_back(p.get(i));
+    return v;
+}
+
+std::vector<int> bumpy(std::size_t n){
+    std::vector<int> v(n);
+    for(std::size_t i = 0; i < n; ++i){
+        v[i] = int((i * 7919) % 1009) - 500;
+    }
+    return v;
+}
+
+// each window worked out on its own
+template<typename F>
+std::vector<int> windows(std::vector<int> const& v, std::size_t w, F f){
+    std::vector<int> result;
+    for(std::size_t i = 0; i < v.size(); ++i){
+        std::size_t const start = i + 1 >= w ? i + 1 - w : 0;
+        result.push_back(f(v.begin() + std::ptrdiff_t(start), v.begin() + std::ptrdiff_t(i) + 1));
+    }
+    return result;
+}
+}
+
+TEST_CASE("shift"){
+    std::vector<int> a{1, 2, 3, 4, 5};
+    CHECK(make_vector(shift(make_proxy(a), 2)) == std::vector<int>{3, 4, 5, 0, 0});
+    CHECK(make_vector(shift(make_proxy(a), -2)) == std::vector<int>{0, 0, 1, 2, 3});
+    CHECK(make_vector(shift(make_proxy(a), 0)) == a);
+    CHECK(make_vector(shift(make_proxy(a), 7, -1)) == std::vector<int>{-1, -1, -1, -1, -1});
+    CHECK(make_vector(shift(make_proxy(a), -9, -1)) == std::vector<int>{-1, -1, -1, -1, -1});
+    auto const s = shift(make_proxy(a), -1, 9);
+    CHECK(make_vector(s) == one_at_a_time(s));
+
+    // a three point stencil
+    std::vector<int> const b = bumpy(1000);
+    auto const stencil = shift(make_proxy(b), -1) + make_proxy(b) + shift(make_proxy(b), 1);
+    auto const v = make_vector(stencil);
+    CHECK(v == one_at_a_time(stencil));
+    CHECK(v[0] == b[0] + b[1]);
+    CHECK(v[500] == b[499] + b[500] + b[501]);
+    CHECK(v[999] == b[998] + b[999]);
+}
+
+TEST_CASE("rolling windows match working each one out"){
+    std::vector<int> const a = bumpy(2000);
+    for(std::size_t w : {1, 2, 3, 255, 256, 257, 700, 2000, 5000}){
+        auto const sums = windows(a, w, [](std::vector<int>::const_iterator b, std::vector<int>::const_iterator e){
+            int s = 0;
+            for(; b != e; ++b) s += *b;
+            return s;
+        });
+        auto const mins = windows(a, w, [](std::vector<int>::const_iterator b, std::vector<int>::const_iterator e){
+            return *std::min_element(b, e);
+        });
+        auto const maxs = windows(a, w, [](std::vector<int>::const_iterator b, std::vector<int>::const_iterator e){
+            return *std::max_element(b, e);
+        });
+        CHECK(make_vector(rolling_sum(make_proxy(a), w)) == sums);
+        CHECK(make_vector(rolling_min(make_proxy(a), w)) == mins);
+        CHECK(make_vector(rolling_max(make_proxy(a), w)) == maxs);
+        CHECK(one_at_a_time(rolling_max(make_proxy(a), w)) == maxs);
+
+        // starting part way along, and a block at a time inside an expression
+        std::vector<int> const zeros(a.size());
+        auto const part = make_vector(slice(rolling_min(make_proxy(a), w) + make_proxy(zeros), 999, 1600));
+        CHECK(part == std::vector<int>(mins.begin() + 999, mins.begin() + 1600));
+        auto const part_sums = make_vector(slice(rolling_sum(make_proxy(a), w) + make_proxy(zeros), 999, 1600));
+        CHECK(part_sums == std::vector<int>(sums.begin() + 999, sums.begin() + 1600));
+        std::vector<double> means;
+        for(std::size_t i = 999; i < 1600; ++i) means.push_back(double(sums[i]) / double(std::min(w, i + 1)));
+        std::vector<double> const no_means(a.size());
+        CHECK(make_vector(slice(rolling_mean(make_proxy(a), w) + make_proxy(no_means), 999, 1600)) == means);
+    }
+}
+
+TEST_CASE("rolling_mean"){
+    std::vector<int> const a{2, 4, 6, 8, 10};
+    auto const m = rolling_mean(make_proxy(a), 2);
+    static_assert(std::is_same<decltype(m)::type, double>::value, "means of ints are double");
+    CHECK(make_vector(m) == std::vector<double>{2, 3, 5, 7, 9});
+    CHECK(make_vector(rolling_mean(make_proxy(a), 4)) == std::vector<double>{2, 3, 4, 5, 7});
+    CHECK(one_at_a_time(m) == make_vector(m));
+
+    std::vector<float> const f{1.f, 2.f, 3.f};
+    static_assert(std::is_same<decltype(rolling_mean(make_proxy(f), 2))::type, float>::value, "");
+    CHECK(make_vector(rolling_mean(make_proxy(f), 2)) == std::vector<float>{1.f, 1.5f, 2.5f});
+}
+
+TEST_CASE("rolling min and max with repeats and monotone runs"){
+    std::vector<int> up(600), down(600), flat(600, 3);
+    for(std::size_t i = 0; i < 600; ++i){
+        up[i] = int(i);
+        down[i] = 600 - int(i);
+    }
+    auto const mu = make_vector(rolling_min(make_proxy(up), 50));
+    auto const md = make_vector(rolling_min(make_proxy(down), 50));
+    auto const xu = make_vector(rolling_max(make_proxy(up), 50));
+    for(std::size_t i = 0; i < 600; ++i){
+        CHECK(mu[i] == int(i >= 49 ? i - 49 : 0));
+        CHECK(md[i] == 600 - int(i));
+        CHECK(xu[i] == int(i));
+    }
+    CHECK(make_vector(rolling_max(make_proxy(flat), 7)) == flat);
+}
+
+TEST_CASE("rolling reductions and bad windows"){
+    std::vector<int> const a{1, 2, 3, 4};
+    CHECK(max(rolling_sum(make_proxy(a), 2)) == 7);
+    CHECK(make_vector(rolling_sum(make_proxy(a), 2) * shift(make_proxy(a), 1, 1))
+          == std::vector<int>{2, 9, 20, 7});
+    CHECK_THROWS_AS(rolling_sum(make_proxy(a), 0), std::invalid_argument);
+    CHECK_THROWS_AS(rolling_min(make_proxy(a), 0), std::invalid_argument);
+    std::vector<int> const empty;
+    CHECK(make_vector(rolling_max(make_proxy(empty), 3)).empty());
+}